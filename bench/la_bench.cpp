@@ -0,0 +1,2019 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Jacob Micoud
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* Every benchmark reports the time per iteration and items/s, where an item
+ * is one call of the underlying operation (one matrix, vector or point).
+ *
+ * Results can be saved for comparison across releases with:
+ *   la_bench --benchmark_out=la_bench.json --benchmark_out_format=json
+ */
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "la.h"
+
+static la_mat4 bench_matrix(unsigned int seed) {
+  la_mat4 m;
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      seed = seed * 1664525u + 1013904223u;
+      m.elem[i][j] = ((seed >> 8) / 16777216.0f) * 2.0f - 1.0f;
+    }
+  }
+  return m;
+}
+
+static la_mat4 bench_affine(void) {
+  la_vec3 axis = {.elem = {0.3f, -1.0f, 0.5f}};
+  la_vec3 t = {.elem = {1.5f, -2.0f, 4.25f}};
+  la_vec3 s = {.elem = {2.0f, 0.5f, 1.5f}};
+  la_mat4 m = la_rotate(la_identitym4(), axis, 0.7f);
+  return la_translate(la_scale(m, s), t);
+}
+
+static la_vec3 bench_v3(void) {
+  la_vec3 v = {.elem = {1.0f, -2.0f, 0.5f}};
+  return v;
+}
+
+static la_vec4 bench_v4(void) {
+  la_vec4 v = {.elem = {1.0f, -2.0f, 0.5f, 1.0f}};
+  return v;
+}
+
+static la_quat bench_quat(float rads) {
+  la_vec3 axis = {.elem = {0.3f, -1.0f, 0.5f}};
+  return la_axis_angleq(axis, rads);
+}
+
+/* Single calls ------------------------------------------------------------ */
+
+typedef la_mat4 (*m4m4_fn)(const la_mat4, const la_mat4);
+typedef la_vec4 (*m4v4_fn)(const la_mat4, const la_vec4);
+typedef la_mat4 (*inverse_fn)(const la_mat4, int *);
+
+template <m4m4_fn F>
+static void bm_m4m4(benchmark::State &state) {
+  la_mat4 a = bench_matrix(1);
+  la_mat4 b = bench_matrix(2);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(F(a, b));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <m4v4_fn F>
+static void bm_m4v4(benchmark::State &state) {
+  la_mat4 m = bench_matrix(1);
+  la_vec4 v = bench_v4();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(v);
+    benchmark::DoNotOptimize(F(m, v));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+template <inverse_fn F>
+static void bm_inverse(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(F(m, NULL));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(bm_m4m4, la_productm4);
+BENCHMARK_TEMPLATE(bm_m4m4, la_productm4_scalar);
+BENCHMARK_TEMPLATE(bm_m4m4, la_productm4_affine);
+BENCHMARK_TEMPLATE(bm_m4v4, la_productm4v4);
+BENCHMARK_TEMPLATE(bm_m4v4, la_productm4v4_scalar);
+BENCHMARK_TEMPLATE(bm_inverse, la_inversem4);
+BENCHMARK_TEMPLATE(bm_inverse, la_inversem4_scalar);
+BENCHMARK_TEMPLATE(bm_inverse, la_inverse_affine);
+
+#ifdef LA_USE_SSE2
+BENCHMARK_TEMPLATE(bm_m4m4, la_productm4_sse2);
+BENCHMARK_TEMPLATE(bm_m4v4, la_productm4v4_sse2);
+BENCHMARK_TEMPLATE(bm_inverse, la_inversem4_sse2);
+#endif
+
+#ifdef LA_USE_AVX
+BENCHMARK_TEMPLATE(bm_m4m4, la_productm4_avx);
+BENCHMARK_TEMPLATE(bm_m4v4, la_productm4v4_avx);
+#endif
+
+#ifdef LA_USE_NEON
+BENCHMARK_TEMPLATE(bm_m4m4, la_productm4_neon);
+BENCHMARK_TEMPLATE(bm_m4v4, la_productm4v4_neon);
+#endif
+
+/* The same products through the pointer API. */
+static void bm_la_productm4_p(benchmark::State &state) {
+  la_mat4 a = bench_matrix(1);
+  la_mat4 b = bench_matrix(2);
+  la_mat4 out;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    la_productm4_p(&out, &a, &b);
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_productm4_p);
+
+static void bm_la_productm4v4_p(benchmark::State &state) {
+  la_mat4 m = bench_matrix(1);
+  la_vec4 v = bench_v4();
+  la_vec4 out;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(v);
+    la_productm4v4_p(&out, &m, &v);
+    benchmark::DoNotOptimize(out);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_productm4v4_p);
+
+static void bm_la_transposem4(benchmark::State &state) {
+  la_mat4 m = bench_matrix(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_transposem4(m));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_transposem4);
+
+static void bm_la_determinantm4(benchmark::State &state) {
+  la_mat4 m = bench_matrix(1);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_determinantm4(m));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_determinantm4);
+
+static void bm_la_identitym4(benchmark::State &state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(la_identitym4());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_identitym4);
+
+static void bm_la_radians(benchmark::State &state) {
+  float d = 45.0f;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(d);
+    benchmark::DoNotOptimize(la_radians(d));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_radians);
+
+typedef float (*f_fn)(const float);
+
+template <f_fn F>
+static void bm_f(benchmark::State &state) {
+  float x = 0.7f;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(x);
+    benchmark::DoNotOptimize(F(x));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(bm_f, la_rsqrt_approx);
+BENCHMARK_TEMPLATE(bm_f, la_sin_approx);
+BENCHMARK_TEMPLATE(bm_f, la_cos_approx);
+BENCHMARK_TEMPLATE(bm_f, la_tan_approx);
+
+static void bm_la_normalizev3(benchmark::State &state) {
+  la_vec3 v = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(v);
+    benchmark::DoNotOptimize(la_normalizev3(v));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_normalizev3);
+
+static void bm_la_dotv3(benchmark::State &state) {
+  la_vec3 a = bench_v3();
+  la_vec3 b = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(la_dotv3(a, b));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_dotv3);
+
+static void bm_la_dotv4(benchmark::State &state) {
+  la_vec4 a = bench_v4();
+  la_vec4 b = bench_v4();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(la_dotv4(a, b));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_dotv4);
+
+static void bm_la_crossv3(benchmark::State &state) {
+  la_vec3 a = bench_v3();
+  la_vec3 b = la_normalizev3(bench_v3());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(la_crossv3(a, b));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_crossv3);
+
+static void bm_la_cmpv3(benchmark::State &state) {
+  la_vec3 a = bench_v3();
+  la_vec3 b = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(la_cmpv3(a, b));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_cmpv3);
+
+static void bm_la_cmpv2(benchmark::State &state) {
+  la_vec2 a = {.elem = {1.0f, 2.0f}};
+  la_vec2 b = {.elem = {1.0f, 2.0f}};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(la_cmpv2(a, b));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_cmpv2);
+
+static void bm_la_perspective(benchmark::State &state) {
+  float fov = la_radians(45.0f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(fov);
+    benchmark::DoNotOptimize(la_perspective(fov, 4.0f / 3.0f, 0.1f, 100.0f));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_perspective);
+
+static void bm_la_orthographic(benchmark::State &state) {
+  float right = 800.0f;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(right);
+    benchmark::DoNotOptimize(
+        la_orthographic(0.0f, right, 600.0f, 0.0f, -1.0f, 1.0f));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_orthographic);
+
+static void bm_la_look_at(benchmark::State &state) {
+  la_vec3 eye = {.elem = {3.0f, 3.0f, 3.0f}};
+  la_vec3 ctr = {.elem = {0.0f, 0.0f, 0.0f}};
+  la_vec3 up = {.elem = {0.0f, 1.0f, 0.0f}};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(eye);
+    benchmark::DoNotOptimize(la_look_at(eye, ctr, up));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_look_at);
+
+static void bm_la_translate(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  la_vec3 v = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_translate(m, v));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_translate);
+
+static void bm_la_rotate(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  la_vec3 axis = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_rotate(m, axis, 0.3f));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_rotate);
+
+static void bm_la_scale(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  la_vec3 v = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_scale(m, v));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_scale);
+
+static void bm_la_transform_point_affine(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  la_vec3 p = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(p);
+    benchmark::DoNotOptimize(la_transform_point_affine(m, p));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_transform_point_affine);
+
+static void bm_la_transform_dir_affine(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  la_vec3 d = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(d);
+    benchmark::DoNotOptimize(la_transform_dir_affine(m, d));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_transform_dir_affine);
+
+static void bm_la_m4tomat3x4(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_m4tomat3x4(m));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_m4tomat3x4);
+
+static void bm_la_mat3x4tom4(benchmark::State &state) {
+  la_mat3x4 m = la_m4tomat3x4(bench_affine());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_mat3x4tom4(m));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_mat3x4tom4);
+
+static void bm_la_transform_point_mat3x4(benchmark::State &state) {
+  la_mat3x4 m = la_m4tomat3x4(bench_affine());
+  la_vec3 p = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(p);
+    benchmark::DoNotOptimize(la_transform_point_mat3x4(&m, p));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_transform_point_mat3x4);
+
+static void bm_la_axis_angleq(benchmark::State &state) {
+  la_vec3 axis = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(axis);
+    benchmark::DoNotOptimize(la_axis_angleq(axis, 0.3f));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_axis_angleq);
+
+static void bm_la_productq(benchmark::State &state) {
+  la_quat a = bench_quat(0.3f);
+  la_quat b = bench_quat(1.1f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(la_productq(a, b));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_productq);
+
+static void bm_la_normalizeq(benchmark::State &state) {
+  la_quat q = bench_quat(0.3f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(q);
+    benchmark::DoNotOptimize(la_normalizeq(q));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_normalizeq);
+
+static void bm_la_inverseq(benchmark::State &state) {
+  la_quat q = bench_quat(0.3f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(q);
+    benchmark::DoNotOptimize(la_inverseq(q));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_inverseq);
+
+static void bm_la_conjugateq(benchmark::State &state) {
+  la_quat q = bench_quat(0.3f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(q);
+    benchmark::DoNotOptimize(la_conjugateq(q));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_conjugateq);
+
+static void bm_la_productqv3(benchmark::State &state) {
+  la_quat q = bench_quat(0.3f);
+  la_vec3 v = bench_v3();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(v);
+    benchmark::DoNotOptimize(la_productqv3(q, v));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_productqv3);
+
+static void bm_la_nlerpq(benchmark::State &state) {
+  la_quat a = bench_quat(0.3f);
+  la_quat b = bench_quat(1.1f);
+  float t = 0.25f;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(t);
+    benchmark::DoNotOptimize(la_nlerpq(a, b, t));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_nlerpq);
+
+static void bm_la_slerpq(benchmark::State &state) {
+  la_quat a = bench_quat(0.3f);
+  la_quat b = bench_quat(1.1f);
+  float t = 0.25f;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(t);
+    benchmark::DoNotOptimize(la_slerpq(a, b, t));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_slerpq);
+
+static void bm_la_quattom4(benchmark::State &state) {
+  la_quat q = bench_quat(0.3f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(q);
+    benchmark::DoNotOptimize(la_quattom4(q));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_quattom4);
+
+static void bm_la_rotateq(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  la_quat q = bench_quat(0.3f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_rotateq(m, q));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_rotateq);
+
+/* Batches ----------------------------------------------------------------- */
+
+#define LA_BENCH_BATCH_SIZES RangeMultiplier(16)->Range(1 << 8, 1 << 20)
+
+struct soa_points {
+  std::vector<float> in[4];
+  std::vector<float> out[4];
+
+  explicit soa_points(size_t n) {
+    for (int k = 0; k < 4; k++) {
+      in[k].resize(n);
+      out[k].resize(n);
+      for (size_t i = 0; i < n; i++) {
+        in[k][i] = (float)((i * (k + 3)) % 97) - 48.0f;
+      }
+    }
+  }
+};
+
+/* The single-call baseline the batch API replaces. */
+static void bm_la_productm4v4_loop(benchmark::State &state) {
+  const size_t n = state.range(0);
+  la_mat4 m = bench_matrix(1);
+  std::vector<la_vec4> in(n, bench_v4());
+  std::vector<la_vec4> out(n);
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = la_productm4v4(m, in[i]);
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 2 * sizeof(la_vec4));
+}
+BENCHMARK(bm_la_productm4v4_loop)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_transform_points_v4(benchmark::State &state) {
+  const size_t n = state.range(0);
+  la_mat4 m = bench_matrix(1);
+  soa_points p(n);
+  for (auto _ : state) {
+    la_transform_points_v4(&m, p.in[0].data(), p.in[1].data(), p.in[2].data(),
+                           p.in[3].data(), p.out[0].data(), p.out[1].data(),
+                           p.out[2].data(), p.out[3].data(), n);
+    benchmark::DoNotOptimize(p.out[0].data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 8 * sizeof(float));
+}
+BENCHMARK(bm_la_transform_points_v4)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_transform_points_v4_aos(benchmark::State &state) {
+  const size_t n = state.range(0);
+  la_mat4 m = bench_matrix(1);
+  std::vector<la_vec4> in(n, bench_v4());
+  std::vector<la_vec4> out(n);
+  for (auto _ : state) {
+    la_transform_points_v4_aos(&m, in.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 2 * sizeof(la_vec4));
+}
+BENCHMARK(bm_la_transform_points_v4_aos)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_productm4_batch(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<la_mat4> a(n, bench_matrix(1));
+  std::vector<la_mat4> b(n, bench_matrix(2));
+  std::vector<la_mat4> out(n);
+  for (auto _ : state) {
+    la_productm4_batch(a.data(), b.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 3 * sizeof(la_mat4));
+}
+BENCHMARK(bm_la_productm4_batch)->RangeMultiplier(16)->Range(1 << 8, 1 << 16);
+
+static void bm_la_m4tomat3x4_batch(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<la_mat4> in(n, bench_affine());
+  std::vector<la_mat3x4> out(n);
+  for (auto _ : state) {
+    la_m4tomat3x4_batch(in.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n *
+                          (sizeof(la_mat4) + sizeof(la_mat3x4)));
+}
+BENCHMARK(bm_la_m4tomat3x4_batch)->RangeMultiplier(16)->Range(1 << 8, 1 << 16);
+
+static void bm_la_normalizev3_loop(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<la_vec3> in(n, bench_v3());
+  std::vector<la_vec3> out(n);
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = la_normalizev3(in[i]);
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 2 * sizeof(la_vec3));
+}
+BENCHMARK(bm_la_normalizev3_loop)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_normalizev3_batch(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<la_vec3> in(n, bench_v3());
+  std::vector<la_vec3> out(n);
+  for (auto _ : state) {
+    la_normalizev3_batch(in.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 2 * sizeof(la_vec3));
+}
+BENCHMARK(bm_la_normalizev3_batch)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_normalizev3_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_points p(n);
+  for (auto _ : state) {
+    la_normalizev3_soa(p.in[0].data(), p.in[1].data(), p.in[2].data(),
+                       p.out[0].data(), p.out[1].data(), p.out[2].data(), n);
+    benchmark::DoNotOptimize(p.out[0].data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 6 * sizeof(float));
+}
+BENCHMARK(bm_la_normalizev3_soa)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_dotv3_batch(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<la_vec3> a(n, bench_v3());
+  std::vector<la_vec3> b(n, bench_v3());
+  std::vector<float> out(n);
+  for (auto _ : state) {
+    la_dotv3_batch(a.data(), b.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 7 * sizeof(float));
+}
+BENCHMARK(bm_la_dotv3_batch)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_dotv3_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_points p(n);
+  for (auto _ : state) {
+    la_dotv3_soa(p.in[0].data(), p.in[1].data(), p.in[2].data(),
+                 p.out[0].data(), p.out[1].data(), p.out[2].data(),
+                 p.in[3].data(), n);
+    benchmark::DoNotOptimize(p.in[3].data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 7 * sizeof(float));
+}
+BENCHMARK(bm_la_dotv3_soa)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_crossv3_batch(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<la_vec3> a(n, bench_v3());
+  std::vector<la_vec3> b(n, bench_v3());
+  std::vector<la_vec3> out(n);
+  for (auto _ : state) {
+    la_crossv3_batch(a.data(), b.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 3 * sizeof(la_vec3));
+}
+BENCHMARK(bm_la_crossv3_batch)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_lerpv3_batch(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<la_vec3> a(n, bench_v3());
+  std::vector<la_vec3> b(n, bench_v3());
+  std::vector<la_vec3> out(n);
+  for (auto _ : state) {
+    la_lerpv3_batch(a.data(), b.data(), 0.25f, out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 3 * sizeof(la_vec3));
+}
+BENCHMARK(bm_la_lerpv3_batch)->LA_BENCH_BATCH_SIZES;
+
+/* Culling ----------------------------------------------------------------- */
+
+#define LA_BENCH_OBJECTS 200000
+
+/* Objects spread around the camera so roughly a third are visible. */
+struct cull_scene {
+  la_frustum f;
+  std::vector<float> c[3];
+  std::vector<float> e[3];
+  std::vector<uint32_t> mask;
+  std::vector<uint32_t> indices;
+
+  explicit cull_scene(size_t n) : mask((n + 31) / 32), indices(n) {
+    f = la_frustum_from_m4(
+        la_perspective(la_radians(70.0f), 16.0f / 9.0f, 0.1f, 500.0f));
+    unsigned int seed = 1;
+    for (int k = 0; k < 3; k++) {
+      for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        c[k].push_back(((seed >> 8) / 16777216.0f) * 600.0f - 300.0f);
+        e[k].push_back(1.0f + (i % 7));
+      }
+    }
+  }
+};
+
+static void bm_la_frustum_test_sphere_loop(benchmark::State &state) {
+  cull_scene s(LA_BENCH_OBJECTS);
+  for (auto _ : state) {
+    size_t count = 0;
+    for (size_t i = 0; i < LA_BENCH_OBJECTS; i++) {
+      la_vec3 c = {.elem = {s.c[0][i], s.c[1][i], s.c[2][i]}};
+      if (la_frustum_test_sphere(&s.f, c, s.e[0][i])) {
+        s.indices[count++] = i;
+      }
+    }
+    benchmark::DoNotOptimize(count);
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_OBJECTS);
+}
+BENCHMARK(bm_la_frustum_test_sphere_loop);
+
+static void bm_la_frustum_cull_spheres(benchmark::State &state) {
+  cull_scene s(LA_BENCH_OBJECTS);
+  for (auto _ : state) {
+    la_frustum_cull_spheres(&s.f, s.c[0].data(), s.c[1].data(),
+                            s.c[2].data(), s.e[0].data(), LA_BENCH_OBJECTS,
+                            s.mask.data());
+    benchmark::DoNotOptimize(s.mask.data());
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_OBJECTS);
+}
+BENCHMARK(bm_la_frustum_cull_spheres);
+
+static void bm_la_frustum_cull_spheres_indices(benchmark::State &state) {
+  cull_scene s(LA_BENCH_OBJECTS);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(la_frustum_cull_spheres_indices(
+        &s.f, s.c[0].data(), s.c[1].data(), s.c[2].data(), s.e[0].data(),
+        LA_BENCH_OBJECTS, s.indices.data()));
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_OBJECTS);
+}
+BENCHMARK(bm_la_frustum_cull_spheres_indices);
+
+static void bm_la_frustum_cull_aabbs(benchmark::State &state) {
+  cull_scene s(LA_BENCH_OBJECTS);
+  for (auto _ : state) {
+    la_frustum_cull_aabbs(&s.f, s.c[0].data(), s.c[1].data(), s.c[2].data(),
+                          s.e[0].data(), s.e[1].data(), s.e[2].data(),
+                          LA_BENCH_OBJECTS, s.mask.data());
+    benchmark::DoNotOptimize(s.mask.data());
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_OBJECTS);
+}
+BENCHMARK(bm_la_frustum_cull_aabbs);
+
+static void bm_la_frustum_cull_aabbs_indices(benchmark::State &state) {
+  cull_scene s(LA_BENCH_OBJECTS);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(la_frustum_cull_aabbs_indices(
+        &s.f, s.c[0].data(), s.c[1].data(), s.c[2].data(), s.e[0].data(),
+        s.e[1].data(), s.e[2].data(), LA_BENCH_OBJECTS, s.indices.data()));
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_OBJECTS);
+}
+BENCHMARK(bm_la_frustum_cull_aabbs_indices);
+
+/* Hierarchy --------------------------------------------------------------- */
+
+#define LA_BENCH_NODES 100000
+
+/* A wide, shallow scene: 100 roots with 4 children per node. */
+static la_hierarchy *bench_hierarchy(void) {
+  std::vector<int32_t> parent(100, -1);
+  for (size_t i = 0; parent.size() < LA_BENCH_NODES; i++) {
+    for (int c = 0; c < 4 && parent.size() < LA_BENCH_NODES; c++) {
+      parent.push_back((int32_t)i);
+    }
+  }
+  la_hierarchy *h = la_hierarchy_create(parent.data(), parent.size());
+  const la_vec3 t = {.elem = {1.0f, 0.5f, 0.0f}};
+  const la_vec3 s = {.elem = {1.0f, 1.0f, 1.0f}};
+  for (size_t i = 0; i < h->count; i++) {
+    la_hierarchy_set_trs(h, i, t, bench_quat(0.01f * (i % 100)), s);
+  }
+  la_hierarchy_update(h);
+  return h;
+}
+
+/* Arguments are the number of nodes in 10000 marked dirty per frame. Leaves
+ * are picked, as moving objects usually are. */
+static void bm_la_hierarchy_update(benchmark::State &state) {
+  la_hierarchy *h = bench_hierarchy();
+  const size_t stride = 10000 / state.range(0);
+  for (auto _ : state) {
+    for (size_t i = stride; i <= h->count; i += stride) {
+      la_hierarchy_mark_dirty(h, h->count - i);
+    }
+    benchmark::DoNotOptimize(la_hierarchy_update(h));
+  }
+  la_hierarchy_destroy(h);
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_NODES);
+}
+BENCHMARK(bm_la_hierarchy_update)->Arg(10000)->Arg(100)->Arg(10);
+
+/* TRS --------------------------------------------------------------------- */
+
+/* The matrix products la_compose_trs replaces. */
+static void bm_la_trs_products(benchmark::State &state) {
+  const la_vec3 t = {.elem = {1.0f, 0.5f, 0.0f}};
+  const la_vec3 s = {.elem = {2.0f, 1.0f, 0.5f}};
+  la_quat q = bench_quat(0.3f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(q);
+    la_mat4 m = la_productm4(la_scale(la_identitym4(), s), la_quattom4(q));
+    benchmark::DoNotOptimize(
+        la_productm4(m, la_translate(la_identitym4(), t)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_trs_products);
+
+static void bm_la_compose_trs(benchmark::State &state) {
+  const la_vec3 t = {.elem = {1.0f, 0.5f, 0.0f}};
+  const la_vec3 s = {.elem = {2.0f, 1.0f, 0.5f}};
+  la_quat q = bench_quat(0.3f);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(q);
+    benchmark::DoNotOptimize(la_compose_trs(t, q, s));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_compose_trs);
+
+static void bm_la_decompose_trs(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  la_vec3 t, s;
+  la_quat r;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_decompose_trs(m, &t, &r, &s));
+    benchmark::DoNotOptimize(r);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_decompose_trs);
+
+struct soa_trs {
+  std::vector<float> v[10];
+  la_trs_soa soa;
+
+  explicit soa_trs(size_t n) {
+    float *p[10];
+    for (int k = 0; k < 10; k++) {
+      v[k].resize(n);
+      p[k] = v[k].data();
+    }
+    soa = {p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8], p[9]};
+    for (size_t i = 0; i < n; i++) {
+      const la_quat q = bench_quat(0.01f * (i % 100));
+      for (int k = 0; k < 4; k++) {
+        v[3 + k][i] = q.elem[k];
+      }
+      for (int k = 0; k < 3; k++) {
+        v[k][i] = (float)((i * (k + 3)) % 97) - 48.0f;
+        v[7 + k][i] = 1.0f + 0.01f * (i % 7);
+      }
+    }
+  }
+};
+
+/* The per-frame local matrices of a 100k instance scene. */
+static void bm_la_compose_trs_loop(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs in(n);
+  std::vector<la_mat4> out(n);
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; i++) {
+      const la_vec3 t = {.elem = {in.v[0][i], in.v[1][i], in.v[2][i]}};
+      const la_quat r = {
+          .elem = {in.v[3][i], in.v[4][i], in.v[5][i], in.v[6][i]}};
+      const la_vec3 s = {.elem = {in.v[7][i], in.v[8][i], in.v[9][i]}};
+      out[i] = la_compose_trs(t, r, s);
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_compose_trs_loop)->Arg(100000);
+
+static void bm_la_compose_trs_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs in(n);
+  std::vector<la_mat4> out(n);
+  for (auto _ : state) {
+    la_compose_trs_soa(&in.soa, out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n *
+                          (10 * sizeof(float) + sizeof(la_mat4)));
+}
+BENCHMARK(bm_la_compose_trs_soa)->Arg(1000)->Arg(100000);
+
+static void bm_la_decompose_trs_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs trs(n);
+  std::vector<la_mat4> in(n);
+  la_compose_trs_soa(&trs.soa, in.data(), n);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(la_decompose_trs_soa(in.data(), &trs.soa, n));
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_decompose_trs_soa)->Arg(100000);
+
+/* Skinning ---------------------------------------------------------------- */
+
+#define LA_BENCH_BONES 64
+
+/* n vertices with 4 influences each and their rigid bone palette. */
+struct skinned_mesh {
+  std::vector<la_mat4> bones;
+  std::vector<uint16_t> index;
+  std::vector<float> weight;
+  soa_points p;
+  la_skin_soa soa;
+
+  explicit skinned_mesh(size_t n) : index(4 * n), weight(4 * n), p(n) {
+    la_vec3 axis = {.elem = {0.3f, -1.0f, 0.5f}};
+    for (int b = 0; b < LA_BENCH_BONES; b++) {
+      la_vec3 t = {.elem = {0.1f * b, 1.0f, -0.5f * b}};
+      bones.push_back(
+          la_translate(la_rotate(la_identitym4(), axis, 0.1f * b), t));
+    }
+    for (size_t i = 0; i < n; i++) {
+      for (size_t k = 0; k < 4; k++) {
+        index[k * n + i] = (uint16_t)((i / 16 + k * 5) % LA_BENCH_BONES);
+        weight[k * n + i] = 0.25f;
+      }
+    }
+    soa = la_skin_soa{n,
+                      4,
+                      index.data(),
+                      weight.data(),
+                      p.in[0].data(),
+                      p.in[1].data(),
+                      p.in[2].data(),
+                      NULL,
+                      NULL,
+                      NULL,
+                      p.out[0].data(),
+                      p.out[1].data(),
+                      p.out[2].data(),
+                      NULL,
+                      NULL,
+                      NULL};
+  }
+};
+
+/* The baseline: one la_productm4v4 per vertex and influence. */
+static void bm_la_skin_productm4v4_loop(benchmark::State &state) {
+  const size_t n = state.range(0);
+  skinned_mesh m(n);
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; i++) {
+      const la_vec4 v = {.elem = {m.p.in[0][i], m.p.in[1][i], m.p.in[2][i],
+                                  1.0f}};
+      float r[3] = {0.0f, 0.0f, 0.0f};
+      for (size_t k = 0; k < 4; k++) {
+        const la_vec4 t = la_productm4v4(m.bones[m.index[k * n + i]], v);
+        for (int c = 0; c < 3; c++) {
+          r[c] += m.weight[k * n + i] * t.elem[c];
+        }
+      }
+      m.p.out[0][i] = r[0];
+      m.p.out[1][i] = r[1];
+      m.p.out[2][i] = r[2];
+    }
+    benchmark::DoNotOptimize(m.p.out[0].data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_skin_productm4v4_loop)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_skin_linear(benchmark::State &state) {
+  const size_t n = state.range(0);
+  skinned_mesh m(n);
+  std::vector<la_mat3x4> palette(LA_BENCH_BONES);
+  la_m4tomat3x4_batch(m.bones.data(), palette.data(), LA_BENCH_BONES);
+  for (auto _ : state) {
+    la_skin_linear(palette.data(), &m.soa);
+    benchmark::DoNotOptimize(m.p.out[0].data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_skin_linear)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_skin_dual_quat(benchmark::State &state) {
+  const size_t n = state.range(0);
+  skinned_mesh m(n);
+  std::vector<la_dualquat> palette(LA_BENCH_BONES);
+  la_m4todq_batch(m.bones.data(), palette.data(), LA_BENCH_BONES);
+  for (auto _ : state) {
+    la_skin_dual_quat(palette.data(), &m.soa);
+    benchmark::DoNotOptimize(m.p.out[0].data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_skin_dual_quat)->LA_BENCH_BATCH_SIZES;
+
+/* Animation --------------------------------------------------------------- */
+
+/* Keys of a character-like clip: every node has a translation, rotation and
+ * scale track, with a key every 1/30 s over 2 s. */
+struct anim_clip {
+  std::vector<float> times;
+  std::vector<float> values[3];
+  std::vector<la_anim_track_desc> tracks;
+
+  anim_clip(size_t nodes, la_anim_interp interp) {
+    const size_t keys = 61;
+    for (size_t k = 0; k < keys; k++) {
+      times.push_back((float)k / 30.0f);
+    }
+    for (size_t k = 0; k < 8 * keys; k++) {
+      const float f = (float)k;
+      values[0].push_back(0.01f * f);
+      values[2].push_back(1.0f + 0.001f * f);
+      const la_quat q = bench_quat(0.02f * f);
+      values[1].insert(values[1].end(), q.elem, q.elem + 4);
+    }
+    /* Hermite tangents reuse the values, any data does. */
+    for (uint32_t i = 0; i < nodes; i++) {
+      for (uint32_t c = 0; c < 3; c++) {
+        const la_anim_track_desc d = {
+            i, (la_anim_channel)c, interp, keys, times.data(),
+            values[c].data(), values[c].data()};
+        tracks.push_back(d);
+      }
+    }
+  }
+};
+
+/* Arguments are {nodes, interpolation}. Playback at 60 Hz. */
+static void bm_la_anim_sample(benchmark::State &state) {
+  const size_t nodes = state.range(0);
+  anim_clip keys(nodes, (la_anim_interp)state.range(1));
+  la_anim_clip *clip = la_anim_clip_create(keys.tracks.data(), 3 * nodes);
+  std::vector<uint32_t> cursor(la_anim_clip_tracks(clip), 0);
+  std::vector<float> streams(10 * nodes);
+  const la_trs_soa pose = {
+      &streams[0],         &streams[nodes],     &streams[2 * nodes],
+      &streams[3 * nodes], &streams[4 * nodes], &streams[5 * nodes],
+      &streams[6 * nodes], &streams[7 * nodes], &streams[8 * nodes],
+      &streams[9 * nodes]};
+  float time = 0.0f;
+  for (auto _ : state) {
+    la_anim_sample(clip, time, cursor.data(), &pose, nodes);
+    benchmark::DoNotOptimize(streams.data());
+    time = time < 2.0f ? time + 1.0f / 60.0f : 0.0f;
+  }
+  la_anim_clip_destroy(clip);
+  state.SetItemsProcessed(state.iterations() * 3 * nodes);
+}
+BENCHMARK(bm_la_anim_sample)
+    ->Args({1000, LA_ANIM_LINEAR})
+    ->Args({1000, LA_ANIM_HERMITE});
+
+/* Three clips blended per frame into a reused pose. */
+static void bm_la_anim_pose_blend(benchmark::State &state) {
+  const size_t nodes = state.range(0);
+  anim_clip keys(nodes, LA_ANIM_LINEAR);
+  la_anim_clip *clip = la_anim_clip_create(keys.tracks.data(), 3 * nodes);
+  std::vector<uint32_t> cursor[3];
+  for (auto &c : cursor) {
+    c.resize(la_anim_clip_tracks(clip));
+  }
+  la_anim_pose *pose = la_anim_pose_create(nodes);
+  float time = 0.0f;
+  for (auto _ : state) {
+    la_anim_pose_clear(pose);
+    for (int c = 0; c < 3; c++) {
+      la_anim_pose_add(pose, clip, time + 0.3f * c, cursor[c].data(), 0.3f);
+    }
+    la_anim_pose_finish(pose, NULL);
+    benchmark::DoNotOptimize(pose->trs.tx);
+    time = time < 1.0f ? time + 1.0f / 60.0f : 0.0f;
+  }
+  la_anim_pose_destroy(pose);
+  la_anim_clip_destroy(clip);
+  state.SetItemsProcessed(state.iterations() * 3 * nodes);
+}
+BENCHMARK(bm_la_anim_pose_blend)->Arg(1000);
+
+/* Quantization ------------------------------------------------------------ */
+
+/* The single-quaternion encoder over a batch, for comparison. */
+static void bm_la_quat_pack32_loop(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs in(n);
+  std::vector<uint32_t> out(n);
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; i++) {
+      const la_quat q = {
+          .elem = {in.v[3][i], in.v[4][i], in.v[5][i], in.v[6][i]}};
+      out[i] = la_quat_pack32(q);
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_quat_pack32_loop)->Arg(100000);
+
+static void bm_la_quat_pack32_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs in(n);
+  const la_trs_soa &s = in.soa;
+  std::vector<uint32_t> out(n);
+  for (auto _ : state) {
+    la_quat_pack32_soa(s.rx, s.ry, s.rz, s.rw, out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 20);
+}
+BENCHMARK(bm_la_quat_pack32_soa)->Arg(1000)->Arg(100000);
+
+static void bm_la_quat_unpack32_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs out(n);
+  const la_trs_soa &s = out.soa;
+  std::vector<uint32_t> in(n);
+  la_quat_pack32_soa(s.rx, s.ry, s.rz, s.rw, in.data(), n);
+  for (auto _ : state) {
+    la_quat_unpack32_soa(in.data(), s.rx, s.ry, s.rz, s.rw, n);
+    benchmark::DoNotOptimize(s.rx);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 20);
+}
+BENCHMARK(bm_la_quat_unpack32_soa)->Arg(1000)->Arg(100000);
+
+static void bm_la_quat_pack48_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs in(n);
+  const la_trs_soa &s = in.soa;
+  std::vector<uint16_t> out(3 * n);
+  for (auto _ : state) {
+    la_quat_pack48_soa(s.rx, s.ry, s.rz, s.rw, out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 22);
+}
+BENCHMARK(bm_la_quat_pack48_soa)->Arg(100000);
+
+static void bm_la_quat_unpack48_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs out(n);
+  const la_trs_soa &s = out.soa;
+  std::vector<uint16_t> in(3 * n);
+  la_quat_pack48_soa(s.rx, s.ry, s.rz, s.rw, in.data(), n);
+  for (auto _ : state) {
+    la_quat_unpack48_soa(in.data(), s.rx, s.ry, s.rz, s.rw, n);
+    benchmark::DoNotOptimize(s.rx);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 22);
+}
+BENCHMARK(bm_la_quat_unpack48_soa)->Arg(100000);
+
+static const la_vec3 bench_bounds_min = {.elem = {-64.0f, -64.0f, -64.0f}};
+static const la_vec3 bench_bounds_max = {.elem = {64.0f, 64.0f, 64.0f}};
+
+static void bm_la_position_pack16_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs in(n);
+  const la_trs_soa &s = in.soa;
+  std::vector<uint16_t> out(3 * n);
+  for (auto _ : state) {
+    la_position_pack16_soa(s.tx, s.ty, s.tz, bench_bounds_min,
+                           bench_bounds_max, out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 18);
+}
+BENCHMARK(bm_la_position_pack16_soa)->Arg(100000);
+
+static void bm_la_position_unpack16_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs out(n);
+  const la_trs_soa &s = out.soa;
+  std::vector<uint16_t> in(3 * n);
+  la_position_pack16_soa(s.tx, s.ty, s.tz, bench_bounds_min, bench_bounds_max,
+                         in.data(), n);
+  for (auto _ : state) {
+    la_position_unpack16_soa(in.data(), bench_bounds_min, bench_bounds_max,
+                             s.tx, s.ty, s.tz, n);
+    benchmark::DoNotOptimize(s.tx);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 18);
+}
+BENCHMARK(bm_la_position_unpack16_soa)->Arg(100000);
+
+static void bm_la_scale_pack16_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs in(n);
+  const la_trs_soa &s = in.soa;
+  std::vector<uint16_t> out(3 * n);
+  for (auto _ : state) {
+    la_scale_pack16_soa(s.sx, s.sy, s.sz, 1.0f / 1024.0f, 1024.0f, out.data(),
+                        n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_scale_pack16_soa)->Arg(100000);
+
+static void bm_la_scale_unpack16_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs out(n);
+  const la_trs_soa &s = out.soa;
+  std::vector<uint16_t> in(3 * n);
+  la_scale_pack16_soa(s.sx, s.sy, s.sz, 1.0f / 1024.0f, 1024.0f, in.data(), n);
+  for (auto _ : state) {
+    la_scale_unpack16_soa(in.data(), 1.0f / 1024.0f, 1024.0f, s.sx, s.sy, s.sz,
+                          n);
+    benchmark::DoNotOptimize(s.sx);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_scale_unpack16_soa)->Arg(100000);
+
+/* Precision --------------------------------------------------------------- */
+
+static void bm_la_ftoh_batch(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<float> in(n);
+  std::vector<la_half> out(n);
+  for (size_t i = 0; i < n; i++) {
+    in[i] = (float)i * 0.37f - 100.0f;
+  }
+  for (auto _ : state) {
+    la_ftoh_batch(in.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 6);
+}
+BENCHMARK(bm_la_ftoh_batch)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_htof_batch(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<la_half> in(n);
+  std::vector<float> out(n);
+  for (size_t i = 0; i < n; i++) {
+    in[i] = la_ftoh((float)i * 0.37f - 100.0f);
+  }
+  for (auto _ : state) {
+    la_htof_batch(in.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 6);
+}
+BENCHMARK(bm_la_htof_batch)->LA_BENCH_BATCH_SIZES;
+
+static void bm_la_camera_relative_soa(benchmark::State &state) {
+  const size_t n = state.range(0);
+  const la_dvec3 camera = {.elem = {1.0e7, 2.0e3, -4.0e6}};
+  std::vector<double> p[3];
+  std::vector<float> o[3];
+  for (int k = 0; k < 3; k++) {
+    for (size_t i = 0; i < n; i++) {
+      p[k].push_back(camera.elem[k] + (double)i * 0.25);
+    }
+    o[k].resize(n);
+  }
+  for (auto _ : state) {
+    la_camera_relative_soa(&camera, p[0].data(), p[1].data(), p[2].data(),
+                           o[0].data(), o[1].data(), o[2].data(), n);
+    benchmark::DoNotOptimize(o[0].data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 3 * 12);
+}
+BENCHMARK(bm_la_camera_relative_soa)->LA_BENCH_BATCH_SIZES;
+
+/* Small matrices ---------------------------------------------------------- */
+
+static void bm_la_productm3(benchmark::State &state) {
+  la_mat3 a = la_m4tom3(bench_matrix(1));
+  la_mat3 b = la_m4tom3(bench_matrix(2));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(a);
+    benchmark::DoNotOptimize(la_productm3(a, b));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_productm3);
+
+static void bm_la_inversem3(benchmark::State &state) {
+  la_mat3 m = la_m4tom3(bench_affine());
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_inversem3(m, NULL));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_inversem3);
+
+static void bm_la_normal_matrix(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_normal_matrix(m, NULL));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_normal_matrix);
+
+/* The normal matrix through a padded 4x4 inverse, for comparison. */
+static void bm_normal_matrix_m4(benchmark::State &state) {
+  la_mat4 m = bench_affine();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(m);
+    benchmark::DoNotOptimize(la_transposem4(la_inversem4(m, NULL)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_normal_matrix_m4);
+
+/* Square n x n products; items are multiply-adds. */
+static std::vector<float> bench_matrix_mn(size_t n, unsigned int seed) {
+  std::vector<float> m(n * n);
+  for (float &f : m) {
+    seed = seed * 1664525u + 1013904223u;
+    f = ((seed >> 8) / 16777216.0f) * 2.0f - 1.0f;
+  }
+  return m;
+}
+
+static void bm_la_productmn(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<float> a = bench_matrix_mn(n, 1);
+  std::vector<float> b = bench_matrix_mn(n, 2);
+  std::vector<float> c(n * n);
+  for (auto _ : state) {
+    la_productmn(a.data(), n, b.data(), n, c.data(), n, n, n, n);
+    benchmark::DoNotOptimize(c.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n * n * n);
+}
+BENCHMARK(bm_la_productmn)->Arg(6)->Arg(16)->Arg(32)->Arg(64)->Arg(256);
+
+/* The textbook i, j, k loop (a dot product per element), for comparison. */
+static void bm_naive_productmn(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<float> a = bench_matrix_mn(n, 1);
+  std::vector<float> b = bench_matrix_mn(n, 2);
+  std::vector<float> c(n * n);
+  for (auto _ : state) {
+    for (size_t i = 0; i < n; i++) {
+      for (size_t k = 0; k < n; k++) {
+        float sum = 0.0f;
+        for (size_t j = 0; j < n; j++) {
+          sum += a[i * n + j] * b[j * n + k];
+        }
+        c[i * n + k] = sum;
+      }
+    }
+    benchmark::DoNotOptimize(c.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n * n * n);
+}
+BENCHMARK(bm_naive_productmn)->Arg(6)->Arg(16)->Arg(32)->Arg(64)->Arg(256);
+
+/* Files ------------------------------------------------------------------- */
+
+#define LA_BENCH_FILE_MATS (1 << 18)
+#define LA_BENCH_FILE "la_bench.bin" // Created in the working directory.
+
+/* Writes 16 MiB of la_mat4s in each layout. */
+static void bm_la_bin_write(benchmark::State &state) {
+  const la_bin_layout layout = (la_bin_layout)state.range(0);
+  std::vector<la_mat4> m(LA_BENCH_FILE_MATS, bench_matrix(1));
+  for (auto _ : state) {
+    la_bin_writer *w = la_bin_writer_open(LA_BENCH_FILE);
+    la_bin_write_array(w, "mats", LA_BIN_MAT4, layout, m.data(), m.size());
+    if (!la_bin_writer_close(w)) {
+      state.SkipWithError("cannot write the file");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * m.size() * sizeof(la_mat4));
+  remove(LA_BENCH_FILE);
+}
+BENCHMARK(bm_la_bin_write)
+    ->Arg(LA_BIN_AOS)
+    ->Arg(LA_BIN_SOA)
+    ->Arg(LA_BIN_Q16)
+    ->Unit(benchmark::kMillisecond);
+
+static std::vector<la_mat4> write_bench_file(la_bin_layout layout) {
+  std::vector<la_mat4> m(LA_BENCH_FILE_MATS, bench_matrix(1));
+  la_bin_writer *w = la_bin_writer_open(LA_BENCH_FILE);
+  la_bin_write_array(w, "mats", LA_BIN_MAT4, layout, m.data(), m.size());
+  la_bin_writer_close(w);
+  return m;
+}
+
+/* Opening a mapped file costs the same whatever its size. */
+static void bm_la_bin_open(benchmark::State &state) {
+  write_bench_file(LA_BIN_AOS);
+  for (auto _ : state) {
+    la_bin *b = la_bin_open(LA_BENCH_FILE);
+    if (b == NULL) {
+      state.SkipWithError("cannot open the file");
+      break;
+    }
+    benchmark::DoNotOptimize(la_bin_data(b, la_bin_find(b, "mats")));
+    la_bin_close(b);
+  }
+  remove(LA_BENCH_FILE);
+}
+BENCHMARK(bm_la_bin_open);
+
+/* The file read into memory with fread, for comparison. */
+static void bm_fread_file(benchmark::State &state) {
+  std::vector<la_mat4> m = write_bench_file(LA_BIN_AOS);
+  for (auto _ : state) {
+    FILE *f = fopen(LA_BENCH_FILE, "rb");
+    if (f == NULL) {
+      state.SkipWithError("cannot open the file");
+      break;
+    }
+    fseek(f, LA_CACHE_LINE, SEEK_SET);
+    benchmark::DoNotOptimize(fread(m.data(), sizeof(la_mat4), m.size(), f));
+    fclose(f);
+  }
+  state.SetBytesProcessed(state.iterations() * m.size() * sizeof(la_mat4));
+  remove(LA_BENCH_FILE);
+}
+BENCHMARK(bm_fread_file)->Unit(benchmark::kMillisecond);
+
+/* Decoding quantized matrices. */
+static void bm_la_bin_read_q16(benchmark::State &state) {
+  std::vector<la_mat4> m = write_bench_file(LA_BIN_Q16);
+  la_bin *b = la_bin_open(LA_BENCH_FILE);
+  if (b == NULL) {
+    state.SkipWithError("cannot open the file");
+    return;
+  }
+  const la_bin_entry *e = la_bin_find(b, "mats");
+  for (auto _ : state) {
+    la_bin_read(b, e, 0, m.size(), m.data());
+    benchmark::DoNotOptimize(m.data());
+  }
+  state.SetItemsProcessed(state.iterations() * m.size());
+  la_bin_close(b);
+  remove(LA_BENCH_FILE);
+}
+BENCHMARK(bm_la_bin_read_q16)->Unit(benchmark::kMillisecond);
+
+/* Rays -------------------------------------------------------------------- */
+
+#define LA_BENCH_RAYS 64
+#define LA_BENCH_PRIMS 256
+
+/* Rays from a camera at the origin through a scene of small primitives in
+ * front of it, with about one ray in four hitting something. */
+struct ray_scene {
+  std::vector<la_ray> rays;
+  std::vector<la_vec3> tris;
+  std::vector<la_vec3> min, max;
+  std::vector<la_vec4> spheres;
+
+  ray_scene() {
+    unsigned int seed = 1;
+    auto next = [&seed](float lo, float hi) {
+      seed = seed * 1664525u + 1013904223u;
+      return lo + ((seed >> 8) / 16777216.0f) * (hi - lo);
+    };
+    for (size_t i = 0; i < LA_BENCH_PRIMS; i++) {
+      la_vec3 c = {.elem = {next(-40.0f, 40.0f), next(-40.0f, 40.0f),
+                            next(-100.0f, -20.0f)}};
+      for (int v = 0; v < 3; v++) {
+        la_vec3 p = c;
+        for (int k = 0; k < 3; k++) {
+          p.elem[k] += next(-1.5f, 1.5f);
+        }
+        tris.push_back(p);
+      }
+      la_vec3 lo = c, hi = c;
+      for (int k = 0; k < 3; k++) {
+        lo.elem[k] -= 1.0f;
+        hi.elem[k] += 1.0f;
+      }
+      min.push_back(lo);
+      max.push_back(hi);
+      la_vec4 s = {.elem = {c.x, c.y, c.z, 1.0f}};
+      spheres.push_back(s);
+    }
+    for (size_t i = 0; i < LA_BENCH_RAYS; i++) {
+      la_vec3 d = {.elem = {next(-0.5f, 0.5f), next(-0.5f, 0.5f), -1.0f}};
+      la_ray r = {.origin = {.elem = {0.0f, 0.0f, 0.0f}},
+                  .dir = la_normalizev3(d),
+                  .tmin = 0.0f,
+                  .tmax = 1000.0f};
+      rays.push_back(r);
+    }
+  }
+
+  template <typename F> void packets(F query) {
+    for (size_t i = 0; i < LA_BENCH_RAYS; i += LA_RAY_PACKET) {
+      la_ray_packet p;
+      for (size_t l = 0; l < LA_RAY_PACKET; l++) {
+        la_ray_packet_set(&p, l, &rays[i + l]);
+      }
+      benchmark::DoNotOptimize(query(&p));
+    }
+  }
+};
+
+static void bm_la_ray_test_triangle(benchmark::State &state) {
+  ray_scene s;
+  for (auto _ : state) {
+    for (la_ray r : s.rays) {
+      for (size_t i = 0; i < LA_BENCH_PRIMS; i++) {
+        float t;
+        if (la_ray_test_triangle(&r, &s.tris[i * 3], &t, NULL)) {
+          r.tmax = t;
+        }
+      }
+      benchmark::DoNotOptimize(r.tmax);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_RAYS * LA_BENCH_PRIMS);
+}
+BENCHMARK(bm_la_ray_test_triangle);
+
+static void bm_la_ray_packet_triangles(benchmark::State &state) {
+  ray_scene s;
+  for (auto _ : state) {
+    s.packets([&](la_ray_packet *p) {
+      return la_ray_packet_triangles(p, s.tris.data(), LA_BENCH_PRIMS,
+                                     LA_RAY_NEAREST);
+    });
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_RAYS * LA_BENCH_PRIMS);
+}
+BENCHMARK(bm_la_ray_packet_triangles);
+
+/* Occlusion rays stop at their first hit. */
+static void bm_la_ray_packet_triangles_any(benchmark::State &state) {
+  ray_scene s;
+  for (auto _ : state) {
+    s.packets([&](la_ray_packet *p) {
+      return la_ray_packet_triangles(p, s.tris.data(), LA_BENCH_PRIMS,
+                                     LA_RAY_ANY);
+    });
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_RAYS * LA_BENCH_PRIMS);
+}
+BENCHMARK(bm_la_ray_packet_triangles_any);
+
+static void bm_la_ray_test_aabb(benchmark::State &state) {
+  ray_scene s;
+  for (auto _ : state) {
+    for (la_ray r : s.rays) {
+      for (size_t i = 0; i < LA_BENCH_PRIMS; i++) {
+        float t;
+        if (la_ray_test_aabb(&r, s.min[i], s.max[i], &t)) {
+          r.tmax = t;
+        }
+      }
+      benchmark::DoNotOptimize(r.tmax);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_RAYS * LA_BENCH_PRIMS);
+}
+BENCHMARK(bm_la_ray_test_aabb);
+
+static void bm_la_ray_packet_aabbs(benchmark::State &state) {
+  ray_scene s;
+  for (auto _ : state) {
+    s.packets([&](la_ray_packet *p) {
+      return la_ray_packet_aabbs(p, s.min.data(), s.max.data(),
+                                 LA_BENCH_PRIMS, LA_RAY_NEAREST);
+    });
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_RAYS * LA_BENCH_PRIMS);
+}
+BENCHMARK(bm_la_ray_packet_aabbs);
+
+static void bm_la_ray_test_sphere(benchmark::State &state) {
+  ray_scene s;
+  for (auto _ : state) {
+    for (la_ray r : s.rays) {
+      for (size_t i = 0; i < LA_BENCH_PRIMS; i++) {
+        la_vec3 c = {.elem = {s.spheres[i].x, s.spheres[i].y, s.spheres[i].z}};
+        float t;
+        if (la_ray_test_sphere(&r, c, s.spheres[i].w, &t)) {
+          r.tmax = t;
+        }
+      }
+      benchmark::DoNotOptimize(r.tmax);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_RAYS * LA_BENCH_PRIMS);
+}
+BENCHMARK(bm_la_ray_test_sphere);
+
+static void bm_la_ray_packet_spheres(benchmark::State &state) {
+  ray_scene s;
+  for (auto _ : state) {
+    s.packets([&](la_ray_packet *p) {
+      return la_ray_packet_spheres(p, s.spheres.data(), LA_BENCH_PRIMS,
+                                   LA_RAY_NEAREST);
+    });
+  }
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_RAYS * LA_BENCH_PRIMS);
+}
+BENCHMARK(bm_la_ray_packet_spheres);
+
+/* BVH --------------------------------------------------------------------- */
+
+/* A height field of 2 * size * size triangles, and the camera rays of a
+ * 64x64 image looking at it. The rays are ordered in 4x2 pixel tiles, one
+ * tile per packet. */
+struct bvh_terrain {
+  std::vector<la_vec3> tris;
+  std::vector<la_ray> rays;
+
+  explicit bvh_terrain(size_t size) {
+    auto at = [size](size_t i, size_t j) {
+      const float x = (float)i / size * 200.0f - 100.0f;
+      const float z = (float)j / size * 200.0f - 100.0f;
+      la_vec3 p = {.elem = {x, 5.0f * sinf(x * 0.1f) * cosf(z * 0.13f), z}};
+      return p;
+    };
+    tris.reserve(size * size * 6);
+    for (size_t i = 0; i < size; i++) {
+      for (size_t j = 0; j < size; j++) {
+        for (la_vec3 v : {at(i, j), at(i + 1, j), at(i, j + 1), at(i + 1, j),
+                          at(i + 1, j + 1), at(i, j + 1)}) {
+          tris.push_back(v);
+        }
+      }
+    }
+    la_vec3 eye = {.elem = {0.0f, 40.0f, 120.0f}};
+    la_vec3 ctr = {.elem = {0.0f, 0.0f, 0.0f}};
+    la_vec3 up = {.elem = {0.0f, 1.0f, 0.0f}};
+    la_mat4 vp = la_productm4(
+        la_look_at(eye, ctr, up),
+        la_perspective(la_radians(60.0f), 1.0f, 0.1f, 1000.0f));
+    la_mat4 inv_vp = la_inversem4(vp, NULL);
+    la_vec4 viewport = {.elem = {0.0f, 0.0f, 64.0f, 64.0f}};
+    for (size_t ty = 0; ty < 64; ty += 2) {
+      for (size_t tx = 0; tx < 64; tx += 4) {
+        for (size_t k = 0; k < LA_RAY_PACKET; k++) {
+          la_vec2 pixel = {.elem = {(float)(tx + k % 4) + 0.5f,
+                                    (float)(ty + k / 4) + 0.5f}};
+          rays.push_back(la_pick_ray(inv_vp, viewport, pixel));
+        }
+      }
+    }
+  }
+
+  size_t count() const { return tris.size() / 3; }
+};
+
+/* 2M triangles. */
+static const bvh_terrain &bench_terrain() {
+  static const bvh_terrain t(1024);
+  return t;
+}
+
+static void bm_la_bvh_create_triangles(benchmark::State &state) {
+  const bvh_terrain &t = bench_terrain();
+  const size_t n = state.range(0);
+  for (auto _ : state) {
+    la_bvh *bvh = la_bvh_create_triangles(NULL, t.tris.data(), n);
+    benchmark::DoNotOptimize(bvh);
+    la_bvh_destroy(bvh);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_bvh_create_triangles)
+    ->Arg(1 << 16)
+    ->Arg(1 << 20)
+    ->Unit(benchmark::kMillisecond);
+
+static void bm_la_bvh_refit_triangles(benchmark::State &state) {
+  const bvh_terrain &t = bench_terrain();
+  la_bvh *bvh = la_bvh_create_triangles(NULL, t.tris.data(), 1 << 20);
+  for (auto _ : state) {
+    la_bvh_refit_triangles(bvh, t.tris.data());
+  }
+  la_bvh_destroy(bvh);
+  state.SetItemsProcessed(state.iterations() * (1 << 20));
+}
+BENCHMARK(bm_la_bvh_refit_triangles)->Unit(benchmark::kMillisecond);
+
+static void bm_la_bvh_closest(benchmark::State &state) {
+  const bvh_terrain &t = bench_terrain();
+  la_bvh *bvh = la_bvh_create_triangles(NULL, t.tris.data(), t.count());
+  for (auto _ : state) {
+    for (const la_ray &r : t.rays) {
+      float h;
+      benchmark::DoNotOptimize(la_bvh_closest(bvh, &r, &h, NULL, NULL));
+    }
+  }
+  la_bvh_destroy(bvh);
+  state.SetItemsProcessed(state.iterations() * t.rays.size());
+}
+BENCHMARK(bm_la_bvh_closest);
+
+static void bm_la_bvh_any(benchmark::State &state) {
+  const bvh_terrain &t = bench_terrain();
+  la_bvh *bvh = la_bvh_create_triangles(NULL, t.tris.data(), t.count());
+  for (auto _ : state) {
+    for (const la_ray &r : t.rays) {
+      benchmark::DoNotOptimize(la_bvh_any(bvh, &r));
+    }
+  }
+  la_bvh_destroy(bvh);
+  state.SetItemsProcessed(state.iterations() * t.rays.size());
+}
+BENCHMARK(bm_la_bvh_any);
+
+static void bm_la_bvh_packet(benchmark::State &state) {
+  const bvh_terrain &t = bench_terrain();
+  la_bvh *bvh = la_bvh_create_triangles(NULL, t.tris.data(), t.count());
+  for (auto _ : state) {
+    for (size_t i = 0; i < t.rays.size(); i += LA_RAY_PACKET) {
+      la_ray_packet p;
+      for (size_t l = 0; l < LA_RAY_PACKET; l++) {
+        la_ray_packet_set(&p, l, &t.rays[i + l]);
+      }
+      benchmark::DoNotOptimize(la_bvh_packet(bvh, &p, LA_RAY_NEAREST));
+    }
+  }
+  la_bvh_destroy(bvh);
+  state.SetItemsProcessed(state.iterations() * t.rays.size());
+}
+BENCHMARK(bm_la_bvh_packet);
+
+static void bm_la_bvh_overlap(benchmark::State &state) {
+  const bvh_terrain &t = bench_terrain();
+  la_bvh *bvh = la_bvh_create_triangles(NULL, t.tris.data(), t.count());
+  std::vector<uint32_t> prims(4096);
+  size_t q = 0;
+  for (auto _ : state) {
+    const float x = (float)(q++ % 64) * 3.0f - 96.0f;
+    la_vec3 lo = {.elem = {x, -10.0f, x}};
+    la_vec3 hi = {.elem = {x + 2.0f, 10.0f, x + 2.0f}};
+    benchmark::DoNotOptimize(
+        la_bvh_overlap(bvh, lo, hi, prims.data(), prims.size()));
+  }
+  la_bvh_destroy(bvh);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(bm_la_bvh_overlap);
+
+/* Dispatch ---------------------------------------------------------------- */
+
+/* The dispatched kernels at every level the CPU supports. The first
+ * argument is the la_simd_level, the second the batch size. */
+static void la_bench_levels(benchmark::internal::Benchmark *b) {
+  for (int level = LA_SIMD_BASELINE; level <= la_simd_max_level(); level++) {
+    b->Args({level, 1 << 12});
+    b->Args({level, 1 << 16});
+  }
+}
+
+/* Selects the level of a benchmark for its duration. */
+struct simd_level_scope {
+  la_simd_level saved;
+  explicit simd_level_scope(const benchmark::State &state)
+      : saved(la_get_simd_level()) {
+    la_set_simd_level((la_simd_level)state.range(0));
+  }
+  ~simd_level_scope() { la_set_simd_level(saved); }
+};
+
+static void bm_la_dispatch_productm4_batch(benchmark::State &state) {
+  simd_level_scope level(state);
+  const size_t n = state.range(1);
+  std::vector<la_mat4> a(n, bench_matrix(1));
+  std::vector<la_mat4> b(n, bench_matrix(2));
+  std::vector<la_mat4> out(n);
+  for (auto _ : state) {
+    la_productm4_batch(a.data(), b.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_dispatch_productm4_batch)->Apply(la_bench_levels);
+
+static void bm_la_dispatch_transform_points_v4(benchmark::State &state) {
+  simd_level_scope level(state);
+  const size_t n = state.range(1);
+  la_mat4 m = bench_matrix(1);
+  soa_points p(n);
+  for (auto _ : state) {
+    la_transform_points_v4(&m, p.in[0].data(), p.in[1].data(), p.in[2].data(),
+                           p.in[3].data(), p.out[0].data(), p.out[1].data(),
+                           p.out[2].data(), p.out[3].data(), n);
+    benchmark::DoNotOptimize(p.out[0].data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_dispatch_transform_points_v4)->Apply(la_bench_levels);
+
+static void bm_la_dispatch_transform_points_v4_aos(benchmark::State &state) {
+  simd_level_scope level(state);
+  const size_t n = state.range(1);
+  la_mat4 m = bench_matrix(1);
+  std::vector<la_vec4> in(n, bench_v4());
+  std::vector<la_vec4> out(n);
+  for (auto _ : state) {
+    la_transform_points_v4_aos(&m, in.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_dispatch_transform_points_v4_aos)->Apply(la_bench_levels);
+
+static void bm_la_dispatch_normalizev3_soa(benchmark::State &state) {
+  simd_level_scope level(state);
+  const size_t n = state.range(1);
+  soa_points p(n);
+  for (auto _ : state) {
+    la_normalizev3_soa(p.in[0].data(), p.in[1].data(), p.in[3].data(),
+                       p.out[0].data(), p.out[1].data(), p.out[2].data(), n);
+    benchmark::DoNotOptimize(p.out[0].data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_dispatch_normalizev3_soa)->Apply(la_bench_levels);
+
+static void bm_la_dispatch_frustum_cull_spheres(benchmark::State &state) {
+  simd_level_scope level(state);
+  const size_t n = state.range(1);
+  cull_scene s(n);
+  for (auto _ : state) {
+    la_frustum_cull_spheres(&s.f, s.c[0].data(), s.c[1].data(),
+                            s.c[2].data(), s.e[0].data(), n, s.mask.data());
+    benchmark::DoNotOptimize(s.mask.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_dispatch_frustum_cull_spheres)->Apply(la_bench_levels);
+
+static void bm_la_dispatch_frustum_cull_aabbs(benchmark::State &state) {
+  simd_level_scope level(state);
+  const size_t n = state.range(1);
+  cull_scene s(n);
+  for (auto _ : state) {
+    la_frustum_cull_aabbs(&s.f, s.c[0].data(), s.c[1].data(), s.c[2].data(),
+                          s.e[0].data(), s.e[1].data(), s.e[2].data(), n,
+                          s.mask.data());
+    benchmark::DoNotOptimize(s.mask.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_dispatch_frustum_cull_aabbs)->Apply(la_bench_levels);
+
+/* Threaded ---------------------------------------------------------------- */
+
+#ifdef LA_HAS_POOL
+/* Arguments are {elements, threads}. */
+static void la_bench_threads(benchmark::internal::Benchmark *b) {
+  for (int threads : {1, 2, 4, 8, 16}) {
+    b->Args({1 << 21, threads});
+  }
+}
+
+static void bm_la_transform_points_v4_mt(benchmark::State &state) {
+  const size_t n = state.range(0);
+  la_mat4 m = bench_matrix(1);
+  soa_points p(n);
+  la_pool *pool = la_pool_create(state.range(1));
+  la_jobs jobs = la_pool_jobs(pool, 0);
+  for (auto _ : state) {
+    la_transform_points_v4_mt(&jobs, &m, p.in[0].data(), p.in[1].data(),
+                              p.in[2].data(), p.in[3].data(), p.out[0].data(),
+                              p.out[1].data(), p.out[2].data(),
+                              p.out[3].data(), n);
+    benchmark::DoNotOptimize(p.out[0].data());
+  }
+  la_pool_destroy(pool);
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 8 * sizeof(float));
+}
+BENCHMARK(bm_la_transform_points_v4_mt)->Apply(la_bench_threads)->UseRealTime();
+
+static void bm_la_transform_points_v4_aos_mt(benchmark::State &state) {
+  const size_t n = state.range(0);
+  la_mat4 m = bench_matrix(1);
+  std::vector<la_vec4> in(n, bench_v4());
+  std::vector<la_vec4> out(n);
+  la_pool *pool = la_pool_create(state.range(1));
+  la_jobs jobs = la_pool_jobs(pool, 0);
+  for (auto _ : state) {
+    la_transform_points_v4_aos_mt(&jobs, &m, in.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  la_pool_destroy(pool);
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * 2 * sizeof(la_vec4));
+}
+BENCHMARK(bm_la_transform_points_v4_aos_mt)
+    ->Apply(la_bench_threads)
+    ->UseRealTime();
+
+/* Arguments are {matrices, threads}, sized like 50k bone palettes. */
+static void la_bench_palette_threads(benchmark::internal::Benchmark *b) {
+  for (int threads : {1, 2, 4, 8, 16}) {
+    b->Args({50000, threads});
+  }
+}
+
+static void bm_la_productm4_batch_mt(benchmark::State &state) {
+  const size_t n = state.range(0);
+  std::vector<la_mat4> a(n, bench_matrix(1));
+  std::vector<la_mat4> b(n, bench_matrix(2));
+  std::vector<la_mat4> out(n);
+  la_pool *pool = la_pool_create(state.range(1));
+  la_jobs jobs = la_pool_jobs(pool, 0);
+  for (auto _ : state) {
+    la_productm4_batch_mt(&jobs, a.data(), b.data(), out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  la_pool_destroy(pool);
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_productm4_batch_mt)
+    ->Apply(la_bench_palette_threads)
+    ->UseRealTime();
+
+static void bm_la_compose_trs_soa_mt(benchmark::State &state) {
+  const size_t n = state.range(0);
+  soa_trs in(n);
+  std::vector<la_mat4> out(n);
+  la_pool *pool = la_pool_create(state.range(1));
+  la_jobs jobs = la_pool_jobs(pool, 0);
+  for (auto _ : state) {
+    la_compose_trs_soa_mt(&jobs, &in.soa, out.data(), n);
+    benchmark::DoNotOptimize(out.data());
+  }
+  la_pool_destroy(pool);
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_compose_trs_soa_mt)
+    ->Apply(la_bench_palette_threads)
+    ->UseRealTime();
+
+static void bm_la_hierarchy_update_mt(benchmark::State &state) {
+  la_hierarchy *h = bench_hierarchy();
+  la_pool *pool = la_pool_create(state.range(0));
+  la_jobs jobs = la_pool_jobs(pool, 0);
+  for (auto _ : state) {
+    for (size_t i = 0; i < h->count; i++) {
+      la_hierarchy_mark_dirty(h, i);
+    }
+    la_hierarchy_update_mt(&jobs, h);
+    benchmark::DoNotOptimize(h->world);
+  }
+  la_pool_destroy(pool);
+  state.SetItemsProcessed(state.iterations() * LA_BENCH_NODES);
+}
+BENCHMARK(bm_la_hierarchy_update_mt)
+    ->DenseRange(1, 4)
+    ->UseRealTime();
+
+/* The build time target: 1M triangles in under 100 ms on 8 cores. Arguments
+ * are {triangles, threads}. */
+static void bm_la_bvh_build(benchmark::State &state) {
+  const bvh_terrain &t = bench_terrain();
+  const size_t n = state.range(0);
+  la_pool *pool = la_pool_create(state.range(1));
+  la_jobs jobs = la_pool_jobs(pool, 0);
+  for (auto _ : state) {
+    la_bvh *bvh = la_bvh_create_triangles(&jobs, t.tris.data(), n);
+    benchmark::DoNotOptimize(bvh);
+    la_bvh_destroy(bvh);
+  }
+  la_pool_destroy(pool);
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(bm_la_bvh_build)
+    ->Args({1000000, 1})
+    ->Args({1000000, 2})
+    ->Args({1000000, 4})
+    ->Args({1000000, 8})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+#endif  // LA_HAS_POOL
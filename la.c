@@ -1,2 +1,14 @@
+/* The implementation uses POSIX functions such as fseeko and posix_memalign,
+ * and 64-bit file offsets. Ask for them here, before any system header, so
+ * that la.h does not change the feature level of the TUs that include it. */
+#ifndef _WIN32
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+#endif
+
 #define LA_IMPLEMENTATION
 #include "la.h"
\ No newline at end of file
@@ -27,6 +27,7 @@
 
 #include <math.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -34,25 +35,109 @@ extern "C" {
 
 int la_feq(float f1, float f2);
 
-typedef struct la_mat4 {
-  float elem[4][4];
-} la_mat4;
+/* The vector and matrix types for one scalar type, so that the float and
+ * double types are generated from the same definition. */
+#define LA_DEFINE_TYPES(T, vec2, vec3, vec4, mat4)                             \
+  typedef struct mat4 {                                                        \
+    T elem[4][4];                                                              \
+  } mat4;                                                                      \
+                                                                               \
+  typedef struct vec4 {                                                        \
+    union {                                                                    \
+      struct {                                                                 \
+        T x;                                                                   \
+        T y;                                                                   \
+        T z;                                                                   \
+        T w;                                                                   \
+      };                                                                       \
+      T elem[4];                                                               \
+    };                                                                         \
+  } vec4;                                                                      \
+                                                                               \
+  typedef struct vec3 {                                                        \
+    union {                                                                    \
+      struct {                                                                 \
+        T x;                                                                   \
+        T y;                                                                   \
+        T z;                                                                   \
+      };                                                                       \
+      T elem[3];                                                               \
+    };                                                                         \
+  } vec3;                                                                      \
+                                                                               \
+  typedef struct vec2 {                                                        \
+    union {                                                                    \
+      struct {                                                                 \
+        T x;                                                                   \
+        T y;                                                                   \
+      };                                                                       \
+      T elem[2];                                                               \
+    };                                                                         \
+  } vec2;
 
-typedef struct la_vec4 {
-  union {
-    struct {
-      float x;
-      float y;
-      float z;
-      float w;
-    };
-    float elem[4];
-  };
-} la_vec4;
+LA_DEFINE_TYPES(float, la_vec2, la_vec3, la_vec4, la_mat4)
+LA_DEFINE_TYPES(double, la_dvec2, la_dvec3, la_dvec4, la_dmat4)
 
 typedef la_vec4 la_quat;
 
-typedef struct la_vec3 {
+/**
+ * 2x2 and 3x3 matrices, laid out and multiplied like la_mat4, e.g. for 2D
+ * transforms, normal matrices and inertia tensors.
+ */
+typedef struct la_mat2 {
+  float elem[2][2];
+} la_mat2;
+
+typedef struct la_mat3 {
+  float elem[3][3];
+} la_mat3;
+
+/**
+ * Compact storage for an affine transform. Each row holds one row of the
+ * transform applied to column vectors (the rotation-scale part and the
+ * translation), so that a point is transformed with three dot products and
+ * the rows can be uploaded directly as three vec4s.
+ */
+typedef struct la_mat3x4 {
+  float elem[3][4];
+} la_mat3x4;
+
+/**
+ * A unit dual quaternion real + eps * dual for a rigid transform: real is the
+ * rotation and dual is half the translation times the rotation.
+ */
+typedef struct la_dualquat {
+  la_quat real;
+  la_quat dual;
+} la_dualquat;
+
+/**
+ * Aligned storage.
+ *
+ * la_vec3a pads a la_vec3 to 16 bytes so that arrays of them keep every
+ * element in one SIMD register and never straddle a cache line. la_vec4a
+ * and la_mat4a wrap a la_vec4 and a la_mat4 with 16 and 64 byte alignment,
+ * so a la_mat4a fills exactly one cache line. Pass &a.v or &a.m to the
+ * functions taking la_vec4 and la_mat4 pointers.
+ */
+
+#define LA_CACHE_LINE 64
+
+#if defined(__cplusplus)
+#define LA_ALIGN(n) alignas(n)
+#define LA_ALIGNOF(t) alignof(t)
+#define LA_STATIC_ASSERT(c, msg) static_assert(c, msg)
+#elif defined(_MSC_VER)
+#define LA_ALIGN(n) __declspec(align(n))
+#define LA_ALIGNOF(t) __alignof(t)
+#define LA_STATIC_ASSERT(c, msg) _Static_assert(c, msg)
+#else
+#define LA_ALIGN(n) _Alignas(n)
+#define LA_ALIGNOF(t) _Alignof(t)
+#define LA_STATIC_ASSERT(c, msg) _Static_assert(c, msg)
+#endif
+
+typedef struct la_vec3a {
   union {
     struct {
       float x;
@@ -60,18 +145,103 @@ typedef struct la_vec3 {
       float z;
     };
     float elem[3];
+    /* elem plus one padding lane, which la_v3tov3a sets to 0. */
+    LA_ALIGN(16) float lanes[4];
   };
-} la_vec3;
+} la_vec3a;
 
-typedef struct la_vec2 {
-  union {
-    struct {
-      float x;
-      float y;
-    };
-    float elem[2];
-  };
-} la_vec2;
+typedef struct la_vec4a {
+  LA_ALIGN(16) la_vec4 v;
+} la_vec4a;
+
+typedef struct la_mat4a {
+  LA_ALIGN(LA_CACHE_LINE) la_mat4 m;
+} la_mat4a;
+
+LA_STATIC_ASSERT(sizeof(la_vec2) == 8, "la_vec2 must be packed");
+LA_STATIC_ASSERT(sizeof(la_vec3) == 12, "la_vec3 must be packed");
+LA_STATIC_ASSERT(sizeof(la_vec4) == 16, "la_vec4 must be packed");
+LA_STATIC_ASSERT(sizeof(la_mat4) == 64, "la_mat4 must be packed");
+LA_STATIC_ASSERT(sizeof(la_mat2) == 16, "la_mat2 must be packed");
+LA_STATIC_ASSERT(sizeof(la_mat3) == 36, "la_mat3 must be packed");
+LA_STATIC_ASSERT(sizeof(la_mat3x4) == 48, "la_mat3x4 must be packed");
+LA_STATIC_ASSERT(sizeof(la_dualquat) == 32, "la_dualquat must be packed");
+LA_STATIC_ASSERT(sizeof(la_vec3a) == 16 && LA_ALIGNOF(la_vec3a) == 16,
+                 "la_vec3a must be 16 bytes");
+LA_STATIC_ASSERT(sizeof(la_vec4a) == 16 && LA_ALIGNOF(la_vec4a) == 16,
+                 "la_vec4a must be 16 bytes");
+LA_STATIC_ASSERT(sizeof(la_mat4a) == LA_CACHE_LINE &&
+                     LA_ALIGNOF(la_mat4a) == LA_CACHE_LINE,
+                 "la_mat4a must fill one cache line");
+
+/**
+ * @brief Convert a la_vec3 to a la_vec3a.
+ */
+la_vec3a la_v3tov3a(const la_vec3 v);
+
+/**
+ * @brief Convert a la_vec3a to a la_vec3.
+ */
+la_vec3 la_v3atov3(const la_vec3a v);
+
+/**
+ * @brief Convert n la_vec3s to la_vec3as.
+ */
+void la_v3tov3a_batch(const la_vec3 *in, la_vec3a *out, size_t n);
+
+/**
+ * @brief Allocate size bytes aligned to align.
+ *
+ * @param size The number of bytes.
+ * @param align A power of two.
+ * @return The memory, to be released with la_aligned_free, or NULL.
+ */
+void *la_aligned_alloc(size_t size, size_t align);
+
+/**
+ * @brief Free memory from la_aligned_alloc. NULL is ignored.
+ */
+void la_aligned_free(void *p);
+
+/**
+ * A fixed-size arena for transform arrays and other per-frame data. Every
+ * block starts on a cache line and is padded to a whole number of cache
+ * lines, so blocks are aligned for any SIMD load and blocks written by
+ * different threads never share a line. An arena is not thread-safe: hand
+ * out the blocks before starting the workers.
+ */
+typedef struct la_arena la_arena;
+
+/**
+ * @brief Create an arena.
+ *
+ * @param capacity The number of bytes available, rounded up to a cache line.
+ * @return The arena, or NULL on failure.
+ */
+la_arena *la_arena_create(size_t capacity);
+
+/**
+ * @brief Free an arena and all blocks allocated from it.
+ */
+void la_arena_destroy(la_arena *arena);
+
+/**
+ * @brief Allocate a cache line aligned and padded block.
+ *
+ * @param size The number of bytes.
+ * @return The block, or NULL if the arena does not have room for it.
+ */
+void *la_arena_alloc(la_arena *arena, size_t size);
+
+/**
+ * @brief Release every block at once, keeping the memory for reuse.
+ */
+void la_arena_reset(la_arena *arena);
+
+/**
+ * @brief The number of bytes allocated, including padding.
+ */
+size_t la_arena_used(const la_arena *arena);
 
 /**
  * @brief Print a matrix to stdout.
@@ -96,6 +266,132 @@ void la_printvn(const float *v, size_t n);
  */
 float la_radians(const float degrees);
 
+/**
+ * Profiling.
+ *
+ * Compiling the implementation with LA_PROFILE defined makes the main entry
+ * points count their calls and the time spent in them, read with the CPU
+ * timestamp counter (the virtual counter on AArch64, CLOCK_MONOTONIC
+ * nanoseconds elsewhere). Each thread updates its own counters, so the hot
+ * path takes no locks; la_profile_dump sums the counters of every thread that
+ * ever made a profiled call. Times include nested la calls: la_rotate also
+ * counts towards la_productm4. Without LA_PROFILE the entry points are not
+ * instrumented at all and la_profile_dump returns 0.
+ */
+typedef struct la_profile_entry {
+  const char *name; // The function, e.g. "la_productm4".
+  uint64_t calls;
+  uint64_t cycles;  // Timestamp counter ticks.
+} la_profile_entry;
+
+/**
+ * @brief Take a snapshot of the profile counters.
+ *
+ * @param entries Receives one entry per profiled function, in a fixed order.
+ * May be NULL if max is 0.
+ * @param max The capacity of entries.
+ * @return The number of profiled functions, which may exceed max. 0 if the
+ * implementation was compiled without LA_PROFILE.
+ */
+size_t la_profile_dump(la_profile_entry *entries, size_t max);
+
+/**
+ * @brief Zero the profile counters of every thread. Calls made by other
+ * threads while resetting may be partly lost.
+ */
+void la_profile_reset(void);
+
+/**
+ * @brief Print the functions that were called, with their call counts and
+ * average cycles per call, to stdout.
+ */
+void la_profile_print(void);
+
+/**
+ * Runtime dispatch.
+ *
+ * Compiling the implementation with LA_DISPATCH on x86 with GCC or Clang
+ * adds AVX2 and AVX-512 versions of the hottest batch kernels, built with
+ * target attributes so that the library itself needs no -mavx2. The first
+ * call to one of them checks the CPU and picks the highest level it
+ * supports: la_productm4_batch, la_transform_points_v4,
+ * la_transform_points_v4_aos, la_normalizev3_soa (and la_normalizev3_batch),
+ * la_frustum_cull_spheres and la_frustum_cull_aabbs. Every level gives
+ * bit-identical results, so the AVX2 kernels do not use FMA and need no FMA
+ * support. With LA_FAST_MATH the reciprocal square root estimates of the
+ * levels differ in the last bits. Setting the LA_SIMD environment variable to
+ * "baseline", "avx2" or "avx512" caps the level, for example to test the
+ * other kernels on a newer machine.
+ */
+typedef enum la_simd_level {
+  LA_SIMD_BASELINE = 0, // The kernels selected at compile time, e.g. SSE2.
+  LA_SIMD_AVX2 = 1,
+  LA_SIMD_AVX512 = 2,
+} la_simd_level;
+
+/**
+ * @brief Get the highest level supported by both the CPU and the build.
+ */
+la_simd_level la_simd_max_level(void);
+
+/**
+ * @brief Get the level the dispatched kernels currently use.
+ */
+la_simd_level la_get_simd_level(void);
+
+/**
+ * @brief Select the level of the dispatched kernels for all threads,
+ * overriding LA_SIMD.
+ *
+ * @param level The level to use.
+ * @return 1 on success, 0 if level is above la_simd_max_level.
+ */
+int la_set_simd_level(la_simd_level level);
+
+/**
+ * Fast approximate math.
+ *
+ * The functions below are always available. Defining LA_FAST_MATH when
+ * compiling the implementation makes la_normalizev3, la_normalizeq,
+ * la_rotate, la_axis_angleq and la_perspective use them in place of the
+ * libm functions.
+ */
+
+/**
+ * @brief Approximate 1 / sqrt(x) using a reciprocal square root estimate
+ * refined with Newton-Raphson. The relative error is below 3e-7 for normal
+ * positive x.
+ *
+ * @param x A positive number.
+ * @return An approximation of 1 / sqrt(x).
+ */
+float la_rsqrt_approx(const float x);
+
+/**
+ * @brief Approximate sin(x) with a minimax polynomial after reducing x to
+ * [-pi/4, pi/4]. The absolute error is below 1.2e-7 for |x| <= 8192, and
+ * grows beyond. The domain is |x| <= LA_TRIG_APPROX_MAX: for larger x,
+ * infinities and NaN the result is NaN.
+ */
+float la_sin_approx(const float x);
+
+/**
+ * @brief Approximate cos(x). The absolute error is below 1.2e-7 for
+ * |x| <= 8192. Same domain as la_sin_approx.
+ */
+float la_cos_approx(const float x);
+
+/**
+ * @brief Approximate tan(x) as the ratio of the reduced sin and cos
+ * polynomials. The relative error is below 5e-7 for |x| <= 2 pi. Same
+ * domain as la_sin_approx.
+ */
+float la_tan_approx(const float x);
+
+/* The largest |x| taken by la_sin_approx, la_cos_approx and la_tan_approx.
+ * The quadrant of x is computed as an int. */
+#define LA_TRIG_APPROX_MAX 1048576.0f
+
 /**
  * @brief Make a la_mat4 into an identity matrix.
  *
@@ -154,6 +450,104 @@ float la_dotv4(const la_vec4 v1, const la_vec4 v2);
  */
 la_vec3 la_crossv3(const la_vec3 v1, const la_vec3 v2);
 
+/**
+ * Batched la_vec3 kernels.
+ *
+ * Every kernel has an AoS form working on arrays of la_vec3 and an _soa
+ * form working on separate x, y and z float streams. The results are the
+ * same as calling the single vector function on each element. Outputs may be
+ * the same arrays as the inputs (in-place) but must not otherwise overlap
+ * them.
+ */
+
+/**
+ * @brief Normalize n la_vec3s, as la_normalizev3.
+ */
+void la_normalizev3_batch(const la_vec3 *in, la_vec3 *out, size_t n);
+
+/**
+ * @brief Get the dot products of n pairs of la_vec3s, as la_dotv3.
+ */
+void la_dotv3_batch(const la_vec3 *a, const la_vec3 *b, float *out,
+                    size_t n);
+
+/**
+ * @brief Get the cross products of n pairs of la_vec3s, as la_crossv3.
+ */
+void la_crossv3_batch(const la_vec3 *a, const la_vec3 *b, la_vec3 *out,
+                      size_t n);
+
+/**
+ * @brief out[i] = a[i] + b[i] for n la_vec3s.
+ */
+void la_addv3_batch(const la_vec3 *a, const la_vec3 *b, la_vec3 *out,
+                    size_t n);
+
+/**
+ * @brief out[i] = a[i] - b[i] for n la_vec3s.
+ */
+void la_subv3_batch(const la_vec3 *a, const la_vec3 *b, la_vec3 *out,
+                    size_t n);
+
+/**
+ * @brief out[i] = in[i] * s for n la_vec3s.
+ */
+void la_scalev3_batch(const la_vec3 *in, const float s, la_vec3 *out,
+                      size_t n);
+
+/**
+ * @brief out[i] = a[i] + (b[i] - a[i]) * t for n la_vec3s.
+ */
+void la_lerpv3_batch(const la_vec3 *a, const la_vec3 *b, const float t,
+                     la_vec3 *out, size_t n);
+
+/**
+ * @brief SoA la_normalizev3_batch.
+ */
+void la_normalizev3_soa(const float *x, const float *y, const float *z,
+                        float *ox, float *oy, float *oz, size_t n);
+
+/**
+ * @brief SoA la_dotv3_batch.
+ */
+void la_dotv3_soa(const float *ax, const float *ay, const float *az,
+                  const float *bx, const float *by, const float *bz,
+                  float *out, size_t n);
+
+/**
+ * @brief SoA la_crossv3_batch.
+ */
+void la_crossv3_soa(const float *ax, const float *ay, const float *az,
+                    const float *bx, const float *by, const float *bz,
+                    float *ox, float *oy, float *oz, size_t n);
+
+/**
+ * @brief SoA la_addv3_batch.
+ */
+void la_addv3_soa(const float *ax, const float *ay, const float *az,
+                  const float *bx, const float *by, const float *bz,
+                  float *ox, float *oy, float *oz, size_t n);
+
+/**
+ * @brief SoA la_subv3_batch.
+ */
+void la_subv3_soa(const float *ax, const float *ay, const float *az,
+                  const float *bx, const float *by, const float *bz,
+                  float *ox, float *oy, float *oz, size_t n);
+
+/**
+ * @brief SoA la_scalev3_batch.
+ */
+void la_scalev3_soa(const float *x, const float *y, const float *z,
+                    const float s, float *ox, float *oy, float *oz, size_t n);
+
+/**
+ * @brief SoA la_lerpv3_batch.
+ */
+void la_lerpv3_soa(const float *ax, const float *ay, const float *az,
+                   const float *bx, const float *by, const float *bz,
+                   const float t, float *ox, float *oy, float *oz, size_t n);
+
 /**
  * @brief Get the product of 2 4 x 4 matrices
  *
@@ -173,203 +567,8866 @@ la_mat4 la_productm4(const la_mat4 m1, const la_mat4 m2);
 la_vec4 la_productm4v4(const la_mat4 m, const la_vec4 v);
 
 /**
- * @brief Create a perspective matrix.
+ * SIMD backends.
  *
+ * la_productm4 and la_productm4v4 are vectorized when one of LA_USE_SSE2,
+ * LA_USE_AVX or LA_USE_NEON is defined when compiling the implementation. The
+ * widest enabled backend is used. The scalar loops are always available as
+ * the reference implementation and each enabled backend is also exported
+ * under its own suffix so that the results can be compared.
  */
-la_mat4 la_perspective(const float fov, const float aspect_ratio,
-                       const float near, const float far);
+#if defined(LA_USE_AVX) && !defined(LA_USE_SSE2)
+#define LA_USE_SSE2
+#endif
 
 /**
- * @brief Create an orthographic projection matrix.
- *
- * @param left
- * @param right
- * @param bottom
- * @param top
- * @param near Normalised device coordinate -1.
- * @param far Normalised device coordinate +1.
- *
- * @return la_mat4
+ * @brief Reference (scalar) implementation of la_productm4.
  */
-la_mat4 la_orthographic(const float left, const float right, const float bottom,
-                        const float top, const float near, const float far);
+la_mat4 la_productm4_scalar(const la_mat4 m1, const la_mat4 m2);
 
 /**
- * @brief Create a view matrix.
- *
- * @param eye The direction of the view.
- * @param ctr The position of the view.
- * @param up The up direction of the view.
- * @return A view matrix.
+ * @brief Reference (scalar) implementation of la_productm4v4.
  */
-la_mat4 la_look_at(const la_vec3 eye, const la_vec3 ctr, const la_vec3 up);
+la_vec4 la_productm4v4_scalar(const la_mat4 m, const la_vec4 v);
+
+#ifdef LA_USE_SSE2
+la_mat4 la_productm4_sse2(const la_mat4 m1, const la_mat4 m2);
+la_vec4 la_productm4v4_sse2(const la_mat4 m, const la_vec4 v);
+#endif
+
+#ifdef LA_USE_AVX
+la_mat4 la_productm4_avx(const la_mat4 m1, const la_mat4 m2);
+la_vec4 la_productm4v4_avx(const la_mat4 m, const la_vec4 v);
+#endif
+
+#ifdef LA_USE_NEON
+la_mat4 la_productm4_neon(const la_mat4 m1, const la_mat4 m2);
+la_vec4 la_productm4v4_neon(const la_mat4 m, const la_vec4 v);
+#endif
 
 /**
- * @brief Translate a la_mat4 by a la_vec3.
+ * @brief Transpose a 4x4 matrix.
  *
- * @param m The matrix to translate.
- * @param v The translation vector.
- * @return The translated matrix.
+ * @param m The matrix.
+ * @return The transpose of m.
  */
-la_mat4 la_translate(const la_mat4 m, const la_vec3 v);
+la_mat4 la_transposem4(const la_mat4 m);
 
 /**
- * @brief Rotate a matrix about and axis (using unit quaternion).
+ * @brief Get the determinant of a 4x4 matrix.
  *
- * @param m The matrix to apply the rotation to.
- * @param axis The axis of the rotation.
- * @param rads The rotation angle in radians.
- * @return The rotated matrix.
+ * @param m The matrix.
+ * @return The determinant of m.
  */
-la_mat4 la_rotate(const la_mat4 m, const la_vec3 axis, const float rads);
+float la_determinantm4(const la_mat4 m);
 
 /**
- * @brief Scale a transformation matrix by a vector v.
+ * @brief Invert a 4x4 matrix.
  *
- * @param m The matrix to transform.
- * @param v The scaling vector.
- * @return The scaled matrix.
+ * Uses the SSE2 backend when LA_USE_SSE2 is defined. For affine matrices
+ * la_inverse_affine is cheaper. m counts as singular when its determinant is
+ * zero relative to the product of its row lengths, so matrices that are
+ * singular up to rounding are reported as such.
+ *
+ * @param m The matrix.
+ * @param invertible Set to 0 if m is singular, otherwise 1. May be NULL.
+ * @return The inverse of m, or the identity matrix if m is singular.
  */
-la_mat4 la_scale(const la_mat4 m, const la_vec3 v);
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif  // LA_H_
-
-#ifdef LA_IMPLEMENTATION
+la_mat4 la_inversem4(const la_mat4 m, int *invertible);
 
-#include <float.h>
-#include <limits.h>
-#include <stdio.h>
-#include <string.h>
+/**
+ * @brief Reference (scalar) implementation of la_inversem4, using cofactors
+ * built from 2x2 sub-determinants.
+ */
+la_mat4 la_inversem4_scalar(const la_mat4 m, int *invertible);
 
-#ifndef M_PI
-#define M_PI (3.14159265358979323846)
+#ifdef LA_USE_SSE2
+la_mat4 la_inversem4_sse2(const la_mat4 m, int *invertible);
 #endif
 
 /**
- * ----------------------------------------------------------------------------
+ * @brief Get the 2x2 identity matrix.
  */
-int la_feq(float f1, float f2) { return fabs(f1 - f2) < FLT_EPSILON; }
+la_mat2 la_identitym2(void);
 
 /**
- * ----------------------------------------------------------------------------
+ * @brief Get the product of 2 2x2 matrices, as la_productm4.
  */
-void la_printm4(const la_mat4 m) {
-  printf("{ ");
-  for (int i = 0; i < 4; i++) {
-    printf("{ %f %f %f %f } ", m.elem[i][0], m.elem[i][1], m.elem[i][2],
-           m.elem[i][3]);
-  }
-  printf("}\n");
-}
+la_mat2 la_productm2(const la_mat2 m1, const la_mat2 m2);
 
 /**
- * ----------------------------------------------------------------------------
+ * @brief Get the product of a 2x2 matrix and a la_vec2, as la_productm4v4.
  */
-void la_printvn(const float *v, size_t n) {
-  printf("{ ");
-  for (size_t i = 0; i < n; i++) {
-    printf("%f ", v[i]);
-  }
-  printf("}\n");
-}
+la_vec2 la_productm2v2(const la_mat2 m, const la_vec2 v);
 
 /**
- * ----------------------------------------------------------------------------
+ * @brief Transpose a 2x2 matrix.
  */
-float la_radians(const float degrees) { return (degrees * M_PI) / 180.0f; }
+la_mat2 la_transposem2(const la_mat2 m);
 
 /**
- * ----------------------------------------------------------------------------
+ * @brief Get the determinant of a 2x2 matrix.
  */
-la_mat4 la_identitym4(void) {
-  la_mat4 i = {.elem = {{1.0f, 0.0f, 0.0f, 0.0f},
-                        {0.0f, 1.0f, 0.0f, 0.0f},
-                        {0.0f, 0.0f, 1.0f, 0.0f},
-                        {0.0f, 0.0f, 0.0f, 1.0f}}};
-  return i;
-}
+float la_determinantm2(const la_mat2 m);
 
 /**
- * ----------------------------------------------------------------------------
+ * @brief Invert a 2x2 matrix.
+ *
+ * @param m The matrix.
+ * @param invertible Set to 0 if m is singular, otherwise 1. May be NULL.
+ * @return The inverse of m, or the identity matrix if m is singular.
  */
-la_vec3 la_normalizev3(const la_vec3 v) {
-  float l = sqrt(la_dotv3(v, v));
-  la_vec3 n = {.elem = {v.elem[0] / l, v.elem[1] / l, v.elem[2] / l}};
-  return n;
-}
+la_mat2 la_inversem2(const la_mat2 m, int *invertible);
 
 /**
- * ----------------------------------------------------------------------------
+ * @brief Get the 3x3 identity matrix.
+ */
+la_mat3 la_identitym3(void);
+
+/**
+ * @brief Get the product of 2 3x3 matrices, as la_productm4.
+ */
+la_mat3 la_productm3(const la_mat3 m1, const la_mat3 m2);
+
+/**
+ * @brief Get the product of a 3x3 matrix and a la_vec3, as la_productm4v4.
+ */
+la_vec3 la_productm3v3(const la_mat3 m, const la_vec3 v);
+
+/**
+ * @brief Transpose a 3x3 matrix.
+ */
+la_mat3 la_transposem3(const la_mat3 m);
+
+/**
+ * @brief Get the determinant of a 3x3 matrix.
+ */
+float la_determinantm3(const la_mat3 m);
+
+/**
+ * @brief Invert a 3x3 matrix.
+ *
+ * @param m The matrix.
+ * @param invertible Set to 0 if m is singular, otherwise 1. May be NULL.
+ * @return The inverse of m, or the identity matrix if m is singular.
+ */
+la_mat3 la_inversem3(const la_mat3 m, int *invertible);
+
+/**
+ * @brief Get the upper left 3x3 part (rotation and scale) of a la_mat4.
+ */
+la_mat3 la_m4tom3(const la_mat4 m);
+
+/**
+ * @brief Expand a la_mat3 into a la_mat4 with no translation.
+ */
+la_mat4 la_m3tom4(const la_mat3 m);
+
+/**
+ * @brief Get the matrix that transforms normals for a la_mat4, the inverse
+ * transpose of its upper left 3x3 part. Transformed normals still need to be
+ * normalized when m scales.
+ *
+ * @param m The matrix that transforms the positions.
+ * @param invertible Set to 0 if the 3x3 part is singular, otherwise 1. May be
+ * NULL.
+ * @return The normal matrix, or the identity matrix if m is singular.
+ */
+la_mat3 la_normal_matrix(const la_mat4 m, int *invertible);
+
+/**
+ * @brief Get the dot product of 2 n dimensional vectors.
+ */
+float la_dotvn(const float *v1, const float *v2, size_t n);
+
+/**
+ * @brief Multiply an m x n matrix by an n x p matrix, c = a * b, with the
+ * same convention as la_productm4 (la_productmn on 4x4 matrices is
+ * la_productm4).
+ *
+ * The matrices are row major with a stride between rows, lda, ldb and ldc
+ * floats, so that blocks of a larger matrix can be multiplied in place. The
+ * product is computed in tiles of 64 x 64 elements of b so that the part of
+ * b in use stays in L1. c must not overlap a or b.
+ *
+ * @param a The m x n matrix.
+ * @param lda The stride between the rows of a, at least n.
+ * @param b The n x p matrix.
+ * @param ldb The stride between the rows of b, at least p.
+ * @param c The m x p product.
+ * @param ldc The stride between the rows of c, at least p.
+ * @param m, n, p The dimensions.
+ */
+void la_productmn(const float *a, size_t lda, const float *b, size_t ldb,
+                  float *c, size_t ldc, size_t m, size_t n, size_t p);
+
+/**
+ * @brief Multiply an m x n matrix by an n dimensional vector, out = a * v,
+ * as la_productm4v4. out must not overlap a or v.
+ *
+ * @param a The m x n matrix.
+ * @param lda The stride between the rows of a, at least n.
+ * @param v The n floats of the vector.
+ * @param out The m floats of the product.
+ * @param m, n The dimensions.
+ */
+void la_productmnvn(const float *a, size_t lda, const float *v, float *out,
+                    size_t m, size_t n);
+
+/**
+ * @brief Transform an array of points stored as separate x, y, z and w
+ * streams (SoA). Each point is transformed as if by la_productm4v4.
+ *
+ * The output streams may be the same as the input streams (in-place) but
+ * must not otherwise overlap them.
+ *
+ * @param m The matrix.
+ * @param x, y, z, w The input streams of n floats.
+ * @param ox, oy, oz, ow The output streams of n floats.
+ * @param n The number of points.
+ */
+void la_transform_points_v4(const la_mat4 *m, const float *x, const float *y,
+                            const float *z, const float *w, float *ox,
+                            float *oy, float *oz, float *ow, size_t n);
+
+/**
+ * @brief Transform an array of la_vec4s (AoS). Each vector is transformed as
+ * if by la_productm4v4.
+ *
+ * out may be the same array as in (in-place) but must not otherwise overlap
+ * it.
+ *
+ * @param m The matrix.
+ * @param in The input vectors.
+ * @param out The output vectors.
+ * @param n The number of vectors.
+ */
+void la_transform_points_v4_aos(const la_mat4 *m, const la_vec4 *in,
+                                la_vec4 *out, size_t n);
+
+/**
+ * @brief Multiply arrays of matrices pairwise, out[i] = a[i] * b[i], as if
+ * by la_productm4. out must not overlap a or b.
+ *
+ * @param a The first n matrices.
+ * @param b The second n matrices.
+ * @param out The n products.
+ * @param n The number of matrices.
+ */
+void la_productm4_batch(const la_mat4 *a, const la_mat4 *b, la_mat4 *out,
+                        size_t n);
+
+/**
+ * Parallel execution.
+ *
+ * The _mt batch functions split their input into chunks and hand them to a
+ * la_jobs description. The chunks can be run by the built-in thread pool
+ * (la_pool_parallel_for) or by a parallel_for supplied by the application's
+ * own job scheduler. A NULL la_jobs runs everything on the calling thread.
+ */
+
+/**
+ * @brief A function run over the element range [begin, end).
+ */
+typedef void (*la_range_fn)(void *ctx, size_t begin, size_t end);
+
+/**
+ * @brief A function run for a single chunk index.
+ */
+typedef void (*la_chunk_fn)(void *ctx, size_t chunk);
+
+/**
+ * @brief A parallel_for implementation. It must call fn(ctx, c) exactly once
+ * for every c in [0, nchunks), in any order and on any thread, and return
+ * only once all of the calls have completed.
+ */
+typedef void (*la_parallel_for_fn)(void *user, size_t nchunks, la_chunk_fn fn,
+                                   void *ctx);
+
+typedef struct la_jobs {
+  la_parallel_for_fn parallel_for;
+  void *user;     // Passed as the first argument of parallel_for.
+  size_t threads; // Number of workers, used to balance the chunks.
+  size_t grain;   // Elements per chunk. 0 balances across threads.
+} la_jobs;
+
+/**
+ * @brief Run fn over [0, n) in chunks using jobs.
+ *
+ * When jobs->grain is non-zero every chunk except the last has exactly grain
+ * elements, so the split does not depend on the thread count and results are
+ * reproducible across machines. Otherwise the range is split into a few
+ * chunks per thread.
+ *
+ * @param jobs The job system, or NULL to run on the calling thread.
+ * @param n The number of elements.
+ * @param fn The function to run for each chunk.
+ * @param ctx User data passed to fn.
+ */
+void la_parallel_for(const la_jobs *jobs, size_t n, la_range_fn fn, void *ctx);
+
+/**
+ * @brief Multithreaded la_transform_points_v4.
+ */
+void la_transform_points_v4_mt(const la_jobs *jobs, const la_mat4 *m,
+                               const float *x, const float *y, const float *z,
+                               const float *w, float *ox, float *oy, float *oz,
+                               float *ow, size_t n);
+
+/**
+ * @brief Multithreaded la_transform_points_v4_aos.
+ */
+void la_transform_points_v4_aos_mt(const la_jobs *jobs, const la_mat4 *m,
+                                   const la_vec4 *in, la_vec4 *out, size_t n);
+
+/**
+ * @brief Multithreaded la_productm4_batch.
+ */
+void la_productm4_batch_mt(const la_jobs *jobs, const la_mat4 *a,
+                           const la_mat4 *b, la_mat4 *out, size_t n);
+
+#if !defined(LA_NO_THREADS) && !defined(_WIN32)
+#define LA_HAS_POOL
+
+typedef struct la_pool la_pool;
+
+/**
+ * @brief Create a thread pool. The calling thread takes part in the work,
+ * so threads - 1 workers are started.
+ *
+ * @param threads The total number of threads, 0 picks the number of online
+ * processors.
+ * @return The pool, or NULL on failure.
+ */
+la_pool *la_pool_create(size_t threads);
+
+/**
+ * @brief Stop the workers and free the pool.
+ */
+void la_pool_destroy(la_pool *pool);
+
+/**
+ * @brief The total number of threads used by the pool.
+ */
+size_t la_pool_threads(const la_pool *pool);
+
+/**
+ * @brief la_parallel_for_fn backed by a la_pool passed as user. A pool runs
+ * one parallel_for at a time.
+ */
+void la_pool_parallel_for(void *pool, size_t nchunks, la_chunk_fn fn,
+                          void *ctx);
+
+/**
+ * @brief Make a la_jobs that runs on pool.
+ *
+ * @param pool The pool.
+ * @param grain Elements per chunk, 0 to balance across the pool's threads.
+ */
+la_jobs la_pool_jobs(la_pool *pool, size_t grain);
+#endif  // LA_HAS_POOL
+
+/**
+ * @brief Create a perspective matrix.
+ *
+ */
+la_mat4 la_perspective(const float fov, const float aspect_ratio,
+                       const float near, const float far);
+
+/**
+ * @brief Create an orthographic projection matrix.
+ *
+ * @param left
+ * @param right
+ * @param bottom
+ * @param top
+ * @param near Normalised device coordinate -1.
+ * @param far Normalised device coordinate +1.
+ *
+ * @return la_mat4
+ */
+la_mat4 la_orthographic(const float left, const float right, const float bottom,
+                        const float top, const float near, const float far);
+
+/**
+ * @brief Create a view matrix.
+ *
+ * @param eye The direction of the view.
+ * @param ctr The position of the view.
+ * @param up The up direction of the view.
+ * @return A view matrix.
+ */
+la_mat4 la_look_at(const la_vec3 eye, const la_vec3 ctr, const la_vec3 up);
+
+/**
+ * @brief Translate a la_mat4 by a la_vec3.
+ *
+ * @param m The matrix to translate.
+ * @param v The translation vector.
+ * @return The translated matrix.
+ */
+la_mat4 la_translate(const la_mat4 m, const la_vec3 v);
+
+/**
+ * @brief Rotate a matrix about and axis (using unit quaternion).
+ *
+ * @param m The matrix to apply the rotation to.
+ * @param axis The axis of the rotation.
+ * @param rads The rotation angle in radians.
+ * @return The rotated matrix.
+ */
+la_mat4 la_rotate(const la_mat4 m, const la_vec3 axis, const float rads);
+
+/**
+ * @brief Scale a transformation matrix by a vector v.
+ *
+ * @param m The matrix to transform.
+ * @param v The scaling vector.
+ * @return The scaled matrix.
+ */
+la_mat4 la_scale(const la_mat4 m, const la_vec3 v);
+
+/**
+ * View frustum culling.
+ *
+ * A plane is stored in a la_vec4 as (normal, d) with the normal pointing into
+ * the frustum, so a point p is inside when dot(normal, p) + d >= 0. The batch
+ * tests take SoA bounds and report the objects that are at least partly
+ * inside. They are conservative: an object near a frustum corner may be
+ * reported visible while being outside.
+ */
+
+typedef struct la_frustum {
+  /* Left, right, bottom, top, near, far. */
+  la_vec4 planes[6];
+} la_frustum;
+
+/**
+ * @brief Extract the normalized frustum planes of a view-projection matrix.
+ *
+ * @param vp The view-projection matrix, la_productm4(view, projection),
+ * mapping depth to [-1, 1] like la_perspective and la_orthographic.
+ * @return The planes, in world space when vp includes the view.
+ */
+la_frustum la_frustum_from_m4(const la_mat4 vp);
+
+/**
+ * @brief Test a sphere against a frustum.
+ *
+ * @return 1 if the sphere is at least partly inside, otherwise 0.
+ */
+int la_frustum_test_sphere(const la_frustum *f, const la_vec3 center,
+                           const float radius);
+
+/**
+ * @brief Test an axis aligned box, given by its center and half extents,
+ * against a frustum.
+ *
+ * @return 1 if the box is at least partly inside, otherwise 0.
+ */
+int la_frustum_test_aabb(const la_frustum *f, const la_vec3 center,
+                         const la_vec3 extents);
+
+/**
+ * @brief Cull n spheres, writing a visibility bitmask.
+ *
+ * @param x, y, z, r The sphere centers and radii.
+ * @param n The number of spheres.
+ * @param mask (n + 31) / 32 words. Bit i % 32 of mask[i / 32] is set when
+ * sphere i is visible. The unused bits of the last word are cleared.
+ */
+void la_frustum_cull_spheres(const la_frustum *f, const float *x,
+                             const float *y, const float *z, const float *r,
+                             size_t n, uint32_t *mask);
+
+/**
+ * @brief Cull n spheres, writing the indices of the visible ones.
+ *
+ * @param indices Room for n indices, filled in increasing order.
+ * @return The number of visible spheres.
+ */
+size_t la_frustum_cull_spheres_indices(const la_frustum *f, const float *x,
+                                       const float *y, const float *z,
+                                       const float *r, size_t n,
+                                       uint32_t *indices);
+
+/**
+ * @brief Cull n boxes, writing a visibility bitmask as
+ * la_frustum_cull_spheres.
+ *
+ * @param cx, cy, cz The box centers.
+ * @param ex, ey, ez The box half extents.
+ */
+void la_frustum_cull_aabbs(const la_frustum *f, const float *cx,
+                           const float *cy, const float *cz, const float *ex,
+                           const float *ey, const float *ez, size_t n,
+                           uint32_t *mask);
+
+/**
+ * @brief Cull n boxes, writing the indices of the visible ones.
+ *
+ * @return The number of visible boxes.
+ */
+size_t la_frustum_cull_aabbs_indices(const la_frustum *f, const float *cx,
+                                     const float *cy, const float *cz,
+                                     const float *ex, const float *ey,
+                                     const float *ez, size_t n,
+                                     uint32_t *indices);
+
+/**
+ * Ray queries.
+ *
+ * A ray is origin + t * dir for tmin < t < tmax. dir does not need to be
+ * normalized, t is in units of its length. The single ray tests return 1 and
+ * the distance of the first intersection on a hit; a ray starting inside a
+ * box or sphere hits it at tmin (box) or where it leaves it (sphere).
+ *
+ * A la_ray_packet holds LA_RAY_PACKET rays as SoA lanes, which are tested
+ * against one primitive at a time with SIMD. Each lane carries its own hit:
+ * t starts as the lane's tmax and is shortened by every closer hit, so
+ * several queries (e.g. triangles, then spheres) can be run on the same
+ * packet. The packet kernels give the same hits as the single ray tests.
+ */
+
+#define LA_RAY_PACKET 8
+
+typedef struct la_ray {
+  la_vec3 origin;
+  la_vec3 dir;
+  float tmin;
+  float tmax;
+} la_ray;
+
+typedef struct la_ray_packet {
+  LA_ALIGN(32) float ox[LA_RAY_PACKET];
+  float oy[LA_RAY_PACKET];
+  float oz[LA_RAY_PACKET];
+  float dx[LA_RAY_PACKET];
+  float dy[LA_RAY_PACKET];
+  float dz[LA_RAY_PACKET];
+  float tmin[LA_RAY_PACKET];
+  float t[LA_RAY_PACKET];      // tmax, then the distance to the hit.
+  float u[LA_RAY_PACKET];      // The barycentric coordinates of a triangle
+  float v[LA_RAY_PACKET];      // hit, (1 - u - v) * v0 + u * v1 + v * v2.
+  int32_t prim[LA_RAY_PACKET]; // The primitive hit, or -1.
+} la_ray_packet;
+
+typedef enum la_ray_mode {
+  LA_RAY_NEAREST = 0, // Find the nearest hit of every ray.
+  LA_RAY_ANY = 1,     // Stop once every ray has a hit, e.g. for occlusion.
+} la_ray_mode;
+
+/**
+ * @brief Test a ray against a triangle (Moller-Trumbore). Both sides of the
+ * triangle are hit.
+ *
+ * @param r The ray.
+ * @param tri The 3 vertices of the triangle.
+ * @param t Receives the distance of the hit. May be NULL.
+ * @param uv Receives the barycentric coordinates of the hit, as in
+ * la_ray_packet. May be NULL.
+ * @return 1 on a hit, otherwise 0.
+ */
+int la_ray_test_triangle(const la_ray *r, const la_vec3 *tri, float *t,
+                         la_vec2 *uv);
+
+/**
+ * @brief Test a ray against an axis aligned box (slab test).
+ *
+ * @param t Receives the distance of the hit. May be NULL.
+ * @return 1 on a hit, otherwise 0.
+ */
+int la_ray_test_aabb(const la_ray *r, const la_vec3 min, const la_vec3 max,
+                     float *t);
+
+/**
+ * @brief Test a ray against a sphere.
+ *
+ * @param t Receives the distance of the hit. May be NULL.
+ * @return 1 on a hit, otherwise 0.
+ */
+int la_ray_test_sphere(const la_ray *r, const la_vec3 center,
+                       const float radius, float *t);
+
+/**
+ * @brief Make every lane of a packet inactive. Inactive lanes never hit.
+ */
+void la_ray_packet_clear(la_ray_packet *p);
+
+/**
+ * @brief Set the ray of a lane and clear its hit.
+ */
+void la_ray_packet_set(la_ray_packet *p, size_t lane, const la_ray *r);
+
+/**
+ * @brief Test the rays of a packet against n triangles.
+ *
+ * @param p The rays. The hits are updated.
+ * @param tris 3 * n vertices, 3 per triangle. prim is the triangle index.
+ * @param n The number of triangles.
+ * @param mode Whether to look for the nearest hit or any hit.
+ * @return A bitmask of the lanes whose hit was set by this call.
+ */
+uint32_t la_ray_packet_triangles(la_ray_packet *p, const la_vec3 *tris,
+                                 size_t n, la_ray_mode mode);
+
+/**
+ * @brief Test the rays of a packet against n boxes, as
+ * la_ray_packet_triangles.
+ *
+ * @param min, max The corners of the boxes.
+ */
+uint32_t la_ray_packet_aabbs(la_ray_packet *p, const la_vec3 *min,
+                             const la_vec3 *max, size_t n, la_ray_mode mode);
+
+/**
+ * @brief Test the rays of a packet against n spheres, as
+ * la_ray_packet_triangles.
+ *
+ * @param spheres The centers in x, y, z and the radii in w.
+ */
+uint32_t la_ray_packet_spheres(la_ray_packet *p, const la_vec4 *spheres,
+                               size_t n, la_ray_mode mode);
+
+/**
+ * @brief Map a point from normalized device coordinates back to world space.
+ *
+ * @param inv_vp The inverse of the view-projection matrix,
+ * la_inversem4(la_productm4(view, projection)).
+ * @param ndc The point, with x, y and z in [-1, 1].
+ * @return The point in world space.
+ */
+la_vec3 la_unproject(const la_mat4 inv_vp, const la_vec3 ndc);
+
+/**
+ * @brief Get the picking ray through a point of the window.
+ *
+ * @param inv_vp The inverse of the view-projection matrix, as la_unproject.
+ * @param viewport The viewport as x, y, width and height in pixels.
+ * @param pixel The point in window coordinates, y pointing down.
+ * @return The ray from the near plane with a normalized direction. tmin is 0
+ * and tmax is the distance to the far plane.
+ */
+la_ray la_pick_ray(const la_mat4 inv_vp, const la_vec4 viewport,
+                   const la_vec2 pixel);
+
+/**
+ * Bounding volume hierarchies.
+ *
+ * A la_bvh indexes triangles or boxes for ray and overlap queries. It is
+ * built with binned SAH splits and flattened into nodes of LA_BVH_WIDTH
+ * children, whose bounds are tested together by the SIMD backend. A node is
+ * 128 bytes with 4 children and 256 bytes with 8, aligned to cache lines.
+ * Queries report the indices of the primitives as given to the build.
+ */
+#if defined(LA_USE_AVX)
+#define LA_BVH_WIDTH 8
+#else
+#define LA_BVH_WIDTH 4
+#endif
+
+typedef struct la_bvh la_bvh;
+
+/**
+ * @brief Build a BVH over triangles.
+ *
+ * The top of the tree is split with the primitives binned in parallel and
+ * the subtrees below are built in parallel. The tree does not depend on the
+ * number of threads.
+ *
+ * @param jobs The job system, or NULL to build on the calling thread.
+ * @param tris 3 * n vertices, 3 per triangle.
+ * @param n The number of triangles, at most INT32_MAX.
+ * @return The BVH, or NULL on failure.
+ */
+la_bvh *la_bvh_create_triangles(const la_jobs *jobs, const la_vec3 *tris,
+                                size_t n);
+
+/**
+ * @brief Build a BVH over boxes, as la_bvh_create_triangles.
+ *
+ * @param min, max The corners of the n boxes.
+ */
+la_bvh *la_bvh_create_aabbs(const la_jobs *jobs, const la_vec3 *min,
+                            const la_vec3 *max, size_t n);
+
+/**
+ * @brief Free a BVH.
+ */
+void la_bvh_destroy(la_bvh *bvh);
+
+/**
+ * @brief Update the bounds of a triangle BVH after its vertices moved, e.g.
+ * for a deforming mesh. The tree is kept, so queries slow down as the
+ * triangles move away from their positions at the build.
+ *
+ * @param bvh The BVH, built by la_bvh_create_triangles.
+ * @param tris The new vertices of the same triangles.
+ * @return 1 on success, 0 if the BVH is not over triangles.
+ */
+int la_bvh_refit_triangles(la_bvh *bvh, const la_vec3 *tris);
+
+/**
+ * @brief Update the bounds of a box BVH after its boxes moved, as
+ * la_bvh_refit_triangles.
+ *
+ * @return 1 on success, 0 if the BVH is not over boxes.
+ */
+int la_bvh_refit_aabbs(la_bvh *bvh, const la_vec3 *min, const la_vec3 *max);
+
+/**
+ * @brief Get the bounds of all of the primitives. An empty BVH has min at
+ * +infinity and max at -infinity.
+ */
+void la_bvh_bounds(const la_bvh *bvh, la_vec3 *min, la_vec3 *max);
+
+/**
+ * @brief Find the nearest hit of a ray, with the tests of
+ * la_ray_test_triangle or la_ray_test_aabb.
+ *
+ * @param bvh The BVH.
+ * @param r The ray.
+ * @param t Receives the distance of the hit. May be NULL.
+ * @param uv Receives the barycentric coordinates of a triangle hit, 0 for
+ * boxes. May be NULL.
+ * @param prim Receives the index of the primitive hit. May be NULL.
+ * @return 1 on a hit, otherwise 0.
+ */
+int la_bvh_closest(const la_bvh *bvh, const la_ray *r, float *t, la_vec2 *uv,
+                   uint32_t *prim);
+
+/**
+ * @brief Whether a ray hits anything, e.g. for shadows and visibility. Stops
+ * at the first hit found.
+ *
+ * @return 1 on a hit, otherwise 0.
+ */
+int la_bvh_any(const la_bvh *bvh, const la_ray *r);
+
+/**
+ * @brief Trace the rays of a packet, as la_ray_packet_triangles over every
+ * primitive of the BVH. Each ray is traced on its own, so that the packet
+ * can be fed to code written against la_ray_packet.
+ *
+ * @param bvh The BVH.
+ * @param p The rays. The hits are updated with prim the primitive index.
+ * @param mode Whether to look for the nearest hit or any hit.
+ * @return A bitmask of the lanes whose hit was set by this call.
+ */
+uint32_t la_bvh_packet(const la_bvh *bvh, la_ray_packet *p, la_ray_mode mode);
+
+/**
+ * @brief Find the primitives whose bounds overlap a box.
+ *
+ * @param bvh The BVH.
+ * @param min, max The corners of the box.
+ * @param prims Receives the indices of the first cap primitives found.
+ * @param cap The size of prims.
+ * @return The number of primitives found, which may be more than cap.
+ */
+size_t la_bvh_overlap(const la_bvh *bvh, const la_vec3 min, const la_vec3 max,
+                      uint32_t *prims, size_t cap);
+
+/**
+ * Affine transforms.
+ *
+ * The functions below assume that the last column of every matrix argument
+ * is (0, 0, 0, 1), as is the case for matrices built with la_translate,
+ * la_rotate, la_scale and la_look_at, and skip the terms that are known to
+ * be zero or one. The translation is stored in elem[3].
+ */
+
+/**
+ * @brief Get the product of 2 affine matrices. Equivalent to la_productm4
+ * with 36 multiplies instead of 64.
+ *
+ * @param m1 The first affine la_mat4.
+ * @param m2 The second affine la_mat4.
+ * @return The product of m1 and m2.
+ */
+la_mat4 la_productm4_affine(const la_mat4 m1, const la_mat4 m2);
+
+/**
+ * @brief Transform a point by an affine matrix, including the translation.
+ *
+ * The point is treated as a row vector, so that transforming by
+ * la_productm4(a, b) is the same as transforming by a and then by b.
+ *
+ * @param m The affine matrix.
+ * @param p The point.
+ * @return The transformed point.
+ */
+la_vec3 la_transform_point_affine(const la_mat4 m, const la_vec3 p);
+
+/**
+ * @brief Transform a direction by an affine matrix, ignoring the translation.
+ *
+ * @param m The affine matrix.
+ * @param d The direction.
+ * @return The transformed direction.
+ */
+la_vec3 la_transform_dir_affine(const la_mat4 m, const la_vec3 d);
+
+/**
+ * @brief Invert an affine matrix by inverting the 3x3 rotation-scale part and
+ * transforming the translation by it.
+ *
+ * @param m The affine matrix.
+ * @param invertible Set to 0 if m is singular, otherwise 1. May be NULL.
+ * @return The inverse of m, or the identity matrix if m is singular.
+ */
+la_mat4 la_inverse_affine(const la_mat4 m, int *invertible);
+
+/**
+ * @brief Pack an affine matrix into a la_mat3x4.
+ */
+la_mat3x4 la_m4tomat3x4(const la_mat4 m);
+
+/**
+ * @brief Expand a la_mat3x4 into an affine la_mat4.
+ */
+la_mat4 la_mat3x4tom4(const la_mat3x4 m);
+
+/**
+ * @brief Pack an array of affine matrices into la_mat3x4s, for example to
+ * upload them to the GPU.
+ *
+ * @param in The n affine matrices.
+ * @param out The n packed matrices.
+ * @param n The number of matrices.
+ */
+void la_m4tomat3x4_batch(const la_mat4 *in, la_mat3x4 *out, size_t n);
+
+/**
+ * @brief Transform a point by a la_mat3x4.
+ *
+ * @param m The packed affine matrix.
+ * @param p The point.
+ * @return The transformed point, as la_transform_point_affine would give for
+ * the expanded matrix.
+ */
+la_vec3 la_transform_point_mat3x4(const la_mat3x4 *m, const la_vec3 p);
+
+/**
+ * Quaternions.
+ *
+ * A la_quat stores the vector part in x, y, z and the scalar part in w. Unit
+ * quaternions represent rotations with the same handedness as la_rotate.
+ */
+
+/**
+ * @brief Get the identity quaternion (no rotation).
+ */
+la_quat la_identityq(void);
+
+/**
+ * @brief Create a rotation about an axis.
+ *
+ * @param axis The axis of the rotation. Does not need to be normalized.
+ * @param rads The rotation angle in radians.
+ * @return A unit quaternion.
+ */
+la_quat la_axis_angleq(const la_vec3 axis, const float rads);
+
+/**
+ * @brief Get the Hamilton product of 2 quaternions. The result rotates by q2
+ * and then by q1.
+ *
+ * @param q1 The first la_quat.
+ * @param q2 The second la_quat.
+ * @return The product of q1 and q2.
+ */
+la_quat la_productq(const la_quat q1, const la_quat q2);
+
+/**
+ * @brief Normalize a la_quat.
+ */
+la_quat la_normalizeq(const la_quat q);
+
+/**
+ * @brief Get the conjugate of a la_quat. For unit quaternions this is the
+ * inverse rotation.
+ */
+la_quat la_conjugateq(const la_quat q);
+
+/**
+ * @brief Get the inverse of a la_quat.
+ */
+la_quat la_inverseq(const la_quat q);
+
+/**
+ * @brief Rotate a la_vec3 by a unit quaternion.
+ *
+ * @param q The rotation.
+ * @param v The vector to rotate.
+ * @return The rotated vector. The same as la_transform_dir_affine with
+ * la_quattom4(q).
+ */
+la_vec3 la_productqv3(const la_quat q, const la_vec3 v);
+
+/**
+ * @brief Normalized linear interpolation between 2 unit quaternions along
+ * the shortest path.
+ *
+ * @param q1 The rotation at t = 0.
+ * @param q2 The rotation at t = 1.
+ * @param t The interpolation factor.
+ * @return A unit quaternion.
+ */
+la_quat la_nlerpq(const la_quat q1, const la_quat q2, const float t);
+
+/**
+ * @brief Spherical linear interpolation between 2 unit quaternions along the
+ * shortest path.
+ *
+ * @param q1 The rotation at t = 0.
+ * @param q2 The rotation at t = 1.
+ * @param t The interpolation factor.
+ * @return A unit quaternion.
+ */
+la_quat la_slerpq(const la_quat q1, const la_quat q2, const float t);
+
+/**
+ * @brief Convert a unit quaternion to a rotation matrix.
+ *
+ * @param q The rotation.
+ * @return The same matrix as la_rotate(la_identitym4(), axis, rads) for
+ * q = la_axis_angleq(axis, rads).
+ */
+la_mat4 la_quattom4(const la_quat q);
+
+/**
+ * @brief Rotate a matrix by a unit quaternion.
+ *
+ * @param m The matrix to apply the rotation to.
+ * @param q The rotation.
+ * @return The rotated matrix.
+ */
+la_mat4 la_rotateq(const la_mat4 m, const la_quat q);
+
+/**
+ * @brief Convert a rotation matrix to a unit quaternion.
+ *
+ * @param m A matrix whose upper 3x3 part is a rotation. The translation is
+ * ignored.
+ * @return The rotation q with la_quattom4(q) == m, up to the sign of q.
+ */
+la_quat la_m4toquat(const la_mat4 m);
+
+/**
+ * TRS transforms.
+ *
+ * A TRS transform applies a scale, then a rotation, then a translation, like
+ * the local transforms of la_hierarchy. Its matrix is the product S * R * T
+ * of the scale, rotation and translation matrices, written directly instead
+ * of through la_scale, la_rotateq and la_translate.
+ *
+ * la_trs_soa holds n TRS transforms as SoA streams, the layout of animation
+ * and instance data, for the batch functions below.
+ */
+
+typedef struct la_trs_soa {
+  float *tx, *ty, *tz;
+  float *rx, *ry, *rz, *rw;
+  float *sx, *sy, *sz;
+} la_trs_soa;
+
+/**
+ * @brief Build the matrix of a TRS transform.
+ *
+ * @param t The translation, applied last.
+ * @param r The unit rotation.
+ * @param s The scale, applied first.
+ * @return The affine matrix.
+ */
+la_mat4 la_compose_trs(const la_vec3 t, const la_quat r, const la_vec3 s);
+
+/**
+ * @brief Split an affine matrix into a TRS transform.
+ *
+ * A reflection is returned as a negative x scale. A zero scale keeps the
+ * other axes of the rotation. Shear is dropped: the rotation is made
+ * orthonormal from the x axis, then the y axis.
+ *
+ * @param m The matrix.
+ * @param t Receives the translation.
+ * @param r Receives the rotation, with w >= 0.
+ * @param s Receives the scale.
+ * @return 1 if la_compose_trs(*t, *r, *s) gives m back, 0 if m has shear or
+ * its last column is not (0, 0, 0, 1).
+ */
+int la_decompose_trs(const la_mat4 m, la_vec3 *t, la_quat *r, la_vec3 *s);
+
+/**
+ * @brief la_compose_trs over n SoA transforms.
+ *
+ * @param trs The transforms.
+ * @param out Receives the n matrices.
+ * @param n The number of transforms.
+ */
+void la_compose_trs_soa(const la_trs_soa *trs, la_mat4 *out, size_t n);
+
+/**
+ * @brief la_decompose_trs over n matrices into SoA transforms.
+ *
+ * @param m The matrices.
+ * @param trs Receives the n transforms.
+ * @param n The number of matrices.
+ * @return 1 if every matrix was a TRS transform, otherwise 0.
+ */
+int la_decompose_trs_soa(const la_mat4 *m, const la_trs_soa *trs, size_t n);
+
+/**
+ * @brief Multithreaded la_compose_trs_soa.
+ */
+void la_compose_trs_soa_mt(const la_jobs *jobs, const la_trs_soa *trs,
+                           la_mat4 *out, size_t n);
+
+/**
+ * Dual quaternions.
+ *
+ * A la_dualquat holds a rigid transform: a rotation followed by a
+ * translation, like an affine la_mat4 without scale. Blending dual
+ * quaternions instead of matrices keeps skinned joints from collapsing.
+ */
+
+/**
+ * @brief Get the identity dual quaternion.
+ */
+la_dualquat la_identitydq(void);
+
+/**
+ * @brief Create a dual quaternion from a rotation and a translation.
+ *
+ * @param r The unit rotation, applied first.
+ * @param t The translation, applied second.
+ * @return A unit dual quaternion.
+ */
+la_dualquat la_rigiddq(const la_quat r, const la_vec3 t);
+
+/**
+ * @brief Convert a rigid affine matrix to a dual quaternion.
+ *
+ * @param m A rotation and a translation, without scale or shear.
+ * @return The same transform as a unit dual quaternion.
+ */
+la_dualquat la_m4todq(const la_mat4 m);
+
+/**
+ * @brief Convert n rigid affine matrices to dual quaternions, for example to
+ * build a skinning palette.
+ */
+void la_m4todq_batch(const la_mat4 *in, la_dualquat *out, size_t n);
+
+/**
+ * @brief Convert a unit dual quaternion to an affine matrix.
+ */
+la_mat4 la_dqtom4(const la_dualquat dq);
+
+/**
+ * @brief Get the translation of a unit dual quaternion.
+ */
+la_vec3 la_translationdq(const la_dualquat dq);
+
+/**
+ * @brief Compose 2 dual quaternions. The result transforms by dq2 and then by
+ * dq1, like la_productq.
+ *
+ * @param dq1 The second transform.
+ * @param dq2 The first transform.
+ * @return The product of dq1 and dq2.
+ */
+la_dualquat la_productdq(const la_dualquat dq1, const la_dualquat dq2);
+
+/**
+ * @brief Normalize a dual quaternion by the length of its real part.
+ */
+la_dualquat la_normalizedq(const la_dualquat dq);
+
+/**
+ * @brief Transform a point by a unit dual quaternion.
+ *
+ * @param dq The transform.
+ * @param p The point.
+ * @return The rotated and translated point.
+ */
+la_vec3 la_transform_point_dq(const la_dualquat dq, const la_vec3 p);
+
+/**
+ * Skinning.
+ *
+ * The skinning functions transform a batch of vertices by a weighted blend
+ * of the bones that influence them, gathering from a bone palette on the
+ * fly so that no blended matrix is ever written to memory. All vertex data
+ * is SoA: influence k of vertex i uses bone bones[k * n + i] with weight
+ * weights[k * n + i]. The weights of a vertex should sum to 1. The outputs
+ * may be the same arrays as the matching inputs.
+ */
+typedef struct la_skin_soa {
+  size_t n;                  // Vertices.
+  size_t influences;         // Per vertex, unused ones have weight 0.
+  const uint16_t *bones;     // influences * n palette indices.
+  const float *weights;      // influences * n weights.
+  const float *x, *y, *z;    // Bind-pose positions.
+  const float *nx, *ny, *nz; // Bind-pose normals, NULL to skip normals.
+  float *out_x, *out_y, *out_z;
+  float *out_nx, *out_ny, *out_nz;
+} la_skin_soa;
+
+/**
+ * @brief Linear blend skinning: transform each vertex by the weighted sum of
+ * its bone matrices.
+ *
+ * Normals are transformed by the blended 3x3 part and not renormalized. A
+ * vertex with no influences, or whose weights are all zero, is passed
+ * through unchanged.
+ *
+ * @param palette The bone transforms, from la_m4tomat3x4_batch.
+ * @param s The vertices.
+ */
+void la_skin_linear(const la_mat3x4 *palette, const la_skin_soa *s);
+
+/**
+ * @brief Dual quaternion skinning: transform each vertex by the normalized
+ * weighted sum of its bone dual quaternions.
+ *
+ * Bones whose rotation lies in the opposite hemisphere from the first
+ * influence are negated before blending, so that a vertex always blends
+ * along the shortest path. Normals are rotated by the blended rotation and
+ * stay unit length. A vertex with no influences, or whose weights are all
+ * zero, is passed through unchanged.
+ *
+ * @param palette The bone transforms, from la_m4todq_batch.
+ * @param s The vertices.
+ */
+void la_skin_dual_quat(const la_dualquat *palette, const la_skin_soa *s);
+
+/**
+ * Animation.
+ *
+ * A la_anim_clip holds tracks of keyframes, each animating the translation,
+ * rotation or scale of one transform of a pose. The keys of a track are
+ * sorted by time, with times, values and tangents in separate streams.
+ * Tracks are gathered into SoA blocks and sampled with la_vf: translations
+ * and scales with lerp, rotations with nlerp, or either with a cubic Hermite
+ * spline. Times before the first key or after the last one hold the end
+ * keys; looping is up to the caller.
+ *
+ * Sampling keeps a cursor per track, the key segment it last used. When
+ * time moves forward by a few keys or less between calls, as in playback,
+ * finding the segment costs O(1). Otherwise it falls back to a binary
+ * search.
+ */
+
+typedef enum la_anim_channel {
+  LA_ANIM_TRANSLATION,
+  LA_ANIM_ROTATION,
+  LA_ANIM_SCALE
+} la_anim_channel;
+
+typedef enum la_anim_interp {
+  LA_ANIM_LINEAR,  // lerp, nlerp for rotations.
+  LA_ANIM_HERMITE  // Cubic Hermite, renormalized for rotations.
+} la_anim_interp;
+
+/* A track to build a clip from. Values and tangents have 3 floats per key,
+ * 4 (a la_quat) for rotations. */
+typedef struct la_anim_track_desc {
+  uint32_t target;         // Index of the transform in the pose.
+  la_anim_channel channel;
+  la_anim_interp interp;
+  size_t count;            // Keys, at least 1.
+  const float *times;      // count increasing times.
+  const float *values;     // count values.
+  const float *tangents;   // Hermite: the in and out tangent of each key.
+} la_anim_track_desc;
+
+typedef struct la_anim_clip la_anim_clip;
+
+/**
+ * @brief Create a clip, copying the keys of its tracks.
+ *
+ * Consecutive rotation keys are flipped to the same hemisphere, so that
+ * they interpolate along the shortest path.
+ *
+ * @param tracks The tracks.
+ * @param n The number of tracks.
+ * @return The clip, or NULL if a track has no keys, times that do not
+ * increase, Hermite interpolation without tangents, or the same target and
+ * channel as another track, or if memory could not be allocated.
+ */
+la_anim_clip *la_anim_clip_create(const la_anim_track_desc *tracks, size_t n);
+
+/**
+ * @brief Free a clip.
+ */
+void la_anim_clip_destroy(la_anim_clip *clip);
+
+/**
+ * @brief Get the number of tracks of a clip, the size of its cursors.
+ */
+size_t la_anim_clip_tracks(const la_anim_clip *clip);
+
+/**
+ * @brief Get the time of the last key of a clip.
+ */
+float la_anim_clip_duration(const la_anim_clip *clip);
+
+/**
+ * @brief Sample a clip, writing the animated channels of a pose.
+ *
+ * @param clip The clip.
+ * @param time The time to sample at.
+ * @param cursor la_anim_clip_tracks(clip) segments, zeroed before the first
+ * call and kept between calls. May be NULL to always search.
+ * @param pose The transforms. Channels without a track are left as is.
+ * @param pose_count The number of transforms in pose.
+ * @return 1 on success, 0 if a track targets a transform past pose_count.
+ */
+int la_anim_sample(const la_anim_clip *clip, float time, uint32_t *cursor,
+                   const la_trs_soa *pose, size_t pose_count);
+
+/* A pose that clips are blended into. The transforms hold weighted sums
+ * until la_anim_pose_finish. */
+typedef struct la_anim_pose {
+  size_t count;
+  la_trs_soa trs;
+  float *weight; // The summed weights, count per channel.
+} la_anim_pose;
+
+/**
+ * @brief Create a pose to blend count transforms into.
+ *
+ * @return The pose, or NULL if memory could not be allocated.
+ */
+la_anim_pose *la_anim_pose_create(size_t count);
+
+/**
+ * @brief Free a pose.
+ */
+void la_anim_pose_destroy(la_anim_pose *pose);
+
+/**
+ * @brief Start blending a new pose.
+ */
+void la_anim_pose_clear(la_anim_pose *pose);
+
+/**
+ * @brief Sample a clip as la_anim_sample and add it to a pose with a weight.
+ * Each rotation is flipped to the hemisphere of the sum so far.
+ *
+ * @return 1 on success, 0 if a track targets a transform past pose->count.
+ */
+int la_anim_pose_add(la_anim_pose *pose, const la_anim_clip *clip,
+                     float time, uint32_t *cursor, float weight);
+
+/**
+ * @brief Finish blending: divide each channel by its summed weight and
+ * normalize the rotations.
+ *
+ * @param pose The pose.
+ * @param rest The transforms used for channels no clip animated, e.g. the
+ * bind pose. NULL uses the identity.
+ */
+void la_anim_pose_finish(la_anim_pose *pose, const la_trs_soa *rest);
+
+/**
+ * Quantization.
+ *
+ * Compact encodings of transforms, for replication and recordings. Each
+ * packed element is stored whole, e.g. three uint16_t per position, and the
+ * batch functions read and write SoA float streams such as la_trs_soa.
+ *
+ * Rotations use the smallest three encoding: the largest component of a
+ * unit quaternion is dropped, made positive by negating q, and rebuilt from
+ * the other three, which lie in [-1/sqrt(2), 1/sqrt(2)]. With 32 bits the
+ * three get 10 bits each and a decoded rotation is within 0.005 radians of
+ * the original. With 48 bits they get 15 bits each, within 0.0002 radians.
+ *
+ * Positions are quantized to 16 bits per axis over a bounding box, within
+ * half a step of (max - min) / 65535. Positions outside the box are
+ * clamped to it.
+ *
+ * Scales are quantized to 16 bits on a log2 scale, so the relative error is
+ * the same at every size: a sign bit, then 0 for a zero scale or a step
+ * between log2(min_scale) and log2(max_scale). Magnitudes outside the range
+ * are clamped to it. For a range of [1/1024, 1024] a decoded scale is within
+ * 0.03% of the original.
+ */
+
+/**
+ * @brief Encode a unit quaternion in 32 bits.
+ */
+uint32_t la_quat_pack32(const la_quat q);
+
+/**
+ * @brief Decode a quaternion from la_quat_pack32.
+ *
+ * @return A unit quaternion for the same rotation, with its largest
+ * component positive.
+ */
+la_quat la_quat_unpack32(uint32_t v);
+
+/**
+ * @brief Encode a unit quaternion in 48 bits, as three uint16_t.
+ */
+void la_quat_pack48(const la_quat q, uint16_t *out);
+
+/**
+ * @brief Decode a quaternion from la_quat_pack48.
+ */
+la_quat la_quat_unpack48(const uint16_t *in);
+
+/**
+ * @brief la_quat_pack32 over n quaternions.
+ */
+void la_quat_pack32_soa(const float *x, const float *y, const float *z,
+                        const float *w, uint32_t *out, size_t n);
+
+/**
+ * @brief la_quat_unpack32 over n quaternions.
+ */
+void la_quat_unpack32_soa(const uint32_t *in, float *x, float *y, float *z,
+                          float *w, size_t n);
+
+/**
+ * @brief la_quat_pack48 over n quaternions, writing 3 * n values.
+ */
+void la_quat_pack48_soa(const float *x, const float *y, const float *z,
+                        const float *w, uint16_t *out, size_t n);
+
+/**
+ * @brief la_quat_unpack48 over n quaternions, reading 3 * n values.
+ */
+void la_quat_unpack48_soa(const uint16_t *in, float *x, float *y, float *z,
+                          float *w, size_t n);
+
+/**
+ * @brief Encode n positions in 16 bits per axis.
+ *
+ * @param x, y, z The positions.
+ * @param min, max The corners of the box to quantize over.
+ * @param out Receives 3 * n values, x, y and z for each position.
+ * @param n The number of positions.
+ */
+void la_position_pack16_soa(const float *x, const float *y, const float *z,
+                            const la_vec3 min, const la_vec3 max,
+                            uint16_t *out, size_t n);
+
+/**
+ * @brief Decode n positions from la_position_pack16_soa, with the same box.
+ */
+void la_position_unpack16_soa(const uint16_t *in, const la_vec3 min,
+                              const la_vec3 max, float *x, float *y, float *z,
+                              size_t n);
+
+/**
+ * @brief Encode n scales in 16 bits per axis.
+ *
+ * Magnitudes are quantized in log2, computed a vector at a time with a
+ * polynomial rather than log2f.
+ *
+ * @param x, y, z The scales.
+ * @param min_scale, max_scale The range of magnitudes, min_scale < max_scale
+ * and both normal floats.
+ * @param out Receives 3 * n values, x, y and z for each scale.
+ * @param n The number of scales.
+ */
+void la_scale_pack16_soa(const float *x, const float *y, const float *z,
+                         float min_scale, float max_scale, uint16_t *out,
+                         size_t n);
+
+/**
+ * @brief Decode n scales from la_scale_pack16_soa, with the same range.
+ */
+void la_scale_unpack16_soa(const uint16_t *in, float min_scale,
+                           float max_scale, float *x, float *y, float *z,
+                           size_t n);
+
+/**
+ * Pointer API.
+ *
+ * The _p functions compute the same results as the functions they are named
+ * after, but take their matrix and vector arguments by pointer and write the
+ * result through out, avoiding by-value copies of la_mat4 across calls into
+ * the library. Unless noted otherwise out is restrict-qualified: it must not
+ * overlap any input, so m = m * b needs a temporary.
+ */
+
+#if defined(__cplusplus) || defined(_MSC_VER)
+#define LA_RESTRICT __restrict
+#else
+#define LA_RESTRICT restrict
+#endif
+
+/**
+ * @brief la_identitym4.
+ */
+void la_identitym4_p(la_mat4 *out);
+
+/**
+ * @brief la_productm4.
+ */
+void la_productm4_p(la_mat4 *LA_RESTRICT out, const la_mat4 *a,
+                    const la_mat4 *b);
+
+/**
+ * @brief la_productm4v4.
+ */
+void la_productm4v4_p(la_vec4 *LA_RESTRICT out, const la_mat4 *m,
+                      const la_vec4 *v);
+
+/**
+ * @brief la_productm4_affine.
+ */
+void la_productm4_affine_p(la_mat4 *LA_RESTRICT out, const la_mat4 *a,
+                           const la_mat4 *b);
+
+/**
+ * @brief la_transposem4.
+ */
+void la_transposem4_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m);
+
+/**
+ * @brief la_inversem4.
+ */
+void la_inversem4_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m,
+                    int *invertible);
+
+/**
+ * @brief la_inverse_affine.
+ */
+void la_inverse_affine_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m,
+                         int *invertible);
+
+/**
+ * @brief la_translate. out may be m, translating in place.
+ */
+void la_translate_p(la_mat4 *out, const la_mat4 *m, const la_vec3 *v);
+
+/**
+ * @brief la_rotate.
+ */
+void la_rotate_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m,
+                 const la_vec3 *axis, const float rads);
+
+/**
+ * @brief la_rotateq.
+ */
+void la_rotateq_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m,
+                  const la_quat *q);
+
+/**
+ * @brief la_scale.
+ */
+void la_scale_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m, const la_vec3 *v);
+
+/**
+ * @brief la_quattom4.
+ */
+void la_quattom4_p(la_mat4 *LA_RESTRICT out, const la_quat *q);
+
+/**
+ * @brief la_perspective.
+ */
+void la_perspective_p(la_mat4 *out, const float fov, const float aspect_ratio,
+                      const float near, const float far);
+
+/**
+ * @brief la_orthographic.
+ */
+void la_orthographic_p(la_mat4 *out, const float left, const float right,
+                       const float bottom, const float top, const float near,
+                       const float far);
+
+/**
+ * @brief la_look_at.
+ */
+void la_look_at_p(la_mat4 *LA_RESTRICT out, const la_vec3 *eye,
+                  const la_vec3 *ctr, const la_vec3 *up);
+
+/**
+ * Transform hierarchy.
+ *
+ * Nodes are stored breadth-first: every node comes after its parent and the
+ * nodes of each depth are contiguous, so one pass in index order computes
+ * every world matrix from an up-to-date parent, and the nodes of a depth can
+ * be updated in parallel. The local transforms are kept as SoA translation,
+ * rotation and scale streams. Only nodes whose local transform was marked
+ * dirty, and their descendants, are recomputed by an update.
+ *
+ * A local transform applies the scale, then the rotation, then the
+ * translation. world[i] = la_productm4_affine(local(i), world[parent[i]]).
+ */
+
+typedef struct la_hierarchy {
+  size_t count;
+  int32_t *parent; // -1 for roots.
+  float *tx, *ty, *tz;
+  float *rx, *ry, *rz, *rw;
+  float *sx, *sy, *sz;
+  la_mat4 *world;  // 64-byte aligned.
+  uint8_t *flags;  // Dirty and changed bits, see la_hierarchy_mark_dirty.
+  size_t nlevels;
+  size_t *levels;  // Depth d is [levels[d], levels[d + 1]).
+} la_hierarchy;
+
+/**
+ * @brief Get a breadth-first order for a forest.
+ *
+ * @param parent The parent of each node, -1 for roots.
+ * @param n The number of nodes.
+ * @param order Receives the node to store at each position. Roots come
+ * first in index order, then their children, and so on.
+ * @return 1 on success, 0 if a parent index is out of range or the parents
+ * form a cycle.
+ */
+int la_bfs_order(const int32_t *parent, size_t n, uint32_t *order);
+
+/**
+ * @brief Create a hierarchy with identity local transforms, all dirty.
+ *
+ * @param parent The parent of each node, -1 for roots, in breadth-first
+ * order as given by la_bfs_order.
+ * @param n The number of nodes.
+ * @return The hierarchy, or NULL if parent is not breadth-first or memory
+ * could not be allocated.
+ */
+la_hierarchy *la_hierarchy_create(const int32_t *parent, size_t n);
+
+/**
+ * @brief Free a hierarchy.
+ */
+void la_hierarchy_destroy(la_hierarchy *h);
+
+/**
+ * @brief Set the local transform of node i and mark it dirty.
+ */
+void la_hierarchy_set_trs(la_hierarchy *h, size_t i, const la_vec3 t,
+                          const la_quat r, const la_vec3 s);
+
+/**
+ * @brief Mark node i dirty after writing its SoA local transform directly.
+ */
+void la_hierarchy_mark_dirty(la_hierarchy *h, size_t i);
+
+/**
+ * @brief Recompute the world matrices of the dirty nodes and their
+ * descendants, and clear the dirty marks.
+ *
+ * @return The number of world matrices recomputed.
+ */
+size_t la_hierarchy_update(la_hierarchy *h);
+
+/**
+ * @brief la_hierarchy_update, running the nodes of each depth in parallel.
+ * Gives the same world matrices and count as la_hierarchy_update.
+ *
+ * @return The number of world matrices recomputed.
+ */
+size_t la_hierarchy_update_mt(const la_jobs *jobs, la_hierarchy *h);
+
+/**
+ * @brief Whether the world matrix of node i was recomputed by the last
+ * update, e.g. to upload only the matrices that changed.
+ */
+int la_hierarchy_changed(const la_hierarchy *h, size_t i);
+
+/**
+ * Double precision.
+ *
+ * The functions below are declared and implemented once by the
+ * LA_DECLARE_FUNCS and LA_IMPLEMENT_FUNCS templates, instantiated for double
+ * with the suffix _d, e.g. la_productm4_d for la_productm4, and for float
+ * with the suffix _scalar. The _scalar functions are the reference
+ * implementations: the float functions call them, or are SIMD versions
+ * tested against them, so a result in double rounded to float is within a
+ * few ulps of the float result:
+ *
+ *   la_identitym4, la_productm4, la_productm4v4, la_transposem4,
+ *   la_determinantm4, la_inversem4, la_translate, la_rotate, la_scale,
+ *   la_dotv3, la_crossv3, la_normalizev3, la_perspective, la_orthographic,
+ *   la_look_at.
+ */
+#define LA_DECLARE_FUNCS(T, S, vec3, vec4, mat4)                               \
+  mat4 la_identitym4##S(void);                                                 \
+  mat4 la_productm4##S(const mat4 m1, const mat4 m2);                          \
+  vec4 la_productm4v4##S(const mat4 m, const vec4 v);                          \
+  mat4 la_transposem4##S(const mat4 m);                                        \
+  T la_determinantm4##S(const mat4 m);                                         \
+  mat4 la_inversem4##S(const mat4 m, int *invertible);                         \
+  mat4 la_translate##S(const mat4 m, const vec3 v);                            \
+  mat4 la_rotate##S(const mat4 m, const vec3 axis, const T rads);              \
+  mat4 la_scale##S(const mat4 m, const vec3 v);                                \
+  T la_dotv3##S(const vec3 v1, const vec3 v2);                                 \
+  vec3 la_crossv3##S(const vec3 v1, const vec3 v2);                            \
+  vec3 la_normalizev3##S(const vec3 v);                                        \
+  mat4 la_perspective##S(const T fov, const T aspect_ratio, const T near,      \
+                         const T far);                                         \
+  mat4 la_orthographic##S(const T left, const T right, const T bottom,         \
+                          const T top, const T near, const T far);             \
+  mat4 la_look_at##S(const vec3 eye, const vec3 ctr, const vec3 up);
+
+LA_DECLARE_FUNCS(float, _scalar, la_vec3, la_vec4, la_mat4)
+LA_DECLARE_FUNCS(double, _d, la_dvec3, la_dvec4, la_dmat4)
+
+/**
+ * @brief Convert a la_dmat4 to a la_mat4.
+ */
+la_mat4 la_dm4tom4(const la_dmat4 m);
+
+/**
+ * @brief Convert a la_mat4 to a la_dmat4.
+ */
+la_dmat4 la_m4todm4(const la_mat4 m);
+
+/**
+ * @brief Convert a la_dvec3 to a la_vec3.
+ */
+la_vec3 la_dv3tov3(const la_dvec3 v);
+
+/**
+ * @brief Convert a la_vec3 to a la_dvec3.
+ */
+la_dvec3 la_v3todv3(const la_vec3 v);
+
+/**
+ * Camera-relative rendering.
+ *
+ * Positions far from the origin lose precision in float. Keeping them in
+ * double and subtracting the camera position before converting to float
+ * leaves full float precision near the camera. The view matrix then uses
+ * the camera at the origin.
+ */
+
+/**
+ * @brief out = (float)(p - camera) for n SoA positions.
+ *
+ * @param camera The camera position.
+ * @param x, y, z The positions.
+ * @param ox, oy, oz The camera-relative positions.
+ * @param n The number of positions.
+ */
+void la_camera_relative_soa(const la_dvec3 *camera, const double *x,
+                            const double *y, const double *z, float *ox,
+                            float *oy, float *oz, size_t n);
+
+/**
+ * @brief Convert n world matrices to float camera-relative world matrices,
+ * la_productm4_d(world[i], translation(-camera)) rounded to float.
+ */
+void la_camera_relative_m4_batch(const la_dvec3 *camera,
+                                 const la_dmat4 *world, la_mat4 *out,
+                                 size_t n);
+
+/**
+ * Half precision.
+ *
+ * la_half holds the bits of an IEEE 754 binary16 value. Conversions round to
+ * nearest even, keep infinities and turn NaNs into quiet NaNs. The batch
+ * conversions use F16C when LA_USE_F16C is defined, or NEON on aarch64,
+ * with the same results as the scalar ones.
+ */
+
+typedef uint16_t la_half;
+
+typedef struct la_hvec4 {
+  union {
+    struct {
+      la_half x;
+      la_half y;
+      la_half z;
+      la_half w;
+    };
+    la_half elem[4];
+  };
+} la_hvec4;
+
+/**
+ * @brief Convert a float to half precision.
+ */
+la_half la_ftoh(const float f);
+
+/**
+ * @brief Convert a half precision value to float. Exact.
+ */
+float la_htof(const la_half h);
+
+/**
+ * @brief Convert n floats to half precision.
+ */
+void la_ftoh_batch(const float *in, la_half *out, size_t n);
+
+/**
+ * @brief Convert n half precision values to float.
+ */
+void la_htof_batch(const la_half *in, float *out, size_t n);
+
+/**
+ * @brief Convert a la_vec4 to a la_hvec4.
+ */
+la_hvec4 la_v4tohv4(const la_vec4 v);
+
+/**
+ * @brief Convert a la_hvec4 to a la_vec4.
+ */
+la_vec4 la_hv4tov4(const la_hvec4 v);
+
+/**
+ * Binary files.
+ *
+ * A la_bin file holds named arrays of floats, la_vec3s, la_vec4s, la_mat3x4s
+ * or la_mat4s, e.g. baked animation or instance transforms. It is written
+ * in one pass by a la_bin_writer, one array at a time and in pieces of any
+ * size, and read by mapping the whole file into memory, so that opening it
+ * needs no parsing or copying and the arrays are used in place.
+ *
+ * The file starts with a 64 byte header (magic, version, byte order and the
+ * location of the directory) and ends with the directory, one la_bin_entry
+ * per array. The data of every array starts on a 64 byte boundary. An array
+ * is stored in one of three layouts:
+ *
+ * - LA_BIN_AOS: the elements as they are in memory, e.g. la_mat4s that can
+ *   be passed to la_productm4_batch.
+ * - LA_BIN_SOA: one stream of floats per component (16 for a la_mat4, in
+ *   elem order), each starting on a 64 byte boundary, e.g. the x, y, z and w
+ *   streams of la_transform_points_v4.
+ * - LA_BIN_Q16: each component quantized to 16 bits over its own range, with
+ *   an error of at most half a step, (max - min) / 131070, and half the size
+ *   of LA_BIN_AOS. Read back through la_bin_read.
+ *
+ * Files are read with the byte order they were written with; la_bin_open
+ * rejects files from a machine with the other byte order and files from a
+ * newer version of the format.
+ */
+
+#define LA_BIN_VERSION 1
+
+typedef enum la_bin_type {
+  LA_BIN_FLOAT = 1,
+  LA_BIN_VEC3 = 2,
+  LA_BIN_VEC4 = 3,
+  LA_BIN_MAT3X4 = 4,
+  LA_BIN_MAT4 = 5,
+} la_bin_type;
+
+typedef enum la_bin_layout {
+  LA_BIN_AOS = 0,
+  LA_BIN_SOA = 1,
+  LA_BIN_Q16 = 2,
+} la_bin_layout;
+
+/* One array in the directory, as stored in the file. */
+typedef struct la_bin_entry {
+  char name[32];     // NUL terminated.
+  uint32_t type;     // la_bin_type
+  uint32_t layout;   // la_bin_layout
+  uint64_t count;    // The number of elements.
+  uint64_t offset;   // The start of the data in the file.
+  uint64_t size;     // The size of the data in bytes.
+} la_bin_entry;
+
+LA_STATIC_ASSERT(sizeof(la_bin_entry) == 64, "la_bin_entry must be packed");
+
+typedef struct la_bin la_bin;
+typedef struct la_bin_writer la_bin_writer;
+
+/**
+ * @brief The number of floats in one element of a type, e.g. 16 for
+ * LA_BIN_MAT4, or 0 for an unknown type.
+ */
+size_t la_bin_components(la_bin_type type);
+
+/**
+ * @brief Create a file to write arrays to.
+ *
+ * @param path The file, replaced if it exists.
+ * @return The writer, or NULL if the file cannot be created.
+ */
+la_bin_writer *la_bin_writer_open(const char *path);
+
+/**
+ * @brief Start an array. Its elements are then given to la_bin_write and the
+ * array is finished by la_bin_end.
+ *
+ * @param w The writer.
+ * @param name The name of the array, shorter than 32 bytes.
+ * @param type The type of the elements.
+ * @param layout How the elements are stored.
+ * @param count The number of elements that will be written.
+ * @param min, max For LA_BIN_Q16, the range of each component, e.g. 16
+ * floats each for a la_mat4. Values outside are clamped. Ignored for the
+ * other layouts and may be NULL.
+ * @return 1 on success, 0 if an array is already started or an argument is
+ * invalid.
+ */
+int la_bin_begin(la_bin_writer *w, const char *name, la_bin_type type,
+                 la_bin_layout layout, uint64_t count, const float *min,
+                 const float *max);
+
+/**
+ * @brief Write the next n elements of the started array, e.g. n la_mat4s for
+ * LA_BIN_MAT4, whatever its layout.
+ *
+ * @return 1 on success, 0 if no array is started, more than count elements
+ * were given or the file cannot be written.
+ */
+int la_bin_write(la_bin_writer *w, const void *elems, size_t n);
+
+/**
+ * @brief Finish the started array.
+ *
+ * @return 1 on success, 0 if fewer than count elements were written.
+ */
+int la_bin_end(la_bin_writer *w);
+
+/**
+ * @brief Write a whole array at once with la_bin_begin, la_bin_write and
+ * la_bin_end. For LA_BIN_Q16 the range of each component is that of the
+ * elements.
+ */
+int la_bin_write_array(la_bin_writer *w, const char *name, la_bin_type type,
+                       la_bin_layout layout, const void *elems, size_t count);
+
+/**
+ * @brief Write the directory and the header, close the file and free the
+ * writer.
+ *
+ * @return 1 if the file is complete, 0 if any call on w failed or the file
+ * cannot be written. The file is not valid then.
+ */
+int la_bin_writer_close(la_bin_writer *w);
+
+/**
+ * @brief Map a file into memory and check its header and directory.
+ *
+ * Where mmap is not available the file is read into memory instead.
+ *
+ * @return The file, or NULL if it cannot be read or is not a valid la_bin
+ * file of a supported version.
+ */
+la_bin *la_bin_open(const char *path);
+
+/**
+ * @brief Unmap a file. Pointers into it become invalid.
+ */
+void la_bin_close(la_bin *b);
+
+/**
+ * @brief The number of arrays in a file.
+ */
+size_t la_bin_count(const la_bin *b);
+
+/**
+ * @brief The directory entry of array i, in the order they were written.
+ */
+const la_bin_entry *la_bin_entry_at(const la_bin *b, size_t i);
+
+/**
+ * @brief Find an array by name.
+ *
+ * @return The first entry with the name, or NULL.
+ */
+const la_bin_entry *la_bin_find(const la_bin *b, const char *name);
+
+/**
+ * @brief The data of an array in the mapped file, 64 byte aligned.
+ *
+ * For LA_BIN_AOS the elements, for LA_BIN_SOA the first stream and for
+ * LA_BIN_Q16 the quantized components, count times the components of the
+ * type.
+ */
+const void *la_bin_data(const la_bin *b, const la_bin_entry *e);
+
+/**
+ * @brief Stream c of a LA_BIN_SOA array, count floats, 64 byte aligned.
+ *
+ * @return The stream, or NULL if the array is not SoA or c is out of range.
+ */
+const float *la_bin_stream(const la_bin *b, const la_bin_entry *e, size_t c);
+
+/**
+ * @brief Copy elements [first, first + n) of an array of any layout into
+ * out as they would be in memory, e.g. n la_mat4s for LA_BIN_MAT4.
+ *
+ * @return 1 on success, 0 if the range is out of bounds.
+ */
+int la_bin_read(const la_bin *b, const la_bin_entry *e, size_t first,
+                size_t n, void *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LA_H_
+
+#ifdef LA_IMPLEMENTATION
+
+#include <float.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <unistd.h>
+#endif
+
+/* fseeko and posix_memalign are used where the includer's feature level
+ * declares them, see la.c. */
+#if defined(_POSIX_VERSION) && _POSIX_VERSION >= 200112L
+#define LA_HAS_POSIX_2001
+#endif
+
+#ifndef M_PI
+#define M_PI (3.14159265358979323846)
+#endif
+
+#if defined(LA_USE_AVX) && !defined(__AVX__)
+#error "LA_USE_AVX requires compiling with AVX enabled (e.g. -mavx)"
+#endif
+
+#if defined(LA_USE_SSE2)
+#include <emmintrin.h>
+#endif
+
+#if defined(LA_USE_F16C) && !defined(__F16C__)
+#error "LA_USE_F16C requires compiling with F16C enabled (-mf16c)"
+#endif
+
+#if defined(LA_USE_AVX) || defined(LA_USE_F16C)
+#include <immintrin.h>
+#endif
+
+#if defined(LA_USE_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifdef LA_HAS_POOL
+#include <pthread.h>
+#endif
+
+#if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0 &&                \
+    !defined(LA_NO_MMAP)
+#define LA_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define LA_MIN_GRAIN 256
+#define LA_CHUNKS_PER_THREAD 4
+
+/* Profiling. LA_PROFILE_ENTER at the top of an entry point reads the
+ * timestamp counter and LA_PROFILE_LEAVE before each return adds the
+ * elapsed ticks to the calling thread's counters. Both expand to nothing
+ * without LA_PROFILE. */
+#ifdef LA_PROFILE
+#if defined(_M_X64) || defined(_M_IX86)
+#define LA_PROFILE_RDTSC
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#define LA_PROFILE_RDTSC
+#include <x86intrin.h>
+#elif !defined(__aarch64__)
+#include <time.h>
+#endif
+
+#define LA_PROFILE_FUNCS(X)                                                    \
+  X(la_productm4)                                                              \
+  X(la_productm4v4)                                                            \
+  X(la_productm4_affine)                                                       \
+  X(la_transposem4)                                                            \
+  X(la_inversem4)                                                              \
+  X(la_inverse_affine)                                                         \
+  X(la_normalizev3)                                                            \
+  X(la_translate)                                                              \
+  X(la_rotate)                                                                 \
+  X(la_scale)                                                                  \
+  X(la_perspective)                                                            \
+  X(la_orthographic)                                                           \
+  X(la_look_at)                                                                \
+  X(la_transform_point_affine)                                                 \
+  X(la_quattom4)                                                               \
+  X(la_compose_trs)                                                            \
+  X(la_compose_trs_soa)                                                        \
+  X(la_nlerpq)                                                                 \
+  X(la_slerpq)                                                                 \
+  X(la_normalizev3_batch)                                                      \
+  X(la_productm4_batch)                                                        \
+  X(la_productmn)                                                              \
+  X(la_transform_points_v4)                                                    \
+  X(la_transform_points_v4_aos)                                                \
+  X(la_frustum_cull_spheres)                                                   \
+  X(la_frustum_cull_aabbs)                                                     \
+  X(la_ray_packet_triangles)                                                   \
+  X(la_ray_packet_aabbs)                                                       \
+  X(la_ray_packet_spheres)                                                     \
+  X(la_hierarchy_update)                                                       \
+  X(la_skin_linear)                                                            \
+  X(la_skin_dual_quat)                                                         \
+  X(la_anim_sample)                                                            \
+  X(la_anim_pose_add)                                                          \
+  X(la_quat_pack32_soa)                                                        \
+  X(la_quat_unpack32_soa)                                                      \
+  X(la_position_pack16_soa)                                                    \
+  X(la_position_unpack16_soa)                                                  \
+  X(la_scale_pack16_soa)                                                       \
+  X(la_scale_unpack16_soa)
+
+#define LA_PROFILE_ID(name) la_profile_id_##name,
+enum { LA_PROFILE_FUNCS(LA_PROFILE_ID) LA_PROFILE_COUNT };
+#undef LA_PROFILE_ID
+
+#if defined(__cplusplus)
+#define LA_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define LA_THREAD_LOCAL __declspec(thread)
+#else
+#define LA_THREAD_LOCAL _Thread_local
+#endif
+
+/* Only the owning thread writes a block. Relaxed loads and stores keep the
+ * reads from la_profile_dump well defined without a locked add on the hot
+ * path. */
+#if defined(__GNUC__)
+#define LA_LOAD_RELAXED(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define LA_STORE_RELAXED(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#else
+#define LA_LOAD_RELAXED(p) (*(volatile uint64_t *)(p))
+#define LA_STORE_RELAXED(p, v) (*(volatile uint64_t *)(p) = (v))
+#endif
+
+typedef struct la_profile_block {
+  uint64_t calls[LA_PROFILE_COUNT];
+  uint64_t cycles[LA_PROFILE_COUNT];
+  struct la_profile_block *next;
+} la_profile_block;
+
+/* A block is pushed onto this list on a thread's first profiled call and
+ * never freed, so the counts of threads that have exited stay in the
+ * totals. */
+static la_profile_block *la_profile_blocks;
+static LA_THREAD_LOCAL la_profile_block *la_profile_tls;
+/* Counts of threads that could not allocate a block, which are dropped. */
+static LA_THREAD_LOCAL la_profile_block la_profile_lost;
+
+static inline uint64_t la_profile_ticks(void) {
+#if defined(LA_PROFILE_RDTSC)
+  return __rdtsc();
+#elif defined(__aarch64__) && defined(__GNUC__)
+  uint64_t t;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(t));
+  return t;
+#else
+  struct timespec ts;
+#ifdef _WIN32
+  timespec_get(&ts, TIME_UTC);
+#else
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static la_profile_block *la_profile_register(void) {
+  la_profile_block *b = (la_profile_block *)calloc(1, sizeof(*b));
+  if (b == NULL) {
+    la_profile_tls = &la_profile_lost;
+    return la_profile_tls;
+  }
+#if defined(__GNUC__)
+  b->next = __atomic_load_n(&la_profile_blocks, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&la_profile_blocks, &b->next, b, 0,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+#else
+  la_profile_block *head;
+  do {
+    head = la_profile_blocks;
+    b->next = head;
+  } while (_InterlockedCompareExchangePointer(
+               (void *volatile *)&la_profile_blocks, b, head) != head);
+#endif
+  la_profile_tls = b;
+  return b;
+}
+
+static la_profile_block *la_profile_head(void) {
+#if defined(__GNUC__)
+  return __atomic_load_n(&la_profile_blocks, __ATOMIC_ACQUIRE);
+#else
+  return *(la_profile_block *volatile *)&la_profile_blocks;
+#endif
+}
+
+static inline void la_profile_add(int id, uint64_t t0) {
+  const uint64_t t = la_profile_ticks() - t0;
+  la_profile_block *b = la_profile_tls;
+  if (b == NULL) {
+    b = la_profile_register();
+  }
+  LA_STORE_RELAXED(&b->calls[id], LA_LOAD_RELAXED(&b->calls[id]) + 1);
+  LA_STORE_RELAXED(&b->cycles[id], LA_LOAD_RELAXED(&b->cycles[id]) + t);
+}
+
+#define LA_PROFILE_ENTER(name)                                                 \
+  const uint64_t la_profile_t0 = la_profile_ticks()
+#define LA_PROFILE_LEAVE(name)                                                 \
+  la_profile_add(la_profile_id_##name, la_profile_t0)
+#else
+#define LA_PROFILE_ENTER(name) (void)0
+#define LA_PROFILE_LEAVE(name) (void)0
+#endif
+
+/* A float vector of the widest enabled backend, used to write the batch
+ * kernels once for all backends. LA_VF_WIDTH is not defined when there is no
+ * SIMD backend, in which case only the scalar loops are compiled. Masks are
+ * vectors with all bits of a lane set or clear. la_vf_bits_to_float reads the
+ * bits of each lane as an int32 and converts it, la_vf_float_to_bits does the
+ * reverse; both are exact for integers below 2^24 times a power of two, such
+ * as an exponent field. */
+#if defined(LA_USE_AVX)
+#define LA_VF_WIDTH 8
+typedef __m256 la_vf;
+static inline la_vf la_vf_load(const float *p) { return _mm256_loadu_ps(p); }
+static inline void la_vf_store(float *p, la_vf a) { _mm256_storeu_ps(p, a); }
+static inline la_vf la_vf_set1(float f) { return _mm256_set1_ps(f); }
+static inline la_vf la_vf_add(la_vf a, la_vf b) { return _mm256_add_ps(a, b); }
+static inline la_vf la_vf_sub(la_vf a, la_vf b) { return _mm256_sub_ps(a, b); }
+static inline la_vf la_vf_mul(la_vf a, la_vf b) { return _mm256_mul_ps(a, b); }
+static inline la_vf la_vf_div(la_vf a, la_vf b) { return _mm256_div_ps(a, b); }
+static inline la_vf la_vf_min(la_vf a, la_vf b) { return _mm256_min_ps(a, b); }
+static inline la_vf la_vf_max(la_vf a, la_vf b) { return _mm256_max_ps(a, b); }
+static inline la_vf la_vf_sqrt(la_vf a) { return _mm256_sqrt_ps(a); }
+static inline la_vf la_vf_rsqrt_estimate(la_vf a) { return _mm256_rsqrt_ps(a); }
+static inline la_vf la_vf_lt(la_vf a, la_vf b) {
+  return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+static inline la_vf la_vf_le(la_vf a, la_vf b) {
+  return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+}
+static inline la_vf la_vf_and(la_vf a, la_vf b) { return _mm256_and_ps(a, b); }
+static inline la_vf la_vf_or(la_vf a, la_vf b) { return _mm256_or_ps(a, b); }
+static inline la_vf la_vf_andnot(la_vf a, la_vf b) {
+  return _mm256_andnot_ps(a, b);
+}
+/* Bitwise rather than _mm256_blendv_ps: when the mask comes straight from a
+ * comparison, GCC 12 folds the pair and, without AVX2, expands the blend
+ * lane by lane with branches. */
+static inline la_vf la_vf_select(la_vf mask, la_vf a, la_vf b) {
+  return _mm256_or_ps(_mm256_and_ps(mask, a), _mm256_andnot_ps(mask, b));
+}
+static inline int la_vf_movemask(la_vf mask) {
+  return _mm256_movemask_ps(mask);
+}
+static inline la_vf la_vf_bits_to_float(la_vf a) {
+  return _mm256_cvtepi32_ps(_mm256_castps_si256(a));
+}
+static inline la_vf la_vf_float_to_bits(la_vf a) {
+  return _mm256_castsi256_ps(_mm256_cvtps_epi32(a));
+}
+#elif defined(LA_USE_SSE2)
+#define LA_VF_WIDTH 4
+typedef __m128 la_vf;
+static inline la_vf la_vf_load(const float *p) { return _mm_loadu_ps(p); }
+static inline void la_vf_store(float *p, la_vf a) { _mm_storeu_ps(p, a); }
+static inline la_vf la_vf_set1(float f) { return _mm_set1_ps(f); }
+static inline la_vf la_vf_add(la_vf a, la_vf b) { return _mm_add_ps(a, b); }
+static inline la_vf la_vf_sub(la_vf a, la_vf b) { return _mm_sub_ps(a, b); }
+static inline la_vf la_vf_mul(la_vf a, la_vf b) { return _mm_mul_ps(a, b); }
+static inline la_vf la_vf_div(la_vf a, la_vf b) { return _mm_div_ps(a, b); }
+static inline la_vf la_vf_min(la_vf a, la_vf b) { return _mm_min_ps(a, b); }
+static inline la_vf la_vf_max(la_vf a, la_vf b) { return _mm_max_ps(a, b); }
+static inline la_vf la_vf_sqrt(la_vf a) { return _mm_sqrt_ps(a); }
+static inline la_vf la_vf_rsqrt_estimate(la_vf a) { return _mm_rsqrt_ps(a); }
+static inline la_vf la_vf_lt(la_vf a, la_vf b) { return _mm_cmplt_ps(a, b); }
+static inline la_vf la_vf_le(la_vf a, la_vf b) { return _mm_cmple_ps(a, b); }
+static inline la_vf la_vf_and(la_vf a, la_vf b) { return _mm_and_ps(a, b); }
+static inline la_vf la_vf_or(la_vf a, la_vf b) { return _mm_or_ps(a, b); }
+static inline la_vf la_vf_andnot(la_vf a, la_vf b) {
+  return _mm_andnot_ps(a, b);
+}
+static inline la_vf la_vf_select(la_vf mask, la_vf a, la_vf b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+static inline int la_vf_movemask(la_vf mask) { return _mm_movemask_ps(mask); }
+static inline la_vf la_vf_bits_to_float(la_vf a) {
+  return _mm_cvtepi32_ps(_mm_castps_si128(a));
+}
+static inline la_vf la_vf_float_to_bits(la_vf a) {
+  return _mm_castsi128_ps(_mm_cvtps_epi32(a));
+}
+#elif defined(LA_USE_NEON) && defined(__aarch64__)
+#define LA_VF_WIDTH 4
+typedef float32x4_t la_vf;
+static inline la_vf la_vf_load(const float *p) { return vld1q_f32(p); }
+static inline void la_vf_store(float *p, la_vf a) { vst1q_f32(p, a); }
+static inline la_vf la_vf_set1(float f) { return vdupq_n_f32(f); }
+static inline la_vf la_vf_add(la_vf a, la_vf b) { return vaddq_f32(a, b); }
+static inline la_vf la_vf_sub(la_vf a, la_vf b) { return vsubq_f32(a, b); }
+static inline la_vf la_vf_mul(la_vf a, la_vf b) { return vmulq_f32(a, b); }
+static inline la_vf la_vf_div(la_vf a, la_vf b) { return vdivq_f32(a, b); }
+static inline la_vf la_vf_min(la_vf a, la_vf b) { return vminq_f32(a, b); }
+static inline la_vf la_vf_max(la_vf a, la_vf b) { return vmaxq_f32(a, b); }
+static inline la_vf la_vf_sqrt(la_vf a) { return vsqrtq_f32(a); }
+static inline la_vf la_vf_rsqrt_estimate(la_vf a) {
+  la_vf y = vrsqrteq_f32(a);
+  return vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(a, y), y));
+}
+static inline la_vf la_vf_lt(la_vf a, la_vf b) {
+  return vreinterpretq_f32_u32(vcltq_f32(a, b));
+}
+static inline la_vf la_vf_le(la_vf a, la_vf b) {
+  return vreinterpretq_f32_u32(vcleq_f32(a, b));
+}
+static inline la_vf la_vf_and(la_vf a, la_vf b) {
+  return vreinterpretq_f32_u32(
+      vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+static inline la_vf la_vf_or(la_vf a, la_vf b) {
+  return vreinterpretq_f32_u32(
+      vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+static inline la_vf la_vf_andnot(la_vf a, la_vf b) {
+  return vreinterpretq_f32_u32(
+      vbicq_u32(vreinterpretq_u32_f32(b), vreinterpretq_u32_f32(a)));
+}
+static inline la_vf la_vf_select(la_vf mask, la_vf a, la_vf b) {
+  return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+}
+static inline int la_vf_movemask(la_vf mask) {
+  static const uint32_t bits[4] = {1, 2, 4, 8};
+  return (int)vaddvq_u32(
+      vandq_u32(vreinterpretq_u32_f32(mask), vld1q_u32(bits)));
+}
+static inline la_vf la_vf_bits_to_float(la_vf a) {
+  return vcvtq_f32_s32(vreinterpretq_s32_f32(a));
+}
+static inline la_vf la_vf_float_to_bits(la_vf a) {
+  return vreinterpretq_f32_s32(vcvtnq_s32_f32(a));
+}
+#endif
+
+#ifdef LA_VF_WIDTH
+/* 1 / sqrt(a) with one Newton-Raphson step, matching la_rsqrt_approx. */
+static inline la_vf la_vf_rsqrt(la_vf a) {
+  const la_vf y = la_vf_rsqrt_estimate(a);
+  const la_vf hxyy =
+      la_vf_mul(la_vf_mul(la_vf_mul(la_vf_set1(0.5f), a), y), y);
+  return la_vf_mul(y, la_vf_sub(la_vf_set1(1.5f), hxyy));
+}
+#endif
+
+/* Number of elements staged through the stack when AoS data is transposed
+ * to SoA for a batch kernel. */
+#define LA_AOS_BLOCK 256
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_feq(float f1, float f2) { return fabs(f1 - f2) < FLT_EPSILON; }
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_printm4(const la_mat4 m) {
+  printf("{ ");
+  for (int i = 0; i < 4; i++) {
+    printf("{ %f %f %f %f } ", m.elem[i][0], m.elem[i][1], m.elem[i][2],
+           m.elem[i][3]);
+  }
+  printf("}\n");
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_printvn(const float *v, size_t n) {
+  printf("{ ");
+  for (size_t i = 0; i < n; i++) {
+    printf("%f ", v[i]);
+  }
+  printf("}\n");
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_radians(const float degrees) { return (degrees * M_PI) / 180.0f; }
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+size_t la_profile_dump(la_profile_entry *entries, size_t max) {
+#ifdef LA_PROFILE
+#define LA_PROFILE_NAME(name) #name,
+  static const char *const names[] = {LA_PROFILE_FUNCS(LA_PROFILE_NAME)};
+#undef LA_PROFILE_NAME
+  const size_t n = max < LA_PROFILE_COUNT ? max : LA_PROFILE_COUNT;
+  for (size_t i = 0; i < n; i++) {
+    entries[i].name = names[i];
+    entries[i].calls = 0;
+    entries[i].cycles = 0;
+  }
+  la_profile_block *b = la_profile_head();
+  for (; b != NULL; b = b->next) {
+    for (size_t i = 0; i < n; i++) {
+      entries[i].calls += LA_LOAD_RELAXED(&b->calls[i]);
+      entries[i].cycles += LA_LOAD_RELAXED(&b->cycles[i]);
+    }
+  }
+  return LA_PROFILE_COUNT;
+#else
+  (void)entries;
+  (void)max;
+  return 0;
+#endif
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_profile_reset(void) {
+#ifdef LA_PROFILE
+  la_profile_block *b = la_profile_head();
+  for (; b != NULL; b = b->next) {
+    for (size_t i = 0; i < LA_PROFILE_COUNT; i++) {
+      LA_STORE_RELAXED(&b->calls[i], 0);
+      LA_STORE_RELAXED(&b->cycles[i], 0);
+    }
+  }
+#endif
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_profile_print(void) {
+#ifdef LA_PROFILE
+  la_profile_entry entries[LA_PROFILE_COUNT];
+  la_profile_dump(entries, LA_PROFILE_COUNT);
+  for (size_t i = 0; i < LA_PROFILE_COUNT; i++) {
+    if (entries[i].calls > 0) {
+      printf("%-28s %12llu calls %12.1f cycles/call\n", entries[i].name,
+             (unsigned long long)entries[i].calls,
+             (double)entries[i].cycles / (double)entries[i].calls);
+    }
+  }
+#endif
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_rsqrt_approx(const float x) {
+#if defined(LA_USE_SSE2)
+  const float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+  return y * (1.5f - 0.5f * x * y * y);
+#elif defined(LA_USE_NEON)
+  float32x2_t v = vdup_n_f32(x);
+  float32x2_t y = vrsqrte_f32(v);
+  y = vmul_f32(y, vrsqrts_f32(vmul_f32(v, y), y));
+  y = vmul_f32(y, vrsqrts_f32(vmul_f32(v, y), y));
+  return vget_lane_f32(y, 0);
+#else
+  uint32_t i;
+  float y;
+  memcpy(&i, &x, sizeof(i));
+  i = 0x5f375a86u - (i >> 1);
+  memcpy(&y, &i, sizeof(y));
+  y = y * (1.5f - 0.5f * x * y * y);
+  y = y * (1.5f - 0.5f * x * y * y);
+  y = y * (1.5f - 0.5f * x * y * y);
+  return y;
+#endif
+}
+
+/* The quadrant of x and the sin and cos polynomials of x reduced to
+ * [-pi/4, pi/4]. pi/2 is split into three parts (Cody-Waite) so that the
+ * reduction stays accurate for large x. */
+typedef struct la_sincos {
+  int quadrant;
+  float s;
+  float c;
+} la_sincos;
+
+static la_sincos la_sincos_approx(const float x) {
+  la_sincos sc;
+  if (!(fabsf(x) <= LA_TRIG_APPROX_MAX)) {
+    sc.quadrant = 0;
+    sc.s = sc.c = NAN;
+    return sc;
+  }
+  const int k = (int)(x * 0.636619772f + (x >= 0.0f ? 0.5f : -0.5f));
+  const float fk = (float)k;
+  float r = x - fk * 1.5703125f;
+  r -= fk * 4.83751296997e-4f;
+  r -= fk * 7.54978995489e-8f;
+
+  const float r2 = r * r;
+  sc.quadrant = k & 3;
+  sc.s = r + r * r2 *
+                 (-1.6666654611e-1f +
+                  r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+  sc.c = 1.0f - 0.5f * r2 +
+         r2 * r2 *
+             (4.166664568298827e-2f +
+              r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+  return sc;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_sin_approx(const float x) {
+  const la_sincos sc = la_sincos_approx(x);
+  switch (sc.quadrant) {
+    case 0:
+      return sc.s;
+    case 1:
+      return sc.c;
+    case 2:
+      return -sc.s;
+    default:
+      return -sc.c;
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_cos_approx(const float x) {
+  const la_sincos sc = la_sincos_approx(x);
+  switch (sc.quadrant) {
+    case 0:
+      return sc.c;
+    case 1:
+      return -sc.s;
+    case 2:
+      return -sc.c;
+    default:
+      return sc.s;
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_tan_approx(const float x) {
+  const la_sincos sc = la_sincos_approx(x);
+  return (sc.quadrant & 1) ? -sc.c / sc.s : sc.s / sc.c;
+}
+
+#ifdef LA_FAST_MATH
+#define LA_SIN(x) la_sin_approx(x)
+#define LA_COS(x) la_cos_approx(x)
+#define LA_TAN(x) la_tan_approx(x)
+#else
+#define LA_SIN(x) sin(x)
+#define LA_COS(x) cos(x)
+#define LA_TAN(x) tan(x)
+#endif
+
+/* A matrix is singular when the magnitude of its determinant is at most
+ * LA_SINGULAR_ULPS machine epsilons times the product of its row lengths,
+ * the largest the determinant can be for those rows. An exact test for zero
+ * lets matrices that are singular up to rounding through, with a huge
+ * inverse. */
+#define LA_SINGULAR_ULPS 8
+
+/* The templates of the type-generic functions, see LA_DECLARE_FUNCS. */
+#define LA_IMPLEMENT_FUNCS(T, S, vec3, vec4, mat4, EPSILON, SQRT, SIN, COS,   \
+                           TAN)                                                \
+mat4 la_identitym4##S(void) {                                                  \
+  mat4 m = {{{0}}};                                                            \
+  for (size_t i = 0; i < 4; i++) {                                             \
+    m.elem[i][i] = 1;                                                          \
+  }                                                                            \
+  return m;                                                                    \
+}                                                                              \
+                                                                               \
+mat4 la_productm4##S(const mat4 m1, const mat4 m2) {                           \
+  mat4 r = {{{0}}};                                                            \
+  for (size_t i = 0; i < 4; i++) {                                             \
+    for (size_t j = 0; j < 4; j++) {                                           \
+      for (size_t k = 0; k < 4; k++) {                                         \
+        r.elem[i][k] += m1.elem[i][j] * m2.elem[j][k];                         \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+  return r;                                                                    \
+}                                                                              \
+                                                                               \
+vec4 la_productm4v4##S(const mat4 m, const vec4 v) {                           \
+  vec4 r = {{{0}}};                                                            \
+  for (size_t i = 0; i < 4; i++) {                                             \
+    for (size_t j = 0; j < 4; j++) {                                           \
+      r.elem[i] += m.elem[i][j] * v.elem[j];                                   \
+    }                                                                          \
+  }                                                                            \
+  return r;                                                                    \
+}                                                                              \
+                                                                               \
+mat4 la_transposem4##S(const mat4 m) {                                         \
+  mat4 r;                                                                      \
+  for (size_t i = 0; i < 4; i++) {                                             \
+    for (size_t j = 0; j < 4; j++) {                                           \
+      r.elem[i][j] = m.elem[j][i];                                             \
+    }                                                                          \
+  }                                                                            \
+  return r;                                                                    \
+}                                                                              \
+                                                                               \
+/* The 2x2 sub-determinants of the first two and last two rows. */             \
+static void la_subdets##S(const mat4 *m, T s[6], T c[6]) {                     \
+  const T(*a)[4] = m->elem;                                                    \
+  s[0] = a[0][0] * a[1][1] - a[1][0] * a[0][1];                                \
+  s[1] = a[0][0] * a[1][2] - a[1][0] * a[0][2];                                \
+  s[2] = a[0][0] * a[1][3] - a[1][0] * a[0][3];                                \
+  s[3] = a[0][1] * a[1][2] - a[1][1] * a[0][2];                                \
+  s[4] = a[0][1] * a[1][3] - a[1][1] * a[0][3];                                \
+  s[5] = a[0][2] * a[1][3] - a[1][2] * a[0][3];                                \
+  c[0] = a[2][0] * a[3][1] - a[3][0] * a[2][1];                                \
+  c[1] = a[2][0] * a[3][2] - a[3][0] * a[2][2];                                \
+  c[2] = a[2][0] * a[3][3] - a[3][0] * a[2][3];                                \
+  c[3] = a[2][1] * a[3][2] - a[3][1] * a[2][2];                                \
+  c[4] = a[2][1] * a[3][3] - a[3][1] * a[2][3];                                \
+  c[5] = a[2][2] * a[3][3] - a[3][2] * a[2][3];                                \
+}                                                                              \
+                                                                               \
+T la_determinantm4##S(const mat4 m) {                                          \
+  T s[6];                                                                      \
+  T c[6];                                                                      \
+  la_subdets##S(&m, s, c);                                                     \
+  return s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] -               \
+         s[4] * c[1] + s[5] * c[0];                                            \
+}                                                                              \
+                                                                               \
+mat4 la_inversem4##S(const mat4 m, int *invertible) {                          \
+  T s[6];                                                                      \
+  T c[6];                                                                      \
+  la_subdets##S(&m, s, c);                                                     \
+  const T det = s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] -        \
+                s[4] * c[1] + s[5] * c[0];                                     \
+  const T(*a)[4] = m.elem;                                                     \
+  double scale = 1;                                                            \
+  for (size_t i = 0; i < 4; i++) {                                             \
+    double l2 = 0;                                                             \
+    for (size_t j = 0; j < 4; j++) {                                           \
+      l2 += (double)a[i][j] * a[i][j];                                         \
+    }                                                                          \
+    scale *= sqrt(l2);                                                         \
+  }                                                                            \
+  const int singular =                                                         \
+      !((det < 0 ? -det : det) > LA_SINGULAR_ULPS * EPSILON * scale);          \
+  if (invertible != NULL) {                                                    \
+    *invertible = !singular;                                                   \
+  }                                                                            \
+  if (singular) {                                                              \
+    return la_identitym4##S();                                                 \
+  }                                                                            \
+  const T d = 1 / det;                                                         \
+  mat4 r;                                                                      \
+  r.elem[0][0] = (a[1][1] * c[5] - a[1][2] * c[4] + a[1][3] * c[3]) * d;       \
+  r.elem[0][1] = (-a[0][1] * c[5] + a[0][2] * c[4] - a[0][3] * c[3]) * d;      \
+  r.elem[0][2] = (a[3][1] * s[5] - a[3][2] * s[4] + a[3][3] * s[3]) * d;       \
+  r.elem[0][3] = (-a[2][1] * s[5] + a[2][2] * s[4] - a[2][3] * s[3]) * d;      \
+  r.elem[1][0] = (-a[1][0] * c[5] + a[1][2] * c[2] - a[1][3] * c[1]) * d;      \
+  r.elem[1][1] = (a[0][0] * c[5] - a[0][2] * c[2] + a[0][3] * c[1]) * d;       \
+  r.elem[1][2] = (-a[3][0] * s[5] + a[3][2] * s[2] - a[3][3] * s[1]) * d;      \
+  r.elem[1][3] = (a[2][0] * s[5] - a[2][2] * s[2] + a[2][3] * s[1]) * d;       \
+  r.elem[2][0] = (a[1][0] * c[4] - a[1][1] * c[2] + a[1][3] * c[0]) * d;       \
+  r.elem[2][1] = (-a[0][0] * c[4] + a[0][1] * c[2] - a[0][3] * c[0]) * d;      \
+  r.elem[2][2] = (a[3][0] * s[4] - a[3][1] * s[2] + a[3][3] * s[0]) * d;       \
+  r.elem[2][3] = (-a[2][0] * s[4] + a[2][1] * s[2] - a[2][3] * s[0]) * d;      \
+  r.elem[3][0] = (-a[1][0] * c[3] + a[1][1] * c[1] - a[1][2] * c[0]) * d;      \
+  r.elem[3][1] = (a[0][0] * c[3] - a[0][1] * c[1] + a[0][2] * c[0]) * d;       \
+  r.elem[3][2] = (-a[3][0] * s[3] + a[3][1] * s[1] - a[3][2] * s[0]) * d;      \
+  r.elem[3][3] = (a[2][0] * s[3] - a[2][1] * s[1] + a[2][2] * s[0]) * d;       \
+  return r;                                                                    \
+}                                                                              \
+                                                                               \
+mat4 la_translate##S(const mat4 m, const vec3 v) {                             \
+  mat4 r = m;                                                                  \
+  r.elem[3][0] += v.elem[0];                                                   \
+  r.elem[3][1] += v.elem[1];                                                   \
+  r.elem[3][2] += v.elem[2];                                                   \
+  return r;                                                                    \
+}                                                                              \
+                                                                               \
+T la_dotv3##S(const vec3 v1, const vec3 v2) {                                  \
+  return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;                              \
+}                                                                              \
+                                                                               \
+vec3 la_crossv3##S(const vec3 v1, const vec3 v2) {                             \
+  vec3 r = {{{(v1.y * v2.z) - (v1.z * v2.y), (v1.z * v2.x) - (v1.x * v2.z),    \
+              (v1.x * v2.y) - (v1.y * v2.x)}}};                                \
+  return r;                                                                    \
+}                                                                              \
+                                                                               \
+vec3 la_normalizev3##S(const vec3 v) {                                         \
+  const T l = SQRT(la_dotv3##S(v, v));                                         \
+  vec3 r = {{{v.x / l, v.y / l, v.z / l}}};                                    \
+  return r;                                                                    \
+}                                                                              \
+                                                                               \
+/* The rotation and scaling matrices la_rotate and la_scale multiply by. */    \
+static mat4 la_rotation##S(const vec3 axis, const T rads) {                    \
+  const T c = COS(rads);                                                       \
+  const T s = SIN(rads);                                                       \
+  const vec3 a = la_normalizev3##S(axis);                                      \
+  mat4 rot = {{{0}}};                                                          \
+  rot.elem[0][0] = c + (1 - c) * a.x * a.x;                                    \
+  rot.elem[0][1] = (1 - c) * a.x * a.y + s * a.z;                              \
+  rot.elem[0][2] = (1 - c) * a.x * a.z - s * a.y;                              \
+  rot.elem[1][0] = (1 - c) * a.y * a.x - s * a.z;                              \
+  rot.elem[1][1] = c + (1 - c) * a.y * a.y;                                    \
+  rot.elem[1][2] = (1 - c) * a.y * a.z + s * a.x;                              \
+  rot.elem[2][0] = (1 - c) * a.z * a.x + s * a.y;                              \
+  rot.elem[2][1] = (1 - c) * a.z * a.y - s * a.x;                              \
+  rot.elem[2][2] = c + (1 - c) * a.z * a.z;                                    \
+  rot.elem[3][3] = 1;                                                          \
+  return rot;                                                                  \
+}                                                                              \
+                                                                               \
+static mat4 la_scaling##S(const mat4 m, const vec3 v) {                        \
+  mat4 sm = la_identitym4##S();                                                \
+  sm.elem[0][0] = v.x;                                                         \
+  sm.elem[1][1] = v.y;                                                         \
+  sm.elem[2][2] = v.z;                                                         \
+  sm.elem[3][0] = m.elem[3][0];                                                \
+  sm.elem[3][1] = m.elem[3][1];                                                \
+  sm.elem[3][2] = m.elem[3][2];                                                \
+  sm.elem[3][3] = m.elem[3][3];                                                \
+  return sm;                                                                   \
+}                                                                              \
+                                                                               \
+mat4 la_rotate##S(const mat4 m, const vec3 axis, const T rads) {               \
+  return la_productm4##S(m, la_rotation##S(axis, rads));                       \
+}                                                                              \
+                                                                               \
+mat4 la_scale##S(const mat4 m, const vec3 v) {                                 \
+  return la_productm4##S(m, la_scaling##S(m, v));                              \
+}                                                                              \
+                                                                               \
+mat4 la_perspective##S(const T fov, const T aspect_ratio, const T near,        \
+                       const T far) {                                          \
+  const T t = TAN(fov / 2);                                                    \
+  mat4 m = {{{0}}};                                                            \
+  m.elem[0][0] = 1 / (aspect_ratio * t);                                       \
+  m.elem[1][1] = 1 / t;                                                        \
+  m.elem[2][2] = -(far + near) / (far - near);                                 \
+  m.elem[2][3] = -1;                                                           \
+  m.elem[3][2] = -(2 * far * near) / (far - near);                             \
+  return m;                                                                    \
+}                                                                              \
+                                                                               \
+mat4 la_orthographic##S(const T left, const T right, const T bottom,           \
+                        const T top, const T near, const T far) {              \
+  mat4 m = la_identitym4##S();                                                 \
+  m.elem[0][0] = 2 / (right - left);                                           \
+  m.elem[1][1] = 2 / (top - bottom);                                           \
+  m.elem[2][2] = -2 / (far - near);                                            \
+  m.elem[3][0] = -(right + left) / (right - left);                             \
+  m.elem[3][1] = -(top + bottom) / (top - bottom);                             \
+  m.elem[3][2] = -(far + near) / (far - near);                                 \
+  return m;                                                                    \
+}                                                                              \
+                                                                               \
+mat4 la_look_at##S(const vec3 eye, const vec3 ctr, const vec3 up) {            \
+  vec3 f = {{{ctr.x - eye.x, ctr.y - eye.y, ctr.z - eye.z}}};                  \
+  f = la_normalizev3##S(f);                                                    \
+  const vec3 s = la_normalizev3##S(la_crossv3##S(f, up));                      \
+  const vec3 u = la_crossv3##S(s, f);                                          \
+  mat4 m = la_identitym4##S();                                                 \
+  m.elem[0][0] = s.x;                                                          \
+  m.elem[1][0] = s.y;                                                          \
+  m.elem[2][0] = s.z;                                                          \
+  m.elem[0][1] = u.x;                                                          \
+  m.elem[1][1] = u.y;                                                          \
+  m.elem[2][1] = u.z;                                                          \
+  m.elem[0][2] = -f.x;                                                         \
+  m.elem[1][2] = -f.y;                                                         \
+  m.elem[2][2] = -f.z;                                                         \
+  m.elem[3][0] = -la_dotv3##S(s, eye);                                         \
+  m.elem[3][1] = -la_dotv3##S(u, eye);                                         \
+  m.elem[3][2] = la_dotv3##S(f, eye);                                          \
+  return m;                                                                    \
+}
+
+/* The float instantiation is the _scalar reference implementations. The
+ * public float functions are these, or SIMD versions that match them. */
+LA_IMPLEMENT_FUNCS(float, _scalar, la_vec3, la_vec4, la_mat4, FLT_EPSILON,
+                   sqrtf, LA_SIN, LA_COS, LA_TAN)
+LA_IMPLEMENT_FUNCS(double, _d, la_dvec3, la_dvec4, la_dmat4, DBL_EPSILON, sqrt,
+                   sin, cos, tan)
+
+/* The product of the lengths of the n rows of a, each stride floats apart.
+ * It bounds the magnitude of the determinant. Summed in double, where the
+ * squares of large elements do not overflow. */
+static double la_row_lengths(const float *a, size_t n, size_t stride) {
+  double r = 1.0;
+  for (size_t i = 0; i < n; i++) {
+    double l2 = 0.0;
+    for (size_t j = 0; j < n; j++) {
+      l2 += (double)a[i * stride + j] * a[i * stride + j];
+    }
+    r *= sqrt(l2);
+  }
+  return r;
+}
+
+/* Whether det is zero relative to the product of the row lengths, scale. A
+ * NaN determinant counts as singular. */
+static int la_singular(float det, double scale) {
+  return !(fabsf(det) > LA_SINGULAR_ULPS * FLT_EPSILON * scale);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_identitym4(void) { return la_identitym4_scalar(); }
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec3 la_normalizev3(const la_vec3 v) {
+  LA_PROFILE_ENTER(la_normalizev3);
+#ifdef LA_FAST_MATH
+  const float r = la_rsqrt_approx(la_dotv3(v, v));
+  la_vec3 n = {.elem = {v.elem[0] * r, v.elem[1] * r, v.elem[2] * r}};
+#else
+  const la_vec3 n = la_normalizev3_scalar(v);
+#endif
+  LA_PROFILE_LEAVE(la_normalizev3);
+  return n;
+}
+
+/**
+ * ----------------------------------------------------------------------------
  */
 float la_dotvn(const float *v1, const float *v2, size_t n) {
   float res = 0.0f;
   for (size_t i = 0; i < n; i++) {
-    res += v1[i] * v2[i];
+    res += v1[i] * v2[i];
+  }
+  return res;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_dotv3(const la_vec3 v1, const la_vec3 v2) {
+  return la_dotv3_scalar(v1, v2);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_cmpv3(const la_vec3 v1, const la_vec3 v2) {
+  for (int i = 0; i < 3; i++) {
+    if (fabs(v1.elem[i] - v2.elem[i]) > FLT_EPSILON) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_cmpv2(const la_vec2 v1, const la_vec2 v2) {
+  for (int i = 0; i < 2; i++) {
+    if (fabs(v1.elem[i] - v2.elem[i]) > FLT_EPSILON) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_dotv4(const la_vec4 v1, const la_vec4 v2) {
+  return (v1.x * v2.x) + (v1.y * v2.y) + (v1.z * v2.z) + (v1.w * v2.w);
+}
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec3 la_crossv3(const struct la_vec3 v1, const struct la_vec3 v2) {
+  return la_crossv3_scalar(v1, v2);
+}
+
+/* Element-wise kernels over flat float arrays. Arrays of la_vec3 are flat
+ * arrays of 3n floats, so the AoS and SoA forms share them. */
+static void la_addf(const float *a, const float *b, float *out, size_t n) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    la_vf_store(out + i, la_vf_add(la_vf_load(a + i), la_vf_load(b + i)));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = a[i] + b[i];
+  }
+}
+
+static void la_subf(const float *a, const float *b, float *out, size_t n) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    la_vf_store(out + i, la_vf_sub(la_vf_load(a + i), la_vf_load(b + i)));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = a[i] - b[i];
+  }
+}
+
+static void la_scalef(const float *in, const float s, float *out, size_t n) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  const la_vf vs = la_vf_set1(s);
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    la_vf_store(out + i, la_vf_mul(la_vf_load(in + i), vs));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = in[i] * s;
+  }
+}
+
+static void la_lerpf(const float *a, const float *b, const float t,
+                     float *out, size_t n) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  const la_vf vt = la_vf_set1(t);
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const la_vf va = la_vf_load(a + i);
+    const la_vf d = la_vf_sub(la_vf_load(b + i), va);
+    la_vf_store(out + i, la_vf_add(va, la_vf_mul(d, vt)));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = a[i] + (b[i] - a[i]) * t;
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+static void la_normalizev3_soa_base(const float *x, const float *y,
+                                    const float *z, float *ox, float *oy,
+                                    float *oz, size_t n) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const la_vf vx = la_vf_load(x + i);
+    const la_vf vy = la_vf_load(y + i);
+    const la_vf vz = la_vf_load(z + i);
+    const la_vf d = la_vf_add(
+        la_vf_add(la_vf_mul(vx, vx), la_vf_mul(vy, vy)), la_vf_mul(vz, vz));
+#ifdef LA_FAST_MATH
+    const la_vf r = la_vf_rsqrt(d);
+    la_vf_store(ox + i, la_vf_mul(vx, r));
+    la_vf_store(oy + i, la_vf_mul(vy, r));
+    la_vf_store(oz + i, la_vf_mul(vz, r));
+#else
+    const la_vf l = la_vf_sqrt(d);
+    la_vf_store(ox + i, la_vf_div(vx, l));
+    la_vf_store(oy + i, la_vf_div(vy, l));
+    la_vf_store(oz + i, la_vf_div(vz, l));
+#endif
+  }
+#endif
+  for (; i < n; i++) {
+    la_vec3 v = {.elem = {x[i], y[i], z[i]}};
+    v = la_normalizev3(v);
+    ox[i] = v.x;
+    oy[i] = v.y;
+    oz[i] = v.z;
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_dotv3_soa(const float *ax, const float *ay, const float *az,
+                  const float *bx, const float *by, const float *bz,
+                  float *out, size_t n) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    la_vf d = la_vf_mul(la_vf_load(ax + i), la_vf_load(bx + i));
+    d = la_vf_add(d, la_vf_mul(la_vf_load(ay + i), la_vf_load(by + i)));
+    d = la_vf_add(d, la_vf_mul(la_vf_load(az + i), la_vf_load(bz + i)));
+    la_vf_store(out + i, d);
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i];
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_crossv3_soa(const float *ax, const float *ay, const float *az,
+                    const float *bx, const float *by, const float *bz,
+                    float *ox, float *oy, float *oz, size_t n) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const la_vf vax = la_vf_load(ax + i);
+    const la_vf vay = la_vf_load(ay + i);
+    const la_vf vaz = la_vf_load(az + i);
+    const la_vf vbx = la_vf_load(bx + i);
+    const la_vf vby = la_vf_load(by + i);
+    const la_vf vbz = la_vf_load(bz + i);
+    la_vf_store(ox + i,
+                la_vf_sub(la_vf_mul(vay, vbz), la_vf_mul(vaz, vby)));
+    la_vf_store(oy + i,
+                la_vf_sub(la_vf_mul(vaz, vbx), la_vf_mul(vax, vbz)));
+    la_vf_store(oz + i,
+                la_vf_sub(la_vf_mul(vax, vby), la_vf_mul(vay, vbx)));
+  }
+#endif
+  for (; i < n; i++) {
+    const float x = ay[i] * bz[i] - az[i] * by[i];
+    const float y = az[i] * bx[i] - ax[i] * bz[i];
+    const float z = ax[i] * by[i] - ay[i] * bx[i];
+    ox[i] = x;
+    oy[i] = y;
+    oz[i] = z;
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_addv3_soa(const float *ax, const float *ay, const float *az,
+                  const float *bx, const float *by, const float *bz,
+                  float *ox, float *oy, float *oz, size_t n) {
+  la_addf(ax, bx, ox, n);
+  la_addf(ay, by, oy, n);
+  la_addf(az, bz, oz, n);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_subv3_soa(const float *ax, const float *ay, const float *az,
+                  const float *bx, const float *by, const float *bz,
+                  float *ox, float *oy, float *oz, size_t n) {
+  la_subf(ax, bx, ox, n);
+  la_subf(ay, by, oy, n);
+  la_subf(az, bz, oz, n);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_scalev3_soa(const float *x, const float *y, const float *z,
+                    const float s, float *ox, float *oy, float *oz,
+                    size_t n) {
+  la_scalef(x, s, ox, n);
+  la_scalef(y, s, oy, n);
+  la_scalef(z, s, oz, n);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_lerpv3_soa(const float *ax, const float *ay, const float *az,
+                   const float *bx, const float *by, const float *bz,
+                   const float t, float *ox, float *oy, float *oz,
+                   size_t n) {
+  la_lerpf(ax, bx, t, ox, n);
+  la_lerpf(ay, by, t, oy, n);
+  la_lerpf(az, bz, t, oz, n);
+}
+
+/* Staging buffers for running the SoA kernels on AoS data. */
+typedef struct la_soa3_block {
+  float x[LA_AOS_BLOCK];
+  float y[LA_AOS_BLOCK];
+  float z[LA_AOS_BLOCK];
+} la_soa3_block;
+
+static void la_aos_to_soa3(const la_vec3 *in, la_soa3_block *b, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    b->x[i] = in[i].x;
+    b->y[i] = in[i].y;
+    b->z[i] = in[i].z;
+  }
+}
+
+static void la_soa3_to_aos(const la_soa3_block *b, la_vec3 *out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    out[i].x = b->x[i];
+    out[i].y = b->y[i];
+    out[i].z = b->z[i];
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_normalizev3_batch(const la_vec3 *in, la_vec3 *out, size_t n) {
+  LA_PROFILE_ENTER(la_normalizev3_batch);
+  la_soa3_block b;
+  for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+    const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+    la_aos_to_soa3(in + i, &b, m);
+    la_normalizev3_soa(b.x, b.y, b.z, b.x, b.y, b.z, m);
+    la_soa3_to_aos(&b, out + i, m);
+  }
+  LA_PROFILE_LEAVE(la_normalizev3_batch);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_dotv3_batch(const la_vec3 *a, const la_vec3 *b, float *out,
+                    size_t n) {
+  la_soa3_block ba;
+  la_soa3_block bb;
+  for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+    const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+    la_aos_to_soa3(a + i, &ba, m);
+    la_aos_to_soa3(b + i, &bb, m);
+    la_dotv3_soa(ba.x, ba.y, ba.z, bb.x, bb.y, bb.z, out + i, m);
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_crossv3_batch(const la_vec3 *a, const la_vec3 *b, la_vec3 *out,
+                      size_t n) {
+  la_soa3_block ba;
+  la_soa3_block bb;
+  for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+    const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+    la_aos_to_soa3(a + i, &ba, m);
+    la_aos_to_soa3(b + i, &bb, m);
+    la_crossv3_soa(ba.x, ba.y, ba.z, bb.x, bb.y, bb.z, ba.x, ba.y, ba.z, m);
+    la_soa3_to_aos(&ba, out + i, m);
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_addv3_batch(const la_vec3 *a, const la_vec3 *b, la_vec3 *out,
+                    size_t n) {
+  la_addf((const float *)a, (const float *)b, (float *)out, n * 3);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_subv3_batch(const la_vec3 *a, const la_vec3 *b, la_vec3 *out,
+                    size_t n) {
+  la_subf((const float *)a, (const float *)b, (float *)out, n * 3);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_scalev3_batch(const la_vec3 *in, const float s, la_vec3 *out,
+                      size_t n) {
+  la_scalef((const float *)in, s, (float *)out, n * 3);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_lerpv3_batch(const la_vec3 *a, const la_vec3 *b, const float t,
+                     la_vec3 *out, size_t n) {
+  la_lerpf((const float *)a, (const float *)b, t, (float *)out, n * 3);
+}
+
+#ifdef LA_USE_SSE2
+/**
+ * ----------------------------------------------------------------------------
+ * Each row of the result is a linear combination of the rows of m2, which
+ * keeps the summation order identical to the scalar loops.
+ */
+la_mat4 la_productm4_sse2(const la_mat4 m1, const la_mat4 m2) {
+  la_mat4 r;
+  const __m128 b0 = _mm_loadu_ps(m2.elem[0]);
+  const __m128 b1 = _mm_loadu_ps(m2.elem[1]);
+  const __m128 b2 = _mm_loadu_ps(m2.elem[2]);
+  const __m128 b3 = _mm_loadu_ps(m2.elem[3]);
+  for (size_t i = 0; i < 4; i++) {
+    __m128 row = _mm_mul_ps(_mm_set1_ps(m1.elem[i][0]), b0);
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m1.elem[i][1]), b1));
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m1.elem[i][2]), b2));
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m1.elem[i][3]), b3));
+    _mm_storeu_ps(r.elem[i], row);
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec4 la_productm4v4_sse2(const la_mat4 m, const la_vec4 v) {
+  la_vec4 res;
+  const __m128 x = _mm_loadu_ps(v.elem);
+  __m128 t0 = _mm_mul_ps(_mm_loadu_ps(m.elem[0]), x);
+  __m128 t1 = _mm_mul_ps(_mm_loadu_ps(m.elem[1]), x);
+  __m128 t2 = _mm_mul_ps(_mm_loadu_ps(m.elem[2]), x);
+  __m128 t3 = _mm_mul_ps(_mm_loadu_ps(m.elem[3]), x);
+  _MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+  _mm_storeu_ps(res.elem, _mm_add_ps(_mm_add_ps(_mm_add_ps(t0, t1), t2), t3));
+  return res;
+}
+#endif  // LA_USE_SSE2
+
+#ifdef LA_USE_AVX
+/**
+ * ----------------------------------------------------------------------------
+ * Computes two rows of the result per iteration. The rows of m2 are
+ * duplicated into both 128 bit lanes and the elements of m1 are broadcast
+ * within each lane.
+ */
+la_mat4 la_productm4_avx(const la_mat4 m1, const la_mat4 m2) {
+  la_mat4 r;
+  __m128 row;
+  row = _mm_loadu_ps(m2.elem[0]);
+  const __m256 b0 = _mm256_insertf128_ps(_mm256_castps128_ps256(row), row, 1);
+  row = _mm_loadu_ps(m2.elem[1]);
+  const __m256 b1 = _mm256_insertf128_ps(_mm256_castps128_ps256(row), row, 1);
+  row = _mm_loadu_ps(m2.elem[2]);
+  const __m256 b2 = _mm256_insertf128_ps(_mm256_castps128_ps256(row), row, 1);
+  row = _mm_loadu_ps(m2.elem[3]);
+  const __m256 b3 = _mm256_insertf128_ps(_mm256_castps128_ps256(row), row, 1);
+  for (size_t i = 0; i < 4; i += 2) {
+    const __m256 a = _mm256_loadu_ps(m1.elem[i]);
+    __m256 rows = _mm256_mul_ps(_mm256_shuffle_ps(a, a, 0x00), b0);
+    rows = _mm256_add_ps(rows,
+                         _mm256_mul_ps(_mm256_shuffle_ps(a, a, 0x55), b1));
+    rows = _mm256_add_ps(rows,
+                         _mm256_mul_ps(_mm256_shuffle_ps(a, a, 0xAA), b2));
+    rows = _mm256_add_ps(rows,
+                         _mm256_mul_ps(_mm256_shuffle_ps(a, a, 0xFF), b3));
+    _mm256_storeu_ps(r.elem[i], rows);
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec4 la_productm4v4_avx(const la_mat4 m, const la_vec4 v) {
+  la_vec4 res;
+  const __m128 x = _mm_loadu_ps(v.elem);
+  const __m256 xx = _mm256_insertf128_ps(_mm256_castps128_ps256(x), x, 1);
+  const __m256 t01 = _mm256_mul_ps(_mm256_loadu_ps(m.elem[0]), xx);
+  const __m256 t23 = _mm256_mul_ps(_mm256_loadu_ps(m.elem[2]), xx);
+  __m128 t0 = _mm256_castps256_ps128(t01);
+  __m128 t1 = _mm256_extractf128_ps(t01, 1);
+  __m128 t2 = _mm256_castps256_ps128(t23);
+  __m128 t3 = _mm256_extractf128_ps(t23, 1);
+  _MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+  _mm_storeu_ps(res.elem, _mm_add_ps(_mm_add_ps(_mm_add_ps(t0, t1), t2), t3));
+  return res;
+}
+#endif  // LA_USE_AVX
+
+#ifdef LA_USE_NEON
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_productm4_neon(const la_mat4 m1, const la_mat4 m2) {
+  la_mat4 r;
+  const float32x4_t b0 = vld1q_f32(m2.elem[0]);
+  const float32x4_t b1 = vld1q_f32(m2.elem[1]);
+  const float32x4_t b2 = vld1q_f32(m2.elem[2]);
+  const float32x4_t b3 = vld1q_f32(m2.elem[3]);
+  for (size_t i = 0; i < 4; i++) {
+    float32x4_t row = vmulq_n_f32(b0, m1.elem[i][0]);
+    row = vmlaq_n_f32(row, b1, m1.elem[i][1]);
+    row = vmlaq_n_f32(row, b2, m1.elem[i][2]);
+    row = vmlaq_n_f32(row, b3, m1.elem[i][3]);
+    vst1q_f32(r.elem[i], row);
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * vld4q_f32 de-interleaves the matrix so that val[j] holds column j.
+ */
+la_vec4 la_productm4v4_neon(const la_mat4 m, const la_vec4 v) {
+  la_vec4 res;
+  const float32x4x4_t c = vld4q_f32(&m.elem[0][0]);
+  float32x4_t r = vmulq_n_f32(c.val[0], v.elem[0]);
+  r = vmlaq_n_f32(r, c.val[1], v.elem[1]);
+  r = vmlaq_n_f32(r, c.val[2], v.elem[2]);
+  r = vmlaq_n_f32(r, c.val[3], v.elem[3]);
+  vst1q_f32(res.elem, r);
+  return res;
+}
+#endif  // LA_USE_NEON
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_productm4(const la_mat4 m1, const la_mat4 m2) {
+  LA_PROFILE_ENTER(la_productm4);
+#if defined(LA_USE_AVX)
+  const la_mat4 r = la_productm4_avx(m1, m2);
+#elif defined(LA_USE_SSE2)
+  const la_mat4 r = la_productm4_sse2(m1, m2);
+#elif defined(LA_USE_NEON)
+  const la_mat4 r = la_productm4_neon(m1, m2);
+#else
+  const la_mat4 r = la_productm4_scalar(m1, m2);
+#endif
+  LA_PROFILE_LEAVE(la_productm4);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec4 la_productm4v4(const la_mat4 m, const la_vec4 v) {
+  LA_PROFILE_ENTER(la_productm4v4);
+#if defined(LA_USE_AVX)
+  const la_vec4 r = la_productm4v4_avx(m, v);
+#elif defined(LA_USE_SSE2)
+  const la_vec4 r = la_productm4v4_sse2(m, v);
+#elif defined(LA_USE_NEON)
+  const la_vec4 r = la_productm4v4_neon(m, v);
+#else
+  const la_vec4 r = la_productm4v4_scalar(m, v);
+#endif
+  LA_PROFILE_LEAVE(la_productm4v4);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_transposem4(const la_mat4 m) {
+  LA_PROFILE_ENTER(la_transposem4);
+  la_mat4 r;
+#if defined(LA_USE_SSE2)
+  __m128 r0 = _mm_loadu_ps(m.elem[0]);
+  __m128 r1 = _mm_loadu_ps(m.elem[1]);
+  __m128 r2 = _mm_loadu_ps(m.elem[2]);
+  __m128 r3 = _mm_loadu_ps(m.elem[3]);
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+  _mm_storeu_ps(r.elem[0], r0);
+  _mm_storeu_ps(r.elem[1], r1);
+  _mm_storeu_ps(r.elem[2], r2);
+  _mm_storeu_ps(r.elem[3], r3);
+#else
+  r = la_transposem4_scalar(m);
+#endif
+  LA_PROFILE_LEAVE(la_transposem4);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_determinantm4(const la_mat4 m) { return la_determinantm4_scalar(m); }
+
+#ifdef LA_USE_SSE2
+#define LA_SHUFFLE_MASK(x, y, z, w) ((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+#define LA_SWIZZLE(v, x, y, z, w)                          \
+  _mm_castsi128_ps(_mm_shuffle_epi32(_mm_castps_si128(v), \
+                                     LA_SHUFFLE_MASK(x, y, z, w)))
+#define LA_SHUFFLE(v1, v2, x, y, z, w) \
+  _mm_shuffle_ps(v1, v2, LA_SHUFFLE_MASK(x, y, z, w))
+
+/* 2x2 matrices are stored row major in a single register. */
+
+/* a * b */
+static inline __m128 la_mat2_mul_sse2(__m128 a, __m128 b) {
+  return _mm_add_ps(_mm_mul_ps(a, LA_SWIZZLE(b, 0, 3, 0, 3)),
+                    _mm_mul_ps(LA_SWIZZLE(a, 1, 0, 3, 2),
+                               LA_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+/* adjugate(a) * b */
+static inline __m128 la_mat2_adjmul_sse2(__m128 a, __m128 b) {
+  return _mm_sub_ps(_mm_mul_ps(LA_SWIZZLE(a, 3, 3, 0, 0), b),
+                    _mm_mul_ps(LA_SWIZZLE(a, 1, 1, 2, 2),
+                               LA_SWIZZLE(b, 2, 3, 0, 1)));
+}
+
+/* a * adjugate(b) */
+static inline __m128 la_mat2_muladj_sse2(__m128 a, __m128 b) {
+  return _mm_sub_ps(_mm_mul_ps(a, LA_SWIZZLE(b, 3, 0, 3, 0)),
+                    _mm_mul_ps(LA_SWIZZLE(a, 1, 0, 3, 2),
+                               LA_SWIZZLE(b, 2, 1, 2, 1)));
+}
+
+/* The squares of the low and high halves of a row, in double. */
+static inline __m128d la_row_norm2_sse2(__m128 r) {
+  const __m128d lo = _mm_cvtps_pd(r);
+  const __m128d hi = _mm_cvtps_pd(_mm_movehl_ps(r, r));
+  return _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi));
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * Block inversion: with m = | A B | split into 2x2 blocks, the blocks of the
+ *                          | C D |
+ * adjugate are built from the four block determinants and 2x2 adjugate
+ * products, so no 3x3 cofactors are needed.
+ */
+la_mat4 la_inversem4_sse2(const la_mat4 m, int *invertible) {
+  const __m128 r0 = _mm_loadu_ps(m.elem[0]);
+  const __m128 r1 = _mm_loadu_ps(m.elem[1]);
+  const __m128 r2 = _mm_loadu_ps(m.elem[2]);
+  const __m128 r3 = _mm_loadu_ps(m.elem[3]);
+
+  const __m128 a = _mm_movelh_ps(r0, r1);
+  const __m128 b = _mm_movehl_ps(r1, r0);
+  const __m128 c = _mm_movelh_ps(r2, r3);
+  const __m128 d = _mm_movehl_ps(r3, r2);
+
+  // (|A|, |B|, |C|, |D|)
+  const __m128 det_sub =
+      _mm_sub_ps(_mm_mul_ps(LA_SHUFFLE(r0, r2, 0, 2, 0, 2),
+                            LA_SHUFFLE(r1, r3, 1, 3, 1, 3)),
+                 _mm_mul_ps(LA_SHUFFLE(r0, r2, 1, 3, 1, 3),
+                            LA_SHUFFLE(r1, r3, 0, 2, 0, 2)));
+  const __m128 det_a = LA_SWIZZLE(det_sub, 0, 0, 0, 0);
+  const __m128 det_b = LA_SWIZZLE(det_sub, 1, 1, 1, 1);
+  const __m128 det_c = LA_SWIZZLE(det_sub, 2, 2, 2, 2);
+  const __m128 det_d = LA_SWIZZLE(det_sub, 3, 3, 3, 3);
+
+  const __m128 d_c = la_mat2_adjmul_sse2(d, c);
+  const __m128 a_b = la_mat2_adjmul_sse2(a, b);
+
+  __m128 x = _mm_sub_ps(_mm_mul_ps(det_d, a), la_mat2_mul_sse2(b, d_c));
+  __m128 w = _mm_sub_ps(_mm_mul_ps(det_a, d), la_mat2_mul_sse2(c, a_b));
+  __m128 y = _mm_sub_ps(_mm_mul_ps(det_b, c), la_mat2_muladj_sse2(d, a_b));
+  __m128 z = _mm_sub_ps(_mm_mul_ps(det_c, b), la_mat2_muladj_sse2(a, d_c));
+
+  // |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+  __m128 tr = _mm_mul_ps(a_b, LA_SWIZZLE(d_c, 0, 2, 1, 3));
+  tr = _mm_add_ps(tr, LA_SWIZZLE(tr, 2, 3, 0, 1));
+  tr = _mm_add_ps(tr, LA_SWIZZLE(tr, 1, 0, 3, 2));
+  const __m128 det = _mm_sub_ps(
+      _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+
+  // The product of the row lengths, in double like la_row_lengths
+  const __m128d n0 = la_row_norm2_sse2(r0);
+  const __m128d n1 = la_row_norm2_sse2(r1);
+  const __m128d n2 = la_row_norm2_sse2(r2);
+  const __m128d n3 = la_row_norm2_sse2(r3);
+  const __m128d l01 = _mm_sqrt_pd(
+      _mm_add_pd(_mm_unpacklo_pd(n0, n1), _mm_unpackhi_pd(n0, n1)));
+  const __m128d l23 = _mm_sqrt_pd(
+      _mm_add_pd(_mm_unpacklo_pd(n2, n3), _mm_unpackhi_pd(n2, n3)));
+  __m128d scale = _mm_mul_pd(l01, l23);
+  scale = _mm_mul_sd(scale, _mm_unpackhi_pd(scale, scale));
+
+  const int singular = la_singular(_mm_cvtss_f32(det), _mm_cvtsd_f64(scale));
+  if (invertible != NULL) {
+    *invertible = !singular;
+  }
+  if (singular) {
+    return la_identitym4();
+  }
+
+  const __m128 inv_det = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+  x = _mm_mul_ps(x, inv_det);
+  y = _mm_mul_ps(y, inv_det);
+  z = _mm_mul_ps(z, inv_det);
+  w = _mm_mul_ps(w, inv_det);
+
+  la_mat4 r;
+  _mm_storeu_ps(r.elem[0], LA_SHUFFLE(x, y, 3, 1, 3, 1));
+  _mm_storeu_ps(r.elem[1], LA_SHUFFLE(x, y, 2, 0, 2, 0));
+  _mm_storeu_ps(r.elem[2], LA_SHUFFLE(z, w, 3, 1, 3, 1));
+  _mm_storeu_ps(r.elem[3], LA_SHUFFLE(z, w, 2, 0, 2, 0));
+  return r;
+}
+#endif  // LA_USE_SSE2
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_inversem4(const la_mat4 m, int *invertible) {
+  LA_PROFILE_ENTER(la_inversem4);
+#if defined(LA_USE_SSE2)
+  const la_mat4 r = la_inversem4_sse2(m, invertible);
+#else
+  const la_mat4 r = la_inversem4_scalar(m, invertible);
+#endif
+  LA_PROFILE_LEAVE(la_inversem4);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat2 la_identitym2(void) {
+  la_mat2 i = {{{1.0f, 0.0f}, {0.0f, 1.0f}}};
+  return i;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat2 la_productm2(const la_mat2 m1, const la_mat2 m2) {
+  la_mat2 r = {0};
+  for (size_t i = 0; i < 2; i++) {
+    for (size_t j = 0; j < 2; j++) {
+      for (size_t k = 0; k < 2; k++) {
+        r.elem[i][k] += m1.elem[i][j] * m2.elem[j][k];
+      }
+    }
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec2 la_productm2v2(const la_mat2 m, const la_vec2 v) {
+  la_vec2 res = {0};
+  for (size_t i = 0; i < 2; i++) {
+    for (size_t j = 0; j < 2; j++) {
+      res.elem[i] += m.elem[i][j] * v.elem[j];
+    }
+  }
+  return res;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat2 la_transposem2(const la_mat2 m) {
+  la_mat2 r = {{{m.elem[0][0], m.elem[1][0]}, {m.elem[0][1], m.elem[1][1]}}};
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_determinantm2(const la_mat2 m) {
+  return m.elem[0][0] * m.elem[1][1] - m.elem[0][1] * m.elem[1][0];
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat2 la_inversem2(const la_mat2 m, int *invertible) {
+  const float det = la_determinantm2(m);
+  const int singular = la_singular(det, la_row_lengths(&m.elem[0][0], 2, 2));
+  if (invertible != NULL) {
+    *invertible = !singular;
+  }
+  if (singular) {
+    return la_identitym2();
+  }
+
+  const float inv_det = 1.0f / det;
+  la_mat2 r = {{{m.elem[1][1] * inv_det, -m.elem[0][1] * inv_det},
+                {-m.elem[1][0] * inv_det, m.elem[0][0] * inv_det}}};
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat3 la_identitym3(void) {
+  la_mat3 i = {{{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}}};
+  return i;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat3 la_productm3(const la_mat3 m1, const la_mat3 m2) {
+  la_mat3 r = {0};
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      for (size_t k = 0; k < 3; k++) {
+        r.elem[i][k] += m1.elem[i][j] * m2.elem[j][k];
+      }
+    }
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec3 la_productm3v3(const la_mat3 m, const la_vec3 v) {
+  la_vec3 res = {0};
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      res.elem[i] += m.elem[i][j] * v.elem[j];
+    }
+  }
+  return res;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat3 la_transposem3(const la_mat3 m) {
+  la_mat3 r;
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      r.elem[i][j] = m.elem[j][i];
+    }
+  }
+  return r;
+}
+
+/* The inverse transpose of a 3x3 matrix, its cofactors divided by its
+ * determinant. The rows of the cofactor matrix are the cross products of
+ * the other two rows of a. */
+static la_mat3 la_inverse_transposem3(const float (*a)[3], int *invertible) {
+  const float c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+  const float c01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+  const float c02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+  const float det = a[0][0] * c00 + a[0][1] * c01 + a[0][2] * c02;
+  const int singular = la_singular(det, la_row_lengths(a[0], 3, 3));
+  if (invertible != NULL) {
+    *invertible = !singular;
+  }
+  if (singular) {
+    return la_identitym3();
+  }
+
+  const float d = 1.0f / det;
+  la_mat3 r = {{{c00 * d, c01 * d, c02 * d},
+                {(a[2][1] * a[0][2] - a[2][2] * a[0][1]) * d,
+                 (a[2][2] * a[0][0] - a[2][0] * a[0][2]) * d,
+                 (a[2][0] * a[0][1] - a[2][1] * a[0][0]) * d},
+                {(a[0][1] * a[1][2] - a[0][2] * a[1][1]) * d,
+                 (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * d,
+                 (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * d}}};
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_determinantm3(const la_mat3 m) {
+  const float(*a)[3] = m.elem;
+  return a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) +
+         a[0][1] * (a[1][2] * a[2][0] - a[1][0] * a[2][2]) +
+         a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat3 la_inversem3(const la_mat3 m, int *invertible) {
+  return la_transposem3(la_inverse_transposem3(m.elem, invertible));
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat3 la_m4tom3(const la_mat4 m) {
+  la_mat3 r;
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      r.elem[i][j] = m.elem[i][j];
+    }
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_m3tom4(const la_mat3 m) {
+  la_mat4 r = la_identitym4();
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      r.elem[i][j] = m.elem[i][j];
+    }
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat3 la_normal_matrix(const la_mat4 m, int *invertible) {
+  const la_mat3 a = la_m4tom3(m);
+  return la_inverse_transposem3(a.elem, invertible);
+}
+
+/* la_productmn works on tiles of LA_GEMM_KC rows and LA_GEMM_NC columns of
+ * b, 16 KiB, which stay in L1 while every row of a passes over them. */
+#define LA_GEMM_KC 64
+#define LA_GEMM_NC 64
+#define LA_GEMM_MR 4
+
+/* c += a * b for rows (at most LA_GEMM_MR) rows of a and c, kc columns of a
+ * and nc columns of b and c. Each element of c is kept in a register while
+ * the kc products are added in order, so the sums match la_productm4. */
+static inline void la_gemm_rows(const float *a, size_t lda, const float *b,
+                                size_t ldb, float *c, size_t ldc,
+                                size_t rows, size_t kc, size_t nc) {
+  size_t k = 0;
+#ifdef LA_VF_WIDTH
+  for (; k + LA_VF_WIDTH <= nc; k += LA_VF_WIDTH) {
+    la_vf acc[LA_GEMM_MR];
+    for (size_t r = 0; r < rows; r++) {
+      acc[r] = la_vf_load(c + r * ldc + k);
+    }
+    for (size_t j = 0; j < kc; j++) {
+      const la_vf bj = la_vf_load(b + j * ldb + k);
+      for (size_t r = 0; r < rows; r++) {
+        acc[r] = la_vf_add(acc[r], la_vf_mul(la_vf_set1(a[r * lda + j]), bj));
+      }
+    }
+    for (size_t r = 0; r < rows; r++) {
+      la_vf_store(c + r * ldc + k, acc[r]);
+    }
+  }
+#endif
+  for (; k < nc; k++) {
+    float acc[LA_GEMM_MR];
+    for (size_t r = 0; r < rows; r++) {
+      acc[r] = c[r * ldc + k];
+    }
+    for (size_t j = 0; j < kc; j++) {
+      const float bj = b[j * ldb + k];
+      for (size_t r = 0; r < rows; r++) {
+        acc[r] += a[r * lda + j] * bj;
+      }
+    }
+    for (size_t r = 0; r < rows; r++) {
+      c[r * ldc + k] = acc[r];
+    }
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * Blocked over the columns of a (kc) and b (nc) so that each tile of b is
+ * reused by all m rows, LA_GEMM_MR rows at a time so that each load of b is
+ * reused by LA_GEMM_MR rows of a.
+ */
+void la_productmn(const float *a, size_t lda, const float *b, size_t ldb,
+                  float *c, size_t ldc, size_t m, size_t n, size_t p) {
+  LA_PROFILE_ENTER(la_productmn);
+  for (size_t i = 0; i < m; i++) {
+    memset(c + i * ldc, 0, p * sizeof(float));
+  }
+  for (size_t j = 0; j < n; j += LA_GEMM_KC) {
+    const size_t kc = n - j < LA_GEMM_KC ? n - j : LA_GEMM_KC;
+    for (size_t k = 0; k < p; k += LA_GEMM_NC) {
+      const size_t nc = p - k < LA_GEMM_NC ? p - k : LA_GEMM_NC;
+      const float *bt = b + j * ldb + k;
+      size_t i = 0;
+      for (; i + LA_GEMM_MR <= m; i += LA_GEMM_MR) {
+        la_gemm_rows(a + i * lda + j, lda, bt, ldb, c + i * ldc + k, ldc,
+                     LA_GEMM_MR, kc, nc);
+      }
+      for (; i < m; i++) {
+        la_gemm_rows(a + i * lda + j, lda, bt, ldb, c + i * ldc + k, ldc, 1,
+                     kc, nc);
+      }
+    }
+  }
+  LA_PROFILE_LEAVE(la_productmn);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_productmnvn(const float *a, size_t lda, const float *v, float *out,
+                    size_t m, size_t n) {
+  for (size_t i = 0; i < m; i++) {
+    out[i] = la_dotvn(a + i * lda, v, n);
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * Vectorized across points: every matrix element is broadcast once and each
+ * iteration transforms 8 (AVX) or 4 (SSE2, NEON) points. The remainder is
+ * handled by the scalar loop, which uses the same summation order.
+ */
+static void la_transform_points_v4_base(const la_mat4 *m, const float *x,
+                                        const float *y, const float *z,
+                                        const float *w, float *ox, float *oy,
+                                        float *oz, float *ow, size_t n) {
+  float *out[4] = {ox, oy, oz, ow};
+  size_t i = 0;
+#if defined(LA_USE_AVX)
+  __m256 c[4][4];
+  for (size_t r = 0; r < 4; r++) {
+    for (size_t k = 0; k < 4; k++) {
+      c[r][k] = _mm256_set1_ps(m->elem[r][k]);
+    }
+  }
+  for (; i + 8 <= n; i += 8) {
+    const __m256 vx = _mm256_loadu_ps(x + i);
+    const __m256 vy = _mm256_loadu_ps(y + i);
+    const __m256 vz = _mm256_loadu_ps(z + i);
+    const __m256 vw = _mm256_loadu_ps(w + i);
+    for (size_t r = 0; r < 4; r++) {
+      __m256 res = _mm256_mul_ps(c[r][0], vx);
+      res = _mm256_add_ps(res, _mm256_mul_ps(c[r][1], vy));
+      res = _mm256_add_ps(res, _mm256_mul_ps(c[r][2], vz));
+      res = _mm256_add_ps(res, _mm256_mul_ps(c[r][3], vw));
+      _mm256_storeu_ps(out[r] + i, res);
+    }
+  }
+#elif defined(LA_USE_SSE2)
+  __m128 c[4][4];
+  for (size_t r = 0; r < 4; r++) {
+    for (size_t k = 0; k < 4; k++) {
+      c[r][k] = _mm_set1_ps(m->elem[r][k]);
+    }
+  }
+  for (; i + 4 <= n; i += 4) {
+    const __m128 vx = _mm_loadu_ps(x + i);
+    const __m128 vy = _mm_loadu_ps(y + i);
+    const __m128 vz = _mm_loadu_ps(z + i);
+    const __m128 vw = _mm_loadu_ps(w + i);
+    for (size_t r = 0; r < 4; r++) {
+      __m128 res = _mm_mul_ps(c[r][0], vx);
+      res = _mm_add_ps(res, _mm_mul_ps(c[r][1], vy));
+      res = _mm_add_ps(res, _mm_mul_ps(c[r][2], vz));
+      res = _mm_add_ps(res, _mm_mul_ps(c[r][3], vw));
+      _mm_storeu_ps(out[r] + i, res);
+    }
+  }
+#elif defined(LA_USE_NEON)
+  for (; i + 4 <= n; i += 4) {
+    const float32x4_t vx = vld1q_f32(x + i);
+    const float32x4_t vy = vld1q_f32(y + i);
+    const float32x4_t vz = vld1q_f32(z + i);
+    const float32x4_t vw = vld1q_f32(w + i);
+    for (size_t r = 0; r < 4; r++) {
+      float32x4_t res = vmulq_n_f32(vx, m->elem[r][0]);
+      res = vmlaq_n_f32(res, vy, m->elem[r][1]);
+      res = vmlaq_n_f32(res, vz, m->elem[r][2]);
+      res = vmlaq_n_f32(res, vw, m->elem[r][3]);
+      vst1q_f32(out[r] + i, res);
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    const float px = x[i];
+    const float py = y[i];
+    const float pz = z[i];
+    const float pw = w[i];
+    for (size_t r = 0; r < 4; r++) {
+      out[r][i] = m->elem[r][0] * px + m->elem[r][1] * py +
+                  m->elem[r][2] * pz + m->elem[r][3] * pw;
+    }
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * Each vector is computed as a linear combination of the columns of m, which
+ * are extracted once up front.
+ */
+static void la_transform_points_v4_aos_base(const la_mat4 *m,
+                                            const la_vec4 *in, la_vec4 *out,
+                                            size_t n) {
+  size_t i = 0;
+#if defined(LA_USE_SSE2)
+  __m128 c0 = _mm_loadu_ps(m->elem[0]);
+  __m128 c1 = _mm_loadu_ps(m->elem[1]);
+  __m128 c2 = _mm_loadu_ps(m->elem[2]);
+  __m128 c3 = _mm_loadu_ps(m->elem[3]);
+  _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+#if defined(LA_USE_AVX)
+  const __m256 cc0 = _mm256_insertf128_ps(_mm256_castps128_ps256(c0), c0, 1);
+  const __m256 cc1 = _mm256_insertf128_ps(_mm256_castps128_ps256(c1), c1, 1);
+  const __m256 cc2 = _mm256_insertf128_ps(_mm256_castps128_ps256(c2), c2, 1);
+  const __m256 cc3 = _mm256_insertf128_ps(_mm256_castps128_ps256(c3), c3, 1);
+  for (; i + 2 <= n; i += 2) {
+    const __m256 v = _mm256_loadu_ps(in[i].elem);
+    __m256 res = _mm256_mul_ps(cc0, _mm256_shuffle_ps(v, v, 0x00));
+    res = _mm256_add_ps(res, _mm256_mul_ps(cc1, _mm256_shuffle_ps(v, v, 0x55)));
+    res = _mm256_add_ps(res, _mm256_mul_ps(cc2, _mm256_shuffle_ps(v, v, 0xAA)));
+    res = _mm256_add_ps(res, _mm256_mul_ps(cc3, _mm256_shuffle_ps(v, v, 0xFF)));
+    _mm256_storeu_ps(out[i].elem, res);
+  }
+#endif
+  for (; i < n; i++) {
+    const __m128 v = _mm_loadu_ps(in[i].elem);
+    __m128 res = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, 0x00));
+    res = _mm_add_ps(res, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, 0x55)));
+    res = _mm_add_ps(res, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, 0xAA)));
+    res = _mm_add_ps(res, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, 0xFF)));
+    _mm_storeu_ps(out[i].elem, res);
+  }
+#elif defined(LA_USE_NEON)
+  const float32x4x4_t c = vld4q_f32(&m->elem[0][0]);
+  for (; i < n; i++) {
+    const float32x4_t v = vld1q_f32(in[i].elem);
+    float32x4_t res = vmulq_n_f32(c.val[0], vgetq_lane_f32(v, 0));
+    res = vmlaq_n_f32(res, c.val[1], vgetq_lane_f32(v, 1));
+    res = vmlaq_n_f32(res, c.val[2], vgetq_lane_f32(v, 2));
+    res = vmlaq_n_f32(res, c.val[3], vgetq_lane_f32(v, 3));
+    vst1q_f32(out[i].elem, res);
+  }
+#else
+  for (; i < n; i++) {
+    out[i] = la_productm4v4_scalar(*m, in[i]);
+  }
+#endif
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+static void la_productm4_batch_base(const la_mat4 *a, const la_mat4 *b,
+                                    la_mat4 *out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = la_productm4(a[i], b[i]);
+  }
+}
+
+typedef struct la_chunks {
+  size_t n;
+  size_t chunk;
+  la_range_fn fn;
+  void *ctx;
+} la_chunks;
+
+static void la_run_chunk(void *ctx, size_t c) {
+  const la_chunks *chunks = ctx;
+  const size_t begin = c * chunks->chunk;
+  const size_t end =
+      chunks->n - begin < chunks->chunk ? chunks->n : begin + chunks->chunk;
+  chunks->fn(chunks->ctx, begin, end);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * Chunks are rounded up to a multiple of 8 elements so that only the last
+ * chunk has a scalar tail.
+ */
+void la_parallel_for(const la_jobs *jobs, size_t n, la_range_fn fn,
+                     void *ctx) {
+  if (n == 0) {
+    return;
+  }
+  if (jobs == NULL || jobs->parallel_for == NULL) {
+    fn(ctx, 0, n);
+    return;
+  }
+
+  size_t chunk = jobs->grain;
+  if (chunk == 0) {
+    const size_t threads = jobs->threads ? jobs->threads : 1;
+    chunk = (n + threads * LA_CHUNKS_PER_THREAD - 1) /
+            (threads * LA_CHUNKS_PER_THREAD);
+    if (chunk < LA_MIN_GRAIN) {
+      chunk = LA_MIN_GRAIN;
+    }
+    chunk = (chunk + 7) & ~(size_t)7;
+  }
+
+  const size_t nchunks = (n + chunk - 1) / chunk;
+  if (nchunks == 1) {
+    fn(ctx, 0, n);
+    return;
+  }
+  la_chunks chunks = {n, chunk, fn, ctx};
+  jobs->parallel_for(jobs->user, nchunks, la_run_chunk, &chunks);
+}
+
+typedef struct la_transform_task {
+  const la_mat4 *m;
+  const float *in[4];
+  float *out[4];
+  const la_vec4 *in_aos;
+  la_vec4 *out_aos;
+} la_transform_task;
+
+static void la_transform_points_v4_range(void *ctx, size_t begin,
+                                         size_t end) {
+  const la_transform_task *t = ctx;
+  la_transform_points_v4(t->m, t->in[0] + begin, t->in[1] + begin,
+                         t->in[2] + begin, t->in[3] + begin,
+                         t->out[0] + begin, t->out[1] + begin,
+                         t->out[2] + begin, t->out[3] + begin, end - begin);
+}
+
+static void la_transform_points_v4_aos_range(void *ctx, size_t begin,
+                                             size_t end) {
+  const la_transform_task *t = ctx;
+  la_transform_points_v4_aos(t->m, t->in_aos + begin, t->out_aos + begin,
+                             end - begin);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_transform_points_v4_mt(const la_jobs *jobs, const la_mat4 *m,
+                               const float *x, const float *y, const float *z,
+                               const float *w, float *ox, float *oy, float *oz,
+                               float *ow, size_t n) {
+  la_transform_task t = {m, {x, y, z, w}, {ox, oy, oz, ow}, NULL, NULL};
+  la_parallel_for(jobs, n, la_transform_points_v4_range, &t);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_transform_points_v4_aos_mt(const la_jobs *jobs, const la_mat4 *m,
+                                   const la_vec4 *in, la_vec4 *out,
+                                   size_t n) {
+  la_transform_task t = {m, {NULL}, {NULL}, in, out};
+  la_parallel_for(jobs, n, la_transform_points_v4_aos_range, &t);
+}
+
+typedef struct la_productm4_task {
+  const la_mat4 *a;
+  const la_mat4 *b;
+  la_mat4 *out;
+} la_productm4_task;
+
+static void la_productm4_batch_range(void *ctx, size_t begin, size_t end) {
+  const la_productm4_task *t = ctx;
+  la_productm4_batch(t->a + begin, t->b + begin, t->out + begin, end - begin);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_productm4_batch_mt(const la_jobs *jobs, const la_mat4 *a,
+                           const la_mat4 *b, la_mat4 *out, size_t n) {
+  la_productm4_task t = {a, b, out};
+  la_parallel_for(jobs, n, la_productm4_batch_range, &t);
+}
+
+#ifdef LA_HAS_POOL
+struct la_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  pthread_t *workers;
+  size_t nworkers;
+  unsigned long generation;
+  int stop;
+
+  // The current parallel_for, protected by lock.
+  la_chunk_fn fn;
+  void *ctx;
+  size_t next;
+  size_t nchunks;
+  size_t pending;
+};
+
+/* Run chunks of the current job until there are none left to claim. Called
+ * and returns with the lock held. */
+static void la_pool_drain(la_pool *p) {
+  while (p->next < p->nchunks) {
+    const size_t c = p->next++;
+    la_chunk_fn fn = p->fn;
+    void *ctx = p->ctx;
+    pthread_mutex_unlock(&p->lock);
+    fn(ctx, c);
+    pthread_mutex_lock(&p->lock);
+    if (--p->pending == 0) {
+      pthread_cond_broadcast(&p->done);
+    }
+  }
+}
+
+static void *la_pool_worker(void *arg) {
+  la_pool *p = arg;
+  unsigned long seen = 0;
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (!p->stop && p->generation == seen) {
+      pthread_cond_wait(&p->work, &p->lock);
+    }
+    if (p->stop) {
+      break;
+    }
+    seen = p->generation;
+    la_pool_drain(p);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_pool *la_pool_create(size_t threads) {
+  if (threads == 0) {
+    const long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = online > 0 ? (size_t)online : 1;
+  }
+
+  la_pool *p = calloc(1, sizeof(*p));
+  if (p == NULL) {
+    return NULL;
+  }
+  p->workers = calloc(threads, sizeof(*p->workers));
+  if (p->workers == NULL) {
+    free(p);
+    return NULL;
+  }
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->work, NULL);
+  pthread_cond_init(&p->done, NULL);
+
+  for (size_t i = 0; i < threads - 1; i++) {
+    if (pthread_create(&p->workers[i], NULL, la_pool_worker, p) != 0) {
+      break;
+    }
+    p->nworkers++;
+  }
+  return p;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_pool_destroy(la_pool *p) {
+  if (p == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&p->lock);
+  p->stop = 1;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+  for (size_t i = 0; i < p->nworkers; i++) {
+    pthread_join(p->workers[i], NULL);
+  }
+  pthread_cond_destroy(&p->done);
+  pthread_cond_destroy(&p->work);
+  pthread_mutex_destroy(&p->lock);
+  free(p->workers);
+  free(p);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+size_t la_pool_threads(const la_pool *p) { return p->nworkers + 1; }
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_pool_parallel_for(void *pool, size_t nchunks, la_chunk_fn fn,
+                          void *ctx) {
+  la_pool *p = pool;
+  if (nchunks == 0) {
+    return;
+  }
+  pthread_mutex_lock(&p->lock);
+  p->fn = fn;
+  p->ctx = ctx;
+  p->next = 0;
+  p->nchunks = nchunks;
+  p->pending = nchunks;
+  p->generation++;
+  pthread_cond_broadcast(&p->work);
+  la_pool_drain(p);
+  while (p->pending != 0) {
+    pthread_cond_wait(&p->done, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_jobs la_pool_jobs(la_pool *pool, size_t grain) {
+  la_jobs jobs = {la_pool_parallel_for, pool, la_pool_threads(pool), grain};
+  return jobs;
+}
+#endif  // LA_HAS_POOL
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec3a la_v3tov3a(const la_vec3 v) {
+  la_vec3a r = {.lanes = {v.x, v.y, v.z, 0.0f}};
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec3 la_v3atov3(const la_vec3a v) {
+  la_vec3 r = {.elem = {v.x, v.y, v.z}};
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_v3tov3a_batch(const la_vec3 *in, la_vec3a *out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = la_v3tov3a(in[i]);
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void *la_aligned_alloc(size_t size, size_t align) {
+#if defined(_WIN32)
+  return _aligned_malloc(size, align);
+#elif defined(LA_HAS_POSIX_2001)
+  void *p = NULL;
+  if (align < sizeof(void *)) {
+    align = sizeof(void *);
+  }
+  return posix_memalign(&p, align, size) == 0 ? p : NULL;
+#else
+  /* aligned_alloc wants a size that is a multiple of the alignment. */
+  return aligned_alloc(align, (size + align - 1) & ~(align - 1));
+#endif
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_aligned_free(void *p) {
+#ifdef _WIN32
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+struct la_arena {
+  unsigned char *base;
+  size_t capacity;
+  size_t used;
+};
+
+static size_t la_round_to_line(size_t size) {
+  return (size + LA_CACHE_LINE - 1) & ~(size_t)(LA_CACHE_LINE - 1);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_arena *la_arena_create(size_t capacity) {
+  la_arena *a = malloc(sizeof(*a));
+  if (a == NULL) {
+    return NULL;
+  }
+  a->capacity = la_round_to_line(capacity);
+  a->used = 0;
+  a->base = la_aligned_alloc(a->capacity ? a->capacity : LA_CACHE_LINE,
+                             LA_CACHE_LINE);
+  if (a->base == NULL) {
+    free(a);
+    return NULL;
+  }
+  return a;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_arena_destroy(la_arena *a) {
+  if (a == NULL) {
+    return;
+  }
+  la_aligned_free(a->base);
+  free(a);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void *la_arena_alloc(la_arena *a, size_t size) {
+  const size_t padded = la_round_to_line(size);
+  if (padded < size || padded > a->capacity - a->used) {
+    return NULL;
+  }
+  void *p = a->base + a->used;
+  a->used += padded;
+  return p;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_arena_reset(la_arena *a) { a->used = 0; }
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+size_t la_arena_used(const la_arena *a) { return a->used; }
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_perspective(const float fov, const float aspect_ratio,
+                       const float near, const float far) {
+  LA_PROFILE_ENTER(la_perspective);
+  const la_mat4 mat = la_perspective_scalar(fov, aspect_ratio, near, far);
+  LA_PROFILE_LEAVE(la_perspective);
+  return mat;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_orthographic(const float left, const float right, const float bottom,
+                        const float top, const float near, const float far) {
+  LA_PROFILE_ENTER(la_orthographic);
+  const la_mat4 mat =
+      la_orthographic_scalar(left, right, bottom, top, near, far);
+  LA_PROFILE_LEAVE(la_orthographic);
+  return mat;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_look_at(const la_vec3 eye, const la_vec3 ctr, const la_vec3 up) {
+  LA_PROFILE_ENTER(la_look_at);
+  const la_mat4 mat = la_look_at_scalar(eye, ctr, up);
+  LA_PROFILE_LEAVE(la_look_at);
+  return mat;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_translate(const la_mat4 m, const la_vec3 v) {
+  LA_PROFILE_ENTER(la_translate);
+  const la_mat4 res = la_translate_scalar(m, v);
+  LA_PROFILE_LEAVE(la_translate);
+  return res;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_rotate(const la_mat4 m, const la_vec3 axis, const float rads) {
+  LA_PROFILE_ENTER(la_rotate);
+  const la_mat4 r = la_productm4(m, la_rotation_scalar(axis, rads));
+  LA_PROFILE_LEAVE(la_rotate);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_scale(const la_mat4 m, const la_vec3 v) {
+  LA_PROFILE_ENTER(la_scale);
+  const la_mat4 r = la_productm4(m, la_scaling_scalar(m, v));
+  LA_PROFILE_LEAVE(la_scale);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * Gribb-Hartmann: with clip = p * vp, the planes are w +- x, w +- y, w +- z
+ * of the clip coordinates, i.e. sums of the columns of vp.
+ */
+la_frustum la_frustum_from_m4(const la_mat4 vp) {
+  la_frustum f;
+  for (int p = 0; p < 6; p++) {
+    const int axis = p / 2;
+    const float sign = p % 2 == 0 ? 1.0f : -1.0f;
+    la_vec4 *pl = &f.planes[p];
+    for (int j = 0; j < 4; j++) {
+      pl->elem[j] = vp.elem[j][3] + sign * vp.elem[j][axis];
+    }
+    const float l = sqrt(pl->x * pl->x + pl->y * pl->y + pl->z * pl->z);
+    for (int j = 0; j < 4; j++) {
+      pl->elem[j] /= l;
+    }
+  }
+  return f;
+}
+
+/* Signed distance of a sphere or box from plane pl, plus its extent along
+ * the plane normal. Negative when the bounds are fully outside. The SIMD
+ * kernels use the same operation order so they agree with these. */
+static inline float la_sphere_plane(const la_vec4 *pl, float x, float y,
+                                    float z, float r) {
+  return pl->x * x + pl->y * y + pl->z * z + pl->w + r;
+}
+
+static inline float la_aabb_plane(const la_vec4 *pl, float cx, float cy,
+                                  float cz, float ex, float ey, float ez) {
+  const float d = pl->x * cx + pl->y * cy + pl->z * cz + pl->w;
+  return d + (fabsf(pl->x) * ex + fabsf(pl->y) * ey + fabsf(pl->z) * ez);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_frustum_test_sphere(const la_frustum *f, const la_vec3 center,
+                           const float radius) {
+  for (int p = 0; p < 6; p++) {
+    if (la_sphere_plane(&f->planes[p], center.x, center.y, center.z,
+                        radius) < 0.0f) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_frustum_test_aabb(const la_frustum *f, const la_vec3 center,
+                         const la_vec3 extents) {
+  for (int p = 0; p < 6; p++) {
+    if (la_aabb_plane(&f->planes[p], center.x, center.y, center.z, extents.x,
+                      extents.y, extents.z) < 0.0f) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Visibility of the bounds [i, i + LA_VF_WIDTH) as a lane bitmask. */
+#ifdef LA_VF_WIDTH
+static inline int la_vf_cull_spheres(const la_frustum *f, const float *x,
+                                     const float *y, const float *z,
+                                     const float *r, size_t i) {
+  const la_vf vx = la_vf_load(x + i);
+  const la_vf vy = la_vf_load(y + i);
+  const la_vf vz = la_vf_load(z + i);
+  const la_vf vr = la_vf_load(r + i);
+  const la_vf zero = la_vf_set1(0.0f);
+  la_vf out = zero;
+  for (int p = 0; p < 6; p++) {
+    const la_vec4 *pl = &f->planes[p];
+    la_vf d = la_vf_mul(la_vf_set1(pl->x), vx);
+    d = la_vf_add(d, la_vf_mul(la_vf_set1(pl->y), vy));
+    d = la_vf_add(d, la_vf_mul(la_vf_set1(pl->z), vz));
+    d = la_vf_add(la_vf_add(d, la_vf_set1(pl->w)), vr);
+    out = la_vf_or(out, la_vf_lt(d, zero));
+  }
+  return ~la_vf_movemask(out) & ((1 << LA_VF_WIDTH) - 1);
+}
+
+static inline int la_vf_cull_aabbs(const la_frustum *f, const float *cx,
+                                   const float *cy, const float *cz,
+                                   const float *ex, const float *ey,
+                                   const float *ez, size_t i) {
+  const la_vf vcx = la_vf_load(cx + i);
+  const la_vf vcy = la_vf_load(cy + i);
+  const la_vf vcz = la_vf_load(cz + i);
+  const la_vf vex = la_vf_load(ex + i);
+  const la_vf vey = la_vf_load(ey + i);
+  const la_vf vez = la_vf_load(ez + i);
+  const la_vf zero = la_vf_set1(0.0f);
+  la_vf out = zero;
+  for (int p = 0; p < 6; p++) {
+    const la_vec4 *pl = &f->planes[p];
+    la_vf d = la_vf_mul(la_vf_set1(pl->x), vcx);
+    d = la_vf_add(d, la_vf_mul(la_vf_set1(pl->y), vcy));
+    d = la_vf_add(d, la_vf_mul(la_vf_set1(pl->z), vcz));
+    d = la_vf_add(d, la_vf_set1(pl->w));
+    la_vf e = la_vf_mul(la_vf_set1(fabsf(pl->x)), vex);
+    e = la_vf_add(e, la_vf_mul(la_vf_set1(fabsf(pl->y)), vey));
+    e = la_vf_add(e, la_vf_mul(la_vf_set1(fabsf(pl->z)), vez));
+    out = la_vf_or(out, la_vf_lt(la_vf_add(d, e), zero));
+  }
+  return ~la_vf_movemask(out) & ((1 << LA_VF_WIDTH) - 1);
+}
+
+/* Appends base + lane for every set lane. Each lane is written
+ * unconditionally and kept by advancing count, which avoids a mispredicted
+ * branch per object; indices never runs past base + lane. */
+static size_t la_mask_to_indices(uint32_t bits, uint32_t base,
+                                 uint32_t *indices) {
+  size_t count = 0;
+  for (uint32_t lane = 0; lane < LA_VF_WIDTH; lane++) {
+    indices[count] = base + lane;
+    count += (bits >> lane) & 1;
+  }
+  return count;
+}
+#endif
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+static void la_frustum_cull_spheres_base(const la_frustum *f, const float *x,
+                                         const float *y, const float *z,
+                                         const float *r, size_t n,
+                                         uint32_t *mask) {
+  size_t i = 0;
+  for (size_t w = 0; w < (n + 31) / 32; w++) {
+    mask[w] = 0;
+  }
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    mask[i / 32] |= (uint32_t)la_vf_cull_spheres(f, x, y, z, r, i) << (i % 32);
+  }
+#endif
+  for (; i < n; i++) {
+    const la_vec3 c = {.elem = {x[i], y[i], z[i]}};
+    mask[i / 32] |= (uint32_t)la_frustum_test_sphere(f, c, r[i]) << (i % 32);
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+size_t la_frustum_cull_spheres_indices(const la_frustum *f, const float *x,
+                                       const float *y, const float *z,
+                                       const float *r, size_t n,
+                                       uint32_t *indices) {
+  size_t count = 0;
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const int bits = la_vf_cull_spheres(f, x, y, z, r, i);
+    count += la_mask_to_indices(bits, (uint32_t)i, indices + count);
+  }
+#endif
+  for (; i < n; i++) {
+    const la_vec3 c = {.elem = {x[i], y[i], z[i]}};
+    if (la_frustum_test_sphere(f, c, r[i])) {
+      indices[count++] = (uint32_t)i;
+    }
+  }
+  return count;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+static void la_frustum_cull_aabbs_base(const la_frustum *f, const float *cx,
+                                       const float *cy, const float *cz,
+                                       const float *ex, const float *ey,
+                                       const float *ez, size_t n,
+                                       uint32_t *mask) {
+  size_t i = 0;
+  for (size_t w = 0; w < (n + 31) / 32; w++) {
+    mask[w] = 0;
+  }
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const int bits = la_vf_cull_aabbs(f, cx, cy, cz, ex, ey, ez, i);
+    mask[i / 32] |= (uint32_t)bits << (i % 32);
+  }
+#endif
+  for (; i < n; i++) {
+    const la_vec3 c = {.elem = {cx[i], cy[i], cz[i]}};
+    const la_vec3 e = {.elem = {ex[i], ey[i], ez[i]}};
+    mask[i / 32] |= (uint32_t)la_frustum_test_aabb(f, c, e) << (i % 32);
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+size_t la_frustum_cull_aabbs_indices(const la_frustum *f, const float *cx,
+                                     const float *cy, const float *cz,
+                                     const float *ex, const float *ey,
+                                     const float *ez, size_t n,
+                                     uint32_t *indices) {
+  size_t count = 0;
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const int bits = la_vf_cull_aabbs(f, cx, cy, cz, ex, ey, ez, i);
+    count += la_mask_to_indices(bits, (uint32_t)i, indices + count);
+  }
+#endif
+  for (; i < n; i++) {
+    const la_vec3 c = {.elem = {cx[i], cy[i], cz[i]}};
+    const la_vec3 e = {.elem = {ex[i], ey[i], ez[i]}};
+    if (la_frustum_test_aabb(f, c, e)) {
+      indices[count++] = (uint32_t)i;
+    }
+  }
+  return count;
+}
+
+/* Runtime dispatch. The AVX2 and AVX-512 kernels are compiled with target
+ * attributes, so they may only run after la_simd_max_level has confirmed
+ * that the CPU supports them. The AVX2 target leaves out FMA on purpose:
+ * the baseline kernels have no FMAs, and every level is bit-identical. For
+ * the same reason GCC, which would contract the multiplies and adds of the
+ * AVX-512 kernels into FMAs, has contraction turned off for them. */
+#if defined(LA_DISPATCH) && defined(__GNUC__) &&                               \
+    (defined(__x86_64__) || defined(__i386__))
+#define LA_HAS_DISPATCH
+
+#include <immintrin.h>
+
+#if !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#define LA_TARGET_AVX2 __attribute__((target("avx2")))
+#define LA_TARGET_AVX512 __attribute__((target("avx512f")))
+
+/* The vector operations of each level, named like the la_vf ones. Masks
+ * are vectors for AVX2 and mask registers for AVX-512. */
+typedef __m256 la_v8;
+typedef __m256 la_v8_mask;
+LA_TARGET_AVX2 static inline la_v8 la_v8_load(const float *p) {
+  return _mm256_loadu_ps(p);
+}
+LA_TARGET_AVX2 static inline void la_v8_store(float *p, la_v8 a) {
+  _mm256_storeu_ps(p, a);
+}
+LA_TARGET_AVX2 static inline la_v8 la_v8_set1(float f) {
+  return _mm256_set1_ps(f);
+}
+LA_TARGET_AVX2 static inline la_v8 la_v8_add(la_v8 a, la_v8 b) {
+  return _mm256_add_ps(a, b);
+}
+LA_TARGET_AVX2 static inline la_v8 la_v8_mul(la_v8 a, la_v8 b) {
+  return _mm256_mul_ps(a, b);
+}
+LA_TARGET_AVX2 static inline la_v8_mask la_v8_none(void) {
+  return _mm256_setzero_ps();
+}
+LA_TARGET_AVX2 static inline la_v8_mask la_v8_lt(la_v8 a, la_v8 b) {
+  return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+}
+LA_TARGET_AVX2 static inline la_v8_mask la_v8_or(la_v8_mask a, la_v8_mask b) {
+  return _mm256_or_ps(a, b);
+}
+LA_TARGET_AVX2 static inline int la_v8_bits(la_v8_mask m) {
+  return _mm256_movemask_ps(m);
+}
+#ifdef LA_FAST_MATH
+LA_TARGET_AVX2 static inline la_v8 la_v8_len(la_v8 d) {
+  const la_v8 y = _mm256_rsqrt_ps(d);
+  const la_v8 h = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), d), y);
+  return _mm256_mul_ps(
+      y, _mm256_sub_ps(_mm256_set1_ps(1.5f), _mm256_mul_ps(h, y)));
+}
+LA_TARGET_AVX2 static inline la_v8 la_v8_unit(la_v8 v, la_v8 l) {
+  return _mm256_mul_ps(v, l);
+}
+#else
+LA_TARGET_AVX2 static inline la_v8 la_v8_len(la_v8 d) {
+  return _mm256_sqrt_ps(d);
+}
+LA_TARGET_AVX2 static inline la_v8 la_v8_unit(la_v8 v, la_v8 l) {
+  return _mm256_div_ps(v, l);
+}
+#endif
+
+typedef __m512 la_v16;
+typedef __mmask16 la_v16_mask;
+LA_TARGET_AVX512 static inline la_v16 la_v16_load(const float *p) {
+  return _mm512_loadu_ps(p);
+}
+LA_TARGET_AVX512 static inline void la_v16_store(float *p, la_v16 a) {
+  _mm512_storeu_ps(p, a);
+}
+LA_TARGET_AVX512 static inline la_v16 la_v16_set1(float f) {
+  return _mm512_set1_ps(f);
+}
+LA_TARGET_AVX512 static inline la_v16 la_v16_add(la_v16 a, la_v16 b) {
+  return _mm512_add_ps(a, b);
+}
+LA_TARGET_AVX512 static inline la_v16 la_v16_mul(la_v16 a, la_v16 b) {
+  return _mm512_mul_ps(a, b);
+}
+LA_TARGET_AVX512 static inline la_v16_mask la_v16_none(void) { return 0; }
+LA_TARGET_AVX512 static inline la_v16_mask la_v16_lt(la_v16 a, la_v16 b) {
+  return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+}
+LA_TARGET_AVX512 static inline la_v16_mask la_v16_or(la_v16_mask a,
+                                                     la_v16_mask b) {
+  return a | b;
+}
+LA_TARGET_AVX512 static inline int la_v16_bits(la_v16_mask m) { return m; }
+#ifdef LA_FAST_MATH
+/* rsqrt14 is more accurate than the SSE estimate, so the AVX-512 level
+ * is only close to the others with LA_FAST_MATH, not identical. */
+LA_TARGET_AVX512 static inline la_v16 la_v16_len(la_v16 d) {
+  const la_v16 y = _mm512_rsqrt14_ps(d);
+  const la_v16 h = _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(0.5f), d), y);
+  return _mm512_mul_ps(
+      y, _mm512_sub_ps(_mm512_set1_ps(1.5f), _mm512_mul_ps(h, y)));
+}
+LA_TARGET_AVX512 static inline la_v16 la_v16_unit(la_v16 v, la_v16 l) {
+  return _mm512_mul_ps(v, l);
+}
+#else
+LA_TARGET_AVX512 static inline la_v16 la_v16_len(la_v16 d) {
+  return _mm512_sqrt_ps(d);
+}
+LA_TARGET_AVX512 static inline la_v16 la_v16_unit(la_v16 v, la_v16 l) {
+  return _mm512_div_ps(v, l);
+}
+#endif
+
+/* Generates the kernels that are written once for every level, with V the
+ * vector type and prefix of its operations and W its width. Each kernel
+ * handles whole vectors and leaves the remainder to the baseline code. */
+#define LA_DISPATCH_KERNELS(S, V, W, TARGET)                                   \
+  TARGET static void la_transform_points_v4##S(                                \
+      const la_mat4 *m, const float *x, const float *y, const float *z,        \
+      const float *w, float *ox, float *oy, float *oz, float *ow, size_t n) {  \
+    float *out[4] = {ox, oy, oz, ow};                                          \
+    V c[4][4];                                                                 \
+    for (size_t r = 0; r < 4; r++) {                                           \
+      for (size_t k = 0; k < 4; k++) {                                         \
+        c[r][k] = V##_set1(m->elem[r][k]);                                     \
+      }                                                                        \
+    }                                                                          \
+    size_t i = 0;                                                              \
+    for (; i + W <= n; i += W) {                                               \
+      const V vx = V##_load(x + i);                                            \
+      const V vy = V##_load(y + i);                                            \
+      const V vz = V##_load(z + i);                                            \
+      const V vw = V##_load(w + i);                                            \
+      for (size_t r = 0; r < 4; r++) {                                         \
+        V res = V##_mul(c[r][0], vx);                                          \
+        res = V##_add(res, V##_mul(c[r][1], vy));                              \
+        res = V##_add(res, V##_mul(c[r][2], vz));                              \
+        res = V##_add(res, V##_mul(c[r][3], vw));                              \
+        V##_store(out[r] + i, res);                                            \
+      }                                                                        \
+    }                                                                          \
+    la_transform_points_v4_base(m, x + i, y + i, z + i, w + i, ox + i,         \
+                                oy + i, oz + i, ow + i, n - i);                \
+  }                                                                            \
+                                                                               \
+  TARGET static void la_normalizev3_soa##S(const float *x, const float *y,     \
+                                           const float *z, float *ox,          \
+                                           float *oy, float *oz, size_t n) {   \
+    size_t i = 0;                                                              \
+    for (; i + W <= n; i += W) {                                               \
+      const V vx = V##_load(x + i);                                            \
+      const V vy = V##_load(y + i);                                            \
+      const V vz = V##_load(z + i);                                            \
+      const V d = V##_add(V##_add(V##_mul(vx, vx), V##_mul(vy, vy)),           \
+                          V##_mul(vz, vz));                                    \
+      const V l = V##_len(d);                                                  \
+      V##_store(ox + i, V##_unit(vx, l));                                      \
+      V##_store(oy + i, V##_unit(vy, l));                                      \
+      V##_store(oz + i, V##_unit(vz, l));                                      \
+    }                                                                          \
+    la_normalizev3_soa_base(x + i, y + i, z + i, ox + i, oy + i, oz + i,       \
+                            n - i);                                            \
+  }                                                                            \
+                                                                               \
+  TARGET static void la_frustum_cull_spheres##S(                               \
+      const la_frustum *f, const float *x, const float *y, const float *z,     \
+      const float *r, size_t n, uint32_t *mask) {                              \
+    size_t i = 0;                                                              \
+    for (size_t w = 0; w < (n + 31) / 32; w++) {                               \
+      mask[w] = 0;                                                             \
+    }                                                                          \
+    const V zero = V##_set1(0.0f);                                             \
+    for (; i + W <= n; i += W) {                                               \
+      const V vx = V##_load(x + i);                                            \
+      const V vy = V##_load(y + i);                                            \
+      const V vz = V##_load(z + i);                                            \
+      const V vr = V##_load(r + i);                                            \
+      V##_mask out = V##_none();                                               \
+      for (int p = 0; p < 6; p++) {                                            \
+        const la_vec4 *pl = &f->planes[p];                                     \
+        V d = V##_mul(V##_set1(pl->x), vx);                                    \
+        d = V##_add(d, V##_mul(V##_set1(pl->y), vy));                          \
+        d = V##_add(d, V##_mul(V##_set1(pl->z), vz));                          \
+        d = V##_add(V##_add(d, V##_set1(pl->w)), vr);                          \
+        out = V##_or(out, V##_lt(d, zero));                                    \
+      }                                                                        \
+      const uint32_t bits = ~(uint32_t)V##_bits(out) & ((1u << W) - 1);        \
+      mask[i / 32] |= bits << (i % 32);                                        \
+    }                                                                          \
+    for (; i < n; i++) {                                                       \
+      const la_vec3 c = {.elem = {x[i], y[i], z[i]}};                          \
+      mask[i / 32] |= (uint32_t)la_frustum_test_sphere(f, c, r[i])             \
+                      << (i % 32);                                             \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  TARGET static void la_frustum_cull_aabbs##S(                                 \
+      const la_frustum *f, const float *cx, const float *cy, const float *cz,  \
+      const float *ex, const float *ey, const float *ez, size_t n,             \
+      uint32_t *mask) {                                                        \
+    size_t i = 0;                                                              \
+    for (size_t w = 0; w < (n + 31) / 32; w++) {                               \
+      mask[w] = 0;                                                             \
+    }                                                                          \
+    const V zero = V##_set1(0.0f);                                             \
+    for (; i + W <= n; i += W) {                                               \
+      const V vcx = V##_load(cx + i);                                          \
+      const V vcy = V##_load(cy + i);                                          \
+      const V vcz = V##_load(cz + i);                                          \
+      const V vex = V##_load(ex + i);                                          \
+      const V vey = V##_load(ey + i);                                          \
+      const V vez = V##_load(ez + i);                                          \
+      V##_mask out = V##_none();                                               \
+      for (int p = 0; p < 6; p++) {                                            \
+        const la_vec4 *pl = &f->planes[p];                                     \
+        V d = V##_mul(V##_set1(pl->x), vcx);                                   \
+        d = V##_add(d, V##_mul(V##_set1(pl->y), vcy));                         \
+        d = V##_add(d, V##_mul(V##_set1(pl->z), vcz));                         \
+        d = V##_add(d, V##_set1(pl->w));                                       \
+        V e = V##_mul(V##_set1(fabsf(pl->x)), vex);                            \
+        e = V##_add(e, V##_mul(V##_set1(fabsf(pl->y)), vey));                  \
+        e = V##_add(e, V##_mul(V##_set1(fabsf(pl->z)), vez));                  \
+        out = V##_or(out, V##_lt(V##_add(d, e), zero));                        \
+      }                                                                        \
+      const uint32_t bits = ~(uint32_t)V##_bits(out) & ((1u << W) - 1);        \
+      mask[i / 32] |= bits << (i % 32);                                        \
+    }                                                                          \
+    for (; i < n; i++) {                                                       \
+      const la_vec3 c = {.elem = {cx[i], cy[i], cz[i]}};                       \
+      const la_vec3 e = {.elem = {ex[i], ey[i], ez[i]}};                       \
+      mask[i / 32] |= (uint32_t)la_frustum_test_aabb(f, c, e) << (i % 32);     \
+    }                                                                          \
+  }
+LA_DISPATCH_KERNELS(_avx2, la_v8, 8, LA_TARGET_AVX2)
+LA_DISPATCH_KERNELS(_avx512, la_v16, 16, LA_TARGET_AVX512)
+
+/* The matrix kernels do not fit the SoA pattern. la_productm4_batch_avx2
+ * computes two rows per instruction like la_productm4_avx; the AVX-512
+ * version holds a whole matrix in one register, broadcasting the rows of b
+ * to all four lanes and the elements of a within each lane. */
+LA_TARGET_AVX2 static void la_productm4_batch_avx2(const la_mat4 *a,
+                                                   const la_mat4 *b,
+                                                   la_mat4 *out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    const __m256 b0 = _mm256_broadcast_ps((const __m128 *)b[i].elem[0]);
+    const __m256 b1 = _mm256_broadcast_ps((const __m128 *)b[i].elem[1]);
+    const __m256 b2 = _mm256_broadcast_ps((const __m128 *)b[i].elem[2]);
+    const __m256 b3 = _mm256_broadcast_ps((const __m128 *)b[i].elem[3]);
+    const __m256 a01 = _mm256_loadu_ps(a[i].elem[0]);
+    const __m256 a23 = _mm256_loadu_ps(a[i].elem[2]);
+    __m256 r01 = _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x00), b0);
+    __m256 r23 = _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x00), b0);
+    r01 = _mm256_add_ps(r01,
+                        _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0x55), b1));
+    r23 = _mm256_add_ps(r23,
+                        _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0x55), b1));
+    r01 = _mm256_add_ps(r01,
+                        _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xAA), b2));
+    r23 = _mm256_add_ps(r23,
+                        _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xAA), b2));
+    r01 = _mm256_add_ps(r01,
+                        _mm256_mul_ps(_mm256_shuffle_ps(a01, a01, 0xFF), b3));
+    r23 = _mm256_add_ps(r23,
+                        _mm256_mul_ps(_mm256_shuffle_ps(a23, a23, 0xFF), b3));
+    _mm256_storeu_ps(out[i].elem[0], r01);
+    _mm256_storeu_ps(out[i].elem[2], r23);
+  }
+}
+
+LA_TARGET_AVX512 static void la_productm4_batch_avx512(const la_mat4 *a,
+                                                       const la_mat4 *b,
+                                                       la_mat4 *out,
+                                                       size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    const __m512 m = _mm512_loadu_ps(a[i].elem[0]);
+    const __m512 b0 = _mm512_broadcast_f32x4(_mm_loadu_ps(b[i].elem[0]));
+    const __m512 b1 = _mm512_broadcast_f32x4(_mm_loadu_ps(b[i].elem[1]));
+    const __m512 b2 = _mm512_broadcast_f32x4(_mm_loadu_ps(b[i].elem[2]));
+    const __m512 b3 = _mm512_broadcast_f32x4(_mm_loadu_ps(b[i].elem[3]));
+    __m512 r = _mm512_mul_ps(_mm512_permute_ps(m, 0x00), b0);
+    r = _mm512_add_ps(r, _mm512_mul_ps(_mm512_permute_ps(m, 0x55), b1));
+    r = _mm512_add_ps(r, _mm512_mul_ps(_mm512_permute_ps(m, 0xAA), b2));
+    r = _mm512_add_ps(r, _mm512_mul_ps(_mm512_permute_ps(m, 0xFF), b3));
+    _mm512_storeu_ps(out[i].elem[0], r);
+  }
+}
+
+/* Two (AVX2) or four (AVX-512) vectors per register, each a combination of
+ * the columns of m. */
+LA_TARGET_AVX2 static void la_transform_points_v4_aos_avx2(const la_mat4 *m,
+                                                           const la_vec4 *in,
+                                                           la_vec4 *out,
+                                                           size_t n) {
+  __m128 c[4];
+  for (size_t k = 0; k < 4; k++) {
+    c[k] = _mm_loadu_ps(m->elem[k]);
+  }
+  _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+  __m256 cc[4];
+  for (size_t k = 0; k < 4; k++) {
+    cc[k] = _mm256_insertf128_ps(_mm256_castps128_ps256(c[k]), c[k], 1);
+  }
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    const __m256 v = _mm256_loadu_ps(in[i].elem);
+    __m256 r = _mm256_mul_ps(cc[0], _mm256_shuffle_ps(v, v, 0x00));
+    r = _mm256_add_ps(r, _mm256_mul_ps(cc[1], _mm256_shuffle_ps(v, v, 0x55)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(cc[2], _mm256_shuffle_ps(v, v, 0xAA)));
+    r = _mm256_add_ps(r, _mm256_mul_ps(cc[3], _mm256_shuffle_ps(v, v, 0xFF)));
+    _mm256_storeu_ps(out[i].elem, r);
+  }
+  la_transform_points_v4_aos_base(m, in + i, out + i, n - i);
+}
+
+LA_TARGET_AVX512 static void la_transform_points_v4_aos_avx512(
+    const la_mat4 *m, const la_vec4 *in, la_vec4 *out, size_t n) {
+  __m128 c[4];
+  for (size_t k = 0; k < 4; k++) {
+    c[k] = _mm_loadu_ps(m->elem[k]);
+  }
+  _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+  __m512 cc[4];
+  for (size_t k = 0; k < 4; k++) {
+    cc[k] = _mm512_broadcast_f32x4(c[k]);
+  }
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m512 v = _mm512_loadu_ps(in[i].elem);
+    __m512 r = _mm512_mul_ps(cc[0], _mm512_permute_ps(v, 0x00));
+    r = _mm512_add_ps(r, _mm512_mul_ps(cc[1], _mm512_permute_ps(v, 0x55)));
+    r = _mm512_add_ps(r, _mm512_mul_ps(cc[2], _mm512_permute_ps(v, 0xAA)));
+    r = _mm512_add_ps(r, _mm512_mul_ps(cc[3], _mm512_permute_ps(v, 0xFF)));
+    _mm512_storeu_ps(out[i].elem, r);
+  }
+  la_transform_points_v4_aos_base(m, in + i, out + i, n - i);
+}
+
+#if !defined(__clang__)
+#pragma GCC pop_options
+#endif
+#endif  // LA_HAS_DISPATCH
+
+typedef struct la_kernels {
+  void (*productm4_batch)(const la_mat4 *a, const la_mat4 *b, la_mat4 *out,
+                          size_t n);
+  void (*transform_points_v4)(const la_mat4 *m, const float *x,
+                              const float *y, const float *z, const float *w,
+                              float *ox, float *oy, float *oz, float *ow,
+                              size_t n);
+  void (*transform_points_v4_aos)(const la_mat4 *m, const la_vec4 *in,
+                                  la_vec4 *out, size_t n);
+  void (*normalizev3_soa)(const float *x, const float *y, const float *z,
+                          float *ox, float *oy, float *oz, size_t n);
+  void (*cull_spheres)(const la_frustum *f, const float *x, const float *y,
+                       const float *z, const float *r, size_t n,
+                       uint32_t *mask);
+  void (*cull_aabbs)(const la_frustum *f, const float *cx, const float *cy,
+                     const float *cz, const float *ex, const float *ey,
+                     const float *ez, size_t n, uint32_t *mask);
+} la_kernels;
+
+#define LA_KERNELS(S)                                                          \
+  {la_productm4_batch##S,         la_transform_points_v4##S,                   \
+   la_transform_points_v4_aos##S, la_normalizev3_soa##S,                       \
+   la_frustum_cull_spheres##S,    la_frustum_cull_aabbs##S}
+
+/* Indexed by la_simd_level. */
+static const la_kernels la_kernels_by_level[] = {
+    LA_KERNELS(_base),
+#ifdef LA_HAS_DISPATCH
+    LA_KERNELS(_avx2),
+    LA_KERNELS(_avx512),
+#endif
+};
+
+#ifdef LA_HAS_DISPATCH
+/* -1 until the first dispatched call reads the CPU and LA_SIMD. */
+static int la_simd_active = -1;
+
+static int la_simd_from_env(int max) {
+  const char *env = getenv("LA_SIMD");
+  int level = max;
+  if (env == NULL) {
+    return level;
+  }
+  if (strcmp(env, "baseline") == 0 || strcmp(env, "sse2") == 0) {
+    level = LA_SIMD_BASELINE;
+  } else if (strcmp(env, "avx2") == 0) {
+    level = LA_SIMD_AVX2;
+  } else if (strcmp(env, "avx512") == 0) {
+    level = LA_SIMD_AVX512;
+  }
+  return level < max ? level : max;
+}
+#endif
+
+static const la_kernels *la_dispatch(void) {
+#ifdef LA_HAS_DISPATCH
+  int level = __atomic_load_n(&la_simd_active, __ATOMIC_RELAXED);
+  if (level < 0) {
+    level = la_simd_from_env(la_simd_max_level());
+    __atomic_store_n(&la_simd_active, level, __ATOMIC_RELAXED);
+  }
+  return &la_kernels_by_level[level];
+#else
+  return &la_kernels_by_level[0];
+#endif
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_simd_level la_simd_max_level(void) {
+#ifdef LA_HAS_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return LA_SIMD_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return LA_SIMD_AVX2;
+  }
+#endif
+  return LA_SIMD_BASELINE;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_simd_level la_get_simd_level(void) {
+  return (la_simd_level)(la_dispatch() - la_kernels_by_level);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_set_simd_level(la_simd_level level) {
+  if (level < LA_SIMD_BASELINE || level > la_simd_max_level()) {
+    return 0;
+  }
+#ifdef LA_HAS_DISPATCH
+  __atomic_store_n(&la_simd_active, (int)level, __ATOMIC_RELAXED);
+#endif
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_productm4_batch(const la_mat4 *a, const la_mat4 *b, la_mat4 *out,
+                        size_t n) {
+  LA_PROFILE_ENTER(la_productm4_batch);
+  la_dispatch()->productm4_batch(a, b, out, n);
+  LA_PROFILE_LEAVE(la_productm4_batch);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_transform_points_v4(const la_mat4 *m, const float *x, const float *y,
+                            const float *z, const float *w, float *ox,
+                            float *oy, float *oz, float *ow, size_t n) {
+  LA_PROFILE_ENTER(la_transform_points_v4);
+  la_dispatch()->transform_points_v4(m, x, y, z, w, ox, oy, oz, ow, n);
+  LA_PROFILE_LEAVE(la_transform_points_v4);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_transform_points_v4_aos(const la_mat4 *m, const la_vec4 *in,
+                                la_vec4 *out, size_t n) {
+  LA_PROFILE_ENTER(la_transform_points_v4_aos);
+  la_dispatch()->transform_points_v4_aos(m, in, out, n);
+  LA_PROFILE_LEAVE(la_transform_points_v4_aos);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_normalizev3_soa(const float *x, const float *y, const float *z,
+                        float *ox, float *oy, float *oz, size_t n) {
+  la_dispatch()->normalizev3_soa(x, y, z, ox, oy, oz, n);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_frustum_cull_spheres(const la_frustum *f, const float *x,
+                             const float *y, const float *z, const float *r,
+                             size_t n, uint32_t *mask) {
+  LA_PROFILE_ENTER(la_frustum_cull_spheres);
+  la_dispatch()->cull_spheres(f, x, y, z, r, n, mask);
+  LA_PROFILE_LEAVE(la_frustum_cull_spheres);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_frustum_cull_aabbs(const la_frustum *f, const float *cx,
+                           const float *cy, const float *cz, const float *ex,
+                           const float *ey, const float *ez, size_t n,
+                           uint32_t *mask) {
+  LA_PROFILE_ENTER(la_frustum_cull_aabbs);
+  la_dispatch()->cull_aabbs(f, cx, cy, cz, ex, ey, ez, n, mask);
+  LA_PROFILE_LEAVE(la_frustum_cull_aabbs);
+}
+
+/* Ray queries. la_minf and la_maxf pick like minps and maxps (the second
+ * operand when either is NaN), so the single ray tests and the packet kernels
+ * agree on every hit. */
+static inline float la_minf(float a, float b) { return a < b ? a : b; }
+static inline float la_maxf(float a, float b) { return a > b ? a : b; }
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_ray_test_triangle(const la_ray *r, const la_vec3 *tri, float *t,
+                         la_vec2 *uv) {
+  const float *o = r->origin.elem;
+  const float *d = r->dir.elem;
+  float e1[3], e2[3], tv[3];
+  for (int k = 0; k < 3; k++) {
+    e1[k] = tri[1].elem[k] - tri[0].elem[k];
+    e2[k] = tri[2].elem[k] - tri[0].elem[k];
+    tv[k] = o[k] - tri[0].elem[k];
+  }
+  const float px = d[1] * e2[2] - d[2] * e2[1];
+  const float py = d[2] * e2[0] - d[0] * e2[2];
+  const float pz = d[0] * e2[1] - d[1] * e2[0];
+  const float det = e1[0] * px + e1[1] * py + e1[2] * pz;
+  const float inv = 1.0f / det;
+  const float u = (tv[0] * px + tv[1] * py + tv[2] * pz) * inv;
+  const float qx = tv[1] * e1[2] - tv[2] * e1[1];
+  const float qy = tv[2] * e1[0] - tv[0] * e1[2];
+  const float qz = tv[0] * e1[1] - tv[1] * e1[0];
+  const float v = (d[0] * qx + d[1] * qy + d[2] * qz) * inv;
+  const float h = (e2[0] * qx + e2[1] * qy + e2[2] * qz) * inv;
+  if (!((det < 0.0f || det > 0.0f) && u >= 0.0f && v >= 0.0f &&
+        u + v <= 1.0f && h > r->tmin && h < r->tmax)) {
+    return 0;
+  }
+  if (t != NULL) {
+    *t = h;
+  }
+  if (uv != NULL) {
+    uv->x = u;
+    uv->y = v;
+  }
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_ray_test_aabb(const la_ray *r, const la_vec3 min, const la_vec3 max,
+                     float *t) {
+  float tn = 0.0f;
+  float tf = 0.0f;
+  for (int k = 0; k < 3; k++) {
+    const float inv = 1.0f / r->dir.elem[k];
+    const float t1 = (min.elem[k] - r->origin.elem[k]) * inv;
+    const float t2 = (max.elem[k] - r->origin.elem[k]) * inv;
+    tn = k == 0 ? la_minf(t1, t2) : la_maxf(tn, la_minf(t1, t2));
+    tf = k == 0 ? la_maxf(t1, t2) : la_minf(tf, la_maxf(t1, t2));
+  }
+  const float h = la_maxf(tn, r->tmin);
+  if (!(h <= tf && h < r->tmax)) {
+    return 0;
+  }
+  if (t != NULL) {
+    *t = h;
+  }
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_ray_test_sphere(const la_ray *r, const la_vec3 center,
+                       const float radius, float *t) {
+  const float *d = r->dir.elem;
+  const float ox = r->origin.x - center.x;
+  const float oy = r->origin.y - center.y;
+  const float oz = r->origin.z - center.z;
+  const float b = ox * d[0] + oy * d[1] + oz * d[2];
+  const float a = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+  const float c = ox * ox + oy * oy + oz * oz - radius * radius;
+  const float disc = b * b - a * c;
+  const float sq = sqrtf(disc);
+  const float t0 = (0.0f - b - sq) / a;
+  const float t1 = (0.0f - b + sq) / a;
+  const float h = t0 > r->tmin ? t0 : t1;
+  if (!(disc >= 0.0f && h > r->tmin && h < r->tmax)) {
+    return 0;
+  }
+  if (t != NULL) {
+    *t = h;
+  }
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_ray_packet_clear(la_ray_packet *p) {
+  memset(p, 0, sizeof(*p));
+  for (size_t i = 0; i < LA_RAY_PACKET; i++) {
+    p->prim[i] = -1;
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_ray_packet_set(la_ray_packet *p, size_t lane, const la_ray *r) {
+  p->ox[lane] = r->origin.x;
+  p->oy[lane] = r->origin.y;
+  p->oz[lane] = r->origin.z;
+  p->dx[lane] = r->dir.x;
+  p->dy[lane] = r->dir.y;
+  p->dz[lane] = r->dir.z;
+  p->tmin[lane] = r->tmin;
+  p->t[lane] = r->tmax;
+  p->u[lane] = 0.0f;
+  p->v[lane] = 0.0f;
+  p->prim[lane] = -1;
+}
+
+typedef enum la_ray_prims {
+  LA_RAY_TRIANGLES,
+  LA_RAY_AABBS,
+  LA_RAY_SPHERES,
+} la_ray_prims;
+
+#ifdef LA_VF_WIDTH
+/* The packet kernels test LA_VF_WIDTH lanes at a time against one primitive,
+ * with the operations of the single ray tests in the same order. Each
+ * returns the lanes that hit after tmin, and the distances in h. */
+#define LA_RAY_GROUP LA_VF_WIDTH
+
+typedef struct la_vf_rays {
+  la_vf ox, oy, oz;
+  la_vf dx, dy, dz;
+  la_vf ix, iy, iz; // 1 / dir, for the slab test.
+  la_vf dd;         // dot(dir, dir), for spheres.
+  la_vf tmin;
+} la_vf_rays;
+
+static inline la_vf_rays la_vf_load_rays(const la_ray_packet *p, size_t g) {
+  la_vf_rays r;
+  const la_vf one = la_vf_set1(1.0f);
+  r.ox = la_vf_load(p->ox + g);
+  r.oy = la_vf_load(p->oy + g);
+  r.oz = la_vf_load(p->oz + g);
+  r.dx = la_vf_load(p->dx + g);
+  r.dy = la_vf_load(p->dy + g);
+  r.dz = la_vf_load(p->dz + g);
+  r.ix = la_vf_div(one, r.dx);
+  r.iy = la_vf_div(one, r.dy);
+  r.iz = la_vf_div(one, r.dz);
+  r.dd = la_vf_add(la_vf_add(la_vf_mul(r.dx, r.dx), la_vf_mul(r.dy, r.dy)),
+                   la_vf_mul(r.dz, r.dz));
+  r.tmin = la_vf_load(p->tmin + g);
+  return r;
+}
+
+static inline la_vf la_vf_dot3(la_vf ax, la_vf ay, la_vf az, la_vf bx,
+                               la_vf by, la_vf bz) {
+  return la_vf_add(la_vf_add(la_vf_mul(ax, bx), la_vf_mul(ay, by)),
+                   la_vf_mul(az, bz));
+}
+
+static inline la_vf la_vf_ray_triangle(const la_vf_rays *r,
+                                       const la_vec3 *tri, la_vf *h,
+                                       la_vf *u, la_vf *v) {
+  float e1[3], e2[3];
+  for (int k = 0; k < 3; k++) {
+    e1[k] = tri[1].elem[k] - tri[0].elem[k];
+    e2[k] = tri[2].elem[k] - tri[0].elem[k];
+  }
+  const la_vf e1x = la_vf_set1(e1[0]), e1y = la_vf_set1(e1[1]);
+  const la_vf e1z = la_vf_set1(e1[2]);
+  const la_vf e2x = la_vf_set1(e2[0]), e2y = la_vf_set1(e2[1]);
+  const la_vf e2z = la_vf_set1(e2[2]);
+  const la_vf tx = la_vf_sub(r->ox, la_vf_set1(tri[0].x));
+  const la_vf ty = la_vf_sub(r->oy, la_vf_set1(tri[0].y));
+  const la_vf tz = la_vf_sub(r->oz, la_vf_set1(tri[0].z));
+  const la_vf px = la_vf_sub(la_vf_mul(r->dy, e2z), la_vf_mul(r->dz, e2y));
+  const la_vf py = la_vf_sub(la_vf_mul(r->dz, e2x), la_vf_mul(r->dx, e2z));
+  const la_vf pz = la_vf_sub(la_vf_mul(r->dx, e2y), la_vf_mul(r->dy, e2x));
+  const la_vf det = la_vf_dot3(e1x, e1y, e1z, px, py, pz);
+  const la_vf inv = la_vf_div(la_vf_set1(1.0f), det);
+  *u = la_vf_mul(la_vf_dot3(tx, ty, tz, px, py, pz), inv);
+  const la_vf qx = la_vf_sub(la_vf_mul(ty, e1z), la_vf_mul(tz, e1y));
+  const la_vf qy = la_vf_sub(la_vf_mul(tz, e1x), la_vf_mul(tx, e1z));
+  const la_vf qz = la_vf_sub(la_vf_mul(tx, e1y), la_vf_mul(ty, e1x));
+  *v = la_vf_mul(la_vf_dot3(r->dx, r->dy, r->dz, qx, qy, qz), inv);
+  *h = la_vf_mul(la_vf_dot3(e2x, e2y, e2z, qx, qy, qz), inv);
+
+  const la_vf zero = la_vf_set1(0.0f);
+  la_vf hit = la_vf_or(la_vf_lt(det, zero), la_vf_lt(zero, det));
+  hit = la_vf_and(hit, la_vf_le(zero, *u));
+  hit = la_vf_and(hit, la_vf_le(zero, *v));
+  hit = la_vf_and(hit, la_vf_le(la_vf_add(*u, *v), la_vf_set1(1.0f)));
+  return la_vf_and(hit, la_vf_lt(r->tmin, *h));
+}
+
+static inline la_vf la_vf_ray_aabb(const la_vf_rays *r, const la_vec3 min,
+                                   const la_vec3 max, la_vf *h) {
+  la_vf t1 = la_vf_mul(la_vf_sub(la_vf_set1(min.x), r->ox), r->ix);
+  la_vf t2 = la_vf_mul(la_vf_sub(la_vf_set1(max.x), r->ox), r->ix);
+  la_vf tn = la_vf_min(t1, t2);
+  la_vf tf = la_vf_max(t1, t2);
+  t1 = la_vf_mul(la_vf_sub(la_vf_set1(min.y), r->oy), r->iy);
+  t2 = la_vf_mul(la_vf_sub(la_vf_set1(max.y), r->oy), r->iy);
+  tn = la_vf_max(tn, la_vf_min(t1, t2));
+  tf = la_vf_min(tf, la_vf_max(t1, t2));
+  t1 = la_vf_mul(la_vf_sub(la_vf_set1(min.z), r->oz), r->iz);
+  t2 = la_vf_mul(la_vf_sub(la_vf_set1(max.z), r->oz), r->iz);
+  tn = la_vf_max(tn, la_vf_min(t1, t2));
+  tf = la_vf_min(tf, la_vf_max(t1, t2));
+  *h = la_vf_max(tn, r->tmin);
+  return la_vf_le(*h, tf);
+}
+
+static inline la_vf la_vf_ray_sphere(const la_vf_rays *r, const la_vec4 s,
+                                     la_vf *h) {
+  const la_vf zero = la_vf_set1(0.0f);
+  const la_vf ox = la_vf_sub(r->ox, la_vf_set1(s.x));
+  const la_vf oy = la_vf_sub(r->oy, la_vf_set1(s.y));
+  const la_vf oz = la_vf_sub(r->oz, la_vf_set1(s.z));
+  const la_vf b = la_vf_dot3(ox, oy, oz, r->dx, r->dy, r->dz);
+  const la_vf c =
+      la_vf_sub(la_vf_dot3(ox, oy, oz, ox, oy, oz), la_vf_set1(s.w * s.w));
+  const la_vf disc = la_vf_sub(la_vf_mul(b, b), la_vf_mul(r->dd, c));
+  const la_vf sq = la_vf_sqrt(disc);
+  const la_vf t0 = la_vf_div(la_vf_sub(la_vf_sub(zero, b), sq), r->dd);
+  const la_vf t1 = la_vf_div(la_vf_add(la_vf_sub(zero, b), sq), r->dd);
+  *h = la_vf_select(la_vf_lt(r->tmin, t0), t0, t1);
+  return la_vf_and(la_vf_le(zero, disc), la_vf_lt(r->tmin, *h));
+}
+#else
+#define LA_RAY_GROUP 1
+#endif
+
+/* Runs the rays of p, LA_RAY_GROUP lanes at a time, against n primitives of
+ * one kind. Lanes with t <= tmin are inactive; in LA_RAY_ANY mode so are
+ * lanes that have a hit, and a group stops once all of its lanes are. */
+static inline uint32_t la_ray_packet_query(la_ray_packet *p,
+                                           la_ray_prims kind, const void *a,
+                                           const void *b, size_t n,
+                                           la_ray_mode mode) {
+  const uint32_t all = (1u << LA_RAY_GROUP) - 1;
+  uint32_t hits = 0;
+  for (size_t g = 0; g < LA_RAY_PACKET; g += LA_RAY_GROUP) {
+    uint32_t done = 0;
+    for (size_t l = 0; l < LA_RAY_GROUP; l++) {
+      const int hit = mode == LA_RAY_ANY && p->prim[g + l] >= 0;
+      done |= (uint32_t)(!(p->t[g + l] > p->tmin[g + l]) || hit) << l;
+    }
+#ifdef LA_VF_WIDTH
+    /* The lanes that are not done, as a mask. */
+    float open[LA_RAY_GROUP];
+    for (size_t l = 0; l < LA_RAY_GROUP; l++) {
+      open[l] = (done >> l) & 1 ? 0.0f : 1.0f;
+    }
+    la_vf active = la_vf_lt(la_vf_set1(0.0f), la_vf_load(open));
+    const la_vf_rays r = la_vf_load_rays(p, g);
+    la_vf t = la_vf_load(p->t + g);
+    la_vf u = la_vf_load(p->u + g);
+    la_vf v = la_vf_load(p->v + g);
+    for (size_t i = 0; i < n && done != all; i++) {
+      const la_vf zero = la_vf_set1(0.0f);
+      la_vf h, hu = zero, hv = zero, hit;
+      if (kind == LA_RAY_TRIANGLES) {
+        hit = la_vf_ray_triangle(&r, (const la_vec3 *)a + 3 * i, &h, &hu, &hv);
+      } else if (kind == LA_RAY_AABBS) {
+        hit = la_vf_ray_aabb(&r, ((const la_vec3 *)a)[i],
+                             ((const la_vec3 *)b)[i], &h);
+      } else {
+        hit = la_vf_ray_sphere(&r, ((const la_vec4 *)a)[i], &h);
+      }
+      hit = la_vf_and(la_vf_and(hit, active), la_vf_lt(h, t));
+      const uint32_t bits = (uint32_t)la_vf_movemask(hit);
+      if (bits != 0) {
+        t = la_vf_select(hit, h, t);
+        u = la_vf_select(hit, hu, u);
+        v = la_vf_select(hit, hv, v);
+        for (size_t l = 0; l < LA_RAY_GROUP; l++) {
+          p->prim[g + l] = (bits >> l) & 1 ? (int32_t)i : p->prim[g + l];
+        }
+        hits |= bits << g;
+        if (mode == LA_RAY_ANY) {
+          done |= bits;
+          active = la_vf_andnot(hit, active);
+        }
+      }
+    }
+    la_vf_store(p->t + g, t);
+    la_vf_store(p->u + g, u);
+    la_vf_store(p->v + g, v);
+#else
+    const la_vec3 o = {.elem = {p->ox[g], p->oy[g], p->oz[g]}};
+    const la_vec3 d = {.elem = {p->dx[g], p->dy[g], p->dz[g]}};
+    for (size_t i = 0; i < n && done != all; i++) {
+      const la_ray r = {o, d, p->tmin[g], p->t[g]};
+      float h;
+      la_vec2 uv = {.elem = {0.0f, 0.0f}};
+      int hit;
+      if (kind == LA_RAY_TRIANGLES) {
+        hit = la_ray_test_triangle(&r, (const la_vec3 *)a + 3 * i, &h, &uv);
+      } else if (kind == LA_RAY_AABBS) {
+        hit = la_ray_test_aabb(&r, ((const la_vec3 *)a)[i],
+                               ((const la_vec3 *)b)[i], &h);
+      } else {
+        const la_vec4 s = ((const la_vec4 *)a)[i];
+        const la_vec3 c = {.elem = {s.x, s.y, s.z}};
+        hit = la_ray_test_sphere(&r, c, s.w, &h);
+      }
+      if (hit) {
+        p->t[g] = h;
+        p->u[g] = uv.x;
+        p->v[g] = uv.y;
+        p->prim[g] = (int32_t)i;
+        hits |= 1u << g;
+        done |= mode == LA_RAY_ANY;
+      }
+    }
+#endif
+  }
+  return hits;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+uint32_t la_ray_packet_triangles(la_ray_packet *p, const la_vec3 *tris,
+                                 size_t n, la_ray_mode mode) {
+  LA_PROFILE_ENTER(la_ray_packet_triangles);
+  const uint32_t hits =
+      la_ray_packet_query(p, LA_RAY_TRIANGLES, tris, NULL, n, mode);
+  LA_PROFILE_LEAVE(la_ray_packet_triangles);
+  return hits;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+uint32_t la_ray_packet_aabbs(la_ray_packet *p, const la_vec3 *min,
+                             const la_vec3 *max, size_t n, la_ray_mode mode) {
+  LA_PROFILE_ENTER(la_ray_packet_aabbs);
+  const uint32_t hits = la_ray_packet_query(p, LA_RAY_AABBS, min, max, n, mode);
+  LA_PROFILE_LEAVE(la_ray_packet_aabbs);
+  return hits;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+uint32_t la_ray_packet_spheres(la_ray_packet *p, const la_vec4 *spheres,
+                               size_t n, la_ray_mode mode) {
+  LA_PROFILE_ENTER(la_ray_packet_spheres);
+  const uint32_t hits =
+      la_ray_packet_query(p, LA_RAY_SPHERES, spheres, NULL, n, mode);
+  LA_PROFILE_LEAVE(la_ray_packet_spheres);
+  return hits;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * The point is transformed as a row vector, like la_frustum_from_m4, and
+ * divided by w.
+ */
+la_vec3 la_unproject(const la_mat4 inv_vp, const la_vec3 ndc) {
+  float h[4];
+  for (size_t k = 0; k < 4; k++) {
+    h[k] = ndc.x * inv_vp.elem[0][k] + ndc.y * inv_vp.elem[1][k] +
+           ndc.z * inv_vp.elem[2][k] + inv_vp.elem[3][k];
+  }
+  la_vec3 r = {.elem = {h[0] / h[3], h[1] / h[3], h[2] / h[3]}};
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_ray la_pick_ray(const la_mat4 inv_vp, const la_vec4 viewport,
+                   const la_vec2 pixel) {
+  const float x = 2.0f * (pixel.x - viewport.x) / viewport.z - 1.0f;
+  const float y = 1.0f - 2.0f * (pixel.y - viewport.y) / viewport.w;
+  const la_vec3 ndc0 = {.elem = {x, y, -1.0f}};
+  const la_vec3 ndc1 = {.elem = {x, y, 1.0f}};
+  const la_vec3 p0 = la_unproject(inv_vp, ndc0);
+  const la_vec3 p1 = la_unproject(inv_vp, ndc1);
+  la_ray r;
+  r.origin = p0;
+  for (int k = 0; k < 3; k++) {
+    r.dir.elem[k] = p1.elem[k] - p0.elem[k];
+  }
+  r.tmin = 0.0f;
+  r.tmax = sqrtf(la_dotv3(r.dir, r.dir));
+  for (int k = 0; k < 3; k++) {
+    r.dir.elem[k] /= r.tmax;
+  }
+  return r;
+}
+
+/* BVH. The build splits the primitives into a binary tree of la_bvh_bnode,
+ * then collapses it into nodes of LA_BVH_WIDTH children. */
+#define LA_BVH_BINS 16
+#define LA_BVH_LEAF 4            // The most primitives in a leaf.
+#define LA_BVH_MAX_DEPTH 48      // Deeper nodes are split at the median.
+#define LA_BVH_PARALLEL 65536    // Nodes binned in parallel from this size.
+#define LA_BVH_CHUNKS 64         // The most chunks of a parallel pass.
+#define LA_BVH_EMPTY UINT32_MAX  // An unused child.
+/* Median splits end in 32 levels, so this holds every node on the way down
+ * with all of their siblings. */
+#define LA_BVH_STACK (LA_BVH_WIDTH * (LA_BVH_MAX_DEPTH + 34))
+
+typedef struct la_bvh_node {
+  float min_x[LA_BVH_WIDTH];
+  float min_y[LA_BVH_WIDTH];
+  float min_z[LA_BVH_WIDTH];
+  float max_x[LA_BVH_WIDTH];
+  float max_y[LA_BVH_WIDTH];
+  float max_z[LA_BVH_WIDTH];
+  /* A node index, the first primitive of a leaf or LA_BVH_EMPTY. An empty
+   * child is a point at +infinity, which no ray reaches, but an unbounded
+   * box does, so box queries check for it. */
+  uint32_t child[LA_BVH_WIDTH];
+  uint32_t count[LA_BVH_WIDTH]; // The primitives of a leaf, 0 for a node.
+} la_bvh_node;
+
+struct la_bvh {
+  la_ray_prims kind; // LA_RAY_TRIANGLES or LA_RAY_AABBS.
+  size_t count;
+  la_bvh_node *nodes; // The root first, and children after their parents.
+  size_t nnodes;
+  size_t capacity;
+  uint32_t *ids; // The primitive index of each leaf position.
+  la_vec3 *tris; // The triangles in leaf order,
+  la_vec3 *min;  // or the boxes.
+  la_vec3 *max;
+};
+
+typedef struct la_bvh_box {
+  float min[3];
+  float max[3];
+} la_bvh_box;
+
+typedef struct la_bvh_prim {
+  float min[3];
+  uint32_t id;
+  float max[3];
+  uint32_t pad;
+} la_bvh_prim;
+
+typedef struct la_bvh_bnode {
+  la_bvh_box box;
+  uint32_t first; // The first primitive of a leaf, or the first child.
+  uint32_t count; // The primitives of a leaf, 0 for children first and
+                  // first + 1.
+} la_bvh_bnode;
+
+typedef struct la_bvh_bins {
+  la_bvh_box box[3][LA_BVH_BINS];
+  uint32_t count[3][LA_BVH_BINS];
+} la_bvh_bins;
+
+/* How the centroids (min + max) of a node map to bins. Small nodes use
+ * fewer bins. */
+typedef struct la_bvh_binning {
+  la_bvh_box cbox;
+  float scale[3]; // 0 for an axis where all centroids are equal.
+  size_t nbins;
+} la_bvh_binning;
+
+typedef struct la_bvh_task {
+  uint32_t node;
+  uint32_t next; // The first of the nodes reserved for the subtree.
+  size_t depth;
+  la_bvh_box cbox;
+} la_bvh_task;
+
+typedef struct la_bvh_build {
+  const la_jobs *jobs;
+  la_bvh_prim *prims;
+  la_bvh_bnode *nodes;
+  size_t nchunks;    // Chunks of a parallel pass, 1 without jobs.
+  la_bvh_box *boxes; // nchunks bounds and centroid bounds.
+  la_bvh_bins *bins; // nchunks bins.
+  size_t task_min;   // Nodes up to this size are built as a whole.
+  la_bvh_task *tasks;
+  size_t ntasks;
+  size_t task_capacity;
+} la_bvh_build;
+
+/* A pass over the primitives [first, first + count) computing their bounds,
+ * or binning them when binning is set. */
+typedef struct la_bvh_pass {
+  la_bvh_build *b;
+  size_t first, count;
+  const la_bvh_binning *binning;
+} la_bvh_pass;
+
+static inline void la_bvh_box_empty(la_bvh_box *box) {
+  for (int k = 0; k < 3; k++) {
+    box->min[k] = INFINITY;
+    box->max[k] = -INFINITY;
+  }
+}
+
+static inline void la_bvh_box_grow(la_bvh_box *box, const float *min,
+                                   const float *max) {
+  for (int k = 0; k < 3; k++) {
+    box->min[k] = la_minf(box->min[k], min[k]);
+    box->max[k] = la_maxf(box->max[k], max[k]);
+  }
+}
+
+static inline void la_bvh_box_centroid(la_bvh_box *cbox,
+                                       const la_bvh_prim *p) {
+  for (int k = 0; k < 3; k++) {
+    const float c = p->min[k] + p->max[k];
+    cbox->min[k] = la_minf(cbox->min[k], c);
+    cbox->max[k] = la_maxf(cbox->max[k], c);
+  }
+}
+
+/* Half the surface area, for the SAH. */
+static inline float la_bvh_area(const la_bvh_box *box) {
+  const float dx = box->max[0] - box->min[0];
+  const float dy = box->max[1] - box->min[1];
+  const float dz = box->max[2] - box->min[2];
+  return dx * dy + dy * dz + dz * dx;
+}
+
+/* The bounds of primitive i of triangles or boxes, a and b as given to
+ * la_bvh_create. */
+static inline void la_bvh_input_box(la_ray_prims kind, const la_vec3 *a,
+                                    const la_vec3 *b, size_t i,
+                                    la_bvh_box *box) {
+  if (kind == LA_RAY_TRIANGLES) {
+    la_bvh_box_empty(box);
+    for (size_t v = 0; v < 3; v++) {
+      la_bvh_box_grow(box, a[i * 3 + v].elem, a[i * 3 + v].elem);
+    }
+  } else {
+    for (int k = 0; k < 3; k++) {
+      box->min[k] = a[i].elem[k];
+      box->max[k] = b[i].elem[k];
+    }
+  }
+}
+
+/* The bounds of the primitive at leaf position i. */
+static inline void la_bvh_leaf_box(const la_bvh *bvh, size_t i,
+                                   la_bvh_box *box) {
+  const la_vec3 *a = bvh->kind == LA_RAY_TRIANGLES ? bvh->tris : bvh->min;
+  la_bvh_input_box(bvh->kind, a, bvh->max, i, box);
+}
+
+static inline size_t la_bvh_bin(const la_bvh_prim *p, int k,
+                                const la_bvh_binning *g) {
+  const float c = p->min[k] + p->max[k];
+  /* Clamp before the cast, converting a float out of range of int is
+   * undefined. */
+  const float x = (c - g->cbox.min[k]) * g->scale[k];
+  return (size_t)fminf(fmaxf(x, 0.0f), (float)(g->nbins - 1));
+}
+
+static void la_bvh_bound(const la_bvh_prim *prims, size_t begin, size_t end,
+                         la_bvh_box *box, la_bvh_box *cbox) {
+  la_bvh_box_empty(box);
+  la_bvh_box_empty(cbox);
+  for (size_t i = begin; i < end; i++) {
+    la_bvh_box_grow(box, prims[i].min, prims[i].max);
+    la_bvh_box_centroid(cbox, &prims[i]);
+  }
+}
+
+static void la_bvh_bin_range(const la_bvh_prim *prims, size_t begin,
+                             size_t end, const la_bvh_binning *g,
+                             la_bvh_bins *bins) {
+  for (int k = 0; k < 3; k++) {
+    for (size_t i = 0; i < g->nbins; i++) {
+      la_bvh_box_empty(&bins->box[k][i]);
+      bins->count[k][i] = 0;
+    }
+  }
+  for (size_t i = begin; i < end; i++) {
+    for (int k = 0; k < 3; k++) {
+      if (g->scale[k] > 0.0f) {
+        const size_t j = la_bvh_bin(&prims[i], k, g);
+        la_bvh_box_grow(&bins->box[k][j], prims[i].min, prims[i].max);
+        bins->count[k][j]++;
+      }
+    }
+  }
+}
+
+static void la_bvh_pass_chunk(void *ctx, size_t c) {
+  const la_bvh_pass *p = ctx;
+  la_bvh_build *b = p->b;
+  const size_t begin = p->first + p->count * c / b->nchunks;
+  const size_t end = p->first + p->count * (c + 1) / b->nchunks;
+  if (p->binning == NULL) {
+    la_bvh_bound(b->prims, begin, end, &b->boxes[c * 2],
+                 &b->boxes[c * 2 + 1]);
+  } else {
+    la_bvh_bin_range(b->prims, begin, end, p->binning, &b->bins[c]);
+  }
+}
+
+/* Bounds the primitives [first, first + count), in parallel when nchunks is
+ * more than 1. The result does not depend on nchunks, as min and max are
+ * exact. */
+static void la_bvh_bound_range(la_bvh_build *b, size_t first, size_t count,
+                               size_t nchunks, la_bvh_box *box,
+                               la_bvh_box *cbox) {
+  if (nchunks <= 1) {
+    la_bvh_bound(b->prims, first, first + count, box, cbox);
+    return;
+  }
+  la_bvh_pass pass = {b, first, count, NULL};
+  b->jobs->parallel_for(b->jobs->user, nchunks, la_bvh_pass_chunk, &pass);
+  *box = b->boxes[0];
+  *cbox = b->boxes[1];
+  for (size_t c = 1; c < nchunks; c++) {
+    la_bvh_box_grow(box, b->boxes[c * 2].min, b->boxes[c * 2].max);
+    la_bvh_box_grow(cbox, b->boxes[c * 2 + 1].min, b->boxes[c * 2 + 1].max);
+  }
+}
+
+/* Finds the split of node, whose centroids are bounded by cbox, and
+ * reorders its primitives. Returns the size of the first half, or 0 for a
+ * leaf. child receives the bounds of the halves, then the bounds of their
+ * centroids. Large nodes are binned in parallel when parallel is set, with
+ * the same result. */
+static size_t la_bvh_split(la_bvh_build *b, const la_bvh_bnode *node,
+                           const la_bvh_box *cbox, size_t depth, int parallel,
+                           la_bvh_box *child) {
+  const size_t first = node->first;
+  const size_t count = node->count;
+  const size_t nchunks =
+      parallel && count >= LA_BVH_PARALLEL ? b->nchunks : 1;
+  if (count <= 1) {
+    return 0;
+  }
+
+  la_bvh_binning g;
+  g.cbox = *cbox;
+  g.nbins = count < LA_BVH_BINS ? count : LA_BVH_BINS;
+  int axes = 0;
+  for (int k = 0; k < 3; k++) {
+    const float extent = cbox->max[k] - cbox->min[k];
+    /* A subnormal extent would make the scale infinite. */
+    g.scale[k] =
+        extent > (float)g.nbins * FLT_MIN ? (float)g.nbins / extent : 0.0f;
+    axes += g.scale[k] > 0.0f;
+  }
+  if (depth >= LA_BVH_MAX_DEPTH || axes == 0) {
+    /* Too deep, or all centroids are equal. */
+    if (count <= LA_BVH_LEAF) {
+      return 0;
+    }
+    la_bvh_bound_range(b, first, count / 2, nchunks, &child[0], &child[2]);
+    la_bvh_bound_range(b, first + count / 2, count - count / 2, nchunks,
+                       &child[1], &child[3]);
+    return count / 2;
+  }
+
+  la_bvh_bins local;
+  la_bvh_bins *bins = &local;
+  if (nchunks > 1) {
+    la_bvh_pass pass = {b, first, count, &g};
+    b->jobs->parallel_for(b->jobs->user, nchunks, la_bvh_pass_chunk, &pass);
+    bins = &b->bins[0];
+    for (size_t c = 1; c < nchunks; c++) {
+      for (int k = 0; k < 3; k++) {
+        for (size_t i = 0; i < g.nbins; i++) {
+          la_bvh_box_grow(&bins->box[k][i], b->bins[c].box[k][i].min,
+                          b->bins[c].box[k][i].max);
+          bins->count[k][i] += b->bins[c].count[k][i];
+        }
+      }
+    }
+  } else {
+    la_bvh_bin_range(b->prims, first, first + count, &g, bins);
+  }
+
+  /* Sweep the bins from the right, then from the left. A split after bin i
+   * costs area * count on each side. */
+  float best = INFINITY;
+  int axis = -1;
+  size_t split = 0;
+  for (int k = 0; k < 3; k++) {
+    if (g.scale[k] <= 0.0f) {
+      continue;
+    }
+    la_bvh_box right[LA_BVH_BINS];
+    size_t right_count[LA_BVH_BINS];
+    la_bvh_box box;
+    la_bvh_box_empty(&box);
+    size_t n = 0;
+    for (size_t i = g.nbins - 1; i > 0; i--) {
+      la_bvh_box_grow(&box, bins->box[k][i].min, bins->box[k][i].max);
+      n += bins->count[k][i];
+      right[i] = box;
+      right_count[i] = n;
+    }
+    la_bvh_box_empty(&box);
+    n = 0;
+    for (size_t i = 0; i + 1 < g.nbins; i++) {
+      la_bvh_box_grow(&box, bins->box[k][i].min, bins->box[k][i].max);
+      n += bins->count[k][i];
+      if (n == 0 || right_count[i + 1] == 0) {
+        continue;
+      }
+      const float cost = la_bvh_area(&box) * (float)n +
+                         la_bvh_area(&right[i + 1]) * (float)right_count[i + 1];
+      if (cost < best) {
+        best = cost;
+        axis = k;
+        split = i;
+        child[0] = box;
+        child[1] = right[i + 1];
+      }
+    }
+  }
+  /* A traversal step costs as much as a primitive test. */
+  const float area = la_bvh_area(&node->box);
+  const int leaf = count <= LA_BVH_LEAF && area * (float)count <= area + best;
+  if (axis < 0 || leaf) {
+    return 0;
+  }
+
+  la_bvh_box_empty(&child[2]);
+  la_bvh_box_empty(&child[3]);
+  size_t i = first;
+  size_t j = first + count;
+  while (i < j) {
+    if (la_bvh_bin(&b->prims[i], axis, &g) <= split) {
+      la_bvh_box_centroid(&child[2], &b->prims[i]);
+      i++;
+    } else {
+      la_bvh_box_centroid(&child[3], &b->prims[i]);
+      const la_bvh_prim p = b->prims[i];
+      b->prims[i] = b->prims[--j];
+      b->prims[j] = p;
+    }
+  }
+  return i - first;
+}
+
+/* Makes the children of node at next and next + 1. */
+static void la_bvh_children(la_bvh_build *b, uint32_t node, size_t left,
+                            const la_bvh_box *child, uint32_t next) {
+  la_bvh_bnode *n = &b->nodes[node];
+  b->nodes[next].box = child[0];
+  b->nodes[next].first = n->first;
+  b->nodes[next].count = (uint32_t)left;
+  b->nodes[next + 1].box = child[1];
+  b->nodes[next + 1].first = n->first + (uint32_t)left;
+  b->nodes[next + 1].count = n->count - (uint32_t)left;
+  n->first = next;
+  n->count = 0;
+}
+
+static void la_bvh_build_subtree(la_bvh_build *b, uint32_t node,
+                                 const la_bvh_box *cbox, size_t depth,
+                                 uint32_t *next) {
+  la_bvh_box child[4];
+  const size_t left = la_bvh_split(b, &b->nodes[node], cbox, depth, 0, child);
+  if (left > 0) {
+    const uint32_t c = *next;
+    *next += 2;
+    la_bvh_children(b, node, left, child, c);
+    la_bvh_build_subtree(b, c, &child[2], depth + 1, next);
+    la_bvh_build_subtree(b, c + 1, &child[3], depth + 1, next);
+  }
+}
+
+/* Splits the nodes larger than task_min, leaving the smaller ones as tasks
+ * for la_bvh_build_subtree. */
+static int la_bvh_build_top(la_bvh_build *b, uint32_t node,
+                            const la_bvh_box *cbox, size_t depth,
+                            uint32_t *next) {
+  if (b->nodes[node].count <= b->task_min) {
+    if (b->ntasks == b->task_capacity) {
+      const size_t capacity = b->task_capacity ? b->task_capacity * 2 : 64;
+      la_bvh_task *tasks = realloc(b->tasks, capacity * sizeof(*tasks));
+      if (tasks == NULL) {
+        return 0;
+      }
+      b->tasks = tasks;
+      b->task_capacity = capacity;
+    }
+    la_bvh_task t = {node, 0, depth, *cbox};
+    b->tasks[b->ntasks++] = t;
+    return 1;
+  }
+  la_bvh_box child[4];
+  const size_t left = la_bvh_split(b, &b->nodes[node], cbox, depth, 1, child);
+  if (left == 0) {
+    return 1;
+  }
+  const uint32_t c = *next;
+  *next += 2;
+  la_bvh_children(b, node, left, child, c);
+  return la_bvh_build_top(b, c, &child[2], depth + 1, next) &&
+         la_bvh_build_top(b, c + 1, &child[3], depth + 1, next);
+}
+
+static void la_bvh_task_chunk(void *ctx, size_t i) {
+  la_bvh_build *b = ctx;
+  const la_bvh_task *t = &b->tasks[i];
+  uint32_t next = t->next;
+  la_bvh_build_subtree(b, t->node, &t->cbox, t->depth, &next);
+}
+
+/* Appends a wide node with empty children. Returns its index, or
+ * LA_BVH_EMPTY when out of memory. */
+static uint32_t la_bvh_add_node(la_bvh *bvh) {
+  if (bvh->nnodes == bvh->capacity) {
+    const size_t capacity = bvh->capacity * 2;
+    la_bvh_node *nodes =
+        la_aligned_alloc(capacity * sizeof(*nodes), LA_CACHE_LINE);
+    if (nodes == NULL) {
+      return LA_BVH_EMPTY;
+    }
+    memcpy(nodes, bvh->nodes, bvh->nnodes * sizeof(*nodes));
+    la_aligned_free(bvh->nodes);
+    bvh->nodes = nodes;
+    bvh->capacity = capacity;
+  }
+  la_bvh_node *n = &bvh->nodes[bvh->nnodes];
+  for (size_t c = 0; c < LA_BVH_WIDTH; c++) {
+    n->min_x[c] = n->min_y[c] = n->min_z[c] = INFINITY;
+    n->max_x[c] = n->max_y[c] = n->max_z[c] = INFINITY;
+    n->child[c] = LA_BVH_EMPTY;
+    n->count[c] = 0;
+  }
+  return (uint32_t)bvh->nnodes++;
+}
+
+static inline void la_bvh_set_child(la_bvh_node *n, size_t c,
+                                    const la_bvh_box *box, uint32_t child,
+                                    uint32_t count) {
+  n->min_x[c] = box->min[0];
+  n->min_y[c] = box->min[1];
+  n->min_z[c] = box->min[2];
+  n->max_x[c] = box->max[0];
+  n->max_y[c] = box->max[1];
+  n->max_z[c] = box->max[2];
+  n->child[c] = child;
+  n->count[c] = count;
+}
+
+/* Fills the wide node w with the binary subtree of node, opening the
+ * largest inner children until there are LA_BVH_WIDTH of them. */
+static int la_bvh_collapse(la_bvh *bvh, const la_bvh_bnode *nodes,
+                           uint32_t node, uint32_t w) {
+  uint32_t slots[LA_BVH_WIDTH] = {nodes[node].first, nodes[node].first + 1};
+  size_t n = 2;
+  while (n < LA_BVH_WIDTH) {
+    size_t open = n;
+    float largest = -INFINITY;
+    for (size_t s = 0; s < n; s++) {
+      const la_bvh_bnode *c = &nodes[slots[s]];
+      if (c->count == 0 && la_bvh_area(&c->box) > largest) {
+        largest = la_bvh_area(&c->box);
+        open = s;
+      }
+    }
+    if (open == n) {
+      break;
+    }
+    const uint32_t first = nodes[slots[open]].first;
+    slots[open] = first;
+    slots[n++] = first + 1;
+  }
+
+  uint32_t inner[LA_BVH_WIDTH];
+  for (size_t s = 0; s < n; s++) {
+    const la_bvh_bnode *c = &nodes[slots[s]];
+    inner[s] = c->count > 0 ? c->first : la_bvh_add_node(bvh);
+    if (inner[s] == LA_BVH_EMPTY) {
+      return 0;
+    }
+    la_bvh_set_child(&bvh->nodes[w], s, &c->box, inner[s], c->count);
+  }
+  for (size_t s = 0; s < n; s++) {
+    if (nodes[slots[s]].count == 0 &&
+        !la_bvh_collapse(bvh, nodes, slots[s], inner[s])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+typedef struct la_bvh_gather_task {
+  la_bvh *bvh;
+  const la_vec3 *a;
+  const la_vec3 *b;
+  const la_bvh_prim *prims; // Sets the ids first, when not NULL.
+} la_bvh_gather_task;
+
+/* Computes the bounds of the input primitives. */
+static void la_bvh_prims_range(void *ctx, size_t begin, size_t end) {
+  const la_bvh_gather_task *t = ctx;
+  la_bvh_prim *prims = (la_bvh_prim *)t->prims;
+  for (size_t i = begin; i < end; i++) {
+    la_bvh_box box;
+    la_bvh_input_box(t->bvh->kind, t->a, t->b, i, &box);
+    for (int k = 0; k < 3; k++) {
+      prims[i].min[k] = box.min[k];
+      prims[i].max[k] = box.max[k];
+    }
+    prims[i].id = (uint32_t)i;
+    prims[i].pad = 0;
+  }
+}
+
+/* Copies the input primitives in leaf order. */
+static void la_bvh_gather_range(void *ctx, size_t begin, size_t end) {
+  const la_bvh_gather_task *t = ctx;
+  la_bvh *bvh = t->bvh;
+  for (size_t i = begin; i < end; i++) {
+    if (t->prims != NULL) {
+      bvh->ids[i] = t->prims[i].id;
+    }
+    const size_t id = bvh->ids[i];
+    if (bvh->kind == LA_RAY_TRIANGLES) {
+      for (size_t v = 0; v < 3; v++) {
+        bvh->tris[i * 3 + v] = t->a[id * 3 + v];
+      }
+    } else {
+      bvh->min[i] = t->a[id];
+      bvh->max[i] = t->b[id];
+    }
+  }
+}
+
+static la_bvh *la_bvh_create(const la_jobs *jobs, la_ray_prims kind,
+                             const la_vec3 *a, const la_vec3 *b, size_t n) {
+  if (n > INT32_MAX) {
+    return NULL;
+  }
+  la_bvh *bvh = calloc(1, sizeof(*bvh));
+  if (bvh == NULL) {
+    return NULL;
+  }
+  const size_t m = n ? n : 1;
+  const int parallel =
+      jobs != NULL && jobs->parallel_for != NULL && jobs->threads > 1;
+  la_bvh_build build = {0};
+  build.jobs = jobs;
+  build.nchunks = 1;
+  build.task_min = n;
+  if (parallel) {
+    build.nchunks = jobs->threads * 4 < LA_BVH_CHUNKS ? jobs->threads * 4
+                                                      : LA_BVH_CHUNKS;
+    build.task_min = n / (jobs->threads * 16);
+    build.task_min = build.task_min < 1024 ? 1024 : build.task_min;
+  }
+  bvh->kind = kind;
+  bvh->count = n;
+  bvh->capacity = m / (LA_BVH_LEAF * (LA_BVH_WIDTH - 1)) + 16;
+  bvh->nodes = la_aligned_alloc(bvh->capacity * sizeof(la_bvh_node),
+                                LA_CACHE_LINE);
+  bvh->ids = malloc(m * sizeof(*bvh->ids));
+  if (kind == LA_RAY_TRIANGLES) {
+    bvh->tris = malloc(m * 3 * sizeof(*bvh->tris));
+  } else {
+    bvh->min = malloc(m * sizeof(*bvh->min));
+    bvh->max = malloc(m * sizeof(*bvh->max));
+  }
+  build.prims = la_aligned_alloc(m * sizeof(la_bvh_prim), LA_CACHE_LINE);
+  build.nodes = malloc((m * 2 - 1) * sizeof(la_bvh_bnode));
+  build.boxes = malloc(LA_BVH_CHUNKS * 2 * sizeof(la_bvh_box));
+  build.bins = malloc(LA_BVH_CHUNKS * sizeof(la_bvh_bins));
+  int ok = bvh->nodes != NULL && bvh->ids != NULL &&
+           (bvh->tris != NULL || (bvh->min != NULL && bvh->max != NULL)) &&
+           build.prims != NULL && build.nodes != NULL &&
+           build.boxes != NULL && build.bins != NULL;
+
+  if (ok) {
+    la_bvh_gather_task t = {bvh, a, b, build.prims};
+    la_parallel_for(jobs, n, la_bvh_prims_range, &t);
+    la_bvh_add_node(bvh);
+    la_bvh_box cbox;
+    la_bvh_bound_range(&build, 0, n, parallel ? build.nchunks : 1,
+                       &build.nodes[0].box, &cbox);
+    build.nodes[0].first = 0;
+    build.nodes[0].count = (uint32_t)n;
+    uint32_t next = 1;
+    ok = n == 0 || la_bvh_build_top(&build, 0, &cbox, 0, &next);
+    for (size_t i = 0; ok && i < build.ntasks; i++) {
+      build.tasks[i].next = next;
+      next += build.nodes[build.tasks[i].node].count * 2 - 2;
+    }
+    if (ok && parallel && build.ntasks > 1) {
+      jobs->parallel_for(jobs->user, build.ntasks, la_bvh_task_chunk,
+                         &build);
+    } else {
+      for (size_t i = 0; ok && i < build.ntasks; i++) {
+        la_bvh_task_chunk(&build, i);
+      }
+    }
+    const la_bvh_bnode *root = &build.nodes[0];
+    if (ok && n > 0 && root->count > 0) {
+      la_bvh_set_child(&bvh->nodes[0], 0, &root->box, 0, root->count);
+    } else if (ok && n > 0) {
+      ok = la_bvh_collapse(bvh, build.nodes, 0, 0);
+    }
+    la_parallel_for(jobs, ok ? n : 0, la_bvh_gather_range, &t);
+  }
+
+  la_aligned_free(build.prims);
+  free(build.nodes);
+  free(build.boxes);
+  free(build.bins);
+  free(build.tasks);
+  if (!ok) {
+    la_bvh_destroy(bvh);
+    return NULL;
+  }
+  return bvh;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_bvh *la_bvh_create_triangles(const la_jobs *jobs, const la_vec3 *tris,
+                                size_t n) {
+  return la_bvh_create(jobs, LA_RAY_TRIANGLES, tris, NULL, n);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_bvh *la_bvh_create_aabbs(const la_jobs *jobs, const la_vec3 *min,
+                            const la_vec3 *max, size_t n) {
+  return la_bvh_create(jobs, LA_RAY_AABBS, min, max, n);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_bvh_destroy(la_bvh *bvh) {
+  if (bvh == NULL) {
+    return;
+  }
+  la_aligned_free(bvh->nodes);
+  free(bvh->ids);
+  free(bvh->tris);
+  free(bvh->min);
+  free(bvh->max);
+  free(bvh);
+}
+
+/* Recomputes the bounds of the children from the last node up, as children
+ * come after their parents. */
+static void la_bvh_refit(la_bvh *bvh) {
+  for (size_t i = bvh->nnodes; i-- > 0;) {
+    la_bvh_node *n = &bvh->nodes[i];
+    for (size_t c = 0; c < LA_BVH_WIDTH; c++) {
+      if (n->child[c] == LA_BVH_EMPTY) {
+        continue;
+      }
+      la_bvh_box box;
+      la_bvh_box_empty(&box);
+      if (n->count[c] > 0) {
+        for (size_t p = n->child[c]; p < n->child[c] + n->count[c]; p++) {
+          la_bvh_box b;
+          la_bvh_leaf_box(bvh, p, &b);
+          la_bvh_box_grow(&box, b.min, b.max);
+        }
+      } else {
+        const la_bvh_node *d = &bvh->nodes[n->child[c]];
+        for (size_t s = 0; s < LA_BVH_WIDTH; s++) {
+          if (d->child[s] != LA_BVH_EMPTY) {
+            const float min[3] = {d->min_x[s], d->min_y[s], d->min_z[s]};
+            const float max[3] = {d->max_x[s], d->max_y[s], d->max_z[s]};
+            la_bvh_box_grow(&box, min, max);
+          }
+        }
+      }
+      la_bvh_set_child(n, c, &box, n->child[c], n->count[c]);
+    }
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_bvh_refit_triangles(la_bvh *bvh, const la_vec3 *tris) {
+  if (bvh->kind != LA_RAY_TRIANGLES) {
+    return 0;
+  }
+  la_bvh_gather_task t = {bvh, tris, NULL, NULL};
+  la_bvh_gather_range(&t, 0, bvh->count);
+  la_bvh_refit(bvh);
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_bvh_refit_aabbs(la_bvh *bvh, const la_vec3 *min, const la_vec3 *max) {
+  if (bvh->kind != LA_RAY_AABBS) {
+    return 0;
+  }
+  la_bvh_gather_task t = {bvh, min, max, NULL};
+  la_bvh_gather_range(&t, 0, bvh->count);
+  la_bvh_refit(bvh);
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_bvh_bounds(const la_bvh *bvh, la_vec3 *min, la_vec3 *max) {
+  la_bvh_box box;
+  la_bvh_box_empty(&box);
+  const la_bvh_node *n = &bvh->nodes[0];
+  for (size_t c = 0; c < LA_BVH_WIDTH; c++) {
+    if (n->child[c] != LA_BVH_EMPTY) {
+      const float lo[3] = {n->min_x[c], n->min_y[c], n->min_z[c]};
+      const float hi[3] = {n->max_x[c], n->max_y[c], n->max_z[c]};
+      la_bvh_box_grow(&box, lo, hi);
+    }
+  }
+  for (int k = 0; k < 3; k++) {
+    min->elem[k] = box.min[k];
+    max->elem[k] = box.max[k];
+  }
+}
+
+/* A single ray, also broadcast for the SIMD node test. */
+typedef struct la_bvh_ray {
+  la_ray r;
+#ifdef LA_VF_WIDTH
+  la_vf ox, oy, oz;
+  la_vf ix, iy, iz;
+  la_vf tmin, tmax;
+#endif
+} la_bvh_ray;
+
+static inline void la_bvh_ray_set(la_bvh_ray *r, const la_ray *ray) {
+  r->r = *ray;
+#ifdef LA_VF_WIDTH
+  r->ox = la_vf_set1(ray->origin.x);
+  r->oy = la_vf_set1(ray->origin.y);
+  r->oz = la_vf_set1(ray->origin.z);
+  r->ix = la_vf_set1(1.0f / ray->dir.x);
+  r->iy = la_vf_set1(1.0f / ray->dir.y);
+  r->iz = la_vf_set1(1.0f / ray->dir.z);
+  r->tmin = la_vf_set1(ray->tmin);
+  r->tmax = la_vf_set1(ray->tmax);
+#endif
+}
+
+static inline void la_bvh_ray_tmax(la_bvh_ray *r, float tmax) {
+  r->r.tmax = tmax;
+#ifdef LA_VF_WIDTH
+  r->tmax = la_vf_set1(tmax);
+#endif
+}
+
+/* Tests a ray against the children of a node with the slab test of
+ * la_ray_test_aabb. Returns the children hit, and their distances in h. */
+static inline uint32_t la_bvh_node_ray(const la_bvh_node *n,
+                                       const la_bvh_ray *r, float *h) {
+  uint32_t mask = 0;
+#ifdef LA_VF_WIDTH
+  for (size_t c = 0; c < LA_BVH_WIDTH; c += LA_VF_WIDTH) {
+    la_vf t1 = la_vf_mul(la_vf_sub(la_vf_load(n->min_x + c), r->ox), r->ix);
+    la_vf t2 = la_vf_mul(la_vf_sub(la_vf_load(n->max_x + c), r->ox), r->ix);
+    la_vf tn = la_vf_min(t1, t2);
+    la_vf tf = la_vf_max(t1, t2);
+    t1 = la_vf_mul(la_vf_sub(la_vf_load(n->min_y + c), r->oy), r->iy);
+    t2 = la_vf_mul(la_vf_sub(la_vf_load(n->max_y + c), r->oy), r->iy);
+    tn = la_vf_max(tn, la_vf_min(t1, t2));
+    tf = la_vf_min(tf, la_vf_max(t1, t2));
+    t1 = la_vf_mul(la_vf_sub(la_vf_load(n->min_z + c), r->oz), r->iz);
+    t2 = la_vf_mul(la_vf_sub(la_vf_load(n->max_z + c), r->oz), r->iz);
+    tn = la_vf_max(tn, la_vf_min(t1, t2));
+    tf = la_vf_min(tf, la_vf_max(t1, t2));
+    const la_vf t = la_vf_max(tn, r->tmin);
+    const la_vf hit = la_vf_and(la_vf_le(t, tf), la_vf_lt(t, r->tmax));
+    la_vf_store(h + c, t);
+    mask |= (uint32_t)la_vf_movemask(hit) << c;
+  }
+#else
+  for (size_t c = 0; c < LA_BVH_WIDTH; c++) {
+    const la_vec3 min = {.elem = {n->min_x[c], n->min_y[c], n->min_z[c]}};
+    const la_vec3 max = {.elem = {n->max_x[c], n->max_y[c], n->max_z[c]}};
+    mask |= (uint32_t)la_ray_test_aabb(&r->r, min, max, &h[c]) << c;
+  }
+#endif
+  return mask;
+}
+
+/* A node or leaf to visit, with the distance to its bounds. */
+typedef struct la_bvh_entry {
+  uint32_t child;
+  uint32_t count;
+  float t;
+} la_bvh_entry;
+
+/* Pushes the children in mask, the nearest last so that it is visited
+ * first. */
+static inline size_t la_bvh_push(la_bvh_entry *stack, size_t sp,
+                                 const la_bvh_node *n, uint32_t mask,
+                                 const float *t) {
+  const size_t first = sp;
+  for (size_t c = 0; c < LA_BVH_WIDTH; c++) {
+    if (!((mask >> c) & 1)) {
+      continue;
+    }
+    size_t i = sp++;
+    for (; i > first && stack[i - 1].t < t[c]; i--) {
+      stack[i] = stack[i - 1];
+    }
+    stack[i].child = n->child[c];
+    stack[i].count = n->count[c];
+    stack[i].t = t[c];
+  }
+  return sp;
+}
+
+/* Traces r, leaving the distance of the nearest hit found in r->tmax. */
+static int la_bvh_trace(const la_bvh *bvh, la_ray *ray, int any, la_vec2 *uv,
+                        uint32_t *prim) {
+  la_bvh_ray r;
+  la_bvh_ray_set(&r, ray);
+  la_bvh_entry stack[LA_BVH_STACK];
+  size_t sp = 0;
+  la_bvh_entry root = {0, 0, ray->tmin};
+  stack[sp++] = root;
+  int found = 0;
+  while (sp > 0) {
+    const la_bvh_entry e = stack[--sp];
+    if (!(e.t < r.r.tmax)) {
+      continue; // Behind the nearest hit.
+    }
+    if (e.count == 0) {
+      float t[LA_BVH_WIDTH];
+      const la_bvh_node *n = &bvh->nodes[e.child];
+      sp = la_bvh_push(stack, sp, n, la_bvh_node_ray(n, &r, t), t);
+      continue;
+    }
+    for (size_t i = e.child; i < e.child + e.count; i++) {
+      float t;
+      la_vec2 tuv = {.elem = {0.0f, 0.0f}};
+      const int hit =
+          bvh->kind == LA_RAY_TRIANGLES
+              ? la_ray_test_triangle(&r.r, &bvh->tris[i * 3], &t, &tuv)
+              : la_ray_test_aabb(&r.r, bvh->min[i], bvh->max[i], &t);
+      if (hit) {
+        la_bvh_ray_tmax(&r, t);
+        *uv = tuv;
+        *prim = bvh->ids[i];
+        found = 1;
+        if (any) {
+          sp = 0;
+          break;
+        }
+      }
+    }
+  }
+  ray->tmax = r.r.tmax;
+  return found;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_bvh_closest(const la_bvh *bvh, const la_ray *r, float *t, la_vec2 *uv,
+                   uint32_t *prim) {
+  la_ray ray = *r;
+  la_vec2 huv;
+  uint32_t hprim;
+  if (!la_bvh_trace(bvh, &ray, 0, &huv, &hprim)) {
+    return 0;
+  }
+  if (t != NULL) {
+    *t = ray.tmax;
+  }
+  if (uv != NULL) {
+    *uv = huv;
+  }
+  if (prim != NULL) {
+    *prim = hprim;
+  }
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_bvh_any(const la_bvh *bvh, const la_ray *r) {
+  la_ray ray = *r;
+  la_vec2 uv;
+  uint32_t prim;
+  return la_bvh_trace(bvh, &ray, 1, &uv, &prim);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+uint32_t la_bvh_packet(const la_bvh *bvh, la_ray_packet *p, la_ray_mode mode) {
+  uint32_t hits = 0;
+  for (size_t l = 0; l < LA_RAY_PACKET; l++) {
+    if (!(p->t[l] > p->tmin[l]) || (mode == LA_RAY_ANY && p->prim[l] >= 0)) {
+      continue;
+    }
+    la_ray ray = {{.elem = {p->ox[l], p->oy[l], p->oz[l]}},
+                  {.elem = {p->dx[l], p->dy[l], p->dz[l]}},
+                  p->tmin[l],
+                  p->t[l]};
+    la_vec2 uv;
+    uint32_t prim;
+    if (la_bvh_trace(bvh, &ray, mode == LA_RAY_ANY, &uv, &prim)) {
+      p->t[l] = ray.tmax;
+      p->u[l] = uv.x;
+      p->v[l] = uv.y;
+      p->prim[l] = (int32_t)prim;
+      hits |= 1u << l;
+    }
+  }
+  return hits;
+}
+
+/* Tests a box against the children of a node. */
+static inline uint32_t la_bvh_node_box(const la_bvh_node *n,
+                                       const la_vec3 min, const la_vec3 max) {
+  uint32_t mask = 0;
+#ifdef LA_VF_WIDTH
+  const la_vf x0 = la_vf_set1(min.x), y0 = la_vf_set1(min.y);
+  const la_vf z0 = la_vf_set1(min.z);
+  const la_vf x1 = la_vf_set1(max.x), y1 = la_vf_set1(max.y);
+  const la_vf z1 = la_vf_set1(max.z);
+  for (size_t c = 0; c < LA_BVH_WIDTH; c += LA_VF_WIDTH) {
+    la_vf hit = la_vf_and(la_vf_le(la_vf_load(n->min_x + c), x1),
+                          la_vf_le(x0, la_vf_load(n->max_x + c)));
+    hit = la_vf_and(hit, la_vf_le(la_vf_load(n->min_y + c), y1));
+    hit = la_vf_and(hit, la_vf_le(y0, la_vf_load(n->max_y + c)));
+    hit = la_vf_and(hit, la_vf_le(la_vf_load(n->min_z + c), z1));
+    hit = la_vf_and(hit, la_vf_le(z0, la_vf_load(n->max_z + c)));
+    mask |= (uint32_t)la_vf_movemask(hit) << c;
+  }
+#else
+  for (size_t c = 0; c < LA_BVH_WIDTH; c++) {
+    const int hit = n->min_x[c] <= max.x && min.x <= n->max_x[c] &&
+                    n->min_y[c] <= max.y && min.y <= n->max_y[c] &&
+                    n->min_z[c] <= max.z && min.z <= n->max_z[c];
+    mask |= (uint32_t)hit << c;
+  }
+#endif
+  return mask;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+size_t la_bvh_overlap(const la_bvh *bvh, const la_vec3 min, const la_vec3 max,
+                      uint32_t *prims, size_t cap) {
+  uint32_t stack[LA_BVH_STACK];
+  size_t sp = 0;
+  stack[sp++] = 0;
+  size_t found = 0;
+  while (sp > 0) {
+    const la_bvh_node *n = &bvh->nodes[stack[--sp]];
+    const uint32_t mask = la_bvh_node_box(n, min, max);
+    for (size_t c = 0; c < LA_BVH_WIDTH; c++) {
+      if (!((mask >> c) & 1) || n->child[c] == LA_BVH_EMPTY) {
+        continue;
+      }
+      if (n->count[c] == 0) {
+        stack[sp++] = n->child[c];
+        continue;
+      }
+      for (size_t i = n->child[c]; i < n->child[c] + n->count[c]; i++) {
+        la_bvh_box b;
+        la_bvh_leaf_box(bvh, i, &b);
+        if (b.min[0] <= max.x && min.x <= b.max[0] && b.min[1] <= max.y &&
+            min.y <= b.max[1] && b.min[2] <= max.z && min.z <= b.max[2]) {
+          if (found < cap) {
+            prims[found] = bvh->ids[i];
+          }
+          found++;
+        }
+      }
+    }
+  }
+  return found;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * The rows of the result are combinations of the first three rows of m2,
+ * plus the translation row for the last one.
+ */
+la_mat4 la_productm4_affine(const la_mat4 m1, const la_mat4 m2) {
+  LA_PROFILE_ENTER(la_productm4_affine);
+  la_mat4 r;
+#if defined(LA_USE_SSE2)
+  const __m128 b0 = _mm_loadu_ps(m2.elem[0]);
+  const __m128 b1 = _mm_loadu_ps(m2.elem[1]);
+  const __m128 b2 = _mm_loadu_ps(m2.elem[2]);
+  for (size_t i = 0; i < 4; i++) {
+    __m128 row = _mm_mul_ps(_mm_set1_ps(m1.elem[i][0]), b0);
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m1.elem[i][1]), b1));
+    row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m1.elem[i][2]), b2));
+    _mm_storeu_ps(r.elem[i], row);
+  }
+  _mm_storeu_ps(r.elem[3],
+                _mm_add_ps(_mm_loadu_ps(r.elem[3]), _mm_loadu_ps(m2.elem[3])));
+#elif defined(LA_USE_NEON)
+  const float32x4_t b0 = vld1q_f32(m2.elem[0]);
+  const float32x4_t b1 = vld1q_f32(m2.elem[1]);
+  const float32x4_t b2 = vld1q_f32(m2.elem[2]);
+  for (size_t i = 0; i < 4; i++) {
+    float32x4_t row = vmulq_n_f32(b0, m1.elem[i][0]);
+    row = vmlaq_n_f32(row, b1, m1.elem[i][1]);
+    row = vmlaq_n_f32(row, b2, m1.elem[i][2]);
+    vst1q_f32(r.elem[i], row);
+  }
+  vst1q_f32(r.elem[3], vaddq_f32(vld1q_f32(r.elem[3]), vld1q_f32(m2.elem[3])));
+#else
+  for (size_t i = 0; i < 4; i++) {
+    for (size_t k = 0; k < 3; k++) {
+      r.elem[i][k] = m1.elem[i][0] * m2.elem[0][k] +
+                     m1.elem[i][1] * m2.elem[1][k] +
+                     m1.elem[i][2] * m2.elem[2][k];
+    }
+  }
+  r.elem[3][0] += m2.elem[3][0];
+  r.elem[3][1] += m2.elem[3][1];
+  r.elem[3][2] += m2.elem[3][2];
+#endif
+  r.elem[0][3] = 0.0f;
+  r.elem[1][3] = 0.0f;
+  r.elem[2][3] = 0.0f;
+  r.elem[3][3] = 1.0f;
+  LA_PROFILE_LEAVE(la_productm4_affine);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec3 la_transform_dir_affine(const la_mat4 m, const la_vec3 d) {
+  la_vec3 r;
+  for (size_t k = 0; k < 3; k++) {
+    r.elem[k] = d.elem[0] * m.elem[0][k] + d.elem[1] * m.elem[1][k] +
+                d.elem[2] * m.elem[2][k];
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec3 la_transform_point_affine(const la_mat4 m, const la_vec3 p) {
+  LA_PROFILE_ENTER(la_transform_point_affine);
+  la_vec3 r = la_transform_dir_affine(m, p);
+  r.elem[0] += m.elem[3][0];
+  r.elem[1] += m.elem[3][1];
+  r.elem[2] += m.elem[3][2];
+  LA_PROFILE_LEAVE(la_transform_point_affine);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * With the rows of the matrix being L (3x3) and t, the inverse has rows
+ * inverse(L) and -t * inverse(L).
+ */
+la_mat4 la_inverse_affine(const la_mat4 m, int *invertible) {
+  LA_PROFILE_ENTER(la_inverse_affine);
+  const float(*a)[4] = m.elem;
+  const float c00 = a[1][1] * a[2][2] - a[1][2] * a[2][1];
+  const float c01 = a[1][2] * a[2][0] - a[1][0] * a[2][2];
+  const float c02 = a[1][0] * a[2][1] - a[1][1] * a[2][0];
+  const float det = a[0][0] * c00 + a[0][1] * c01 + a[0][2] * c02;
+
+  const int singular = la_singular(det, la_row_lengths(a[0], 3, 4));
+  if (invertible != NULL) {
+    *invertible = !singular;
+  }
+  if (singular) {
+    LA_PROFILE_LEAVE(la_inverse_affine);
+    return la_identitym4();
+  }
+
+  const float inv_det = 1.0f / det;
+  la_mat4 r;
+  r.elem[0][0] = c00 * inv_det;
+  r.elem[0][1] = (a[0][2] * a[2][1] - a[0][1] * a[2][2]) * inv_det;
+  r.elem[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * inv_det;
+  r.elem[1][0] = c01 * inv_det;
+  r.elem[1][1] = (a[0][0] * a[2][2] - a[0][2] * a[2][0]) * inv_det;
+  r.elem[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * inv_det;
+  r.elem[2][0] = c02 * inv_det;
+  r.elem[2][1] = (a[0][1] * a[2][0] - a[0][0] * a[2][1]) * inv_det;
+  r.elem[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * inv_det;
+
+  for (size_t k = 0; k < 3; k++) {
+    r.elem[3][k] = -(a[3][0] * r.elem[0][k] + a[3][1] * r.elem[1][k] +
+                     a[3][2] * r.elem[2][k]);
+  }
+  r.elem[0][3] = 0.0f;
+  r.elem[1][3] = 0.0f;
+  r.elem[2][3] = 0.0f;
+  r.elem[3][3] = 1.0f;
+  LA_PROFILE_LEAVE(la_inverse_affine);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat3x4 la_m4tomat3x4(const la_mat4 m) {
+  la_mat3x4 r;
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 4; j++) {
+      r.elem[i][j] = m.elem[j][i];
+    }
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_mat3x4tom4(const la_mat3x4 m) {
+  la_mat4 r;
+  for (size_t i = 0; i < 3; i++) {
+    for (size_t j = 0; j < 4; j++) {
+      r.elem[j][i] = m.elem[i][j];
+    }
+  }
+  r.elem[0][3] = 0.0f;
+  r.elem[1][3] = 0.0f;
+  r.elem[2][3] = 0.0f;
+  r.elem[3][3] = 1.0f;
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_m4tomat3x4_batch(const la_mat4 *in, la_mat3x4 *out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+#if defined(LA_USE_SSE2)
+    __m128 c0 = _mm_loadu_ps(in[i].elem[0]);
+    __m128 c1 = _mm_loadu_ps(in[i].elem[1]);
+    __m128 c2 = _mm_loadu_ps(in[i].elem[2]);
+    __m128 c3 = _mm_loadu_ps(in[i].elem[3]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _mm_storeu_ps(out[i].elem[0], c0);
+    _mm_storeu_ps(out[i].elem[1], c1);
+    _mm_storeu_ps(out[i].elem[2], c2);
+#else
+    out[i] = la_m4tomat3x4(in[i]);
+#endif
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec3 la_transform_point_mat3x4(const la_mat3x4 *m, const la_vec3 p) {
+  la_vec3 r;
+  for (size_t i = 0; i < 3; i++) {
+    r.elem[i] = m->elem[i][0] * p.elem[0] + m->elem[i][1] * p.elem[1] +
+                m->elem[i][2] * p.elem[2] + m->elem[i][3];
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_quat la_identityq(void) {
+  la_quat q = {.elem = {0.0f, 0.0f, 0.0f, 1.0f}};
+  return q;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_quat la_axis_angleq(const la_vec3 axis, const float rads) {
+  const la_vec3 a = la_normalizev3(axis);
+  const float s = LA_SIN(rads * 0.5f);
+  la_quat q = {.elem = {a.x * s, a.y * s, a.z * s, LA_COS(rads * 0.5f)}};
+  return q;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_quat la_productq(const la_quat q1, const la_quat q2) {
+  la_quat r;
+  r.x = q1.w * q2.x + q1.x * q2.w + q1.y * q2.z - q1.z * q2.y;
+  r.y = q1.w * q2.y - q1.x * q2.z + q1.y * q2.w + q1.z * q2.x;
+  r.z = q1.w * q2.z + q1.x * q2.y - q1.y * q2.x + q1.z * q2.w;
+  r.w = q1.w * q2.w - q1.x * q2.x - q1.y * q2.y - q1.z * q2.z;
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_quat la_normalizeq(const la_quat q) {
+#ifdef LA_FAST_MATH
+  const float r = la_rsqrt_approx(la_dotv4(q, q));
+  la_quat n = {.elem = {q.x * r, q.y * r, q.z * r, q.w * r}};
+#else
+  const float l = sqrt(la_dotv4(q, q));
+  la_quat n = {.elem = {q.x / l, q.y / l, q.z / l, q.w / l}};
+#endif
+  return n;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_quat la_conjugateq(const la_quat q) {
+  la_quat r = {.elem = {-q.x, -q.y, -q.z, q.w}};
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_quat la_inverseq(const la_quat q) {
+  const float l2 = la_dotv4(q, q);
+  la_quat r = {.elem = {-q.x / l2, -q.y / l2, -q.z / l2, q.w / l2}};
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * v' = v + w * t + u x t, with u the vector part of q and t = 2 (u x v).
+ */
+la_vec3 la_productqv3(const la_quat q, const la_vec3 v) {
+  const la_vec3 u = {.elem = {q.x, q.y, q.z}};
+  la_vec3 t = la_crossv3(u, v);
+  t.x *= 2.0f;
+  t.y *= 2.0f;
+  t.z *= 2.0f;
+  const la_vec3 c = la_crossv3(u, t);
+  la_vec3 r = {.elem = {v.x + q.w * t.x + c.x, v.y + q.w * t.y + c.y,
+                        v.z + q.w * t.z + c.z}};
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_quat la_nlerpq(const la_quat q1, const la_quat q2, const float t) {
+  LA_PROFILE_ENTER(la_nlerpq);
+  const float s = la_dotv4(q1, q2) < 0.0f ? -t : t;
+  la_quat r;
+  for (size_t i = 0; i < 4; i++) {
+    r.elem[i] = q1.elem[i] * (1.0f - t) + q2.elem[i] * s;
+  }
+  const la_quat n = la_normalizeq(r);
+  LA_PROFILE_LEAVE(la_nlerpq);
+  return n;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * Falls back to la_nlerpq when the rotations are too close for sin(theta) to
+ * be divided by safely.
+ */
+la_quat la_slerpq(const la_quat q1, const la_quat q2, const float t) {
+  LA_PROFILE_ENTER(la_slerpq);
+  float d = la_dotv4(q1, q2);
+  float sign = 1.0f;
+  if (d < 0.0f) {
+    d = -d;
+    sign = -1.0f;
+  }
+  if (d > 0.9995f) {
+    const la_quat n = la_nlerpq(q1, q2, t);
+    LA_PROFILE_LEAVE(la_slerpq);
+    return n;
+  }
+
+  const float theta = acos(d);
+  const float inv_sin = 1.0f / sin(theta);
+  const float s1 = sin((1.0f - t) * theta) * inv_sin;
+  const float s2 = sin(t * theta) * inv_sin * sign;
+  la_quat r;
+  for (size_t i = 0; i < 4; i++) {
+    r.elem[i] = q1.elem[i] * s1 + q2.elem[i] * s2;
+  }
+  LA_PROFILE_LEAVE(la_slerpq);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_quattom4(const la_quat q) {
+  LA_PROFILE_ENTER(la_quattom4);
+  const float xx = q.x * q.x;
+  const float yy = q.y * q.y;
+  const float zz = q.z * q.z;
+  const float xy = q.x * q.y;
+  const float xz = q.x * q.z;
+  const float yz = q.y * q.z;
+  const float wx = q.w * q.x;
+  const float wy = q.w * q.y;
+  const float wz = q.w * q.z;
+
+  la_mat4 m = la_identitym4();
+  m.elem[0][0] = 1.0f - 2.0f * (yy + zz);
+  m.elem[0][1] = 2.0f * (xy + wz);
+  m.elem[0][2] = 2.0f * (xz - wy);
+
+  m.elem[1][0] = 2.0f * (xy - wz);
+  m.elem[1][1] = 1.0f - 2.0f * (xx + zz);
+  m.elem[1][2] = 2.0f * (yz + wx);
+
+  m.elem[2][0] = 2.0f * (xz + wy);
+  m.elem[2][1] = 2.0f * (yz - wx);
+  m.elem[2][2] = 1.0f - 2.0f * (xx + yy);
+  LA_PROFILE_LEAVE(la_quattom4);
+  return m;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_rotateq(const la_mat4 m, const la_quat q) {
+  return la_productm4(m, la_quattom4(q));
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * Picks the largest of w, x, y and z to divide by, which keeps the result
+ * accurate for rotations near 180 degrees.
+ */
+la_quat la_m4toquat(const la_mat4 m) {
+  const float (*e)[4] = m.elem;
+  const float trace = e[0][0] + e[1][1] + e[2][2];
+  la_quat q;
+  if (trace > 0.0f) {
+    const float s = sqrtf(trace + 1.0f) * 2.0f;
+    q.w = 0.25f * s;
+    q.x = (e[1][2] - e[2][1]) / s;
+    q.y = (e[2][0] - e[0][2]) / s;
+    q.z = (e[0][1] - e[1][0]) / s;
+  } else if (e[0][0] > e[1][1] && e[0][0] > e[2][2]) {
+    const float s = sqrtf(1.0f + e[0][0] - e[1][1] - e[2][2]) * 2.0f;
+    q.w = (e[1][2] - e[2][1]) / s;
+    q.x = 0.25f * s;
+    q.y = (e[0][1] + e[1][0]) / s;
+    q.z = (e[2][0] + e[0][2]) / s;
+  } else if (e[1][1] > e[2][2]) {
+    const float s = sqrtf(1.0f + e[1][1] - e[0][0] - e[2][2]) * 2.0f;
+    q.w = (e[2][0] - e[0][2]) / s;
+    q.x = (e[0][1] + e[1][0]) / s;
+    q.y = 0.25f * s;
+    q.z = (e[1][2] + e[2][1]) / s;
+  } else {
+    const float s = sqrtf(1.0f + e[2][2] - e[0][0] - e[1][1]) * 2.0f;
+    q.w = (e[0][1] - e[1][0]) / s;
+    q.x = (e[2][0] + e[0][2]) / s;
+    q.y = (e[1][2] + e[2][1]) / s;
+    q.z = 0.25f * s;
+  }
+  return la_normalizeq(q);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * The rows of la_quattom4(r), each multiplied by its scale.
+ */
+la_mat4 la_compose_trs(const la_vec3 t, const la_quat r, const la_vec3 s) {
+  LA_PROFILE_ENTER(la_compose_trs);
+  const float xx = r.x * r.x;
+  const float yy = r.y * r.y;
+  const float zz = r.z * r.z;
+  const float xy = r.x * r.y;
+  const float xz = r.x * r.z;
+  const float yz = r.y * r.z;
+  const float wx = r.w * r.x;
+  const float wy = r.w * r.y;
+  const float wz = r.w * r.z;
+
+  la_mat4 m;
+  m.elem[0][0] = (1.0f - 2.0f * (yy + zz)) * s.x;
+  m.elem[0][1] = 2.0f * (xy + wz) * s.x;
+  m.elem[0][2] = 2.0f * (xz - wy) * s.x;
+  m.elem[0][3] = 0.0f;
+
+  m.elem[1][0] = 2.0f * (xy - wz) * s.y;
+  m.elem[1][1] = (1.0f - 2.0f * (xx + zz)) * s.y;
+  m.elem[1][2] = 2.0f * (yz + wx) * s.y;
+  m.elem[1][3] = 0.0f;
+
+  m.elem[2][0] = 2.0f * (xz + wy) * s.z;
+  m.elem[2][1] = 2.0f * (yz - wx) * s.z;
+  m.elem[2][2] = (1.0f - 2.0f * (xx + yy)) * s.z;
+  m.elem[2][3] = 0.0f;
+
+  m.elem[3][0] = t.x;
+  m.elem[3][1] = t.y;
+  m.elem[3][2] = t.z;
+  m.elem[3][3] = 1.0f;
+  LA_PROFILE_LEAVE(la_compose_trs);
+  return m;
+}
+
+/* Squared length under which an axis is treated as zero. */
+#define LA_TRS_TINY 1e-12f
+
+/* Relative error allowed in the last column and between the axes of a TRS
+ * matrix before la_decompose_trs reports it as sheared or projective. */
+#define LA_TRS_TOLERANCE 1e-4f
+
+/* Returns v / |v|, or 0 if v is too short to have a direction. */
+static inline la_vec3 la_trs_unit(const la_vec3 v) {
+  const float l2 = la_dotv3(v, v);
+  const float r = l2 > LA_TRS_TINY ? 1.0f / sqrtf(l2) : 0.0f;
+  la_vec3 u = {.elem = {v.x * r, v.y * r, v.z * r}};
+  return u;
+}
+
+/* Returns a unit vector perpendicular to the unit vector v, crossing it with
+ * the axis it is least aligned with. */
+static inline la_vec3 la_trs_perpendicular(const la_vec3 v) {
+  const float ax = fabsf(v.x), ay = fabsf(v.y), az = fabsf(v.z);
+  la_vec3 e = {.elem = {0.0f, 0.0f, 0.0f}};
+  e.elem[ax <= ay && ax <= az ? 0 : ay <= az ? 1 : 2] = 1.0f;
+  return la_trs_unit(la_crossv3(v, e));
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * The x axis of the rotation is the x row of m, the y axis the y row without
+ * its x part, and the z axis their cross product, so the scales are the rows
+ * projected on those axes. When a row is zero, the axis comes from the other
+ * rows instead.
+ */
+int la_decompose_trs(const la_mat4 m, la_vec3 *t, la_quat *r, la_vec3 *s) {
+  const float (*e)[4] = m.elem;
+  const la_vec3 row0 = {.elem = {e[0][0], e[0][1], e[0][2]}};
+  const la_vec3 row1 = {.elem = {e[1][0], e[1][1], e[1][2]}};
+  const la_vec3 row2 = {.elem = {e[2][0], e[2][1], e[2][2]}};
+  const la_vec3 yz = la_crossv3(row1, row2);
+
+  /* A reflection flips the x axis, to be undone by a negative x scale. */
+  const float sign = la_dotv3(row0, yz) < 0.0f ? -1.0f : 1.0f;
+  const la_vec3 a = {.elem = {row0.x * sign, row0.y * sign, row0.z * sign}};
+  la_vec3 x = la_trs_unit(a);
+  if (la_dotv3(x, x) == 0.0f) {
+    x = la_trs_unit(yz);
+  }
+  if (la_dotv3(x, x) == 0.0f) {
+    const la_vec3 other = la_trs_unit(la_dotv3(row1, row1) > LA_TRS_TINY
+                                          ? row1
+                                          : row2);
+    if (la_dotv3(other, other) == 0.0f) {
+      const la_vec3 ex = {.elem = {1.0f, 0.0f, 0.0f}};
+      x = ex;
+    } else {
+      x = la_trs_perpendicular(other);
+    }
+  }
+
+  const float bx = la_dotv3(row1, x);
+  const la_vec3 b = {.elem = {row1.x - bx * x.x, row1.y - bx * x.y,
+                              row1.z - bx * x.z}};
+  la_vec3 y = la_trs_unit(b);
+  if (la_dotv3(y, y) == 0.0f) {
+    y = la_trs_unit(la_crossv3(row2, x));
+  }
+  if (la_dotv3(y, y) == 0.0f) {
+    y = la_trs_perpendicular(x);
+  }
+  const la_vec3 z = la_crossv3(x, y);
+
+  la_mat4 rot = la_identitym4();
+  for (size_t k = 0; k < 3; k++) {
+    rot.elem[0][k] = x.elem[k];
+    rot.elem[1][k] = y.elem[k];
+    rot.elem[2][k] = z.elem[k];
+  }
+  la_quat q = la_m4toquat(rot);
+  if (q.w < 0.0f) {
+    la_quat n = {.elem = {-q.x, -q.y, -q.z, -q.w}};
+    q = n;
+  }
+  *r = q;
+  s->x = la_dotv3(row0, x);
+  s->y = la_dotv3(row1, y);
+  s->z = la_dotv3(row2, z);
+  t->x = e[3][0];
+  t->y = e[3][1];
+  t->z = e[3][2];
+
+  /* Shear shows as rows that are not along their axes. */
+  const float len1 = sqrtf(la_dotv3(row1, row1));
+  const float len2 = sqrtf(la_dotv3(row2, row2));
+  const float tol = LA_TRS_TOLERANCE;
+  const float w = tol * fabsf(e[3][3]);
+  return fabsf(bx) <= tol * len1 && fabsf(la_dotv3(row2, x)) <= tol * len2 &&
+         fabsf(la_dotv3(row2, y)) <= tol * len2 && fabsf(e[0][3]) <= w &&
+         fabsf(e[1][3]) <= w && fabsf(e[2][3]) <= w &&
+         fabsf(e[3][3] - 1.0f) <= tol;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * Computes the rows of LA_VF_WIDTH matrices at once, then writes them out
+ * one matrix at a time.
+ */
+void la_compose_trs_soa(const la_trs_soa *trs, la_mat4 *out, size_t n) {
+  LA_PROFILE_ENTER(la_compose_trs_soa);
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  const la_vf one = la_vf_set1(1.0f);
+  const la_vf two = la_vf_set1(2.0f);
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const la_vf x = la_vf_load(trs->rx + i), y = la_vf_load(trs->ry + i);
+    const la_vf z = la_vf_load(trs->rz + i), w = la_vf_load(trs->rw + i);
+    const la_vf xx = la_vf_mul(x, x), yy = la_vf_mul(y, y);
+    const la_vf zz = la_vf_mul(z, z), xy = la_vf_mul(x, y);
+    const la_vf xz = la_vf_mul(x, z), yz = la_vf_mul(y, z);
+    const la_vf wx = la_vf_mul(w, x), wy = la_vf_mul(w, y);
+    const la_vf wz = la_vf_mul(w, z);
+
+    const la_vf rot[9] = {la_vf_sub(one, la_vf_mul(two, la_vf_add(yy, zz))),
+                          la_vf_mul(two, la_vf_add(xy, wz)),
+                          la_vf_mul(two, la_vf_sub(xz, wy)),
+                          la_vf_mul(two, la_vf_sub(xy, wz)),
+                          la_vf_sub(one, la_vf_mul(two, la_vf_add(xx, zz))),
+                          la_vf_mul(two, la_vf_add(yz, wx)),
+                          la_vf_mul(two, la_vf_add(xz, wy)),
+                          la_vf_mul(two, la_vf_sub(yz, wx)),
+                          la_vf_sub(one, la_vf_mul(two, la_vf_add(xx, yy)))};
+    const la_vf scale[3] = {la_vf_load(trs->sx + i), la_vf_load(trs->sy + i),
+                            la_vf_load(trs->sz + i)};
+    float rows[9][LA_VF_WIDTH];
+    for (size_t k = 0; k < 9; k++) {
+      la_vf_store(rows[k], la_vf_mul(rot[k], scale[k / 3]));
+    }
+    for (size_t l = 0; l < LA_VF_WIDTH; l++) {
+      la_mat4 *m = &out[i + l];
+      for (size_t j = 0; j < 3; j++) {
+        m->elem[j][0] = rows[j * 3][l];
+        m->elem[j][1] = rows[j * 3 + 1][l];
+        m->elem[j][2] = rows[j * 3 + 2][l];
+        m->elem[j][3] = 0.0f;
+      }
+      m->elem[3][0] = trs->tx[i + l];
+      m->elem[3][1] = trs->ty[i + l];
+      m->elem[3][2] = trs->tz[i + l];
+      m->elem[3][3] = 1.0f;
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    const la_vec3 t = {.elem = {trs->tx[i], trs->ty[i], trs->tz[i]}};
+    const la_quat r = {
+        .elem = {trs->rx[i], trs->ry[i], trs->rz[i], trs->rw[i]}};
+    const la_vec3 s = {.elem = {trs->sx[i], trs->sy[i], trs->sz[i]}};
+    out[i] = la_compose_trs(t, r, s);
+  }
+  LA_PROFILE_LEAVE(la_compose_trs_soa);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_decompose_trs_soa(const la_mat4 *m, const la_trs_soa *trs, size_t n) {
+  int exact = 1;
+  for (size_t i = 0; i < n; i++) {
+    la_vec3 t, s;
+    la_quat r;
+    exact &= la_decompose_trs(m[i], &t, &r, &s);
+    trs->tx[i] = t.x;
+    trs->ty[i] = t.y;
+    trs->tz[i] = t.z;
+    trs->rx[i] = r.x;
+    trs->ry[i] = r.y;
+    trs->rz[i] = r.z;
+    trs->rw[i] = r.w;
+    trs->sx[i] = s.x;
+    trs->sy[i] = s.y;
+    trs->sz[i] = s.z;
+  }
+  return exact;
+}
+
+typedef struct la_trs_task {
+  const la_trs_soa *trs;
+  la_mat4 *out;
+} la_trs_task;
+
+static void la_compose_trs_range(void *ctx, size_t begin, size_t end) {
+  const la_trs_task *t = ctx;
+  const la_trs_soa *s = t->trs;
+  const la_trs_soa part = {s->tx + begin, s->ty + begin, s->tz + begin,
+                           s->rx + begin, s->ry + begin, s->rz + begin,
+                           s->rw + begin, s->sx + begin, s->sy + begin,
+                           s->sz + begin};
+  la_compose_trs_soa(&part, t->out + begin, end - begin);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_compose_trs_soa_mt(const la_jobs *jobs, const la_trs_soa *trs,
+                           la_mat4 *out, size_t n) {
+  la_trs_task t = {trs, out};
+  la_parallel_for(jobs, n, la_compose_trs_range, &t);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_dualquat la_identitydq(void) {
+  la_dualquat dq = {.real = {.elem = {0.0f, 0.0f, 0.0f, 1.0f}},
+                    .dual = {.elem = {0.0f, 0.0f, 0.0f, 0.0f}}};
+  return dq;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * dual = 0.5 * t * r, with t as a pure quaternion.
+ */
+la_dualquat la_rigiddq(const la_quat r, const la_vec3 t) {
+  const la_quat tq = {.elem = {t.x, t.y, t.z, 0.0f}};
+  const la_quat d = la_productq(tq, r);
+  la_dualquat dq;
+  dq.real = r;
+  for (size_t i = 0; i < 4; i++) {
+    dq.dual.elem[i] = 0.5f * d.elem[i];
+  }
+  return dq;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_dualquat la_m4todq(const la_mat4 m) {
+  const la_vec3 t = {.elem = {m.elem[3][0], m.elem[3][1], m.elem[3][2]}};
+  return la_rigiddq(la_m4toquat(m), t);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_m4todq_batch(const la_mat4 *in, la_dualquat *out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    out[i] = la_m4todq(in[i]);
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * t = 2 * dual * conjugate(real).
+ */
+la_vec3 la_translationdq(const la_dualquat dq) {
+  const la_quat t = la_productq(dq.dual, la_conjugateq(dq.real));
+  la_vec3 r = {.elem = {2.0f * t.x, 2.0f * t.y, 2.0f * t.z}};
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_mat4 la_dqtom4(const la_dualquat dq) {
+  la_mat4 m = la_quattom4(dq.real);
+  const la_vec3 t = la_translationdq(dq);
+  m.elem[3][0] = t.x;
+  m.elem[3][1] = t.y;
+  m.elem[3][2] = t.z;
+  return m;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_dualquat la_productdq(const la_dualquat dq1, const la_dualquat dq2) {
+  la_dualquat r;
+  r.real = la_productq(dq1.real, dq2.real);
+  const la_quat a = la_productq(dq1.real, dq2.dual);
+  const la_quat b = la_productq(dq1.dual, dq2.real);
+  for (size_t i = 0; i < 4; i++) {
+    r.dual.elem[i] = a.elem[i] + b.elem[i];
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_dualquat la_normalizedq(const la_dualquat dq) {
+  const float inv = 1.0f / sqrtf(la_dotv4(dq.real, dq.real));
+  la_dualquat r;
+  for (size_t i = 0; i < 4; i++) {
+    r.real.elem[i] = dq.real.elem[i] * inv;
+    r.dual.elem[i] = dq.dual.elem[i] * inv;
+  }
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec3 la_transform_point_dq(const la_dualquat dq, const la_vec3 p) {
+  const la_vec3 r = la_productqv3(dq.real, p);
+  const la_vec3 t = la_translationdq(dq);
+  la_vec3 out = {.elem = {r.x + t.x, r.y + t.y, r.z + t.z}};
+  return out;
+}
+
+/* The skinning kernels blend the palette entries of a vertex into a
+ * transform held in registers and apply it right away. The SIMD versions
+ * skin LA_VF_WIDTH vertices at a time: the palette entries of each lane are
+ * gathered through the stack into SoA form, one vector per element. The
+ * scalar versions handle the remainder and the builds without SIMD. */
+
+/* A blended rotation whose squared length, or a weight sum whose square, is
+ * below this is treated as no influence at all, and the vertex is passed
+ * through. */
+#define LA_SKIN_TINY 1e-12f
+
+/* b is a unit dual quaternion, real part in b[0..3] and dual part in
+ * b[4..7]. Rotates v by the real part (r, rw) and, when translate is set,
+ * adds the translation 2 * (rw * d - dw * r + r x d). */
+static void la_skin_dq_apply(const float *b, const float *v, float *out,
+                             int translate) {
+  const float ax = b[1] * v[2] - b[2] * v[1] + b[3] * v[0];
+  const float ay = b[2] * v[0] - b[0] * v[2] + b[3] * v[1];
+  const float az = b[0] * v[1] - b[1] * v[0] + b[3] * v[2];
+  float x = v[0] + 2.0f * (b[1] * az - b[2] * ay);
+  float y = v[1] + 2.0f * (b[2] * ax - b[0] * az);
+  float z = v[2] + 2.0f * (b[0] * ay - b[1] * ax);
+  if (translate) {
+    x += 2.0f * (b[3] * b[4] - b[7] * b[0] + b[1] * b[6] - b[2] * b[5]);
+    y += 2.0f * (b[3] * b[5] - b[7] * b[1] + b[2] * b[4] - b[0] * b[6]);
+    z += 2.0f * (b[3] * b[6] - b[7] * b[2] + b[0] * b[5] - b[1] * b[4]);
+  }
+  out[0] = x;
+  out[1] = y;
+  out[2] = z;
+}
+
+static void la_skin_linear_one(const la_mat3x4 *palette,
+                               const la_skin_soa *s, size_t i) {
+  float m[12] = {0.0f};
+  float sum = 0.0f;
+  for (size_t k = 0; k < s->influences; k++) {
+    const float w = s->weights[k * s->n + i];
+    const float *b = palette[s->bones[k * s->n + i]].elem[0];
+    for (size_t j = 0; j < 12; j++) {
+      m[j] += w * b[j];
+    }
+    sum += w;
+  }
+  if (sum * sum < LA_SKIN_TINY) {
+    /* The 3x4 identity, whose diagonal is every fifth element. */
+    for (size_t j = 0; j < 12; j++) {
+      m[j] = j % 5 == 0 ? 1.0f : 0.0f;
+    }
+  }
+  const float x = s->x[i];
+  const float y = s->y[i];
+  const float z = s->z[i];
+  s->out_x[i] = m[0] * x + m[1] * y + m[2] * z + m[3];
+  s->out_y[i] = m[4] * x + m[5] * y + m[6] * z + m[7];
+  s->out_z[i] = m[8] * x + m[9] * y + m[10] * z + m[11];
+  if (s->nx) {
+    const float nx = s->nx[i];
+    const float ny = s->ny[i];
+    const float nz = s->nz[i];
+    s->out_nx[i] = m[0] * nx + m[1] * ny + m[2] * nz;
+    s->out_ny[i] = m[4] * nx + m[5] * ny + m[6] * nz;
+    s->out_nz[i] = m[8] * nx + m[9] * ny + m[10] * nz;
+  }
+}
+
+static void la_skin_dual_quat_one(const la_dualquat *palette,
+                                  const la_skin_soa *s, size_t i) {
+  la_quat q0 = la_identityq();
+  float b[8] = {0.0f};
+  for (size_t k = 0; k < s->influences; k++) {
+    const la_dualquat *dq = &palette[s->bones[k * s->n + i]];
+    float w = s->weights[k * s->n + i];
+    if (k == 0) {
+      q0 = dq->real;
+    }
+    if (la_dotv4(dq->real, q0) < 0.0f) {
+      w = -w;
+    }
+    for (size_t j = 0; j < 4; j++) {
+      b[j] += w * dq->real.elem[j];
+      b[j + 4] += w * dq->dual.elem[j];
+    }
+  }
+  const float l2 = b[0] * b[0] + b[1] * b[1] + b[2] * b[2] + b[3] * b[3];
+  const float inv = l2 < LA_SKIN_TINY ? 0.0f : 1.0f / sqrtf(l2);
+  for (size_t j = 0; j < 8; j++) {
+    b[j] *= inv;
+  }
+  b[3] = l2 < LA_SKIN_TINY ? 1.0f : b[3];
+  const float p[3] = {s->x[i], s->y[i], s->z[i]};
+  float r[3];
+  la_skin_dq_apply(b, p, r, 1);
+  s->out_x[i] = r[0];
+  s->out_y[i] = r[1];
+  s->out_z[i] = r[2];
+  if (s->nx) {
+    const float nv[3] = {s->nx[i], s->ny[i], s->nz[i]};
+    la_skin_dq_apply(b, nv, r, 0);
+    s->out_nx[i] = r[0];
+    s->out_ny[i] = r[1];
+    s->out_nz[i] = r[2];
+  }
+}
+
+#ifdef LA_VF_WIDTH
+/* Component c of rw * d - dw * r + r x d, with c1 and c2 the next two. */
+static inline la_vf la_vf_skin_dq_term(const la_vf *b, int c, int c1,
+                                       int c2) {
+  la_vf t = la_vf_sub(la_vf_mul(b[3], b[4 + c]), la_vf_mul(b[7], b[c]));
+  t = la_vf_add(t, la_vf_mul(b[c1], b[4 + c2]));
+  return la_vf_sub(t, la_vf_mul(b[c2], b[4 + c1]));
+}
+
+static void la_vf_skin_dq_apply(const la_vf *b, const la_vf *v, la_vf *out,
+                                int translate) {
+  const la_vf two = la_vf_set1(2.0f);
+  const la_vf ax = la_vf_add(
+      la_vf_sub(la_vf_mul(b[1], v[2]), la_vf_mul(b[2], v[1])),
+      la_vf_mul(b[3], v[0]));
+  const la_vf ay = la_vf_add(
+      la_vf_sub(la_vf_mul(b[2], v[0]), la_vf_mul(b[0], v[2])),
+      la_vf_mul(b[3], v[1]));
+  const la_vf az = la_vf_add(
+      la_vf_sub(la_vf_mul(b[0], v[1]), la_vf_mul(b[1], v[0])),
+      la_vf_mul(b[3], v[2]));
+  la_vf x = la_vf_add(
+      v[0],
+      la_vf_mul(two, la_vf_sub(la_vf_mul(b[1], az), la_vf_mul(b[2], ay))));
+  la_vf y = la_vf_add(
+      v[1],
+      la_vf_mul(two, la_vf_sub(la_vf_mul(b[2], ax), la_vf_mul(b[0], az))));
+  la_vf z = la_vf_add(
+      v[2],
+      la_vf_mul(two, la_vf_sub(la_vf_mul(b[0], ay), la_vf_mul(b[1], ax))));
+  if (translate) {
+    x = la_vf_add(x, la_vf_mul(two, la_vf_skin_dq_term(b, 0, 1, 2)));
+    y = la_vf_add(y, la_vf_mul(two, la_vf_skin_dq_term(b, 1, 2, 0)));
+    z = la_vf_add(z, la_vf_mul(two, la_vf_skin_dq_term(b, 2, 0, 1)));
+  }
+  out[0] = x;
+  out[1] = y;
+  out[2] = z;
+}
+
+static void la_vf_skin_linear(const la_mat3x4 *palette, const la_skin_soa *s,
+                              size_t i) {
+  la_vf m[12];
+  la_vf sum = la_vf_set1(0.0f);
+  for (size_t j = 0; j < 12; j++) {
+    m[j] = la_vf_set1(0.0f);
+  }
+  for (size_t k = 0; k < s->influences; k++) {
+    const uint16_t *bones = s->bones + k * s->n + i;
+    const la_vf w = la_vf_load(s->weights + k * s->n + i);
+    float g[12][LA_VF_WIDTH];
+    for (size_t lane = 0; lane < LA_VF_WIDTH; lane++) {
+      const float *b = palette[bones[lane]].elem[0];
+      for (size_t j = 0; j < 12; j++) {
+        g[j][lane] = b[j];
+      }
+    }
+    for (size_t j = 0; j < 12; j++) {
+      m[j] = la_vf_add(m[j], la_vf_mul(w, la_vf_load(g[j])));
+    }
+    sum = la_vf_add(sum, w);
+  }
+  const la_vf none =
+      la_vf_lt(la_vf_mul(sum, sum), la_vf_set1(LA_SKIN_TINY));
+  for (size_t j = 0; j < 12; j++) {
+    m[j] = la_vf_select(none, la_vf_set1(j % 5 == 0 ? 1.0f : 0.0f), m[j]);
+  }
+  const la_vf x = la_vf_load(s->x + i);
+  const la_vf y = la_vf_load(s->y + i);
+  const la_vf z = la_vf_load(s->z + i);
+  float *out[3] = {s->out_x + i, s->out_y + i, s->out_z + i};
+  for (size_t r = 0; r < 3; r++) {
+    const la_vf *row = m + 4 * r;
+    la_vf v = la_vf_add(la_vf_mul(row[0], x), la_vf_mul(row[1], y));
+    v = la_vf_add(la_vf_add(v, la_vf_mul(row[2], z)), row[3]);
+    la_vf_store(out[r], v);
+  }
+  if (s->nx) {
+    const la_vf nx = la_vf_load(s->nx + i);
+    const la_vf ny = la_vf_load(s->ny + i);
+    const la_vf nz = la_vf_load(s->nz + i);
+    float *nout[3] = {s->out_nx + i, s->out_ny + i, s->out_nz + i};
+    for (size_t r = 0; r < 3; r++) {
+      const la_vf *row = m + 4 * r;
+      la_vf v = la_vf_add(la_vf_mul(row[0], nx), la_vf_mul(row[1], ny));
+      la_vf_store(nout[r], la_vf_add(v, la_vf_mul(row[2], nz)));
+    }
+  }
+}
+
+static void la_vf_skin_dual_quat(const la_dualquat *palette,
+                                 const la_skin_soa *s, size_t i) {
+  const la_vf zero = la_vf_set1(0.0f);
+  la_vf b[8];
+  la_vf q0[4] = {zero, zero, zero, zero};
+  for (size_t j = 0; j < 8; j++) {
+    b[j] = zero;
+  }
+  for (size_t k = 0; k < s->influences; k++) {
+    const uint16_t *bones = s->bones + k * s->n + i;
+    float g[8][LA_VF_WIDTH];
+    for (size_t lane = 0; lane < LA_VF_WIDTH; lane++) {
+      const la_dualquat *dq = &palette[bones[lane]];
+      for (size_t j = 0; j < 4; j++) {
+        g[j][lane] = dq->real.elem[j];
+        g[j + 4][lane] = dq->dual.elem[j];
+      }
+    }
+    la_vf q[8];
+    for (size_t j = 0; j < 8; j++) {
+      q[j] = la_vf_load(g[j]);
+    }
+    if (k == 0) {
+      for (size_t j = 0; j < 4; j++) {
+        q0[j] = q[j];
+      }
+    }
+    la_vf d = la_vf_add(la_vf_mul(q[0], q0[0]), la_vf_mul(q[1], q0[1]));
+    d = la_vf_add(la_vf_add(d, la_vf_mul(q[2], q0[2])),
+                  la_vf_mul(q[3], q0[3]));
+    la_vf w = la_vf_load(s->weights + k * s->n + i);
+    w = la_vf_select(la_vf_lt(d, zero), la_vf_sub(zero, w), w);
+    for (size_t j = 0; j < 8; j++) {
+      b[j] = la_vf_add(b[j], la_vf_mul(w, q[j]));
+    }
+  }
+  la_vf l2 = la_vf_add(la_vf_mul(b[0], b[0]), la_vf_mul(b[1], b[1]));
+  l2 = la_vf_add(la_vf_add(l2, la_vf_mul(b[2], b[2])),
+                 la_vf_mul(b[3], b[3]));
+  const la_vf none = la_vf_lt(l2, la_vf_set1(LA_SKIN_TINY));
+  const la_vf inv = la_vf_select(
+      none, zero, la_vf_div(la_vf_set1(1.0f), la_vf_sqrt(l2)));
+  for (size_t j = 0; j < 8; j++) {
+    b[j] = la_vf_mul(b[j], inv);
+  }
+  b[3] = la_vf_select(none, la_vf_set1(1.0f), b[3]);
+  la_vf v[3] = {la_vf_load(s->x + i), la_vf_load(s->y + i),
+                la_vf_load(s->z + i)};
+  la_vf r[3];
+  la_vf_skin_dq_apply(b, v, r, 1);
+  la_vf_store(s->out_x + i, r[0]);
+  la_vf_store(s->out_y + i, r[1]);
+  la_vf_store(s->out_z + i, r[2]);
+  if (s->nx) {
+    v[0] = la_vf_load(s->nx + i);
+    v[1] = la_vf_load(s->ny + i);
+    v[2] = la_vf_load(s->nz + i);
+    la_vf_skin_dq_apply(b, v, r, 0);
+    la_vf_store(s->out_nx + i, r[0]);
+    la_vf_store(s->out_ny + i, r[1]);
+    la_vf_store(s->out_nz + i, r[2]);
+  }
+}
+#endif
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_skin_linear(const la_mat3x4 *palette, const la_skin_soa *s) {
+  LA_PROFILE_ENTER(la_skin_linear);
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= s->n; i += LA_VF_WIDTH) {
+    la_vf_skin_linear(palette, s, i);
+  }
+#endif
+  for (; i < s->n; i++) {
+    la_skin_linear_one(palette, s, i);
+  }
+  LA_PROFILE_LEAVE(la_skin_linear);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_skin_dual_quat(const la_dualquat *palette, const la_skin_soa *s) {
+  LA_PROFILE_ENTER(la_skin_dual_quat);
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  for (; i + LA_VF_WIDTH <= s->n; i += LA_VF_WIDTH) {
+    la_vf_skin_dual_quat(palette, s, i);
+  }
+#endif
+  for (; i < s->n; i++) {
+    la_skin_dual_quat_one(palette, s, i);
+  }
+  LA_PROFILE_LEAVE(la_skin_dual_quat);
+}
+
+/* Tracks are sorted into groups that sample the same way: translations and
+ * scales, then rotations, each linear then Hermite. */
+#define LA_ANIM_GROUPS 4
+
+/* Number of tracks gathered and interpolated together. */
+#define LA_ANIM_BLOCK 64
+
+/* Keys the cursor may move forward before sampling searches instead. */
+#define LA_ANIM_STEPS 4
+
+typedef struct la_anim_track {
+  uint32_t target;
+  uint32_t channel;
+  uint32_t first;   // First key in times.
+  uint32_t count;
+  uint32_t value;   // First float in values.
+  uint32_t tangent; // First float in tangents, for a Hermite track.
+} la_anim_track;
+
+/* The times are a stream of their own, for the segment search. Values and
+ * tangents keep the components of a key together, so that sampling a track
+ * reads a few cache lines. */
+struct la_anim_clip {
+  size_t ntracks;
+  la_anim_track *tracks; // Sorted by group.
+  size_t groups[LA_ANIM_GROUPS + 1];
+  size_t targets; // One past the largest target.
+  float duration;
+  float *times;
+  float *inv_dt;   // 1 / (times[k + 1] - times[k]), 0 for the last key.
+  float *values;   // 3 or 4 per key.
+  float *tangents; // In then out tangent of each key, as given.
+};
+
+static inline size_t la_anim_group(la_anim_channel channel,
+                                   la_anim_interp interp) {
+  return (channel == LA_ANIM_ROTATION) * 2 + (interp == LA_ANIM_HERMITE);
+}
+
+static int la_anim_cmp_id(const void *a, const void *b) {
+  const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/* Whether a track is valid, and no two tracks animate the same channel. */
+static int la_anim_check(const la_anim_track_desc *tracks, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    const la_anim_track_desc *d = &tracks[i];
+    if (d->count == 0 || d->count > UINT32_MAX || d->times == NULL ||
+        d->values == NULL || (unsigned)d->channel > LA_ANIM_SCALE ||
+        (unsigned)d->interp > LA_ANIM_HERMITE ||
+        (d->interp == LA_ANIM_HERMITE && d->tangents == NULL)) {
+      return 0;
+    }
+    for (size_t k = 1; k < d->count; k++) {
+      if (!(d->times[k] > d->times[k - 1])) {
+        return 0;
+      }
+    }
+  }
+  uint64_t *ids = malloc((n > 0 ? n : 1) * sizeof(*ids));
+  if (ids == NULL) {
+    return 0;
+  }
+  for (size_t i = 0; i < n; i++) {
+    ids[i] = (uint64_t)tracks[i].target * 3 + (uint64_t)tracks[i].channel;
+  }
+  qsort(ids, n, sizeof(*ids), la_anim_cmp_id);
+  int unique = 1;
+  for (size_t i = 1; i < n; i++) {
+    unique &= ids[i] != ids[i - 1];
+  }
+  free(ids);
+  return unique;
+}
+
+/* Copies the keys of a track to the SoA streams of the clip. */
+static void la_anim_copy(la_anim_clip *c, const la_anim_track *t,
+                         const la_anim_track_desc *d) {
+  const size_t width = d->channel == LA_ANIM_ROTATION ? 4 : 3;
+  const float *prev = NULL;
+  for (size_t k = 0; k < d->count; k++) {
+    c->times[t->first + k] = d->times[k];
+    c->inv_dt[t->first + k] =
+        k + 1 < d->count ? 1.0f / (d->times[k + 1] - d->times[k]) : 0.0f;
+    const float *v = d->values + k * width;
+    float *out = c->values + t->value + k * width;
+    float dot = 0.0f;
+    for (size_t j = 0; prev != NULL && j < width; j++) {
+      dot += prev[j] * v[j];
+    }
+    /* Rotation keys follow the hemisphere of the key before. */
+    const float sign = width == 4 && dot < 0.0f ? -1.0f : 1.0f;
+    for (size_t j = 0; j < width; j++) {
+      out[j] = v[j] * sign;
+    }
+    prev = out;
+    if (d->interp == LA_ANIM_HERMITE) {
+      for (size_t j = 0; j < 2 * width; j++) {
+        c->tangents[t->tangent + k * 2 * width + j] =
+            d->tangents[k * 2 * width + j] * sign;
+      }
+    }
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_anim_clip *la_anim_clip_create(const la_anim_track_desc *tracks,
+                                  size_t n) {
+  if (!la_anim_check(tracks, n)) {
+    return NULL;
+  }
+  size_t nkeys = 0;
+  size_t nvalues = 0;
+  size_t ntangents = 0;
+  for (size_t i = 0; i < n; i++) {
+    const size_t width = tracks[i].channel == LA_ANIM_ROTATION ? 4 : 3;
+    const int hermite = tracks[i].interp == LA_ANIM_HERMITE;
+    nkeys += tracks[i].count;
+    nvalues += tracks[i].count * width;
+    ntangents += hermite ? tracks[i].count * width * 2 : 0;
+  }
+  if (ntangents > UINT32_MAX || nvalues > UINT32_MAX) {
+    return NULL;
+  }
+
+  la_anim_clip *c = calloc(1, sizeof(*c));
+  if (c == NULL) {
+    return NULL;
+  }
+  c->ntracks = n;
+  c->tracks = malloc((n > 0 ? n : 1) * sizeof(*c->tracks));
+  c->times = malloc((2 * nkeys + nvalues + ntangents + 1) * sizeof(float));
+  if (c->tracks == NULL || c->times == NULL) {
+    la_anim_clip_destroy(c);
+    return NULL;
+  }
+  c->inv_dt = c->times + nkeys;
+  c->values = c->inv_dt + nkeys;
+  c->tangents = c->values + nvalues;
+
+  for (size_t i = 0; i < n; i++) {
+    c->groups[la_anim_group(tracks[i].channel, tracks[i].interp) + 1]++;
+  }
+  for (size_t g = 0; g < LA_ANIM_GROUPS; g++) {
+    c->groups[g + 1] += c->groups[g];
+  }
+  size_t slot[LA_ANIM_GROUPS];
+  memcpy(slot, c->groups, sizeof(slot));
+  for (size_t i = 0; i < n; i++) {
+    const la_anim_track_desc *d = &tracks[i];
+    la_anim_track *t = &c->tracks[slot[la_anim_group(d->channel, d->interp)]++];
+    t->target = d->target;
+    t->channel = (uint32_t)d->channel;
+    t->count = (uint32_t)d->count;
+  }
+
+  /* The keys are laid out in track order, so a block of tracks reads
+   * nearby keys. */
+  uint32_t first = 0;
+  uint32_t value = 0;
+  uint32_t tangent = 0;
+  for (size_t g = 0, i = 0; g < LA_ANIM_GROUPS; g++) {
+    const uint32_t width = g >= 2 ? 4 : 3;
+    for (; i < c->groups[g + 1]; i++) {
+      la_anim_track *t = &c->tracks[i];
+      t->first = first;
+      t->value = value;
+      t->tangent = tangent;
+      first += t->count;
+      value += t->count * width;
+      tangent += g & 1 ? t->count * width * 2 : 0;
+    }
+  }
+  memcpy(slot, c->groups, sizeof(slot));
+  for (size_t i = 0; i < n; i++) {
+    const la_anim_track_desc *d = &tracks[i];
+    const la_anim_track *t =
+        &c->tracks[slot[la_anim_group(d->channel, d->interp)]++];
+    la_anim_copy(c, t, d);
+    c->targets = d->target >= c->targets ? (size_t)d->target + 1 : c->targets;
+    const float end = d->times[d->count - 1];
+    c->duration = i == 0 ? end : la_maxf(c->duration, end);
+  }
+  return c;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_anim_clip_destroy(la_anim_clip *clip) {
+  if (clip == NULL) {
+    return;
+  }
+  free(clip->times);
+  free(clip->tracks);
+  free(clip);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+size_t la_anim_clip_tracks(const la_anim_clip *clip) { return clip->ntracks; }
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_anim_clip_duration(const la_anim_clip *clip) {
+  return clip->duration;
+}
+
+/* Returns the segment [k, k + 1] to sample a track at, the last one with
+ * times[k] <= time, or 0. Starts from the cursor k. */
+static inline uint32_t la_anim_seek(const float *times, uint32_t count,
+                                    float time, uint32_t k) {
+  if (count < 2) {
+    return 0;
+  }
+  const uint32_t last = count - 2;
+  k = k < last ? k : last;
+  if (time >= times[k]) {
+    for (int step = 0; step < LA_ANIM_STEPS; step++) {
+      if (k == last || time < times[k + 1]) {
+        return k;
+      }
+      k++;
+    }
+  }
+  uint32_t lo = 0, hi = last;
+  while (lo < hi) {
+    const uint32_t mid = lo + (hi - lo + 1) / 2;
+    if (times[mid] <= time) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+/* The keys around the sample time of a block of tracks. The result replaces
+ * v0. */
+typedef struct la_anim_block {
+  float t0[LA_ANIM_BLOCK];
+  float inv_dt[LA_ANIM_BLOCK];
+  float dt[LA_ANIM_BLOCK];
+  float v0[4][LA_ANIM_BLOCK];
+  float v1[4][LA_ANIM_BLOCK];
+  float m0[4][LA_ANIM_BLOCK]; // Out tangent of the first key.
+  float m1[4][LA_ANIM_BLOCK]; // In tangent of the second key.
+} la_anim_block;
+
+static void la_anim_gather(const la_anim_clip *c, size_t begin, size_t n,
+                           float time, uint32_t *cursor, size_t width,
+                           int hermite, la_anim_block *b) {
+  for (size_t l = 0; l < n; l++) {
+    const la_anim_track *t = &c->tracks[begin + l];
+    const uint32_t k = la_anim_seek(c->times + t->first, t->count, time,
+                                    cursor != NULL ? cursor[begin + l] : 0);
+    if (cursor != NULL) {
+      cursor[begin + l] = k;
+    }
+    const uint32_t next = t->count > 1;
+    const uint32_t i = t->first + k;
+    b->t0[l] = c->times[i];
+    b->inv_dt[l] = c->inv_dt[i];
+    const float *v = c->values + t->value + k * width;
+    for (size_t j = 0; j < width; j++) {
+      b->v0[j][l] = v[j];
+      b->v1[j][l] = v[next * width + j];
+    }
+    if (hermite) {
+      const float *m = c->tangents + t->tangent + k * width * 2;
+      b->dt[l] = c->times[i + next] - c->times[i];
+      for (size_t j = 0; j < width; j++) {
+        b->m0[j][l] = m[width + j];
+        b->m1[j][l] = m[next * width * 2 + j];
+      }
+    }
+  }
+}
+
+/* Interpolates lane l of a block. */
+static inline void la_anim_lane(la_anim_block *b, size_t l, size_t width,
+                                int hermite, float time) {
+  const float a = la_minf(la_maxf((time - b->t0[l]) * b->inv_dt[l], 0.0f),
+                          1.0f);
+  if (hermite) {
+    const float a2 = a * a, a3 = a2 * a;
+    const float h00 = 2.0f * a3 - 3.0f * a2 + 1.0f;
+    const float h01 = 3.0f * a2 - 2.0f * a3;
+    const float h10 = (a3 - 2.0f * a2 + a) * b->dt[l];
+    const float h11 = (a3 - a2) * b->dt[l];
+    for (size_t j = 0; j < width; j++) {
+      b->v0[j][l] = h00 * b->v0[j][l] + h01 * b->v1[j][l] +
+                    h10 * b->m0[j][l] + h11 * b->m1[j][l];
+    }
+  } else {
+    for (size_t j = 0; j < width; j++) {
+      b->v0[j][l] += (b->v1[j][l] - b->v0[j][l]) * a;
+    }
+  }
+  if (width == 4) {
+    float l2 = 0.0f;
+    for (size_t j = 0; j < 4; j++) {
+      l2 += b->v0[j][l] * b->v0[j][l];
+    }
+    const float len = sqrtf(l2);
+    for (size_t j = 0; j < 4; j++) {
+      b->v0[j][l] /= len;
+    }
+  }
+}
+
+#ifdef LA_VF_WIDTH
+/* Interpolates lanes [l, l + LA_VF_WIDTH) of a block. */
+static inline void la_vf_anim_lanes(la_anim_block *b, size_t l, size_t width,
+                                    int hermite, float time) {
+  la_vf a = la_vf_mul(la_vf_sub(la_vf_set1(time), la_vf_load(b->t0 + l)),
+                      la_vf_load(b->inv_dt + l));
+  a = la_vf_min(la_vf_max(a, la_vf_set1(0.0f)), la_vf_set1(1.0f));
+  if (hermite) {
+    const la_vf one = la_vf_set1(1.0f), two = la_vf_set1(2.0f);
+    const la_vf three = la_vf_set1(3.0f);
+    const la_vf dt = la_vf_load(b->dt + l);
+    const la_vf a2 = la_vf_mul(a, a), a3 = la_vf_mul(a2, a);
+    const la_vf h00 = la_vf_add(
+        la_vf_sub(la_vf_mul(two, a3), la_vf_mul(three, a2)), one);
+    const la_vf h01 = la_vf_sub(la_vf_mul(three, a2), la_vf_mul(two, a3));
+    const la_vf h10 = la_vf_mul(
+        la_vf_add(la_vf_sub(a3, la_vf_mul(two, a2)), a), dt);
+    const la_vf h11 = la_vf_mul(la_vf_sub(a3, a2), dt);
+    for (size_t j = 0; j < width; j++) {
+      la_vf v = la_vf_mul(h00, la_vf_load(b->v0[j] + l));
+      v = la_vf_add(v, la_vf_mul(h01, la_vf_load(b->v1[j] + l)));
+      v = la_vf_add(v, la_vf_mul(h10, la_vf_load(b->m0[j] + l)));
+      v = la_vf_add(v, la_vf_mul(h11, la_vf_load(b->m1[j] + l)));
+      la_vf_store(b->v0[j] + l, v);
+    }
+  } else {
+    for (size_t j = 0; j < width; j++) {
+      const la_vf v0 = la_vf_load(b->v0[j] + l);
+      const la_vf d = la_vf_sub(la_vf_load(b->v1[j] + l), v0);
+      la_vf_store(b->v0[j] + l, la_vf_add(v0, la_vf_mul(d, a)));
+    }
+  }
+  if (width == 4) {
+    la_vf q[4];
+    la_vf l2 = la_vf_set1(0.0f);
+    for (size_t j = 0; j < 4; j++) {
+      q[j] = la_vf_load(b->v0[j] + l);
+      l2 = la_vf_add(l2, la_vf_mul(q[j], q[j]));
+    }
+    const la_vf len = la_vf_sqrt(l2);
+    for (size_t j = 0; j < 4; j++) {
+      la_vf_store(b->v0[j] + l, la_vf_div(q[j], len));
+    }
+  }
+}
+#endif
+
+static void la_anim_interpolate(la_anim_block *b, size_t n, size_t width,
+                                int hermite, float time) {
+  size_t l = 0;
+#ifdef LA_VF_WIDTH
+  for (; l + LA_VF_WIDTH <= n; l += LA_VF_WIDTH) {
+    la_vf_anim_lanes(b, l, width, hermite, time);
+  }
+#endif
+  for (; l < n; l++) {
+    la_anim_lane(b, l, width, hermite, time);
+  }
+}
+
+/* The streams of a channel of a pose. */
+static inline void la_anim_streams(const la_trs_soa *trs, uint32_t channel,
+                                   float **s) {
+  float *const all[3][4] = {{trs->tx, trs->ty, trs->tz, NULL},
+                            {trs->rx, trs->ry, trs->rz, trs->rw},
+                            {trs->sx, trs->sy, trs->sz, NULL}};
+  for (size_t j = 0; j < 4; j++) {
+    s[j] = all[channel][j];
+  }
+}
+
+/* Writes a block of samples to the streams of a pose, or adds them with a
+ * weight. */
+static void la_anim_scatter(const la_anim_clip *c, size_t begin, size_t n,
+                            size_t width, const la_anim_block *b,
+                            float *(*streams)[4], la_anim_pose *pose,
+                            float weight) {
+  for (size_t l = 0; l < n; l++) {
+    const la_anim_track *t = &c->tracks[begin + l];
+    const size_t i = t->target;
+    float **s = streams[t->channel];
+    if (pose == NULL) {
+      for (size_t j = 0; j < width; j++) {
+        s[j][i] = b->v0[j][l];
+      }
+      continue;
+    }
+    float w = weight;
+    if (width == 4) {
+      float dot = 0.0f;
+      for (size_t j = 0; j < 4; j++) {
+        dot += s[j][i] * b->v0[j][l];
+      }
+      w = dot < 0.0f ? -w : w;
+    }
+    for (size_t j = 0; j < width; j++) {
+      s[j][i] += w * b->v0[j][l];
+    }
+    pose->weight[t->channel * pose->count + i] += weight;
+  }
+}
+
+/* Samples every track of a clip, by groups of tracks that sample the same
+ * way. */
+static void la_anim_run(const la_anim_clip *c, float time, uint32_t *cursor,
+                        const la_trs_soa *trs, la_anim_pose *pose,
+                        float weight) {
+  float *streams[3][4];
+  for (uint32_t ch = 0; ch < 3; ch++) {
+    la_anim_streams(trs, ch, streams[ch]);
+  }
+  la_anim_block b;
+  for (size_t g = 0; g < LA_ANIM_GROUPS; g++) {
+    const size_t width = g >= 2 ? 4 : 3;
+    const int hermite = g & 1;
+    for (size_t i = c->groups[g]; i < c->groups[g + 1]; i += LA_ANIM_BLOCK) {
+      const size_t n = c->groups[g + 1] - i < LA_ANIM_BLOCK
+                           ? c->groups[g + 1] - i
+                           : LA_ANIM_BLOCK;
+      la_anim_gather(c, i, n, time, cursor, width, hermite, &b);
+      la_anim_interpolate(&b, n, width, hermite, time);
+      la_anim_scatter(c, i, n, width, &b, streams, pose, weight);
+    }
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_anim_sample(const la_anim_clip *clip, float time, uint32_t *cursor,
+                   const la_trs_soa *pose, size_t pose_count) {
+  if (clip->targets > pose_count) {
+    return 0;
+  }
+  LA_PROFILE_ENTER(la_anim_sample);
+  la_anim_run(clip, time, cursor, pose, NULL, 1.0f);
+  LA_PROFILE_LEAVE(la_anim_sample);
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_anim_pose *la_anim_pose_create(size_t count) {
+  la_anim_pose *pose = calloc(1, sizeof(*pose));
+  if (pose == NULL) {
+    return NULL;
+  }
+  /* One block for the transforms, then the weights. */
+  float *p = malloc((13 * count + 1) * sizeof(float));
+  if (p == NULL) {
+    free(pose);
+    return NULL;
+  }
+  float **streams[10] = {&pose->trs.tx, &pose->trs.ty, &pose->trs.tz,
+                         &pose->trs.rx, &pose->trs.ry, &pose->trs.rz,
+                         &pose->trs.rw, &pose->trs.sx, &pose->trs.sy,
+                         &pose->trs.sz};
+  for (size_t j = 0; j < 10; j++) {
+    *streams[j] = p + j * count;
+  }
+  pose->weight = p + 10 * count;
+  pose->count = count;
+  la_anim_pose_clear(pose);
+  return pose;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_anim_pose_destroy(la_anim_pose *pose) {
+  if (pose == NULL) {
+    return;
+  }
+  free(pose->trs.tx);
+  free(pose);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_anim_pose_clear(la_anim_pose *pose) {
+  memset(pose->trs.tx, 0, 13 * pose->count * sizeof(float));
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_anim_pose_add(la_anim_pose *pose, const la_anim_clip *clip,
+                     float time, uint32_t *cursor, float weight) {
+  if (clip->targets > pose->count) {
+    return 0;
+  }
+  LA_PROFILE_ENTER(la_anim_pose_add);
+  la_anim_run(clip, time, cursor, &pose->trs, pose, weight);
+  LA_PROFILE_LEAVE(la_anim_pose_add);
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_anim_pose_finish(la_anim_pose *pose, const la_trs_soa *rest) {
+  static const float identity[3][4] = {{0.0f, 0.0f, 0.0f, 0.0f},
+                                       {0.0f, 0.0f, 0.0f, 1.0f},
+                                       {1.0f, 1.0f, 1.0f, 0.0f}};
+  for (uint32_t c = 0; c < 3; c++) {
+    const size_t width = c == LA_ANIM_ROTATION ? 4 : 3;
+    const float *weight = pose->weight + c * pose->count;
+    float *s[4], *r[4];
+    la_anim_streams(&pose->trs, c, s);
+    if (rest != NULL) {
+      la_anim_streams(rest, c, r);
+    }
+    for (size_t i = 0; i < pose->count; i++) {
+      float scale = 0.0f;
+      if (weight[i] > 0.0f && width == 4) {
+        float l2 = 0.0f;
+        for (size_t j = 0; j < 4; j++) {
+          l2 += s[j][i] * s[j][i];
+        }
+        scale = l2 > 0.0f ? 1.0f / sqrtf(l2) : 0.0f;
+      } else if (weight[i] > 0.0f) {
+        scale = 1.0f / weight[i];
+      }
+      for (size_t j = 0; j < width; j++) {
+        s[j][i] = scale > 0.0f     ? s[j][i] * scale
+                  : rest != NULL ? r[j][i]
+                                 : identity[c][j];
+      }
+    }
+  }
+}
+
+/* Quantization ------------------------------------------------------------ */
+
+/* Steps of the smallest three components in 32 and 48 bits, and of the
+ * other packed values. */
+#define LA_QUAT_STEPS32 1023.0f
+#define LA_QUAT_STEPS48 32767.0f
+#define LA_QUANT_STEPS16 65535.0f
+#define LA_SCALE_STEPS16 32766.0f
+
+/* The smallest three components of a unit quaternion lie in
+ * [-LA_QUAT_LIMIT, LA_QUAT_LIMIT]. */
+#define LA_QUAT_LIMIT 0.70710678f
+
+/* Codes of one quaternion: the index of its largest component, then the
+ * other three mapped to [0, steps] with q negated to make the largest
+ * positive. The codes are left unrounded; packing converts them. */
+static void la_quat_code(const float *q, float steps, float *code) {
+  const float k = steps * LA_QUAT_LIMIT;
+  float best = fabsf(q[0]);
+  int index = 0;
+  for (int j = 1; j < 4; j++) {
+    if (best < fabsf(q[j])) {
+      best = fabsf(q[j]);
+      index = j;
+    }
+  }
+  code[0] = (float)index;
+  for (int j = 0, o = 1; j < 4; j++) {
+    if (j != index) {
+      const float v = q[index] < 0.0f ? -q[j] : q[j];
+      code[o++] = la_minf(la_maxf(v * k + 0.5f * steps, 0.0f), steps);
+    }
+  }
+}
+
+/* la_quat_code over n quaternions, into code[0..3][0..n). */
+static void la_quat_codes(const float *x, const float *y, const float *z,
+                          const float *w, size_t n, float steps,
+                          float (*code)[LA_AOS_BLOCK]) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  const la_vf zero = la_vf_set1(0.0f);
+  const la_vf top = la_vf_set1(steps);
+  const la_vf half = la_vf_set1(0.5f * steps);
+  const la_vf k = la_vf_set1(steps * LA_QUAT_LIMIT);
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const la_vf q[4] = {la_vf_load(x + i), la_vf_load(y + i),
+                        la_vf_load(z + i), la_vf_load(w + i)};
+    la_vf best = la_vf_max(q[0], la_vf_sub(zero, q[0]));
+    la_vf index = zero;
+    la_vf largest = q[0];
+    for (int j = 1; j < 4; j++) {
+      const la_vf mag = la_vf_max(q[j], la_vf_sub(zero, q[j]));
+      const la_vf more = la_vf_lt(best, mag);
+      best = la_vf_select(more, mag, best);
+      index = la_vf_select(more, la_vf_set1((float)j), index);
+      largest = la_vf_select(more, q[j], largest);
+    }
+    /* Component o of the three skips the largest: it is q[o] below the
+     * index and q[o + 1] from it on. */
+    const la_vf flip = la_vf_lt(largest, zero);
+    la_vf_store(code[0] + i, index);
+    for (int o = 0; o < 3; o++) {
+      const la_vf below = la_vf_lt(la_vf_set1((float)o + 0.5f), index);
+      la_vf v = la_vf_select(below, q[o], q[o + 1]);
+      v = la_vf_select(flip, la_vf_sub(zero, v), v);
+      v = la_vf_add(la_vf_mul(v, k), half);
+      la_vf_store(code[o + 1] + i, la_vf_min(la_vf_max(v, zero), top));
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    const float q[4] = {x[i], y[i], z[i], w[i]};
+    float c[4];
+    la_quat_code(q, steps, c);
+    for (int j = 0; j < 4; j++) {
+      code[j][i] = c[j];
+    }
+  }
+}
+
+/* The quaternion of one set of codes, inverting la_quat_code. */
+static void la_quat_value(const float *code, float steps, float *q) {
+  const float k = 1.0f / (steps * LA_QUAT_LIMIT);
+  const int index = (int)code[0];
+  float l2 = 1.0f;
+  for (int j = 0, o = 1; j < 4; j++) {
+    if (j != index) {
+      q[j] = code[o++] * k - LA_QUAT_LIMIT;
+      l2 -= q[j] * q[j];
+    }
+  }
+  q[index] = sqrtf(la_maxf(l2, 0.0f));
+}
+
+/* la_quat_value over n sets of codes in code[0..3][0..n). */
+static void la_quat_values(float (*code)[LA_AOS_BLOCK], size_t n, float steps,
+                           float *x, float *y, float *z, float *w) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  const la_vf zero = la_vf_set1(0.0f);
+  const la_vf one = la_vf_set1(1.0f);
+  const la_vf limit = la_vf_set1(LA_QUAT_LIMIT);
+  const la_vf k = la_vf_set1(1.0f / (steps * LA_QUAT_LIMIT));
+  float *out[4] = {x, y, z, w};
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const la_vf index = la_vf_load(code[0] + i);
+    la_vf v[3];
+    la_vf l2 = one;
+    for (int o = 0; o < 3; o++) {
+      v[o] = la_vf_sub(la_vf_mul(la_vf_load(code[o + 1] + i), k), limit);
+      l2 = la_vf_sub(l2, la_vf_mul(v[o], v[o]));
+    }
+    const la_vf l = la_vf_sqrt(la_vf_max(l2, zero));
+    /* Component j is v[j] below the index, the largest at it and v[j - 1]
+     * above it. */
+    for (int j = 0; j < 4; j++) {
+      const la_vf at_or_below = la_vf_lt(la_vf_set1((float)j - 0.5f), index);
+      const la_vf below = la_vf_lt(la_vf_set1((float)j + 0.5f), index);
+      la_vf q = j > 0 ? v[j - 1] : zero;
+      q = la_vf_select(at_or_below, l, q);
+      q = j < 3 ? la_vf_select(below, v[j], q) : q;
+      la_vf_store(out[j] + i, q);
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    const float c[4] = {code[0][i], code[1][i], code[2][i], code[3][i]};
+    float q[4];
+    la_quat_value(c, steps, q);
+    x[i] = q[0];
+    y[i] = q[1];
+    z[i] = q[2];
+    w[i] = q[3];
+  }
+}
+
+/* Round an unrounded code, which is in [0, steps]. */
+static inline uint32_t la_quant_round(float code) {
+  return (uint32_t)(code + 0.5f);
+}
+
+static inline uint32_t la_quat_word32(float index, float a, float b,
+                                      float c) {
+  return (uint32_t)index << 30 | la_quant_round(a) << 20 |
+         la_quant_round(b) << 10 | la_quant_round(c);
+}
+
+static inline void la_quat_unword32(uint32_t v, float *code) {
+  code[0] = (float)(v >> 30);
+  code[1] = (float)(v >> 20 & 1023u);
+  code[2] = (float)(v >> 10 & 1023u);
+  code[3] = (float)(v & 1023u);
+}
+
+/* 48 bits hold the low bit of the index above the first component and the
+ * high bit above the second. */
+static inline void la_quat_word48(float index, float a, float b, float c,
+                                  uint16_t *out) {
+  const uint32_t i = (uint32_t)index;
+  out[0] = (uint16_t)((i & 1u) << 15 | la_quant_round(a));
+  out[1] = (uint16_t)((i >> 1) << 15 | la_quant_round(b));
+  out[2] = (uint16_t)la_quant_round(c);
+}
+
+static inline void la_quat_unword48(const uint16_t *in, float *code) {
+  code[0] = (float)((uint32_t)(in[0] >> 15) | (uint32_t)(in[1] >> 15) << 1);
+  code[1] = (float)(in[0] & 32767u);
+  code[2] = (float)(in[1] & 32767u);
+  code[3] = (float)(in[2] & 32767u);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+uint32_t la_quat_pack32(const la_quat q) {
+  float code[4];
+  la_quat_code(q.elem, LA_QUAT_STEPS32, code);
+  return la_quat_word32(code[0], code[1], code[2], code[3]);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_quat la_quat_unpack32(uint32_t v) {
+  float code[4];
+  la_quat q;
+  la_quat_unword32(v, code);
+  la_quat_value(code, LA_QUAT_STEPS32, q.elem);
+  return q;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_quat_pack48(const la_quat q, uint16_t *out) {
+  float code[4];
+  la_quat_code(q.elem, LA_QUAT_STEPS48, code);
+  la_quat_word48(code[0], code[1], code[2], code[3], out);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_quat la_quat_unpack48(const uint16_t *in) {
+  float code[4];
+  la_quat q;
+  la_quat_unword48(in, code);
+  la_quat_value(code, LA_QUAT_STEPS48, q.elem);
+  return q;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * The codes are computed a vector at a time into a block on the stack, then
+ * rounded and packed into integers, which la_vf has no operations for.
+ */
+void la_quat_pack32_soa(const float *x, const float *y, const float *z,
+                        const float *w, uint32_t *out, size_t n) {
+  LA_PROFILE_ENTER(la_quat_pack32_soa);
+  float code[4][LA_AOS_BLOCK];
+  for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+    const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+    la_quat_codes(x + i, y + i, z + i, w + i, m, LA_QUAT_STEPS32, code);
+    for (size_t j = 0; j < m; j++) {
+      out[i + j] = la_quat_word32(code[0][j], code[1][j], code[2][j],
+                                  code[3][j]);
+    }
+  }
+  LA_PROFILE_LEAVE(la_quat_pack32_soa);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_quat_unpack32_soa(const uint32_t *in, float *x, float *y, float *z,
+                          float *w, size_t n) {
+  LA_PROFILE_ENTER(la_quat_unpack32_soa);
+  float code[4][LA_AOS_BLOCK];
+  for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+    const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+    for (size_t j = 0; j < m; j++) {
+      float c[4];
+      la_quat_unword32(in[i + j], c);
+      for (int k = 0; k < 4; k++) {
+        code[k][j] = c[k];
+      }
+    }
+    la_quat_values(code, m, LA_QUAT_STEPS32, x + i, y + i, z + i, w + i);
+  }
+  LA_PROFILE_LEAVE(la_quat_unpack32_soa);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_quat_pack48_soa(const float *x, const float *y, const float *z,
+                        const float *w, uint16_t *out, size_t n) {
+  float code[4][LA_AOS_BLOCK];
+  for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+    const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+    la_quat_codes(x + i, y + i, z + i, w + i, m, LA_QUAT_STEPS48, code);
+    for (size_t j = 0; j < m; j++) {
+      la_quat_word48(code[0][j], code[1][j], code[2][j], code[3][j],
+                     out + 3 * (i + j));
+    }
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_quat_unpack48_soa(const uint16_t *in, float *x, float *y, float *z,
+                          float *w, size_t n) {
+  float code[4][LA_AOS_BLOCK];
+  for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+    const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+    for (size_t j = 0; j < m; j++) {
+      float c[4];
+      la_quat_unword48(in + 3 * (i + j), c);
+      for (int k = 0; k < 4; k++) {
+        code[k][j] = c[k];
+      }
+    }
+    la_quat_values(code, m, LA_QUAT_STEPS48, x + i, y + i, z + i, w + i);
+  }
+}
+
+/* Map n values of one axis from [lo, lo + steps / k] to [0, steps], or back
+ * when decoding, a vector at a time. */
+static void la_quant_axis(const float *in, size_t n, float lo, float k,
+                          float steps, int decode, float *out) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  const la_vf vlo = la_vf_set1(lo);
+  const la_vf vk = la_vf_set1(k);
+  const la_vf zero = la_vf_set1(0.0f);
+  const la_vf top = la_vf_set1(steps);
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const la_vf v = la_vf_load(in + i);
+    la_vf_store(out + i,
+                decode ? la_vf_add(la_vf_mul(v, vk), vlo)
+                       : la_vf_min(la_vf_max(la_vf_mul(la_vf_sub(v, vlo), vk),
+                                             zero),
+                                   top));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = decode ? in[i] * k + lo
+                    : la_minf(la_maxf((in[i] - lo) * k, 0.0f), steps);
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_position_pack16_soa(const float *x, const float *y, const float *z,
+                            const la_vec3 min, const la_vec3 max,
+                            uint16_t *out, size_t n) {
+  LA_PROFILE_ENTER(la_position_pack16_soa);
+  const float *in[3] = {x, y, z};
+  float code[LA_AOS_BLOCK];
+  for (int a = 0; a < 3; a++) {
+    const float range = max.elem[a] - min.elem[a];
+    const float k = range > 0.0f ? LA_QUANT_STEPS16 / range : 0.0f;
+    for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+      const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+      la_quant_axis(in[a] + i, m, min.elem[a], k, LA_QUANT_STEPS16, 0, code);
+      for (size_t j = 0; j < m; j++) {
+        out[3 * (i + j) + a] = (uint16_t)la_quant_round(code[j]);
+      }
+    }
+  }
+  LA_PROFILE_LEAVE(la_position_pack16_soa);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_position_unpack16_soa(const uint16_t *in, const la_vec3 min,
+                              const la_vec3 max, float *x, float *y, float *z,
+                              size_t n) {
+  LA_PROFILE_ENTER(la_position_unpack16_soa);
+  float *out[3] = {x, y, z};
+  float code[LA_AOS_BLOCK];
+  for (int a = 0; a < 3; a++) {
+    const float range = max.elem[a] - min.elem[a];
+    const float k = range > 0.0f ? range / LA_QUANT_STEPS16 : 0.0f;
+    for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+      const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+      for (size_t j = 0; j < m; j++) {
+        code[j] = (float)in[3 * (i + j) + a];
+      }
+      la_quant_axis(code, m, min.elem[a], k, LA_QUANT_STEPS16, 1,
+                    out[a] + i);
+    }
+  }
+  LA_PROFILE_LEAVE(la_position_unpack16_soa);
+}
+
+/* log2 and exp2 for the scale codes, to within a few float ulps. log2 splits
+ * x into 2^e * m with m in [sqrt(1/2), sqrt(2)) and sums the atanh series of
+ * (m - 1) / (m + 1). exp2 rounds x to an integer n and evaluates the Taylor
+ * series of 2^(x - n). x must be a positive normal float for log2, and in
+ * [-126, 128) for exp2. The scalar and la_vf versions do the same steps. */
+#define LA_LOG2_E 1.44269504f
+
+static inline float la_quant_log2(float x) {
+  uint32_t i;
+  memcpy(&i, &x, sizeof(i));
+  float e = (float)(int32_t)(i & 0x7f800000u) * (1.0f / 8388608.0f) - 127.0f;
+  i = (i & 0x007fffffu) | 0x3f800000u;
+  float m;
+  memcpy(&m, &i, sizeof(m));
+  if (m > 1.41421356f) {
+    m *= 0.5f;
+    e += 1.0f;
+  }
+  const float t = (m - 1.0f) / (m + 1.0f);
+  const float t2 = t * t;
+  const float p =
+      1.0f + t2 * (1.0f / 3.0f +
+                   t2 * (1.0f / 5.0f + t2 * (1.0f / 7.0f + t2 * (1.0f / 9.0f))));
+  return e + 2.0f * LA_LOG2_E * t * p;
+}
+
+static inline float la_quant_exp2(float x) {
+  const float n = (x + 12582912.0f) - 12582912.0f;
+  const float f = x - n;
+  const float p =
+      1.0f +
+      f * (6.93147181e-1f +
+           f * (2.40226507e-1f +
+                f * (5.55041087e-2f +
+                     f * (9.61812911e-3f +
+                          f * (1.33335581e-3f +
+                               f * (1.54035304e-4f + f * 1.52527338e-5f))))));
+  const uint32_t i = (uint32_t)((n + 127.0f) * 8388608.0f);
+  float scale;
+  memcpy(&scale, &i, sizeof(scale));
+  return p * scale;
+}
+
+#ifdef LA_VF_WIDTH
+static inline la_vf la_vf_quant_log2(la_vf x) {
+  const la_vf one = la_vf_set1(1.0f);
+  /* The bits of +inf are the exponent field, those of -inf the sign too. */
+  la_vf e = la_vf_bits_to_float(la_vf_and(x, la_vf_set1(INFINITY)));
+  e = la_vf_sub(la_vf_mul(e, la_vf_set1(1.0f / 8388608.0f)),
+                la_vf_set1(127.0f));
+  la_vf m = la_vf_or(la_vf_andnot(la_vf_set1(-INFINITY), x), one);
+  const la_vf big = la_vf_lt(la_vf_set1(1.41421356f), m);
+  m = la_vf_select(big, la_vf_mul(m, la_vf_set1(0.5f)), m);
+  e = la_vf_select(big, la_vf_add(e, one), e);
+  const la_vf t = la_vf_div(la_vf_sub(m, one), la_vf_add(m, one));
+  const la_vf t2 = la_vf_mul(t, t);
+  la_vf p = la_vf_set1(1.0f / 9.0f);
+  p = la_vf_add(la_vf_mul(p, t2), la_vf_set1(1.0f / 7.0f));
+  p = la_vf_add(la_vf_mul(p, t2), la_vf_set1(1.0f / 5.0f));
+  p = la_vf_add(la_vf_mul(p, t2), la_vf_set1(1.0f / 3.0f));
+  p = la_vf_add(la_vf_mul(p, t2), one);
+  return la_vf_add(e,
+                   la_vf_mul(la_vf_mul(la_vf_set1(2.0f * LA_LOG2_E), t), p));
+}
+
+static inline la_vf la_vf_quant_exp2(la_vf x) {
+  const la_vf magic = la_vf_set1(12582912.0f);
+  const la_vf n = la_vf_sub(la_vf_add(x, magic), magic);
+  const la_vf f = la_vf_sub(x, n);
+  la_vf p = la_vf_set1(1.52527338e-5f);
+  p = la_vf_add(la_vf_mul(p, f), la_vf_set1(1.54035304e-4f));
+  p = la_vf_add(la_vf_mul(p, f), la_vf_set1(1.33335581e-3f));
+  p = la_vf_add(la_vf_mul(p, f), la_vf_set1(9.61812911e-3f));
+  p = la_vf_add(la_vf_mul(p, f), la_vf_set1(5.55041087e-2f));
+  p = la_vf_add(la_vf_mul(p, f), la_vf_set1(2.40226507e-1f));
+  p = la_vf_add(la_vf_mul(p, f), la_vf_set1(6.93147181e-1f));
+  p = la_vf_add(la_vf_mul(p, f), la_vf_set1(1.0f));
+  const la_vf scale = la_vf_float_to_bits(
+      la_vf_mul(la_vf_add(n, la_vf_set1(127.0f)), la_vf_set1(8388608.0f)));
+  return la_vf_mul(p, scale);
+}
+#endif
+
+/* Map n magnitudes of one axis to unrounded codes in [0, LA_SCALE_STEPS16],
+ * clamping them to [min_scale, max_scale] first. */
+static void la_scale_codes(const float *in, size_t n, float min_scale,
+                           float max_scale, float lo, float k, float *out) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  const la_vf sign = la_vf_set1(-0.0f);
+  const la_vf vmin = la_vf_set1(min_scale);
+  const la_vf vmax = la_vf_set1(max_scale);
+  const la_vf vlo = la_vf_set1(lo);
+  const la_vf vk = la_vf_set1(k);
+  const la_vf zero = la_vf_set1(0.0f);
+  const la_vf top = la_vf_set1(LA_SCALE_STEPS16);
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    la_vf a = la_vf_andnot(sign, la_vf_load(in + i));
+    a = la_vf_min(la_vf_max(a, vmin), vmax);
+    const la_vf l = la_vf_mul(la_vf_sub(la_vf_quant_log2(a), vlo), vk);
+    la_vf_store(out + i, la_vf_min(la_vf_max(l, zero), top));
+  }
+#endif
+  for (; i < n; i++) {
+    const float a = la_minf(la_maxf(fabsf(in[i]), min_scale), max_scale);
+    const float l = (la_quant_log2(a) - lo) * k;
+    out[i] = la_minf(la_maxf(l, 0.0f), LA_SCALE_STEPS16);
+  }
+}
+
+/* out[i] = m[i] * 2^(code[i] * k + lo) for n values of one axis. */
+static void la_scale_values(const float *code, const float *m, size_t n,
+                            float lo, float k, float *out) {
+  size_t i = 0;
+#ifdef LA_VF_WIDTH
+  const la_vf vlo = la_vf_set1(lo);
+  const la_vf vk = la_vf_set1(k);
+  for (; i + LA_VF_WIDTH <= n; i += LA_VF_WIDTH) {
+    const la_vf l = la_vf_add(la_vf_mul(la_vf_load(code + i), vk), vlo);
+    la_vf_store(out + i, la_vf_mul(la_vf_load(m + i), la_vf_quant_exp2(l)));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = m[i] * la_quant_exp2(code[i] * k + lo);
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ * The log2 codes are computed a vector at a time into a block on the stack,
+ * then the sign and zero are packed in with the rounded codes.
+ */
+void la_scale_pack16_soa(const float *x, const float *y, const float *z,
+                         float min_scale, float max_scale, uint16_t *out,
+                         size_t n) {
+  LA_PROFILE_ENTER(la_scale_pack16_soa);
+  const float *in[3] = {x, y, z};
+  const float lo = la_quant_log2(min_scale);
+  const float k = LA_SCALE_STEPS16 / (la_quant_log2(max_scale) - lo);
+  float code[LA_AOS_BLOCK];
+  for (int a = 0; a < 3; a++) {
+    for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+      const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+      la_scale_codes(in[a] + i, m, min_scale, max_scale, lo, k, code);
+      for (size_t j = 0; j < m; j++) {
+        const float s = in[a][i + j];
+        const uint32_t sign = s < 0.0f ? 32768u : 0u;
+        const uint32_t c = s != 0.0f ? la_quant_round(code[j]) + 1 : 0;
+        out[3 * (i + j) + a] = (uint16_t)(sign | c);
+      }
+    }
+  }
+  LA_PROFILE_LEAVE(la_scale_pack16_soa);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_scale_unpack16_soa(const uint16_t *in, float min_scale,
+                           float max_scale, float *x, float *y, float *z,
+                           size_t n) {
+  LA_PROFILE_ENTER(la_scale_unpack16_soa);
+  float *out[3] = {x, y, z};
+  const float lo = la_quant_log2(min_scale);
+  const float k = (la_quant_log2(max_scale) - lo) / LA_SCALE_STEPS16;
+  float code[LA_AOS_BLOCK], sign[LA_AOS_BLOCK];
+  for (int a = 0; a < 3; a++) {
+    for (size_t i = 0; i < n; i += LA_AOS_BLOCK) {
+      const size_t m = n - i < LA_AOS_BLOCK ? n - i : LA_AOS_BLOCK;
+      for (size_t j = 0; j < m; j++) {
+        const uint32_t v = in[3 * (i + j) + a];
+        const uint32_t c = v & 32767u;
+        code[j] = c > 0 ? (float)(c - 1) : 0.0f;
+        sign[j] = c == 0 ? 0.0f : v & 32768u ? -1.0f : 1.0f;
+      }
+      la_scale_values(code, sign, m, lo, k, out[a] + i);
+    }
+  }
+  LA_PROFILE_LEAVE(la_scale_unpack16_soa);
+}
+
+/* The _p functions are thin wrappers: the by-value functions are in this
+ * translation unit, so the compiler inlines them and writes the result
+ * straight to out. The copies only happen across the library boundary. */
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_identitym4_p(la_mat4 *out) { *out = la_identitym4(); }
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_productm4_p(la_mat4 *LA_RESTRICT out, const la_mat4 *a,
+                    const la_mat4 *b) {
+  *out = la_productm4(*a, *b);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_productm4v4_p(la_vec4 *LA_RESTRICT out, const la_mat4 *m,
+                      const la_vec4 *v) {
+  *out = la_productm4v4(*m, *v);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_productm4_affine_p(la_mat4 *LA_RESTRICT out, const la_mat4 *a,
+                           const la_mat4 *b) {
+  *out = la_productm4_affine(*a, *b);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_transposem4_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m) {
+  *out = la_transposem4(*m);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_inversem4_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m,
+                    int *invertible) {
+  *out = la_inversem4(*m, invertible);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_inverse_affine_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m,
+                         int *invertible) {
+  *out = la_inverse_affine(*m, invertible);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_translate_p(la_mat4 *out, const la_mat4 *m, const la_vec3 *v) {
+  if (out != m) {
+    *out = *m;
+  }
+  out->elem[3][0] += v->elem[0];
+  out->elem[3][1] += v->elem[1];
+  out->elem[3][2] += v->elem[2];
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_rotate_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m,
+                 const la_vec3 *axis, const float rads) {
+  *out = la_rotate(*m, *axis, rads);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_rotateq_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m,
+                  const la_quat *q) {
+  *out = la_rotateq(*m, *q);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_scale_p(la_mat4 *LA_RESTRICT out, const la_mat4 *m, const la_vec3 *v) {
+  *out = la_scale(*m, *v);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_quattom4_p(la_mat4 *LA_RESTRICT out, const la_quat *q) {
+  *out = la_quattom4(*q);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_perspective_p(la_mat4 *out, const float fov, const float aspect_ratio,
+                      const float near, const float far) {
+  *out = la_perspective(fov, aspect_ratio, near, far);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_orthographic_p(la_mat4 *out, const float left, const float right,
+                       const float bottom, const float top, const float near,
+                       const float far) {
+  *out = la_orthographic(left, right, bottom, top, near, far);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_look_at_p(la_mat4 *LA_RESTRICT out, const la_vec3 *eye,
+                  const la_vec3 *ctr, const la_vec3 *up) {
+  *out = la_look_at(*eye, *ctr, *up);
+}
+
+#define LA_NODE_DIRTY 1
+#define LA_NODE_CHANGED 2
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_bfs_order(const int32_t *parent, size_t n, uint32_t *order) {
+  /* The children of p, in index order, are child[start[p]] up to
+   * child[start[p + 1]]. Roots are stored as the children of p = n. */
+  size_t *start = calloc(n + 2, sizeof(*start));
+  size_t *fill = malloc((n + 1) * sizeof(*fill));
+  uint32_t *child = malloc((n ? n : 1) * sizeof(*child));
+  int ok = start != NULL && fill != NULL && child != NULL;
+  for (size_t i = 0; ok && i < n; i++) {
+    if (parent[i] < -1 || (parent[i] >= 0 && (size_t)parent[i] >= n)) {
+      ok = 0;
+    } else {
+      start[(parent[i] < 0 ? n : (size_t)parent[i]) + 1]++;
+    }
+  }
+  if (ok) {
+    for (size_t p = 0; p <= n; p++) {
+      start[p + 1] += start[p];
+    }
+    memcpy(fill, start, (n + 1) * sizeof(*fill));
+    for (size_t i = 0; i < n; i++) {
+      child[fill[parent[i] < 0 ? n : (size_t)parent[i]]++] = (uint32_t)i;
+    }
+
+    size_t tail = 0;
+    for (size_t k = start[n]; k < start[n + 1]; k++) {
+      order[tail++] = child[k];
+    }
+    for (size_t head = 0; head < tail; head++) {
+      const uint32_t p = order[head];
+      for (size_t k = start[p]; k < start[p + 1]; k++) {
+        order[tail++] = child[k];
+      }
+    }
+    /* Nodes on a cycle are never reached from a root. */
+    ok = tail == n;
+  }
+  free(child);
+  free(fill);
+  free(start);
+  return ok;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_hierarchy *la_hierarchy_create(const int32_t *parent, size_t n) {
+  la_hierarchy *h = calloc(1, sizeof(*h));
+  uint32_t *depth = malloc((n ? n : 1) * sizeof(*depth));
+  if (h == NULL || depth == NULL) {
+    free(depth);
+    free(h);
+    return NULL;
+  }
+
+  /* Breadth-first means parents come first and depth never decreases. */
+  int bfs = 1;
+  for (size_t i = 0; bfs && i < n; i++) {
+    const int32_t p = parent[i];
+    bfs = p < 0 || (size_t)p < i;
+    if (bfs) {
+      depth[i] = p < 0 ? 0 : depth[p] + 1;
+      bfs = i == 0 || depth[i] >= depth[i - 1];
+      h->nlevels = depth[i] + 1;
+    }
+  }
+  if (!bfs) {
+    free(depth);
+    free(h);
+    return NULL;
+  }
+
+  const size_t m = n ? n : 1;
+  h->count = n;
+  h->parent = malloc(m * sizeof(*h->parent));
+  h->tx = malloc(10 * m * sizeof(float)); // One block for the SoA streams.
+  h->world = la_aligned_alloc(m * sizeof(la_mat4), LA_CACHE_LINE);
+  h->flags = malloc(m);
+  h->levels = calloc(h->nlevels + 1, sizeof(*h->levels));
+  if (h->parent == NULL || h->tx == NULL || h->world == NULL ||
+      h->flags == NULL || h->levels == NULL) {
+    free(depth);
+    la_hierarchy_destroy(h);
+    return NULL;
+  }
+  h->ty = h->tx + m;
+  h->tz = h->ty + m;
+  h->rx = h->tz + m;
+  h->ry = h->rx + m;
+  h->rz = h->ry + m;
+  h->rw = h->rz + m;
+  h->sx = h->rw + m;
+  h->sy = h->sx + m;
+  h->sz = h->sy + m;
+
+  const la_vec3 zero = {.elem = {0.0f, 0.0f, 0.0f}};
+  const la_vec3 one = {.elem = {1.0f, 1.0f, 1.0f}};
+  for (size_t i = 0; i < n; i++) {
+    h->parent[i] = parent[i];
+    la_hierarchy_set_trs(h, i, zero, la_identityq(), one);
+    h->levels[depth[i] + 1] = i + 1;
   }
-  return res;
+  free(depth);
+  return h;
 }
 
 /**
  * ----------------------------------------------------------------------------
  */
-float la_dotv3(const la_vec3 v1, const la_vec3 v2) {
-  return la_dotvn(v1.elem, v2.elem, 3);
+void la_hierarchy_destroy(la_hierarchy *h) {
+  if (h == NULL) {
+    return;
+  }
+  free(h->levels);
+  free(h->flags);
+  la_aligned_free(h->world);
+  free(h->tx);
+  free(h->parent);
+  free(h);
 }
 
 /**
  * ----------------------------------------------------------------------------
  */
-int la_cmpv3(const la_vec3 v1, const la_vec3 v2) {
-  for (int i = 0; i < 3; i++) {
-    if (fabs(v1.elem[i] - v2.elem[i]) > FLT_EPSILON) {
-      return 0;
-    }
+void la_hierarchy_set_trs(la_hierarchy *h, size_t i, const la_vec3 t,
+                          const la_quat r, const la_vec3 s) {
+  h->tx[i] = t.x;
+  h->ty[i] = t.y;
+  h->tz[i] = t.z;
+  h->rx[i] = r.x;
+  h->ry[i] = r.y;
+  h->rz[i] = r.z;
+  h->rw[i] = r.w;
+  h->sx[i] = s.x;
+  h->sy[i] = s.y;
+  h->sz[i] = s.z;
+  h->flags[i] = LA_NODE_DIRTY;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_hierarchy_mark_dirty(la_hierarchy *h, size_t i) {
+  h->flags[i] |= LA_NODE_DIRTY;
+}
+
+/* Recomputes node i if it or its parent changed. The parent has a smaller
+ * index, and a lower depth, so it is already up to date. */
+static inline size_t la_hierarchy_node(la_hierarchy *h, size_t i) {
+  const int32_t p = h->parent[i];
+  if (!(h->flags[i] & LA_NODE_DIRTY) &&
+      (p < 0 || !(h->flags[p] & LA_NODE_CHANGED))) {
+    h->flags[i] = 0;
+    return 0;
   }
+
+  const la_vec3 t = {.elem = {h->tx[i], h->ty[i], h->tz[i]}};
+  const la_quat r = {.elem = {h->rx[i], h->ry[i], h->rz[i], h->rw[i]}};
+  const la_vec3 s = {.elem = {h->sx[i], h->sy[i], h->sz[i]}};
+  const la_mat4 local = la_compose_trs(t, r, s);
+  h->world[i] = p < 0 ? local : la_productm4_affine(local, h->world[p]);
+  h->flags[i] = LA_NODE_CHANGED;
   return 1;
 }
 
 /**
  * ----------------------------------------------------------------------------
  */
-int la_cmpv2(const la_vec2 v1, const la_vec2 v2) {
-  for (int i = 0; i < 2; i++) {
-    if (fabs(v1.elem[i] - v2.elem[i]) > FLT_EPSILON) {
-      return 0;
-    }
+size_t la_hierarchy_update(la_hierarchy *h) {
+  LA_PROFILE_ENTER(la_hierarchy_update);
+  size_t updated = 0;
+  for (size_t i = 0; i < h->count; i++) {
+    updated += la_hierarchy_node(h, i);
+  }
+  LA_PROFILE_LEAVE(la_hierarchy_update);
+  return updated;
+}
+
+typedef struct la_hierarchy_task {
+  la_hierarchy *h;
+  size_t first;
+} la_hierarchy_task;
+
+static void la_hierarchy_range(void *ctx, size_t begin, size_t end) {
+  const la_hierarchy_task *t = ctx;
+  for (size_t i = t->first + begin; i < t->first + end; i++) {
+    la_hierarchy_node(t->h, i);
   }
-  return 1;
 }
 
 /**
  * ----------------------------------------------------------------------------
  */
-float la_dotv4(const la_vec4 v1, const la_vec4 v2) {
-  return (v1.x * v2.x) + (v1.y * v2.y) + (v1.z * v2.z) + (v1.w * v2.w);
+size_t la_hierarchy_update_mt(const la_jobs *jobs, la_hierarchy *h) {
+  for (size_t d = 0; d < h->nlevels; d++) {
+    la_hierarchy_task t = {h, h->levels[d]};
+    la_parallel_for(jobs, h->levels[d + 1] - h->levels[d], la_hierarchy_range,
+                    &t);
+  }
+  /* Counted afterwards from the flags rather than summed across threads. */
+  size_t updated = 0;
+  for (size_t i = 0; i < h->count; i++) {
+    updated += (h->flags[i] & LA_NODE_CHANGED) != 0;
+  }
+  return updated;
 }
+
 /**
  * ----------------------------------------------------------------------------
  */
-la_vec3 la_crossv3(const struct la_vec3 v1, const struct la_vec3 v2) {
-  struct la_vec3 r = {
-      {{(v1.y * v2.z) - (v1.z * v2.y), (v1.z * v2.x) - (v1.x * v2.z),
-        (v1.x * v2.y) - (v1.y * v2.x)}}};
-  return r;
+int la_hierarchy_changed(const la_hierarchy *h, size_t i) {
+  return (h->flags[i] & LA_NODE_CHANGED) != 0;
 }
 
 /**
  * ----------------------------------------------------------------------------
  */
-la_mat4 la_productm4(const la_mat4 m1, const la_mat4 m2) {
-  la_mat4 r = {0};
+la_mat4 la_dm4tom4(const la_dmat4 m) {
+  la_mat4 r;
   for (size_t i = 0; i < 4; i++) {
     for (size_t j = 0; j < 4; j++) {
-      for (size_t k = 0; k < 4; k++) {
-        r.elem[i][k] += m1.elem[i][j] * m2.elem[j][k];
-      }
+      r.elem[i][j] = (float)m.elem[i][j];
     }
   }
   return r;
@@ -378,135 +9435,672 @@ la_mat4 la_productm4(const la_mat4 m1, const la_mat4 m2) {
 /**
  * ----------------------------------------------------------------------------
  */
-la_vec4 la_productm4v4(const la_mat4 m, const la_vec4 v) {
-  la_vec4 res = {0};
+la_dmat4 la_m4todm4(const la_mat4 m) {
+  la_dmat4 r;
   for (size_t i = 0; i < 4; i++) {
     for (size_t j = 0; j < 4; j++) {
-      res.elem[i] += m.elem[i][j] * v.elem[j];
+      r.elem[i][j] = m.elem[i][j];
     }
   }
-  return res;
+  return r;
 }
 
 /**
  * ----------------------------------------------------------------------------
  */
-la_mat4 la_perspective(const float fov, const float aspect_ratio,
-                       const float near, const float far) {
-  const float t = tan(fov / 2.0f);
-
-  la_mat4 mat = {0};
-  mat.elem[0][0] = 1.0f / (aspect_ratio * t);
-  mat.elem[1][1] = 1.0f / t;
-  mat.elem[2][2] = -(far + near) / (far - near);
-  mat.elem[2][3] = -1.0f;
-  mat.elem[3][2] = -(2.0f * far * near) / (far - near);
-  return mat;
+la_vec3 la_dv3tov3(const la_dvec3 v) {
+  la_vec3 r = {.elem = {(float)v.x, (float)v.y, (float)v.z}};
+  return r;
 }
 
 /**
  * ----------------------------------------------------------------------------
  */
-la_mat4 la_orthographic(const float left, const float right, const float bottom,
-                        const float top, const float near, const float far) {
-  la_mat4 mat = la_identitym4();
-  mat.elem[0][0] = 2.0f / (right - left);
-  mat.elem[1][1] = 2.0f / (top - bottom);
-  mat.elem[2][2] = -2.0f / (far - near);
-  mat.elem[3][0] = -(right + left) / (right - left);
-  mat.elem[3][1] = -(top + bottom) / (top - bottom);
-  mat.elem[3][2] = -(far + near) / (far - near);
-  return mat;
+la_dvec3 la_v3todv3(const la_vec3 v) {
+  la_dvec3 r = {.elem = {v.x, v.y, v.z}};
+  return r;
+}
+
+/* out[i] = (float)(in[i] - c). Both the subtraction and the rounding are
+ * single IEEE operations, so the SIMD loops match the scalar one. */
+static void la_sub_to_float(const double *in, double c, float *out,
+                            size_t n) {
+  size_t i = 0;
+#if defined(LA_USE_AVX)
+  const __m256d vc = _mm256_set1_pd(c);
+  for (; i + 4 <= n; i += 4) {
+    const __m256d d = _mm256_sub_pd(_mm256_loadu_pd(in + i), vc);
+    _mm_storeu_ps(out + i, _mm256_cvtpd_ps(d));
+  }
+#elif defined(LA_USE_SSE2)
+  const __m128d vc = _mm_set1_pd(c);
+  for (; i + 4 <= n; i += 4) {
+    const __m128 lo = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(in + i), vc));
+    const __m128 hi = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(in + i + 2), vc));
+    _mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = (float)(in[i] - c);
+  }
 }
 
 /**
  * ----------------------------------------------------------------------------
  */
-la_mat4 la_look_at(const la_vec3 eye, const la_vec3 ctr, const la_vec3 up) {
-  la_vec3 f = {{{ctr.elem[0] - eye.elem[0], ctr.elem[1] - eye.elem[1],
-                 ctr.elem[2] - eye.elem[2]}}};
+void la_camera_relative_soa(const la_dvec3 *camera, const double *x,
+                            const double *y, const double *z, float *ox,
+                            float *oy, float *oz, size_t n) {
+  la_sub_to_float(x, camera->x, ox, n);
+  la_sub_to_float(y, camera->y, oy, n);
+  la_sub_to_float(z, camera->z, oz, n);
+}
 
-  f = la_normalizev3(f);
-  la_vec3 s = la_normalizev3(la_crossv3(f, up));
-  la_vec3 u = la_crossv3(s, f);
+/**
+ * ----------------------------------------------------------------------------
+ * Multiplying by a translation only changes the first three columns: row i
+ * loses camera * elem[i][3].
+ */
+void la_camera_relative_m4_batch(const la_dvec3 *camera,
+                                 const la_dmat4 *world, la_mat4 *out,
+                                 size_t n) {
+  for (size_t k = 0; k < n; k++) {
+    for (size_t i = 0; i < 4; i++) {
+      const double *row = world[k].elem[i];
+      for (size_t j = 0; j < 3; j++) {
+        out[k].elem[i][j] = (float)(row[j] - camera->elem[j] * row[3]);
+      }
+      out[k].elem[i][3] = (float)row[3];
+    }
+  }
+}
 
-  la_mat4 mat = la_identitym4();
+static inline uint32_t la_ftou(float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
 
-  mat.elem[0][0] = s.elem[0];
-  mat.elem[1][0] = s.elem[1];
-  mat.elem[2][0] = s.elem[2];
+static inline float la_utof(uint32_t u) {
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
 
-  mat.elem[0][1] = u.elem[0];
-  mat.elem[1][1] = u.elem[1];
-  mat.elem[2][1] = u.elem[2];
+/**
+ * ----------------------------------------------------------------------------
+ * Normal results round by adding half a unit in the last place, plus one when
+ * the kept part is odd, before truncating. Subnormal results are rounded by
+ * the FPU when the value is added to 0.5f, whose exponent lines the float
+ * mantissa up with the half precision subnormal one.
+ */
+la_half la_ftoh(const float f) {
+  uint32_t u = la_ftou(f);
+  const uint32_t sign = (u >> 16) & 0x8000u;
+  u &= 0x7fffffffu;
 
-  mat.elem[0][2] = -f.elem[0];
-  mat.elem[1][2] = -f.elem[1];
-  mat.elem[2][2] = -f.elem[2];
+  uint32_t h;
+  if (u > 0x7f800000u) {
+    h = 0x7e00u | ((u >> 13) & 0x3ffu); // Quiet NaN, top payload bits kept.
+  } else if (u >= 0x477ff000u) {
+    h = 0x7c00u; // Infinity, or too large for half precision.
+  } else if (u < 0x38800000u) {
+    h = la_ftou(la_utof(u) + 0.5f) - la_ftou(0.5f);
+  } else {
+    u += 0xc8000fffu + ((u >> 13) & 1u); // Rebias from 127 to 15 and round.
+    h = u >> 13;
+  }
+  return (la_half)(sign | h);
+}
 
-  mat.elem[3][0] = -la_dotv3(s, eye);
-  mat.elem[3][1] = -la_dotv3(u, eye);
-  mat.elem[3][2] = la_dotv3(f, eye);
-  return mat;
+/**
+ * ----------------------------------------------------------------------------
+ */
+float la_htof(const la_half h) {
+  const uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+  const uint32_t em = h & 0x7fffu;
+  if (em >= 0x7c00u) {
+    return la_utof(sign | 0x7f800000u | ((em & 0x3ffu) << 13));
+  }
+  if (em >= 0x0400u) {
+    return la_utof(sign | ((em << 13) + 0x38000000u));
+  }
+  const float f = (float)em * 5.9604644775390625e-8f; // 2^-24
+  return la_utof(sign | la_ftou(f));
 }
 
 /**
  * ----------------------------------------------------------------------------
  */
-la_mat4 la_translate(const la_mat4 m, const la_vec3 v) {
-  la_mat4 res = m;
-  res.elem[3][0] += v.elem[0];
-  res.elem[3][1] += v.elem[1];
-  res.elem[3][2] += v.elem[2];
-  return res;
+void la_ftoh_batch(const float *in, la_half *out, size_t n) {
+  size_t i = 0;
+#if defined(LA_USE_F16C)
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i),
+                                      _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i *)(out + i), h);
+  }
+#elif defined(LA_USE_NEON) && defined(__aarch64__)
+  for (; i + 4 <= n; i += 4) {
+    const float16x4_t h = vcvt_f16_f32(vld1q_f32(in + i));
+    vst1_u16(out + i, vreinterpret_u16_f16(h));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = la_ftoh(in[i]);
+  }
 }
 
 /**
  * ----------------------------------------------------------------------------
  */
-la_mat4 la_rotate(const la_mat4 m, const la_vec3 axis, const float rads) {
-  const float c = cos(rads);
-  const float s = sin(rads);
+void la_htof_batch(const la_half *in, float *out, size_t n) {
+  size_t i = 0;
+#if defined(LA_USE_F16C)
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h = _mm_loadu_si128((const __m128i *)(in + i));
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+  }
+#elif defined(LA_USE_NEON) && defined(__aarch64__)
+  for (; i + 4 <= n; i += 4) {
+    const float16x4_t h = vreinterpret_f16_u16(vld1_u16(in + i));
+    vst1q_f32(out + i, vcvt_f32_f16(h));
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = la_htof(in[i]);
+  }
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_hvec4 la_v4tohv4(const la_vec4 v) {
+  la_hvec4 r;
+  la_ftoh_batch(v.elem, r.elem, 4);
+  return r;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_vec4 la_hv4tov4(const la_hvec4 v) {
+  la_vec4 r;
+  la_htof_batch(v.elem, r.elem, 4);
+  return r;
+}
+
+/* Binary files. The header is written last, when the directory is known. */
+typedef struct la_bin_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order; // LA_BIN_BYTE_ORDER as stored by the writer.
+  uint64_t count;      // The number of directory entries.
+  uint64_t directory;  // The offset of the directory.
+  uint8_t reserved[32];
+} la_bin_header;
+
+LA_STATIC_ASSERT(sizeof(la_bin_header) == LA_CACHE_LINE,
+                 "la_bin_header must fill one cache line");
+
+static const char la_bin_magic[8] = {'\x89', 'L', 'A', 'B', 'I', 'N', '\r',
+                                     '\n'};
+
+#define LA_BIN_BYTE_ORDER 0x01020304u
+/* Floats (or quantized components) converted per fwrite. */
+#define LA_BIN_BLOCK 4096
+
+struct la_bin_writer {
+  FILE *f;
+  int failed; // Set by any failed call, see la_bin_writer_close.
+  int open;   // Whether an array is started.
+  uint64_t end;
+  uint64_t written; // The elements of the started array written so far.
+  la_bin_entry *entries;
+  size_t count;
+  size_t capacity;
+  float min[16]; // The LA_BIN_Q16 ranges of the started array.
+  float step[16];
+  union {
+    float f[LA_BIN_BLOCK];
+    uint16_t q[LA_BIN_BLOCK];
+  } scratch;
+};
+
+struct la_bin {
+  const uint8_t *base;
+  uint64_t size;
+  const la_bin_entry *entries;
+  size_t count;
+};
+
+static uint64_t la_bin_align(uint64_t offset) {
+  return (offset + LA_CACHE_LINE - 1) & ~(uint64_t)(LA_CACHE_LINE - 1);
+}
+
+/* The bytes of the (min, step) pairs in front of LA_BIN_Q16 data. */
+static uint64_t la_bin_ranges_size(size_t components) {
+  return la_bin_align(components * 2 * sizeof(float));
+}
+
+static uint64_t la_bin_data_size(size_t components, uint32_t layout,
+                                 uint64_t count) {
+  switch (layout) {
+  case LA_BIN_AOS:
+    return count * components * sizeof(float);
+  case LA_BIN_SOA:
+    return components * la_bin_align(count * sizeof(float));
+  default:
+    return la_bin_ranges_size(components) +
+           count * components * sizeof(uint16_t);
+  }
+}
 
-  la_vec3 a = la_normalizev3(axis);
+static int la_bin_seek(FILE *f, uint64_t offset) {
+#if defined(_WIN32)
+  return _fseeki64(f, (__int64)offset, SEEK_SET) == 0;
+#elif defined(LA_HAS_POSIX_2001)
+  return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#else
+  return offset <= LONG_MAX && fseek(f, (long)offset, SEEK_SET) == 0;
+#endif
+}
+
+static int la_bin_put(la_bin_writer *w, const void *p, size_t size) {
+  if (!w->failed && size > 0 && fwrite(p, 1, size, w->f) != size) {
+    w->failed = 1;
+  }
+  return !w->failed;
+}
 
-  la_mat4 rot = {0};
-  rot.elem[0][0] = c + (1.0f - c) * a.elem[0] * a.elem[0];
-  rot.elem[0][1] = (1.0f - c) * a.elem[0] * a.elem[1] + s * a.elem[2];
-  rot.elem[0][2] = (1.0f - c) * a.elem[0] * a.elem[2] - s * a.elem[1];
+static uint16_t la_bin_quantize(float v, float min, float step) {
+  if (!(step > 0.0f)) {
+    return 0;
+  }
+  const float t = (v - min) / step + 0.5f;
+  return t > 0.0f ? (t < 65535.0f ? (uint16_t)t : 65535) : 0;
+}
 
-  rot.elem[1][0] = (1.0f - c) * a.elem[1] * a.elem[0] - s * a.elem[2];
-  rot.elem[1][1] = c + (1.0f - c) * a.elem[1] * a.elem[1];
-  rot.elem[1][2] = (1.0f - c) * a.elem[1] * a.elem[2] + s * a.elem[0];
+/**
+ * ----------------------------------------------------------------------------
+ */
+size_t la_bin_components(la_bin_type type) {
+  switch (type) {
+  case LA_BIN_FLOAT:
+    return 1;
+  case LA_BIN_VEC3:
+    return 3;
+  case LA_BIN_VEC4:
+    return 4;
+  case LA_BIN_MAT3X4:
+    return 12;
+  case LA_BIN_MAT4:
+    return 16;
+  }
+  return 0;
+}
 
-  rot.elem[2][0] = (1.0f - c) * a.elem[2] * a.elem[0] + s * a.elem[1];
-  rot.elem[2][1] = (1.0f - c) * a.elem[2] * a.elem[1] - s * a.elem[0];
-  rot.elem[2][2] = c + (1.0f - c) * a.elem[2] * a.elem[2];
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_bin_writer *la_bin_writer_open(const char *path) {
+  la_bin_writer *w = calloc(1, sizeof(*w));
+  if (w == NULL) {
+    return NULL;
+  }
+  w->f = fopen(path, "wb");
+  if (w->f == NULL) {
+    free(w);
+    return NULL;
+  }
+  w->end = sizeof(la_bin_header);
+  return w;
+}
 
-  rot.elem[3][3] = 1.0f;
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_bin_begin(la_bin_writer *w, const char *name, la_bin_type type,
+                 la_bin_layout layout, uint64_t count, const float *min,
+                 const float *max) {
+  const size_t components = la_bin_components(type);
+  if (w->open || components == 0 || (unsigned)layout > LA_BIN_Q16 ||
+      strlen(name) >= sizeof(w->entries->name) ||
+      (layout == LA_BIN_Q16 && (min == NULL || max == NULL))) {
+    w->failed = 1;
+    return 0;
+  }
+  if (w->count == w->capacity) {
+    const size_t capacity = w->capacity ? 2 * w->capacity : 16;
+    la_bin_entry *entries =
+        realloc(w->entries, capacity * sizeof(*w->entries));
+    if (entries == NULL) {
+      w->failed = 1;
+      return 0;
+    }
+    w->entries = entries;
+    w->capacity = capacity;
+  }
 
-  // rot.elem[3][0] = m.elem[3][0];
-  // rot.elem[3][1] = m.elem[3][1];
-  // rot.elem[3][2] = m.elem[3][2];
-  // rot.elem[3][3] = m.elem[3][3];
+  la_bin_entry *e = &w->entries[w->count];
+  memset(e, 0, sizeof(*e));
+  strcpy(e->name, name);
+  e->type = type;
+  e->layout = layout;
+  e->count = count;
+  e->offset = la_bin_align(w->end);
+  e->size = la_bin_data_size(components, layout, count);
+  w->written = 0;
+  w->open = 1;
+  if (!la_bin_seek(w->f, e->offset)) {
+    w->failed = 1;
+    return 0;
+  }
 
-  return la_productm4(m, rot);
+  if (layout == LA_BIN_Q16) {
+    float ranges[2 * 16] = {0};
+    for (size_t c = 0; c < components; c++) {
+      const float step = (max[c] - min[c]) / 65535.0f;
+      w->min[c] = min[c];
+      w->step[c] = step > 0.0f ? step : 0.0f;
+      ranges[2 * c] = w->min[c];
+      ranges[2 * c + 1] = w->step[c];
+    }
+    la_bin_put(w, ranges, la_bin_ranges_size(components));
+  }
+  return !w->failed;
 }
 
 /**
  * ----------------------------------------------------------------------------
+ * SoA arrays are written one block of each stream at a time, seeking to the
+ * stream, so that the elements can arrive in any number of pieces.
  */
-la_mat4 la_scale(const la_mat4 m, const la_vec3 v) {
-  la_mat4 sm = la_identitym4();
-  sm.elem[0][0] = v.elem[0];
-  sm.elem[1][1] = v.elem[1];
-  sm.elem[2][2] = v.elem[2];
-  sm.elem[3][0] = m.elem[3][0];
-  sm.elem[3][1] = m.elem[3][1];
-  sm.elem[3][2] = m.elem[3][2];
-  sm.elem[3][3] = m.elem[3][3];
-
-  return la_productm4(m, sm);
+int la_bin_write(la_bin_writer *w, const void *elems, size_t n) {
+  const la_bin_entry *e = &w->entries[w->count];
+  if (!w->open || n > e->count - w->written) {
+    w->failed = 1;
+    return 0;
+  }
+
+  const size_t components = la_bin_components(e->type);
+  const float *in = elems;
+  if (e->layout == LA_BIN_AOS) {
+    la_bin_put(w, in, n * components * sizeof(float));
+  } else if (e->layout == LA_BIN_SOA) {
+    const uint64_t stride = la_bin_align(e->count * sizeof(float));
+    for (size_t i = 0; i < n; i += LA_BIN_BLOCK) {
+      const size_t m = n - i < LA_BIN_BLOCK ? n - i : LA_BIN_BLOCK;
+      for (size_t c = 0; c < components; c++) {
+        for (size_t k = 0; k < m; k++) {
+          w->scratch.f[k] = in[(i + k) * components + c];
+        }
+        const uint64_t at =
+            e->offset + c * stride + (w->written + i) * sizeof(float);
+        if (!la_bin_seek(w->f, at)) {
+          w->failed = 1;
+        }
+        la_bin_put(w, w->scratch.f, m * sizeof(float));
+      }
+    }
+  } else {
+    const size_t block = LA_BIN_BLOCK / components;
+    for (size_t i = 0; i < n; i += block) {
+      const size_t m = n - i < block ? n - i : block;
+      const float *v = in + i * components;
+      for (size_t k = 0; k < m; k++) {
+        for (size_t c = 0; c < components; c++) {
+          w->scratch.q[k * components + c] = la_bin_quantize(
+              v[k * components + c], w->min[c], w->step[c]);
+        }
+      }
+      la_bin_put(w, w->scratch.q, m * components * sizeof(uint16_t));
+    }
+  }
+  w->written += n;
+  return !w->failed;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_bin_end(la_bin_writer *w) {
+  const la_bin_entry *e = &w->entries[w->count];
+  if (!w->open || w->written != e->count) {
+    w->open = 0;
+    w->failed = 1;
+    return 0;
+  }
+  w->open = 0;
+  w->end = e->offset + e->size;
+  w->count++;
+  return !w->failed;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_bin_write_array(la_bin_writer *w, const char *name, la_bin_type type,
+                       la_bin_layout layout, const void *elems, size_t count) {
+  const size_t components = la_bin_components(type);
+  const float *in = elems;
+  float min[16] = {0};
+  float max[16] = {0};
+  for (size_t i = 0; layout == LA_BIN_Q16 && i < count; i++) {
+    for (size_t c = 0; c < components; c++) {
+      const float v = in[i * components + c];
+      min[c] = i == 0 || v < min[c] ? v : min[c];
+      max[c] = i == 0 || v > max[c] ? v : max[c];
+    }
+  }
+  return la_bin_begin(w, name, type, layout, count, min, max) &&
+         la_bin_write(w, elems, count) && la_bin_end(w);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_bin_writer_close(la_bin_writer *w) {
+  if (w == NULL) {
+    return 0;
+  }
+  la_bin_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, la_bin_magic, sizeof(h.magic));
+  h.version = LA_BIN_VERSION;
+  h.byte_order = LA_BIN_BYTE_ORDER;
+  h.count = w->count;
+  h.directory = la_bin_align(w->end);
+
+  int ok = !w->failed && !w->open && la_bin_seek(w->f, h.directory) &&
+           fwrite(w->entries, sizeof(*w->entries), w->count, w->f) ==
+               w->count &&
+           la_bin_seek(w->f, 0) && fwrite(&h, sizeof(h), 1, w->f) == 1;
+  if (fclose(w->f) != 0) {
+    ok = 0;
+  }
+  free(w->entries);
+  free(w);
+  return ok;
+}
+
+/* Checks everything la_bin_data, la_bin_stream and la_bin_read rely on, so
+ * that a truncated or corrupt file is rejected by la_bin_open. */
+static int la_bin_check(la_bin *b) {
+  if (b->size < sizeof(la_bin_header)) {
+    return 0;
+  }
+  const la_bin_header *h = (const la_bin_header *)b->base;
+  if (memcmp(h->magic, la_bin_magic, sizeof(h->magic)) != 0 ||
+      h->version == 0 || h->version > LA_BIN_VERSION ||
+      h->byte_order != LA_BIN_BYTE_ORDER ||
+      h->directory % LA_CACHE_LINE != 0 || h->directory > b->size ||
+      h->count > (b->size - h->directory) / sizeof(la_bin_entry)) {
+    return 0;
+  }
+  b->entries = (const la_bin_entry *)(b->base + h->directory);
+  b->count = h->count;
+  for (size_t i = 0; i < b->count; i++) {
+    const la_bin_entry *e = &b->entries[i];
+    const size_t components = la_bin_components((la_bin_type)e->type);
+    if (components == 0 || e->layout > LA_BIN_Q16 ||
+        memchr(e->name, 0, sizeof(e->name)) == NULL ||
+        e->offset % LA_CACHE_LINE != 0 || e->offset < sizeof(*h) ||
+        e->offset > h->directory || e->size > h->directory - e->offset ||
+        e->count > b->size ||
+        e->size != la_bin_data_size(components, e->layout, e->count)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+la_bin *la_bin_open(const char *path) {
+  la_bin *b = calloc(1, sizeof(*b));
+  if (b == NULL) {
+    return NULL;
+  }
+#ifdef LA_HAS_MMAP
+  const int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      b->base = p;
+      b->size = (uint64_t)st.st_size;
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+#else
+  FILE *f = fopen(path, "rb");
+  if (f != NULL && fseek(f, 0, SEEK_END) == 0) {
+#ifdef _WIN32
+    const int64_t size = _ftelli64(f);
+#else
+    const int64_t size = ftell(f);
+#endif
+    uint8_t *p = size > 0 ? la_aligned_alloc((size_t)size, LA_CACHE_LINE)
+                          : NULL;
+    if (p != NULL && la_bin_seek(f, 0) &&
+        fread(p, 1, (size_t)size, f) == (size_t)size) {
+      b->base = p;
+      b->size = (uint64_t)size;
+    } else {
+      la_aligned_free(p);
+    }
+  }
+  if (f != NULL) {
+    fclose(f);
+  }
+#endif
+  if (b->base == NULL || !la_bin_check(b)) {
+    la_bin_close(b);
+    return NULL;
+  }
+  return b;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+void la_bin_close(la_bin *b) {
+  if (b == NULL) {
+    return;
+  }
+#ifdef LA_HAS_MMAP
+  if (b->base != NULL) {
+    munmap((void *)b->base, b->size);
+  }
+#else
+  la_aligned_free((void *)b->base);
+#endif
+  free(b);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+size_t la_bin_count(const la_bin *b) { return b->count; }
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+const la_bin_entry *la_bin_entry_at(const la_bin *b, size_t i) {
+  return i < b->count ? &b->entries[i] : NULL;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+const la_bin_entry *la_bin_find(const la_bin *b, const char *name) {
+  for (size_t i = 0; i < b->count; i++) {
+    if (strcmp(b->entries[i].name, name) == 0) {
+      return &b->entries[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+const void *la_bin_data(const la_bin *b, const la_bin_entry *e) {
+  const uint8_t *p = b->base + e->offset;
+  if (e->layout == LA_BIN_Q16) {
+    p += la_bin_ranges_size(la_bin_components((la_bin_type)e->type));
+  }
+  return p;
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+const float *la_bin_stream(const la_bin *b, const la_bin_entry *e, size_t c) {
+  if (e->layout != LA_BIN_SOA ||
+      c >= la_bin_components((la_bin_type)e->type)) {
+    return NULL;
+  }
+  const uint64_t stride = la_bin_align(e->count * sizeof(float));
+  return (const float *)(b->base + e->offset + c * stride);
+}
+
+/**
+ * ----------------------------------------------------------------------------
+ */
+int la_bin_read(const la_bin *b, const la_bin_entry *e, size_t first,
+                size_t n, void *out) {
+  if (first > e->count || n > e->count - first) {
+    return 0;
+  }
+  const size_t components = la_bin_components((la_bin_type)e->type);
+  float *o = out;
+  if (e->layout == LA_BIN_AOS) {
+    const float *in = la_bin_data(b, e);
+    memcpy(o, in + first * components, n * components * sizeof(float));
+  } else if (e->layout == LA_BIN_SOA) {
+    for (size_t c = 0; c < components; c++) {
+      const float *s = la_bin_stream(b, e, c) + first;
+      for (size_t i = 0; i < n; i++) {
+        o[i * components + c] = s[i];
+      }
+    }
+  } else {
+    const float *ranges = (const float *)(b->base + e->offset);
+    const uint16_t *q = (const uint16_t *)la_bin_data(b, e);
+    q += first * components;
+    for (size_t i = 0; i < n; i++) {
+      for (size_t c = 0; c < components; c++) {
+        o[i * components + c] =
+            ranges[2 * c] + q[i * components + c] * ranges[2 * c + 1];
+      }
+    }
+  }
+  return 1;
 }
 
 #endif  // LA_IMPLEMENTATION
\ No newline at end of file
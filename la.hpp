@@ -0,0 +1,425 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Jacob Micoud
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * C++ types and operators over la.h.
+ *
+ * la::vec2/3/4, la::quat and la::mat4 have the same layout as the la_ C
+ * types and convert to and from them implicitly. Everything that does not
+ * need sqrt or trigonometry is constexpr and defined inline, so fixed
+ * matrices can be built at compile time and chains of operations can be
+ * folded by the compiler. The constexpr functions use the same formulas and
+ * summation order as the C implementation, so they give the same results as
+ * their la_ counterparts. The rest forward to the C functions.
+ */
+
+#ifndef LA_HPP_
+#define LA_HPP_
+
+#include <string.h>
+
+#include <type_traits>
+
+#include "la.h"
+
+#if __cplusplus < 201402L && (!defined(_MSVC_LANG) || _MSVC_LANG < 201402L)
+#error "la.hpp requires C++14"
+#endif
+
+namespace la {
+
+struct vec2 {
+  float x = 0.0f;
+  float y = 0.0f;
+
+  operator la_vec2() const {
+    la_vec2 r;
+    memcpy(&r, this, sizeof(r));
+    return r;
+  }
+};
+
+struct vec3 {
+  float x = 0.0f;
+  float y = 0.0f;
+  float z = 0.0f;
+
+  operator la_vec3() const {
+    la_vec3 r;
+    memcpy(&r, this, sizeof(r));
+    return r;
+  }
+};
+
+struct vec4 {
+  float x = 0.0f;
+  float y = 0.0f;
+  float z = 0.0f;
+  float w = 0.0f;
+
+  operator la_vec4() const {
+    la_vec4 r;
+    memcpy(&r, this, sizeof(r));
+    return r;
+  }
+};
+
+/* A rotation (x, y, z) * sin(a / 2), w = cos(a / 2). Kept distinct from vec4
+ * so that operator* is the Hamilton product. */
+struct quat {
+  float x = 0.0f;
+  float y = 0.0f;
+  float z = 0.0f;
+  float w = 1.0f;
+
+  operator la_quat() const {
+    la_quat r;
+    memcpy(&r, this, sizeof(r));
+    return r;
+  }
+};
+
+struct mat4 {
+  float elem[4][4] = {};
+
+  operator la_mat4() const {
+    la_mat4 r;
+    memcpy(&r, this, sizeof(r));
+    return r;
+  }
+};
+
+static_assert(sizeof(vec2) == sizeof(la_vec2), "vec2 layout");
+static_assert(sizeof(vec3) == sizeof(la_vec3), "vec3 layout");
+static_assert(sizeof(vec4) == sizeof(la_vec4), "vec4 layout");
+static_assert(sizeof(quat) == sizeof(la_quat), "quat layout");
+static_assert(sizeof(mat4) == sizeof(la_mat4), "mat4 layout");
+
+inline vec2 from_c(const la_vec2 &v) { return {v.x, v.y}; }
+inline vec3 from_c(const la_vec3 &v) { return {v.x, v.y, v.z}; }
+inline vec4 from_c(const la_vec4 &v) { return {v.x, v.y, v.z, v.w}; }
+inline mat4 from_c(const la_mat4 &m) {
+  mat4 r;
+  memcpy(r.elem, m.elem, sizeof(r.elem));
+  return r;
+}
+inline quat from_c_quat(const la_quat &q) { return {q.x, q.y, q.z, q.w}; }
+
+/* Vectors ----------------------------------------------------------------- */
+
+constexpr vec2 operator+(const vec2 &a, const vec2 &b) {
+  return {a.x + b.x, a.y + b.y};
+}
+constexpr vec2 operator-(const vec2 &a, const vec2 &b) {
+  return {a.x - b.x, a.y - b.y};
+}
+constexpr vec2 operator-(const vec2 &v) { return {-v.x, -v.y}; }
+constexpr vec2 operator*(const vec2 &v, float s) { return {v.x * s, v.y * s}; }
+constexpr vec2 operator*(float s, const vec2 &v) { return v * s; }
+constexpr vec2 operator/(const vec2 &v, float s) { return {v.x / s, v.y / s}; }
+constexpr bool operator==(const vec2 &a, const vec2 &b) {
+  return a.x == b.x && a.y == b.y;
+}
+
+constexpr vec3 operator+(const vec3 &a, const vec3 &b) {
+  return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+constexpr vec3 operator-(const vec3 &a, const vec3 &b) {
+  return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+constexpr vec3 operator-(const vec3 &v) { return {-v.x, -v.y, -v.z}; }
+constexpr vec3 operator*(const vec3 &v, float s) {
+  return {v.x * s, v.y * s, v.z * s};
+}
+constexpr vec3 operator*(float s, const vec3 &v) { return v * s; }
+constexpr vec3 operator/(const vec3 &v, float s) {
+  return {v.x / s, v.y / s, v.z / s};
+}
+constexpr bool operator==(const vec3 &a, const vec3 &b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+constexpr vec4 operator+(const vec4 &a, const vec4 &b) {
+  return {a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w};
+}
+constexpr vec4 operator-(const vec4 &a, const vec4 &b) {
+  return {a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w};
+}
+constexpr vec4 operator-(const vec4 &v) { return {-v.x, -v.y, -v.z, -v.w}; }
+constexpr vec4 operator*(const vec4 &v, float s) {
+  return {v.x * s, v.y * s, v.z * s, v.w * s};
+}
+constexpr vec4 operator*(float s, const vec4 &v) { return v * s; }
+constexpr vec4 operator/(const vec4 &v, float s) {
+  return {v.x / s, v.y / s, v.z / s, v.w / s};
+}
+constexpr bool operator==(const vec4 &a, const vec4 &b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+/* The shared operators below only take the la vector types, and != also the
+ * quaternion and the matrix, so that they do not match other types that
+ * find them through la. */
+template <typename T>
+struct is_vec : std::false_type {};
+template <>
+struct is_vec<vec2> : std::true_type {};
+template <>
+struct is_vec<vec3> : std::true_type {};
+template <>
+struct is_vec<vec4> : std::true_type {};
+
+template <typename T>
+struct is_la_type : is_vec<T> {};
+template <>
+struct is_la_type<quat> : std::true_type {};
+template <>
+struct is_la_type<mat4> : std::true_type {};
+
+template <typename V, typename = std::enable_if_t<is_la_type<V>::value>>
+constexpr bool operator!=(const V &a, const V &b) {
+  return !(a == b);
+}
+template <typename V, typename = std::enable_if_t<is_vec<V>::value>>
+constexpr V &operator+=(V &a, const V &b) {
+  return a = a + b;
+}
+template <typename V, typename = std::enable_if_t<is_vec<V>::value>>
+constexpr V &operator-=(V &a, const V &b) {
+  return a = a - b;
+}
+template <typename V, typename = std::enable_if_t<is_vec<V>::value>>
+constexpr V &operator*=(V &a, float s) {
+  return a = a * s;
+}
+template <typename V, typename = std::enable_if_t<is_vec<V>::value>>
+constexpr V &operator/=(V &a, float s) {
+  return a = a / s;
+}
+
+/* The same expressions as la_dotv3/4, so the results match bit for bit. */
+constexpr float dot(const vec2 &a, const vec2 &b) {
+  return a.x * b.x + a.y * b.y;
+}
+constexpr float dot(const vec3 &a, const vec3 &b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+constexpr float dot(const vec4 &a, const vec4 &b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+}
+
+constexpr vec3 cross(const vec3 &a, const vec3 &b) {
+  return {(a.y * b.z) - (a.z * b.y), (a.z * b.x) - (a.x * b.z),
+          (a.x * b.y) - (a.y * b.x)};
+}
+
+constexpr vec3 lerp(const vec3 &a, const vec3 &b, float t) {
+  return a + (b - a) * t;
+}
+
+inline vec3 normalize(const vec3 &v) { return from_c(la_normalizev3(v)); }
+
+constexpr float radians(float degrees) {
+  return static_cast<float>((degrees * 3.14159265358979323846) / 180.0f);
+}
+
+/* Matrices ---------------------------------------------------------------- */
+
+constexpr mat4 identity() {
+  mat4 m;
+  for (int i = 0; i < 4; i++) {
+    m.elem[i][i] = 1.0f;
+  }
+  return m;
+}
+
+/* a * b is la_productm4(a, b). */
+constexpr mat4 operator*(const mat4 &a, const mat4 &b) {
+  mat4 r;
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      for (int k = 0; k < 4; k++) {
+        r.elem[i][k] += a.elem[i][j] * b.elem[j][k];
+      }
+    }
+  }
+  return r;
+}
+
+constexpr mat4 &operator*=(mat4 &a, const mat4 &b) { return a = a * b; }
+
+/* m * v is la_productm4v4(m, v). */
+constexpr vec4 operator*(const mat4 &m, const vec4 &v) {
+  float r[4] = {};
+  const float e[4] = {v.x, v.y, v.z, v.w};
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      r[i] += m.elem[i][j] * e[j];
+    }
+  }
+  return {r[0], r[1], r[2], r[3]};
+}
+
+constexpr bool operator==(const mat4 &a, const mat4 &b) {
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      if (a.elem[i][j] != b.elem[i][j]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+constexpr mat4 transpose(const mat4 &m) {
+  mat4 r;
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      r.elem[i][j] = m.elem[j][i];
+    }
+  }
+  return r;
+}
+
+constexpr mat4 orthographic(float left, float right, float bottom, float top,
+                            float near, float far) {
+  mat4 m = identity();
+  m.elem[0][0] = 2.0f / (right - left);
+  m.elem[1][1] = 2.0f / (top - bottom);
+  m.elem[2][2] = -2.0f / (far - near);
+  m.elem[3][0] = -(right + left) / (right - left);
+  m.elem[3][1] = -(top + bottom) / (top - bottom);
+  m.elem[3][2] = -(far + near) / (far - near);
+  return m;
+}
+
+constexpr mat4 translate(const mat4 &m, const vec3 &v) {
+  mat4 r = m;
+  r.elem[3][0] += v.x;
+  r.elem[3][1] += v.y;
+  r.elem[3][2] += v.z;
+  return r;
+}
+
+constexpr mat4 scale(const mat4 &m, const vec3 &v) {
+  mat4 s = identity();
+  s.elem[0][0] = v.x;
+  s.elem[1][1] = v.y;
+  s.elem[2][2] = v.z;
+  s.elem[3][0] = m.elem[3][0];
+  s.elem[3][1] = m.elem[3][1];
+  s.elem[3][2] = m.elem[3][2];
+  s.elem[3][3] = m.elem[3][3];
+  return m * s;
+}
+
+inline mat4 perspective(float fov, float aspect_ratio, float near, float far) {
+  return from_c(la_perspective(fov, aspect_ratio, near, far));
+}
+
+inline mat4 look_at(const vec3 &eye, const vec3 &ctr, const vec3 &up) {
+  return from_c(la_look_at(eye, ctr, up));
+}
+
+inline mat4 rotate(const mat4 &m, const vec3 &axis, float rads) {
+  return from_c(la_rotate(m, axis, rads));
+}
+
+inline float determinant(const mat4 &m) { return la_determinantm4(m); }
+
+inline mat4 inverse(const mat4 &m, int *invertible = nullptr) {
+  return from_c(la_inversem4(m, invertible));
+}
+
+/* Quaternions ------------------------------------------------------------- */
+
+constexpr quat operator*(const quat &a, const quat &b) {
+  return {a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+          a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+          a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+          a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z};
+}
+
+constexpr quat &operator*=(quat &a, const quat &b) { return a = a * b; }
+
+constexpr bool operator==(const quat &a, const quat &b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+constexpr quat conjugate(const quat &q) { return {-q.x, -q.y, -q.z, q.w}; }
+
+/* q * v rotates v by q, as la_productqv3. */
+constexpr vec3 operator*(const quat &q, const vec3 &v) {
+  const vec3 u = {q.x, q.y, q.z};
+  const vec3 t = cross(u, v) * 2.0f;
+  const vec3 c = cross(u, t);
+  return {v.x + q.w * t.x + c.x, v.y + q.w * t.y + c.y,
+          v.z + q.w * t.z + c.z};
+}
+
+constexpr mat4 to_mat4(const quat &q) {
+  const float xx = q.x * q.x;
+  const float yy = q.y * q.y;
+  const float zz = q.z * q.z;
+  const float xy = q.x * q.y;
+  const float xz = q.x * q.z;
+  const float yz = q.y * q.z;
+  const float wx = q.w * q.x;
+  const float wy = q.w * q.y;
+  const float wz = q.w * q.z;
+
+  mat4 m = identity();
+  m.elem[0][0] = 1.0f - 2.0f * (yy + zz);
+  m.elem[0][1] = 2.0f * (xy + wz);
+  m.elem[0][2] = 2.0f * (xz - wy);
+
+  m.elem[1][0] = 2.0f * (xy - wz);
+  m.elem[1][1] = 1.0f - 2.0f * (xx + zz);
+  m.elem[1][2] = 2.0f * (yz + wx);
+
+  m.elem[2][0] = 2.0f * (xz + wy);
+  m.elem[2][1] = 2.0f * (yz - wx);
+  m.elem[2][2] = 1.0f - 2.0f * (xx + yy);
+  return m;
+}
+
+inline quat axis_angle(const vec3 &axis, float rads) {
+  return from_c_quat(la_axis_angleq(axis, rads));
+}
+
+inline quat normalize(const quat &q) {
+  return from_c_quat(la_normalizeq(q));
+}
+
+inline quat slerp(const quat &a, const quat &b, float t) {
+  return from_c_quat(la_slerpq(a, b, t));
+}
+
+inline quat nlerp(const quat &a, const quat &b, float t) {
+  return from_c_quat(la_nlerpq(a, b, t));
+}
+
+}  // namespace la
+
+#endif  // LA_HPP_
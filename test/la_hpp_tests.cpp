@@ -0,0 +1,150 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2023 Jacob Micoud
+
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "la.hpp"
+
+/* Evaluated at compile time: fails to build if any of these is not a
+ * constant expression. */
+constexpr la::mat4 proj = la::orthographic(-2.0f, 2.0f, -1.0f, 1.0f, 0.1f,
+                                           100.0f);
+constexpr la::mat4 view = la::translate(la::identity(), {1.0f, 2.0f, 3.0f});
+constexpr la::mat4 view_proj = view * proj;
+constexpr la::vec4 origin = view_proj * la::vec4{0.0f, 0.0f, 0.0f, 1.0f};
+constexpr la::quat quarter_z = {0.0f, 0.0f, 0.70710678f, 0.70710678f};
+
+static_assert(la::identity() * la::identity() == la::identity(), "");
+static_assert(la::transpose(la::transpose(view)) == view, "");
+static_assert(la::cross({1, 0, 0}, {0, 1, 0}) == la::vec3{0, 0, 1}, "");
+static_assert(la::dot(la::vec3{1, 2, 3}, la::vec3{4, 5, 6}) == 32.0f, "");
+static_assert(la::conjugate(la::conjugate(quarter_z)) == quarter_z, "");
+static_assert(view.elem[3][2] == 3.0f, "");
+
+/* The shared compound operators only take the la vector types, not every
+ * type that finds them through la, such as a std::pair of la types. */
+template <typename T, typename = void>
+struct has_add_assign : std::false_type {};
+template <typename T>
+struct has_add_assign<
+    T, decltype(void(std::declval<T &>() += std::declval<const T &>()))>
+    : std::true_type {};
+
+static_assert(has_add_assign<la::vec3>::value, "");
+static_assert(!has_add_assign<la::quat>::value, "");
+static_assert(!has_add_assign<la::mat4>::value, "");
+static_assert(!has_add_assign<std::pair<la::vec3, int>>::value, "");
+
+static void expect_m4_same(const la::mat4 &a, const la_mat4 &b) {
+  EXPECT_EQ(memcmp(&a, &b, sizeof(b)), 0);
+}
+
+static la::mat4 test_matrix(unsigned int seed) {
+  la::mat4 m;
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      seed = seed * 1664525u + 1013904223u;
+      m.elem[i][j] = ((seed >> 8) / 16777216.0f) * 16.0f - 8.0f;
+    }
+  }
+  return m;
+}
+
+TEST(la_hpp_tests, matches_c) {
+  expect_m4_same(la::identity(), la_identitym4());
+  expect_m4_same(proj, la_orthographic(-2.0f, 2.0f, -1.0f, 1.0f, 0.1f,
+                                       100.0f));
+  la_vec3 t = {.elem = {1.0f, 2.0f, 3.0f}};
+  expect_m4_same(view, la_translate(la_identitym4(), t));
+  expect_m4_same(view_proj, la_productm4(view, proj));
+
+  la_vec4 o = la_productm4v4(view_proj, la_vec4{.elem = {0, 0, 0, 1}});
+  EXPECT_EQ(memcmp(&origin, &o, sizeof(o)), 0);
+
+  for (unsigned int seed = 1; seed < 32; seed++) {
+    la::mat4 a = test_matrix(seed);
+    la::mat4 b = test_matrix(seed * 7919u);
+    expect_m4_same(a * b, la_productm4(a, b));
+    expect_m4_same(la::transpose(a), la_transposem4(a));
+    expect_m4_same(la::scale(a, {2.0f, 3.0f, 0.5f}),
+                   la_scale(a, la_vec3{.elem = {2.0f, 3.0f, 0.5f}}));
+    la::vec3 u = {a.elem[0][0], a.elem[0][1], a.elem[0][2]};
+    la::vec3 v = {b.elem[0][0], b.elem[0][1], b.elem[0][2]};
+    EXPECT_EQ(la::dot(u, v), la_dotv3(u, v));
+    EXPECT_EQ(la::cross(u, v), la::from_c(la_crossv3(u, v)));
+  }
+
+  /* Down to the sign of a zero. */
+  const la::vec3 neg = {-1.0f, -2.0f, -3.0f}, zero = {0.0f, 0.0f, 0.0f};
+  EXPECT_TRUE(std::signbit(la_dotv3(neg, zero)));
+  EXPECT_TRUE(std::signbit(la::dot(neg, zero)));
+  const la::vec4 neg4 = {-1.0f, -2.0f, -3.0f, -4.0f}, zero4 = {};
+  EXPECT_TRUE(std::signbit(la_dotv4(neg4, zero4)));
+  EXPECT_TRUE(std::signbit(la::dot(neg4, zero4)));
+
+  EXPECT_EQ(la::radians(90.0f), la_radians(90.0f));
+}
+
+TEST(la_hpp_tests, quat) {
+  la_vec3 axis = {.elem = {0.3f, -0.5f, 0.8f}};
+  la::quat a = la::axis_angle(la::normalize(la::from_c(axis)), 0.7f);
+  la::quat b = la::axis_angle({0.0f, 1.0f, 0.0f}, -1.3f);
+  EXPECT_EQ(a * b, la::from_c_quat(la_productq(a, b)));
+  expect_m4_same(la::to_mat4(a), la_quattom4(a));
+
+  la::vec3 v = {1.0f, -2.0f, 4.0f};
+  EXPECT_EQ(a * v, la::from_c(la_productqv3(a, v)));
+  la::vec3 r = quarter_z * la::vec3{1.0f, 0.0f, 0.0f};
+  EXPECT_NEAR(r.x, 0.0f, 1e-6f);
+  EXPECT_NEAR(r.y, 1.0f, 1e-6f);
+}
+
+TEST(la_hpp_tests, operators) {
+  la::vec3 v = {1.0f, 2.0f, 3.0f};
+  v += {1.0f, 1.0f, 1.0f};
+  v *= 2.0f;
+  const la::vec3 expected = {4.0f, 6.0f, 8.0f};
+  EXPECT_EQ(v, expected);
+  v -= expected;
+  EXPECT_EQ(v, la::vec3{});
+  const la::vec2 x = {1.0f, 0.0f};
+  EXPECT_NE(-x, x);
+  const la::vec4 h = {1.0f, 2.0f, 3.0f, 4.0f};
+  EXPECT_EQ(h * 2.0f / 2.0f, h);
+
+  la::mat4 m = la::identity();
+  m *= la::translate(la::identity(), {5.0f, 0.0f, 0.0f});
+  int ok = 0;
+  la::mat4 inv = la::inverse(m, &ok);
+  EXPECT_EQ(ok, 1);
+  const la::vec4 o = {0.0f, 0.0f, 0.0f, 1.0f};
+  const la::vec4 p = {5.0f, 0.0f, 0.0f, 1.0f};
+  EXPECT_EQ(la::transpose(m) * o, p);
+  EXPECT_EQ(la::transpose(inv) * p, o);
+}
@@ -26,10 +26,24 @@
  * built with cmake */
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "la.h"
 
+/* LA_FAST_MATH trades a few ulps for speed in the functions that normalize
+ * or use trig, so exact checks of their results allow a small error. */
+#ifdef LA_FAST_MATH
+#define ASSERT_APPROX_EQ(a, b) ASSERT_NEAR(a, b, 1e-6f)
+#else
+#define ASSERT_APPROX_EQ(a, b) ASSERT_FLOAT_EQ(a, b)
+#endif
+
 TEST(la_tests, la_feq) {
   ASSERT_FALSE(la_feq(1.0f, 1.001f));
   ASSERT_TRUE(la_feq(1.0f, 1.0f));
@@ -141,6 +155,541 @@ TEST(la_tests, la_productm4v4) {
   ASSERT_FLOAT_EQ(result.w, 140.0f);
 }
 
+/* Fills a matrix with reproducible non-integer values in [-8, 8). */
+static la_mat4 test_matrix(unsigned int seed) {
+  la_mat4 m;
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      seed = seed * 1664525u + 1013904223u;
+      m.elem[i][j] = ((seed >> 8) / 16777216.0f) * 16.0f - 8.0f;
+    }
+  }
+  return m;
+}
+
+static void expect_m4_eq(const la_mat4 &a, const la_mat4 &b) {
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      EXPECT_FLOAT_EQ(a.elem[i][j], b.elem[i][j]) << i << ", " << j;
+    }
+  }
+}
+
+static void expect_v4_eq(const la_vec4 &a, const la_vec4 &b) {
+  for (int i = 0; i < 4; i++) {
+    EXPECT_FLOAT_EQ(a.elem[i], b.elem[i]) << i;
+  }
+}
+
+typedef la_mat4 (*productm4_fn)(const la_mat4, const la_mat4);
+typedef la_vec4 (*productm4v4_fn)(const la_mat4, const la_vec4);
+
+static void check_backend(productm4_fn productm4,
+                          productm4v4_fn productm4v4) {
+  for (unsigned int seed = 1; seed < 64; seed++) {
+    la_mat4 m1 = test_matrix(seed);
+    la_mat4 m2 = test_matrix(seed * 7919u);
+    la_mat4 v = test_matrix(seed * 104729u);
+    expect_m4_eq(productm4(m1, m2), la_productm4_scalar(m1, m2));
+    for (int i = 0; i < 4; i++) {
+      la_vec4 x = {.elem = {v.elem[i][0], v.elem[i][1], v.elem[i][2],
+                            v.elem[i][3]}};
+      expect_v4_eq(productm4v4(m1, x), la_productm4v4_scalar(m1, x));
+    }
+  }
+}
+
+TEST(la_tests, la_productm4_backend) {
+  check_backend(la_productm4, la_productm4v4);
+}
+
+#ifdef LA_USE_SSE2
+TEST(la_tests, la_productm4_sse2) {
+  check_backend(la_productm4_sse2, la_productm4v4_sse2);
+}
+#endif
+
+#ifdef LA_USE_AVX
+TEST(la_tests, la_productm4_avx) {
+  check_backend(la_productm4_avx, la_productm4v4_avx);
+}
+#endif
+
+#ifdef LA_USE_NEON
+TEST(la_tests, la_productm4_neon) {
+  check_backend(la_productm4_neon, la_productm4v4_neon);
+}
+#endif
+
+TEST(la_tests, la_transform_points_v4) {
+  const la_mat4 m = test_matrix(42);
+  for (size_t n = 0; n < 38; n++) {
+    std::vector<float> in[4];
+    std::vector<float> out[4];
+    la_mat4 src = test_matrix(n + 1);
+    for (int k = 0; k < 4; k++) {
+      for (size_t i = 0; i < n; i++) {
+        in[k].push_back(src.elem[i % 4][k] + i);
+      }
+      out[k].resize(n);
+    }
+    la_transform_points_v4(&m, in[0].data(), in[1].data(), in[2].data(),
+                           in[3].data(), out[0].data(), out[1].data(),
+                           out[2].data(), out[3].data(), n);
+    for (size_t i = 0; i < n; i++) {
+      la_vec4 v = {.elem = {in[0][i], in[1][i], in[2][i], in[3][i]}};
+      la_vec4 e = la_productm4v4_scalar(m, v);
+      la_vec4 r = {.elem = {out[0][i], out[1][i], out[2][i], out[3][i]}};
+      expect_v4_eq(r, e);
+    }
+
+    /* in-place */
+    la_transform_points_v4(&m, in[0].data(), in[1].data(), in[2].data(),
+                           in[3].data(), in[0].data(), in[1].data(),
+                           in[2].data(), in[3].data(), n);
+    for (int k = 0; k < 4; k++) {
+      ASSERT_EQ(in[k], out[k]);
+    }
+  }
+}
+
+TEST(la_tests, la_transform_points_v4_aos) {
+  const la_mat4 m = test_matrix(42);
+  for (size_t n = 0; n < 19; n++) {
+    std::vector<la_vec4> in(n);
+    std::vector<la_vec4> out(n);
+    for (size_t i = 0; i < n; i++) {
+      la_mat4 src = test_matrix(i + 1);
+      in[i] = {.elem = {src.elem[0][0], src.elem[1][1], src.elem[2][2],
+                        src.elem[3][3]}};
+    }
+    la_transform_points_v4_aos(&m, in.data(), out.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      expect_v4_eq(out[i], la_productm4v4_scalar(m, in[i]));
+    }
+
+    /* in-place */
+    la_transform_points_v4_aos(&m, in.data(), in.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      expect_v4_eq(in[i], out[i]);
+    }
+  }
+}
+
+static la_vec3 test_vec3(unsigned int seed) {
+  la_mat4 m = test_matrix(seed);
+  la_vec3 v = {.elem = {m.elem[0][0], m.elem[0][1], m.elem[0][2]}};
+  return v;
+}
+
+static void expect_v3_eq(const la_vec3 &a, const la_vec3 &b) {
+  for (int i = 0; i < 3; i++) {
+    EXPECT_FLOAT_EQ(a.elem[i], b.elem[i]) << i;
+  }
+}
+
+/* Sizes around the SIMD widths and the AoS staging block. */
+static const size_t batch_sizes[] = {0,  1,  2,  3,  4,   5,   7,   8,  9,
+                                     15, 16, 17, 31, 255, 256, 257, 600};
+
+TEST(la_tests, la_v3_batch) {
+  for (size_t n : batch_sizes) {
+    std::vector<la_vec3> a(n);
+    std::vector<la_vec3> b(n);
+    for (size_t i = 0; i < n; i++) {
+      a[i] = test_vec3(i + 1);
+      b[i] = test_vec3(i + 1000);
+    }
+    std::vector<la_vec3> out(n);
+    std::vector<float> dots(n);
+
+    la_normalizev3_batch(a.data(), out.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      expect_v3_eq(out[i], la_normalizev3(a[i]));
+    }
+    la_dotv3_batch(a.data(), b.data(), dots.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      EXPECT_FLOAT_EQ(dots[i], la_dotv3(a[i], b[i]));
+    }
+    la_crossv3_batch(a.data(), b.data(), out.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      expect_v3_eq(out[i], la_crossv3(a[i], b[i]));
+    }
+    la_addv3_batch(a.data(), b.data(), out.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 e = {.elem = {a[i].x + b[i].x, a[i].y + b[i].y,
+                            a[i].z + b[i].z}};
+      expect_v3_eq(out[i], e);
+    }
+    la_subv3_batch(a.data(), b.data(), out.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 e = {.elem = {a[i].x - b[i].x, a[i].y - b[i].y,
+                            a[i].z - b[i].z}};
+      expect_v3_eq(out[i], e);
+    }
+    la_scalev3_batch(a.data(), 2.5f, out.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 e = {.elem = {a[i].x * 2.5f, a[i].y * 2.5f, a[i].z * 2.5f}};
+      expect_v3_eq(out[i], e);
+    }
+    la_lerpv3_batch(a.data(), b.data(), 0.25f, out.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      for (int k = 0; k < 3; k++) {
+        float e = a[i].elem[k] + (b[i].elem[k] - a[i].elem[k]) * 0.25f;
+        EXPECT_FLOAT_EQ(out[i].elem[k], e);
+      }
+    }
+
+    /* in-place */
+    std::vector<la_vec3> c = a;
+    la_crossv3_batch(c.data(), b.data(), c.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      expect_v3_eq(c[i], la_crossv3(a[i], b[i]));
+    }
+    c = a;
+    la_normalizev3_batch(c.data(), c.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      expect_v3_eq(c[i], la_normalizev3(a[i]));
+    }
+  }
+}
+
+TEST(la_tests, la_v3_soa) {
+  for (size_t n : batch_sizes) {
+    std::vector<float> a[3];
+    std::vector<float> b[3];
+    std::vector<float> o[3];
+    for (int k = 0; k < 3; k++) {
+      for (size_t i = 0; i < n; i++) {
+        a[k].push_back(test_vec3(i + 1).elem[k]);
+        b[k].push_back(test_vec3(i + 1000).elem[k]);
+      }
+      o[k].resize(n);
+    }
+    std::vector<float> dots(n);
+    la_normalizev3_soa(a[0].data(), a[1].data(), a[2].data(), o[0].data(),
+                       o[1].data(), o[2].data(), n);
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 r = {.elem = {o[0][i], o[1][i], o[2][i]}};
+      expect_v3_eq(r, la_normalizev3(test_vec3(i + 1)));
+    }
+    la_dotv3_soa(a[0].data(), a[1].data(), a[2].data(), b[0].data(),
+                 b[1].data(), b[2].data(), dots.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      EXPECT_FLOAT_EQ(dots[i],
+                      la_dotv3(test_vec3(i + 1), test_vec3(i + 1000)));
+    }
+    la_crossv3_soa(a[0].data(), a[1].data(), a[2].data(), b[0].data(),
+                   b[1].data(), b[2].data(), o[0].data(), o[1].data(),
+                   o[2].data(), n);
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 r = {.elem = {o[0][i], o[1][i], o[2][i]}};
+      expect_v3_eq(r, la_crossv3(test_vec3(i + 1), test_vec3(i + 1000)));
+    }
+    la_lerpv3_soa(a[0].data(), a[1].data(), a[2].data(), b[0].data(),
+                  b[1].data(), b[2].data(), 0.75f, o[0].data(), o[1].data(),
+                  o[2].data(), n);
+    for (int k = 0; k < 3; k++) {
+      for (size_t i = 0; i < n; i++) {
+        EXPECT_FLOAT_EQ(o[k][i], a[k][i] + (b[k][i] - a[k][i]) * 0.75f);
+      }
+    }
+
+    /* in-place */
+    la_crossv3_soa(a[0].data(), a[1].data(), a[2].data(), b[0].data(),
+                   b[1].data(), b[2].data(), a[0].data(), a[1].data(),
+                   a[2].data(), n);
+    for (int k = 0; k < 3; k++) {
+      for (size_t i = 0; i < n; i++) {
+        la_vec3 e = la_crossv3(test_vec3(i + 1), test_vec3(i + 1000));
+        EXPECT_FLOAT_EQ(a[k][i], e.elem[k]);
+      }
+    }
+  }
+}
+
+TEST(la_tests, la_frustum_from_m4) {
+  la_mat4 proj = la_perspective(la_radians(90.0f), 1.0f, 1.0f, 100.0f);
+  la_frustum f = la_frustum_from_m4(proj);
+  for (int p = 0; p < 6; p++) {
+    la_vec3 n = {.elem = {f.planes[p].x, f.planes[p].y, f.planes[p].z}};
+    EXPECT_NEAR(la_dotv3(n, n), 1.0f, 1e-5f) << p;
+  }
+  la_vec3 zero = {.elem = {0.0f, 0.0f, 0.0f}};
+  la_vec3 ahead = {.elem = {0.0f, 0.0f, -10.0f}};
+  la_vec3 behind = {.elem = {0.0f, 0.0f, 10.0f}};
+  la_vec3 too_near = {.elem = {0.0f, 0.0f, -0.5f}};
+  la_vec3 too_far = {.elem = {0.0f, 0.0f, -101.0f}};
+  la_vec3 left = {.elem = {-11.0f, 0.0f, -10.0f}};
+  la_vec3 above = {.elem = {0.0f, 11.0f, -10.0f}};
+  EXPECT_TRUE(la_frustum_test_sphere(&f, ahead, 0.0f));
+  EXPECT_FALSE(la_frustum_test_sphere(&f, behind, 0.0f));
+  EXPECT_FALSE(la_frustum_test_sphere(&f, behind, 9.0f));
+  EXPECT_TRUE(la_frustum_test_sphere(&f, behind, 12.0f));
+  EXPECT_FALSE(la_frustum_test_sphere(&f, too_near, 0.0f));
+  EXPECT_FALSE(la_frustum_test_sphere(&f, too_far, 0.0f));
+  EXPECT_FALSE(la_frustum_test_sphere(&f, left, 0.0f));
+  EXPECT_TRUE(la_frustum_test_sphere(&f, left, 1.0f));
+  EXPECT_FALSE(la_frustum_test_sphere(&f, above, 0.5f));
+  la_vec3 e = {.elem = {1.5f, 1.5f, 1.5f}};
+  EXPECT_TRUE(la_frustum_test_aabb(&f, above, e));
+  EXPECT_FALSE(la_frustum_test_aabb(&f, above, zero));
+
+  /* World space planes move with the camera. */
+  la_vec3 eye = {.elem = {0.0f, 0.0f, -20.0f}};
+  la_vec3 ctr = {.elem = {0.0f, 0.0f, -30.0f}};
+  la_vec3 up = {.elem = {0.0f, 1.0f, 0.0f}};
+  la_mat4 vp = la_productm4(la_look_at(eye, ctr, up), proj);
+  f = la_frustum_from_m4(vp);
+  EXPECT_FALSE(la_frustum_test_sphere(&f, ahead, 0.0f));
+  EXPECT_TRUE(la_frustum_test_sphere(&f, too_far, 0.0f));
+
+  la_mat4 ortho = la_orthographic(-1.0f, 1.0f, -1.0f, 1.0f, 0.1f, 10.0f);
+  f = la_frustum_from_m4(ortho);
+  la_vec3 in = {.elem = {0.9f, -0.9f, -5.0f}};
+  la_vec3 out = {.elem = {1.1f, 0.0f, -5.0f}};
+  EXPECT_TRUE(la_frustum_test_sphere(&f, in, 0.0f));
+  EXPECT_FALSE(la_frustum_test_sphere(&f, out, 0.0f));
+}
+
+TEST(la_tests, la_frustum_cull) {
+  la_mat4 proj = la_perspective(la_radians(60.0f), 1.5f, 0.5f, 50.0f);
+  la_frustum f = la_frustum_from_m4(proj);
+  for (size_t n : batch_sizes) {
+    std::vector<float> c[3];
+    std::vector<float> e[3];
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 p = test_vec3(i + 1);
+      la_vec3 q = test_vec3(i + 5000);
+      for (int k = 0; k < 3; k++) {
+        c[k].push_back(p.elem[k] * (k == 2 ? 4.0f : 2.0f));
+        e[k].push_back(fabsf(q.elem[k]) * 0.25f);
+      }
+    }
+    std::vector<uint32_t> mask((n + 31) / 32, 0xffffffffu);
+    std::vector<uint32_t> indices(n);
+
+    la_frustum_cull_spheres(&f, c[0].data(), c[1].data(), c[2].data(),
+                            e[0].data(), n, mask.data());
+    size_t count = la_frustum_cull_spheres_indices(
+        &f, c[0].data(), c[1].data(), c[2].data(), e[0].data(), n,
+        indices.data());
+    size_t visible = 0;
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 p = {.elem = {c[0][i], c[1][i], c[2][i]}};
+      int v = la_frustum_test_sphere(&f, p, e[0][i]);
+      EXPECT_EQ((mask[i / 32] >> (i % 32)) & 1, (uint32_t)v) << i;
+      if (v) {
+        ASSERT_LT(visible, count);
+        EXPECT_EQ(indices[visible++], i);
+      }
+    }
+    EXPECT_EQ(visible, count);
+    if (n % 32) {
+      EXPECT_EQ(mask.back() >> (n % 32), 0u);
+    }
+
+    la_frustum_cull_aabbs(&f, c[0].data(), c[1].data(), c[2].data(),
+                          e[0].data(), e[1].data(), e[2].data(), n,
+                          mask.data());
+    count = la_frustum_cull_aabbs_indices(
+        &f, c[0].data(), c[1].data(), c[2].data(), e[0].data(), e[1].data(),
+        e[2].data(), n, indices.data());
+    visible = 0;
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 p = {.elem = {c[0][i], c[1][i], c[2][i]}};
+      la_vec3 x = {.elem = {e[0][i], e[1][i], e[2][i]}};
+      int v = la_frustum_test_aabb(&f, p, x);
+      EXPECT_EQ((mask[i / 32] >> (i % 32)) & 1, (uint32_t)v) << i;
+      if (v) {
+        ASSERT_LT(visible, count);
+        EXPECT_EQ(indices[visible++], i);
+      }
+    }
+    EXPECT_EQ(visible, count);
+    if (n > 100) {
+      EXPECT_GT(count, 0u);
+      EXPECT_LT(count, n);
+    }
+  }
+}
+
+TEST(la_tests, la_vec3a) {
+  la_vec3a a[4];
+  for (size_t i = 0; i < 4; i++) {
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(&a[i]) % 16, 0u);
+  }
+  la_vec3 v = {.elem = {1.0f, -2.0f, 3.5f}};
+  la_vec3a va = la_v3tov3a(v);
+  EXPECT_EQ(va.lanes[3], 0.0f);
+  EXPECT_TRUE(la_cmpv3(la_v3atov3(va), v));
+
+  std::vector<la_vec3> in(4, v);
+  la_v3tov3a_batch(in.data(), a, 4);
+  EXPECT_EQ(a[3].x, 1.0f);
+  EXPECT_EQ(a[3].z, 3.5f);
+
+  la_mat4a m[2];
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(&m[1]) % LA_CACHE_LINE, 0u);
+  m[1].m = la_identitym4();
+  la_mat4 out;
+  la_productm4_p(&out, &m[1].m, &m[1].m);
+  expect_m4_eq(out, la_identitym4());
+
+  la_vec4a v4;
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(&v4) % 16, 0u);
+  v4.v = la_vec4{.elem = {1.0f, 2.0f, 3.0f, 4.0f}};
+  EXPECT_EQ(v4.v.w, 4.0f);
+}
+
+TEST(la_tests, la_aligned_alloc) {
+  for (size_t align : {16, 32, 64, 4096}) {
+    void *p = la_aligned_alloc(100, align);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % align, 0u);
+    memset(p, 0, 100);
+    la_aligned_free(p);
+  }
+  la_aligned_free(NULL);
+}
+
+TEST(la_tests, la_arena) {
+  la_arena *a = la_arena_create(1000);
+  ASSERT_NE(a, nullptr);
+  EXPECT_EQ(la_arena_used(a), 0u);
+
+  unsigned char *p1 = static_cast<unsigned char *>(la_arena_alloc(a, 1));
+  unsigned char *p2 = static_cast<unsigned char *>(la_arena_alloc(a, 65));
+  la_mat4 *m = static_cast<la_mat4 *>(la_arena_alloc(a, 3 * sizeof(la_mat4)));
+  ASSERT_NE(p1, nullptr);
+  ASSERT_NE(p2, nullptr);
+  ASSERT_NE(m, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(p1) % LA_CACHE_LINE, 0u);
+  EXPECT_EQ(p2 - p1, LA_CACHE_LINE);
+  EXPECT_EQ(reinterpret_cast<unsigned char *>(m) - p2, 2 * LA_CACHE_LINE);
+  EXPECT_EQ(la_arena_used(a), 6u * LA_CACHE_LINE);
+
+  /* 1000 rounds up to 16 lines, 10 are left. */
+  EXPECT_EQ(la_arena_alloc(a, 11 * LA_CACHE_LINE), nullptr);
+  EXPECT_NE(la_arena_alloc(a, 10 * LA_CACHE_LINE), nullptr);
+  EXPECT_EQ(la_arena_alloc(a, 1), nullptr);
+  EXPECT_EQ(la_arena_alloc(a, SIZE_MAX), nullptr);
+
+  la_arena_reset(a);
+  EXPECT_EQ(la_arena_used(a), 0u);
+  EXPECT_EQ(la_arena_alloc(a, 1), p1);
+  la_arena_destroy(a);
+}
+
+/* Runs the chunks serially in reverse order, like a scheduler that does not
+ * preserve submission order would. */
+static void reverse_parallel_for(void *user, size_t nchunks, la_chunk_fn fn,
+                                 void *ctx) {
+  size_t *calls = static_cast<size_t *>(user);
+  for (size_t c = nchunks; c > 0; c--) {
+    fn(ctx, c - 1);
+    (*calls)++;
+  }
+}
+
+static void count_range(void *ctx, size_t begin, size_t end) {
+  std::vector<int> *seen = static_cast<std::vector<int> *>(ctx);
+  for (size_t i = begin; i < end; i++) {
+    (*seen)[i]++;
+  }
+}
+
+TEST(la_tests, la_parallel_for) {
+  for (size_t n : {0, 1, 255, 256, 1000, 4097}) {
+    std::vector<int> seen(n, 0);
+    size_t calls = 0;
+    la_jobs jobs = {reverse_parallel_for, &calls, 4, 0};
+    la_parallel_for(&jobs, n, count_range, &seen);
+    for (size_t i = 0; i < n; i++) {
+      ASSERT_EQ(seen[i], 1) << i;
+    }
+
+    /* Fixed grain gives the same split regardless of the thread count. */
+    size_t calls2 = 0;
+    la_jobs det1 = {reverse_parallel_for, &calls, 1, 100};
+    la_jobs det16 = {reverse_parallel_for, &calls2, 16, 100};
+    calls = 0;
+    la_parallel_for(&det1, n, count_range, &seen);
+    la_parallel_for(&det16, n, count_range, &seen);
+    ASSERT_EQ(calls, calls2);
+    ASSERT_EQ(calls, n > 100 ? (n + 99) / 100 : 0);
+  }
+
+  std::vector<int> seen(10, 0);
+  la_parallel_for(NULL, seen.size(), count_range, &seen);
+  ASSERT_EQ(seen, std::vector<int>(10, 1));
+}
+
+#ifdef LA_HAS_POOL
+TEST(la_tests, la_transform_points_v4_mt) {
+  const size_t n = 100003;
+  const la_mat4 m = test_matrix(7);
+  std::vector<float> in[4];
+  std::vector<float> ref[4];
+  std::vector<float> out[4];
+  for (int k = 0; k < 4; k++) {
+    for (size_t i = 0; i < n; i++) {
+      in[k].push_back((float)((i * (k + 3)) % 97) - 48.0f);
+    }
+    ref[k].resize(n);
+    out[k].resize(n);
+  }
+  la_transform_points_v4(&m, in[0].data(), in[1].data(), in[2].data(),
+                         in[3].data(), ref[0].data(), ref[1].data(),
+                         ref[2].data(), ref[3].data(), n);
+
+  la_pool *pool = la_pool_create(4);
+  ASSERT_NE(pool, nullptr);
+  ASSERT_EQ(la_pool_threads(pool), 4u);
+  for (size_t grain : {0, 1000, 4096}) {
+    la_jobs jobs = la_pool_jobs(pool, grain);
+    la_transform_points_v4_mt(&jobs, &m, in[0].data(), in[1].data(),
+                              in[2].data(), in[3].data(), out[0].data(),
+                              out[1].data(), out[2].data(), out[3].data(), n);
+    for (int k = 0; k < 4; k++) {
+      ASSERT_EQ(out[k], ref[k]);
+    }
+  }
+
+  std::vector<la_vec4> aos(n);
+  std::vector<la_vec4> aos_out(n);
+  for (size_t i = 0; i < n; i++) {
+    aos[i] = {.elem = {in[0][i], in[1][i], in[2][i], in[3][i]}};
+  }
+  la_jobs jobs = la_pool_jobs(pool, 0);
+  la_transform_points_v4_aos_mt(&jobs, &m, aos.data(), aos_out.data(), n);
+  for (size_t i = 0; i < n; i++) {
+    for (int k = 0; k < 4; k++) {
+      ASSERT_EQ(aos_out[i].elem[k], ref[k][i]);
+    }
+  }
+  la_pool_destroy(pool);
+}
+
+TEST(la_tests, la_productm4_batch_mt) {
+  const size_t n = 5000;
+  std::vector<la_mat4> a(n);
+  std::vector<la_mat4> b(n);
+  std::vector<la_mat4> out(n);
+  for (size_t i = 0; i < n; i++) {
+    a[i] = test_matrix(i + 1);
+    b[i] = test_matrix(i + 7919);
+  }
+  la_pool *pool = la_pool_create(3);
+  la_jobs jobs = la_pool_jobs(pool, 64);
+  la_productm4_batch_mt(&jobs, a.data(), b.data(), out.data(), n);
+  for (size_t i = 0; i < n; i++) {
+    expect_m4_eq(out[i], la_productm4_scalar(a[i], b[i]));
+  }
+  la_pool_destroy(pool);
+}
+#endif
+
 TEST(la_tests, la_dotv3) {
   la_vec3 v1 = {.elem = {1.0f, -3.2f, 0.0f}};
   la_vec3 v2 = {.elem = {5.4f, 3.2f, -5.0f}};
@@ -260,22 +809,22 @@ TEST(la_tests, la_look_at) {
   la_vec3 c = {.elem = {eye.x + ctr.x, eye.y + ctr.y, eye.z + ctr.z}};
   la_vec3 up = {.elem = {0.0f, 1.0f, 0.0f}};
   la_mat4 m = la_look_at(eye, c, up);
-  ASSERT_FLOAT_EQ(m.elem[0][0], -0.707107f);
-  ASSERT_FLOAT_EQ(m.elem[0][1], 0.0f);
-  ASSERT_FLOAT_EQ(m.elem[0][2], -0.707107f);
-  ASSERT_FLOAT_EQ(m.elem[0][3], 0.0f);
-  ASSERT_FLOAT_EQ(m.elem[1][0], 0.0f);
-  ASSERT_FLOAT_EQ(m.elem[1][1], 1.0f);
-  ASSERT_FLOAT_EQ(m.elem[1][2], -0.0f);
-  ASSERT_FLOAT_EQ(m.elem[1][3], 0.0f);
-  ASSERT_FLOAT_EQ(m.elem[2][0], 0.707107f);
-  ASSERT_FLOAT_EQ(m.elem[2][1], -0.0f);
-  ASSERT_FLOAT_EQ(m.elem[2][2], -0.707107f);
-  ASSERT_FLOAT_EQ(m.elem[2][3], 0.0f);
-  ASSERT_FLOAT_EQ(m.elem[3][0], -0.0f);
-  ASSERT_FLOAT_EQ(m.elem[3][1], -3.0f);
-  ASSERT_FLOAT_EQ(m.elem[3][2], 4.24264f);
-  ASSERT_FLOAT_EQ(m.elem[3][3], 1.0f);
+  ASSERT_APPROX_EQ(m.elem[0][0], -0.707107f);
+  ASSERT_APPROX_EQ(m.elem[0][1], 0.0f);
+  ASSERT_APPROX_EQ(m.elem[0][2], -0.707107f);
+  ASSERT_APPROX_EQ(m.elem[0][3], 0.0f);
+  ASSERT_APPROX_EQ(m.elem[1][0], 0.0f);
+  ASSERT_APPROX_EQ(m.elem[1][1], 1.0f);
+  ASSERT_APPROX_EQ(m.elem[1][2], -0.0f);
+  ASSERT_APPROX_EQ(m.elem[1][3], 0.0f);
+  ASSERT_APPROX_EQ(m.elem[2][0], 0.707107f);
+  ASSERT_APPROX_EQ(m.elem[2][1], -0.0f);
+  ASSERT_APPROX_EQ(m.elem[2][2], -0.707107f);
+  ASSERT_APPROX_EQ(m.elem[2][3], 0.0f);
+  ASSERT_APPROX_EQ(m.elem[3][0], -0.0f);
+  ASSERT_APPROX_EQ(m.elem[3][1], -3.0f);
+  ASSERT_APPROX_EQ(m.elem[3][2], 4.24264f);
+  ASSERT_APPROX_EQ(m.elem[3][3], 1.0f);
 }
 
 TEST(la_tests, la_scale) {
@@ -305,3 +854,2768 @@ TEST(la_tests, la_scale) {
   ASSERT_FLOAT_EQ(result.elem[3][2], 2.664000f);
   ASSERT_FLOAT_EQ(result.elem[3][3], 0.000000f);
 }
+
+static la_mat4 test_affine(float angle) {
+  la_vec3 axis = {.elem = {0.3f, -1.0f, 0.5f}};
+  la_vec3 t = {.elem = {1.5f, -2.0f, 4.25f}};
+  la_vec3 sc = {.elem = {2.0f, 0.5f, 1.5f}};
+  la_mat4 m = la_rotate(la_identitym4(), axis, angle);
+  m = la_scale(m, sc);
+  return la_translate(m, t);
+}
+
+static void expect_v3_near(const la_vec3 &a, const la_vec3 &b, float eps) {
+  for (int i = 0; i < 3; i++) {
+    EXPECT_NEAR(a.elem[i], b.elem[i], eps) << i;
+  }
+}
+
+TEST(la_tests, la_productm4_affine) {
+  la_mat4 a = test_affine(0.7f);
+  la_mat4 b = test_affine(-2.1f);
+  expect_m4_eq(la_productm4_affine(a, b), la_productm4(a, b));
+  expect_m4_eq(la_productm4_affine(b, a), la_productm4(b, a));
+}
+
+TEST(la_tests, la_transform_point_affine) {
+  la_mat4 a = test_affine(0.7f);
+  la_mat4 b = test_affine(-2.1f);
+  la_vec3 p = {.elem = {1.0f, 2.0f, -3.0f}};
+
+  la_vec4 ph = {.elem = {p.x, p.y, p.z, 1.0f}};
+  la_vec3 r = la_transform_point_affine(a, p);
+  for (int k = 0; k < 3; k++) {
+    float e = 0.0f;
+    for (int j = 0; j < 4; j++) {
+      e += ph.elem[j] * a.elem[j][k];
+    }
+    EXPECT_FLOAT_EQ(r.elem[k], e);
+  }
+
+  /* transforming by a * b is transforming by a then b */
+  expect_v3_near(la_transform_point_affine(la_productm4_affine(a, b), p),
+                 la_transform_point_affine(b, la_transform_point_affine(a, p)),
+                 1e-4f);
+
+  la_vec3 d = la_transform_dir_affine(a, p);
+  la_vec3 o = {.elem = {0.0f, 0.0f, 0.0f}};
+  la_vec3 t0 = la_transform_point_affine(a, o);
+  expect_v3_near(d, {.elem = {r.x - t0.x, r.y - t0.y, r.z - t0.z}}, 1e-5f);
+}
+
+TEST(la_tests, la_inverse_affine) {
+  la_mat4 a = test_affine(0.7f);
+  int invertible = 0;
+  la_mat4 inv = la_inverse_affine(a, &invertible);
+  ASSERT_TRUE(invertible);
+
+  la_mat4 id = la_productm4(a, inv);
+  la_mat4 e = la_identitym4();
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      EXPECT_NEAR(id.elem[i][j], e.elem[i][j], 1e-5f);
+    }
+  }
+
+  la_vec3 zero = {.elem = {0.0f, 0.0f, 0.0f}};
+  la_mat4 singular = la_scale(la_identitym4(), zero);
+  expect_m4_eq(la_inverse_affine(singular, &invertible), e);
+  ASSERT_FALSE(invertible);
+}
+
+TEST(la_tests, la_mat3x4) {
+  std::vector<la_mat4> m;
+  for (int i = 0; i < 5; i++) {
+    m.push_back(test_affine(0.3f * i));
+  }
+  std::vector<la_mat3x4> packed(m.size());
+  la_m4tomat3x4_batch(m.data(), packed.data(), m.size());
+
+  la_vec3 p = {.elem = {1.0f, 2.0f, -3.0f}};
+  for (size_t i = 0; i < m.size(); i++) {
+    la_mat3x4 single = la_m4tomat3x4(m[i]);
+    ASSERT_EQ(memcmp(&single, &packed[i], sizeof(single)), 0);
+    expect_m4_eq(la_mat3x4tom4(packed[i]), m[i]);
+    expect_v3_near(la_transform_point_mat3x4(&packed[i], p),
+                   la_transform_point_affine(m[i], p), 1e-5f);
+  }
+  ASSERT_EQ(sizeof(la_mat3x4), 48u);
+}
+
+TEST(la_tests, la_transposem4) {
+  la_mat4 m = test_matrix(3);
+  la_mat4 t = la_transposem4(m);
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      ASSERT_EQ(t.elem[i][j], m.elem[j][i]);
+    }
+  }
+}
+
+TEST(la_tests, la_determinantm4) {
+  la_mat4 m = {.elem = {{2.0f, 0.0f, 1.0f, 3.0f},
+                        {1.0f, 1.0f, 0.0f, 2.0f},
+                        {0.0f, 4.0f, 1.0f, 1.0f},
+                        {3.0f, 0.0f, 2.0f, 1.0f}}};
+  ASSERT_FLOAT_EQ(la_determinantm4(m), -20.0f);
+  ASSERT_FLOAT_EQ(la_determinantm4(la_transposem4(m)), -20.0f);
+  ASSERT_FLOAT_EQ(la_determinantm4(la_identitym4()), 1.0f);
+}
+
+static void expect_identity(const la_mat4 &m, float eps) {
+  la_mat4 e = la_identitym4();
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      EXPECT_NEAR(m.elem[i][j], e.elem[i][j], eps) << i << ", " << j;
+    }
+  }
+}
+
+typedef la_mat4 (*inversem4_fn)(const la_mat4, int *);
+
+static void check_inverse(inversem4_fn inversem4) {
+  for (unsigned int seed = 1; seed < 64; seed++) {
+    la_mat4 m = test_matrix(seed);
+    int invertible = 0;
+    la_mat4 inv = inversem4(m, &invertible);
+    ASSERT_TRUE(invertible);
+    expect_identity(la_productm4(m, inv), 1e-3f);
+    expect_identity(la_productm4(inv, m), 1e-3f);
+
+    la_mat4 ref = la_inversem4_scalar(m, NULL);
+    for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 4; j++) {
+        EXPECT_NEAR(inv.elem[i][j], ref.elem[i][j],
+                    1e-4f * (1.0f + fabsf(ref.elem[i][j])));
+      }
+    }
+  }
+
+  la_mat4 singular = test_matrix(5);
+  for (int j = 0; j < 4; j++) {
+    singular.elem[2][j] = 0.0f;
+  }
+  int invertible = 1;
+  expect_m4_eq(inversem4(singular, &invertible), la_identitym4());
+  ASSERT_FALSE(invertible);
+}
+
+TEST(la_tests, la_inversem4_scalar) { check_inverse(la_inversem4_scalar); }
+
+#ifdef LA_USE_SSE2
+TEST(la_tests, la_inversem4_sse2) { check_inverse(la_inversem4_sse2); }
+#endif
+
+TEST(la_tests, la_inversem4) {
+  check_inverse(la_inversem4);
+
+  /* A view matrix inverse puts the camera back at the eye position. */
+  la_vec3 eye = {.elem = {3.0f, 3.0f, 3.0f}};
+  la_vec3 ctr = {.elem = {0.0f, 0.0f, 0.0f}};
+  la_vec3 up = {.elem = {0.0f, 1.0f, 0.0f}};
+  la_mat4 inv = la_inversem4(la_look_at(eye, ctr, up), NULL);
+  EXPECT_NEAR(inv.elem[3][0], 3.0f, 1e-5f);
+  EXPECT_NEAR(inv.elem[3][1], 3.0f, 1e-5f);
+  EXPECT_NEAR(inv.elem[3][2], 3.0f, 1e-5f);
+
+  la_mat4 p = la_perspective(la_radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+  expect_identity(la_productm4(p, la_inversem4(p, NULL)), 1e-5f);
+}
+
+TEST(la_tests, la_inverse_near_singular) {
+  /* The last row is a combination of the first two, rounded to float. The
+   * determinant is tiny but not zero. */
+  la_mat4 m = test_matrix(7);
+  la_dmat4 dm = la_m4todm4(m);
+  for (int j = 0; j < 4; j++) {
+    m.elem[3][j] = 0.1f * m.elem[0][j] + 0.7f * m.elem[1][j];
+    dm.elem[3][j] = 0.1 * dm.elem[0][j] + 0.7 * dm.elem[1][j];
+  }
+  int invertible = 1;
+  expect_m4_eq(la_inversem4_scalar(m, &invertible), la_identitym4());
+  EXPECT_EQ(invertible, 0);
+#ifdef LA_USE_SSE2
+  invertible = 1;
+  expect_m4_eq(la_inversem4_sse2(m, &invertible), la_identitym4());
+  EXPECT_EQ(invertible, 0);
+#endif
+  invertible = 1;
+  expect_m4_eq(la_inversem4(m, &invertible), la_identitym4());
+  EXPECT_EQ(invertible, 0);
+  invertible = 1;
+  la_inversem4_d(dm, &invertible);
+  EXPECT_EQ(invertible, 0);
+
+  la_mat4 a = la_identitym4();
+  for (int j = 0; j < 3; j++) {
+    a.elem[0][j] = m.elem[0][j];
+    a.elem[1][j] = m.elem[1][j];
+    a.elem[2][j] = 0.1f * m.elem[0][j] + 0.7f * m.elem[1][j];
+  }
+  invertible = 1;
+  expect_m4_eq(la_inverse_affine(a, &invertible), la_identitym4());
+  EXPECT_EQ(invertible, 0);
+  invertible = 1;
+  expect_m4_eq(la_m3tom4(la_inversem3(la_m4tom3(a), &invertible)),
+               la_identitym4());
+  EXPECT_EQ(invertible, 0);
+  invertible = 1;
+  la_normal_matrix(a, &invertible);
+  EXPECT_EQ(invertible, 0);
+
+  la_mat2 m2 = {{{0.1f, 0.7f}, {0.3f, 0.3f * 0.7f / 0.1f}}};
+  invertible = 1;
+  la_inversem2(m2, &invertible);
+  EXPECT_EQ(invertible, 0);
+
+  /* The test is relative to the magnitude of the matrix: a small scale is
+   * invertible, also with a large translation. */
+  la_mat4 s = la_scale(la_identitym4(), {.elem = {1e-3f, 1e-3f, 1e-3f}});
+  s.elem[3][0] = 50.0f;
+  s.elem[3][1] = -20.0f;
+  invertible = 0;
+  la_inversem4(s, &invertible);
+  EXPECT_EQ(invertible, 1);
+  invertible = 0;
+  expect_identity(la_productm4(s, la_inverse_affine(s, &invertible)), 1e-4f);
+  EXPECT_EQ(invertible, 1);
+  invertible = 0;
+  la_inversem4_d(la_m4todm4(s), &invertible);
+  EXPECT_EQ(invertible, 1);
+  la_mat2 s2 = {{{1e-3f, 0.0f}, {0.0f, 1e-3f}}};
+  invertible = 0;
+  la_inversem2(s2, &invertible);
+  EXPECT_EQ(invertible, 1);
+  /* Elements whose squares overflow float do not make the row lengths
+   * infinite: the determinant of this matrix is 1. */
+  la_mat4 big = la_identitym4();
+  big.elem[0][0] = 1e20f;
+  big.elem[1][1] = 1e-20f;
+  la_mat4 (*const inverses[])(const la_mat4, int *) = {
+      la_inversem4_scalar,
+#ifdef LA_USE_SSE2
+      la_inversem4_sse2,
+#endif
+      la_inversem4, la_inverse_affine};
+  for (auto inverse : inverses) {
+    invertible = 0;
+    const la_mat4 inv = inverse(big, &invertible);
+    EXPECT_EQ(invertible, 1);
+    EXPECT_FLOAT_EQ(inv.elem[0][0], 1e-20f);
+    EXPECT_FLOAT_EQ(inv.elem[1][1], 1e20f);
+  }
+  invertible = 0;
+  la_inversem3(la_m4tom3(big), &invertible);
+  EXPECT_EQ(invertible, 1);
+  invertible = 0;
+  la_normal_matrix(big, &invertible);
+  EXPECT_EQ(invertible, 1);
+  const la_mat2 big2 = {{{1e20f, 0.0f}, {0.0f, 1e-20f}}};
+  invertible = 0;
+  la_inversem2(big2, &invertible);
+  EXPECT_EQ(invertible, 1);
+}
+
+static void expect_q_near(const la_quat &a, const la_quat &b, float eps) {
+  for (int i = 0; i < 4; i++) {
+    EXPECT_NEAR(a.elem[i], b.elem[i], eps) << i;
+  }
+}
+
+static void expect_m4_near(const la_mat4 &a, const la_mat4 &b, float eps) {
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      EXPECT_NEAR(a.elem[i][j], b.elem[i][j], eps) << i << ", " << j;
+    }
+  }
+}
+
+TEST(la_tests, la_quattom4) {
+  la_vec3 axis = {.elem = {0.3f, -1.0f, 0.5f}};
+  la_quat q = la_axis_angleq(axis, 1.2f);
+  ASSERT_NEAR(la_dotv4(q, q), 1.0f, 1e-6f);
+  expect_m4_near(la_quattom4(q), la_rotate(la_identitym4(), axis, 1.2f),
+                 1e-6f);
+  expect_m4_eq(la_quattom4(la_identityq()), la_identitym4());
+
+  la_mat4 m = test_affine(0.4f);
+  expect_m4_near(la_rotateq(m, q), la_rotate(m, axis, 1.2f), 1e-5f);
+}
+
+TEST(la_tests, la_productq) {
+  la_vec3 a1 = {.elem = {0.0f, 0.0f, 1.0f}};
+  la_vec3 a2 = {.elem = {1.0f, 2.0f, 0.5f}};
+  la_quat q1 = la_axis_angleq(a1, 0.9f);
+  la_quat q2 = la_axis_angleq(a2, -2.3f);
+
+  /* q1 * q2 rotates by q2 and then by q1 */
+  la_mat4 expected = la_productm4(la_quattom4(q2), la_quattom4(q1));
+  expect_m4_near(la_quattom4(la_productq(q1, q2)), expected, 1e-6f);
+
+  /* rotations about the same axis add up */
+  expect_q_near(la_productq(q1, q1), la_axis_angleq(a1, 1.8f), 1e-6f);
+
+  expect_q_near(la_productq(q2, la_conjugateq(q2)), la_identityq(), 1e-6f);
+  la_quat s = {.elem = {q2.x * 2.0f, q2.y * 2.0f, q2.z * 2.0f, q2.w * 2.0f}};
+  expect_q_near(la_productq(s, la_inverseq(s)), la_identityq(), 1e-6f);
+  expect_q_near(la_normalizeq(s), q2, 1e-6f);
+}
+
+TEST(la_tests, la_productqv3) {
+  la_vec3 axis = {.elem = {0.0f, 0.0f, 1.0f}};
+  la_vec3 x = {.elem = {1.0f, 0.0f, 0.0f}};
+  la_vec3 r = la_productqv3(la_axis_angleq(axis, la_radians(90.0f)), x);
+  expect_v3_near(r, {.elem = {0.0f, 1.0f, 0.0f}}, 1e-6f);
+
+  la_vec3 a = {.elem = {1.0f, 2.0f, 0.5f}};
+  la_vec3 v = {.elem = {-3.0f, 0.25f, 7.0f}};
+  la_quat q = la_axis_angleq(a, 2.0f);
+  expect_v3_near(la_productqv3(q, v),
+                 la_transform_dir_affine(la_quattom4(q), v), 1e-5f);
+}
+
+TEST(la_tests, la_slerpq) {
+  la_vec3 axis = {.elem = {1.0f, 1.0f, 0.0f}};
+  la_quat q1 = la_axis_angleq(axis, 0.2f);
+  la_quat q2 = la_axis_angleq(axis, 1.4f);
+  for (float t = 0.0f; t <= 1.0f; t += 0.125f) {
+    la_quat e = la_axis_angleq(axis, 0.2f + 1.2f * t);
+    expect_q_near(la_slerpq(q1, q2, t), e, 1e-5f);
+
+    la_quat n = la_nlerpq(q1, q2, t);
+    ASSERT_NEAR(la_dotv4(n, n), 1.0f, 1e-6f);
+    EXPECT_GT(fabsf(la_dotv4(n, e)), 0.999f);
+  }
+
+  /* q and -q are the same rotation; interpolation takes the short path. */
+  la_quat neg = {.elem = {-q2.x, -q2.y, -q2.z, -q2.w}};
+  la_quat h = la_slerpq(q1, neg, 0.5f);
+  EXPECT_NEAR(fabsf(la_dotv4(h, la_axis_angleq(axis, 0.8f))), 1.0f, 1e-5f);
+  h = la_nlerpq(q1, neg, 0.5f);
+  EXPECT_NEAR(fabsf(la_dotv4(h, la_axis_angleq(axis, 0.8f))), 1.0f, 1e-5f);
+}
+
+TEST(la_tests, la_rsqrt_approx) {
+  for (float x = 1e-30f; x < 1e30f; x *= 1.0137f) {
+    const double e = 1.0 / sqrt((double)x);
+    ASSERT_LT(fabs(la_rsqrt_approx(x) - e) / e, 3e-7) << x;
+  }
+}
+
+TEST(la_tests, la_sin_cos_approx) {
+  for (double x = -8192.0; x <= 8192.0; x += 0.0137) {
+    const float f = (float)x;
+    ASSERT_LT(fabs(la_sin_approx(f) - sin((double)f)), 1.2e-7) << f;
+    ASSERT_LT(fabs(la_cos_approx(f) - cos((double)f)), 1.2e-7) << f;
+  }
+
+  /* Outside of the domain the result is NaN rather than a wrapped int. */
+  const float outside[] = {NAN, INFINITY, -INFINITY, 3e9f, -1e30f,
+                           LA_TRIG_APPROX_MAX * 2.0f};
+  for (const float f : outside) {
+    EXPECT_TRUE(std::isnan(la_sin_approx(f))) << f;
+    EXPECT_TRUE(std::isnan(la_cos_approx(f))) << f;
+    EXPECT_TRUE(std::isnan(la_tan_approx(f))) << f;
+  }
+  EXPECT_LT(fabs(la_sin_approx(LA_TRIG_APPROX_MAX) -
+                 sin((double)LA_TRIG_APPROX_MAX)),
+            1e-3);
+}
+
+TEST(la_tests, la_tan_approx) {
+  for (double x = -2.0 * M_PI; x <= 2.0 * M_PI; x += 0.00013) {
+    const float f = (float)x;
+    const double e = tan((double)f);
+    ASSERT_LT(fabs(la_tan_approx(f) - e) / fabs(e), 5e-7) << f;
+  }
+}
+
+/* Holds for both the precise and the LA_FAST_MATH builds. */
+TEST(la_tests, la_normalizev3_error) {
+  for (float x = -4.0f; x <= 4.0f; x += 0.37f) {
+    la_vec3 v = {.elem = {x, 1.5f - x, 0.25f * x * x}};
+    la_vec3 n = la_normalizev3(v);
+    const double l = sqrt((double)v.x * v.x + (double)v.y * v.y +
+                          (double)v.z * v.z);
+    for (int i = 0; i < 3; i++) {
+      ASSERT_NEAR(n.elem[i], v.elem[i] / l, 5e-7);
+    }
+  }
+}
+
+TEST(la_tests, la_pointer_api) {
+  for (unsigned int seed = 1; seed < 16; seed++) {
+    const la_mat4 a = test_matrix(seed);
+    const la_mat4 b = test_matrix(seed * 7919u);
+    const la_mat4 t = test_affine(0.1f * seed);
+    const la_vec3 v = test_vec3(seed);
+    const la_vec4 v4 = {.elem = {v.x, v.y, v.z, 1.0f}};
+    const la_quat q = la_axis_angleq(v, 0.3f * seed);
+    la_mat4 out;
+    la_vec4 out4;
+    int ok = 0;
+
+    la_productm4_p(&out, &a, &b);
+    expect_m4_eq(out, la_productm4(a, b));
+    la_productm4v4_p(&out4, &a, &v4);
+    expect_v4_eq(out4, la_productm4v4(a, v4));
+    la_productm4_affine_p(&out, &t, &t);
+    expect_m4_eq(out, la_productm4_affine(t, t));
+    la_transposem4_p(&out, &a);
+    expect_m4_eq(out, la_transposem4(a));
+    la_inversem4_p(&out, &a, &ok);
+    expect_m4_eq(out, la_inversem4(a, NULL));
+    EXPECT_EQ(ok, 1);
+    la_inverse_affine_p(&out, &t, NULL);
+    expect_m4_eq(out, la_inverse_affine(t, NULL));
+    la_rotate_p(&out, &a, &v, 0.7f);
+    expect_m4_eq(out, la_rotate(a, v, 0.7f));
+    la_rotateq_p(&out, &a, &q);
+    expect_m4_eq(out, la_rotateq(a, q));
+    la_scale_p(&out, &a, &v);
+    expect_m4_eq(out, la_scale(a, v));
+    la_quattom4_p(&out, &q);
+    expect_m4_eq(out, la_quattom4(q));
+    la_translate_p(&out, &a, &v);
+    expect_m4_eq(out, la_translate(a, v));
+
+    /* la_translate_p may work in place. */
+    out = a;
+    la_translate_p(&out, &out, &v);
+    expect_m4_eq(out, la_translate(a, v));
+  }
+
+  la_vec3 eye = {.elem = {1.0f, 2.0f, 3.0f}};
+  la_vec3 ctr = {.elem = {0.0f, 0.0f, 0.0f}};
+  la_vec3 up = {.elem = {0.0f, 1.0f, 0.0f}};
+  la_mat4 out;
+  la_identitym4_p(&out);
+  expect_m4_eq(out, la_identitym4());
+  la_look_at_p(&out, &eye, &ctr, &up);
+  expect_m4_eq(out, la_look_at(eye, ctr, up));
+  la_perspective_p(&out, 1.0f, 1.5f, 0.1f, 100.0f);
+  expect_m4_eq(out, la_perspective(1.0f, 1.5f, 0.1f, 100.0f));
+  la_orthographic_p(&out, -1.0f, 2.0f, -3.0f, 4.0f, 0.5f, 50.0f);
+  expect_m4_eq(out, la_orthographic(-1.0f, 2.0f, -3.0f, 4.0f, 0.5f, 50.0f));
+}
+
+TEST(la_tests, la_bfs_order) {
+  const int32_t parent[] = {3, -1, 1, 1, 2, -1};
+  uint32_t order[6];
+  ASSERT_TRUE(la_bfs_order(parent, 6, order));
+  const uint32_t expected[] = {1, 5, 2, 3, 4, 0};
+  for (int i = 0; i < 6; i++) {
+    EXPECT_EQ(order[i], expected[i]) << i;
+  }
+
+  const int32_t cycle[] = {-1, 2, 1};
+  EXPECT_FALSE(la_bfs_order(cycle, 3, order));
+  const int32_t out_of_range[] = {-1, 2};
+  EXPECT_FALSE(la_bfs_order(out_of_range, 2, order));
+  EXPECT_TRUE(la_bfs_order(NULL, 0, order));
+}
+
+/* A forest of two roots, each with a few levels of 3 children, in
+ * breadth-first order. */
+static std::vector<int32_t> test_forest(void) {
+  std::vector<int32_t> parent = {-1, -1};
+  for (size_t i = 0; parent.size() < 200; i++) {
+    for (int c = 0; c < 3; c++) {
+      parent.push_back((int32_t)i);
+    }
+  }
+  return parent;
+}
+
+static la_mat4 test_local(const la_hierarchy *h, size_t i) {
+  const la_quat q = {.elem = {h->rx[i], h->ry[i], h->rz[i], h->rw[i]}};
+  const la_vec3 t = {.elem = {h->tx[i], h->ty[i], h->tz[i]}};
+  const la_vec3 s = {.elem = {h->sx[i], h->sy[i], h->sz[i]}};
+  la_mat4 m = la_scale(la_identitym4(), s);
+  m = la_productm4(m, la_quattom4(q));
+  return la_productm4(m, la_translate(la_identitym4(), t));
+}
+
+static void check_hierarchy(const la_hierarchy *h) {
+  std::vector<la_mat4> world(h->count);
+  for (size_t i = 0; i < h->count; i++) {
+    world[i] = test_local(h, i);
+    if (h->parent[i] >= 0) {
+      world[i] = la_productm4(world[i], world[h->parent[i]]);
+    }
+    expect_m4_near(h->world[i], world[i], 1e-4f);
+  }
+}
+
+static void set_test_trs(la_hierarchy *h, size_t i, unsigned int seed) {
+  const la_vec3 v = test_vec3(seed);
+  const la_vec3 t = {.elem = {v.x * 0.5f, v.y * 0.5f, v.z * 0.5f}};
+  const la_vec3 s = {.elem = {1.0f + 0.01f * (seed % 7), 1.0f, 0.9f}};
+  la_hierarchy_set_trs(h, i, t, la_axis_angleq(la_normalizev3(v), 0.1f * seed),
+                       s);
+}
+
+TEST(la_tests, la_hierarchy) {
+  const std::vector<int32_t> parent = test_forest();
+  la_hierarchy *h = la_hierarchy_create(parent.data(), parent.size());
+  ASSERT_NE(h, nullptr);
+  EXPECT_EQ(h->nlevels, 5u);
+  EXPECT_EQ(h->levels[1], 2u);
+  EXPECT_EQ(h->levels[2], 8u);
+  for (size_t i = 0; i < h->count; i++) {
+    set_test_trs(h, i, i + 1);
+  }
+  EXPECT_EQ(la_hierarchy_update(h), h->count);
+  check_hierarchy(h);
+
+  EXPECT_EQ(la_hierarchy_update(h), 0u);
+
+  /* Node i has children 3i + 2 .. 3i + 4, so node 3 has a subtree of 3
+   * children, 9 grandchildren and 27 great-grandchildren. */
+  set_test_trs(h, 3, 1234);
+  EXPECT_EQ(la_hierarchy_update(h), 1u + 3u + 9u + 27u);
+  EXPECT_TRUE(la_hierarchy_changed(h, 3));
+  EXPECT_TRUE(la_hierarchy_changed(h, 11));
+  EXPECT_FALSE(la_hierarchy_changed(h, 2));
+  EXPECT_FALSE(la_hierarchy_changed(h, 14));
+  check_hierarchy(h);
+
+  /* Direct SoA writes. */
+  h->tx[parent.size() - 1] += 1.0f;
+  la_hierarchy_mark_dirty(h, parent.size() - 1);
+  EXPECT_EQ(la_hierarchy_update(h), 1u);
+  check_hierarchy(h);
+  la_hierarchy_destroy(h);
+
+  const int32_t not_bfs[] = {-1, 0, 1, -1};
+  EXPECT_EQ(la_hierarchy_create(not_bfs, 4), nullptr);
+  const int32_t child_first[] = {1, -1};
+  EXPECT_EQ(la_hierarchy_create(child_first, 2), nullptr);
+}
+
+TEST(la_tests, la_hierarchy_update_mt) {
+  const std::vector<int32_t> parent = test_forest();
+  la_hierarchy *a = la_hierarchy_create(parent.data(), parent.size());
+  la_hierarchy *b = la_hierarchy_create(parent.data(), parent.size());
+  for (size_t i = 0; i < parent.size(); i++) {
+    set_test_trs(a, i, i + 1);
+    set_test_trs(b, i, i + 1);
+  }
+  size_t calls = 0;
+  la_jobs jobs = {reverse_parallel_for, &calls, 4, 8};
+  EXPECT_EQ(la_hierarchy_update(a), parent.size());
+  EXPECT_EQ(la_hierarchy_update_mt(&jobs, b), parent.size());
+  EXPECT_GT(calls, 0u);
+  EXPECT_EQ(memcmp(a->world, b->world, parent.size() * sizeof(la_mat4)), 0);
+
+  set_test_trs(a, 5, 99);
+  set_test_trs(b, 5, 99);
+  const size_t updated = la_hierarchy_update(a);
+  EXPECT_GT(updated, 0u);
+  EXPECT_LT(updated, parent.size());
+  EXPECT_EQ(la_hierarchy_update_mt(&jobs, b), updated);
+  EXPECT_EQ(memcmp(a->world, b->world, parent.size() * sizeof(la_mat4)), 0);
+  for (size_t i = 0; i < parent.size(); i++) {
+    EXPECT_EQ(la_hierarchy_changed(a, i), la_hierarchy_changed(b, i)) << i;
+  }
+  EXPECT_EQ(la_hierarchy_update_mt(&jobs, b), 0u);
+  la_hierarchy_destroy(a);
+  la_hierarchy_destroy(b);
+}
+
+static void expect_dm4_near(const la_dmat4 &a, const la_mat4 &b, float eps) {
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      EXPECT_NEAR(a.elem[i][j], b.elem[i][j],
+                  eps * fmaxf(1.0f, fabsf(b.elem[i][j])))
+          << i << ", " << j;
+    }
+  }
+}
+
+TEST(la_tests, la_double) {
+  for (unsigned int seed = 1; seed < 16; seed++) {
+    const la_mat4 a = test_matrix(seed);
+    const la_mat4 b = test_matrix(seed * 7919u);
+    const la_vec3 v = test_vec3(seed);
+    const la_dvec3 dv = la_v3todv3(v);
+    const la_vec4 v4 = {.elem = {v.x, v.y, v.z, 1.0f}};
+    const la_dvec4 dv4 = {.elem = {v.x, v.y, v.z, 1.0}};
+
+    expect_dm4_near(la_productm4_d(la_m4todm4(a), la_m4todm4(b)),
+                    la_productm4(a, b), 1e-5f);
+    const la_dvec4 p = la_productm4v4_d(la_m4todm4(a), dv4);
+    const la_vec4 e = la_productm4v4(a, v4);
+    for (int i = 0; i < 4; i++) {
+      EXPECT_NEAR(p.elem[i], e.elem[i], 1e-4f);
+    }
+    expect_dm4_near(la_transposem4_d(la_m4todm4(a)), la_transposem4(a), 0.0f);
+    EXPECT_NEAR(la_determinantm4_d(la_m4todm4(a)), la_determinantm4(a),
+                1e-4f * fmaxf(1.0f, fabsf(la_determinantm4(a))));
+    expect_dm4_near(la_translate_d(la_m4todm4(a), dv), la_translate(a, v),
+                    1e-6f);
+    expect_dm4_near(la_rotate_d(la_m4todm4(a), dv, 0.7), la_rotate(a, v, 0.7f),
+                    1e-5f);
+    expect_dm4_near(la_scale_d(la_m4todm4(a), dv), la_scale(a, v), 1e-5f);
+    EXPECT_NEAR(la_dotv3_d(dv, dv), la_dotv3(v, v), 1e-4f);
+    const la_dvec3 c = la_crossv3_d(dv, la_v3todv3(test_vec3(seed + 99)));
+    const la_vec3 fc = la_crossv3(v, test_vec3(seed + 99));
+    for (int i = 0; i < 3; i++) {
+      EXPECT_NEAR(c.elem[i], fc.elem[i], 1e-4f);
+      EXPECT_NEAR(la_normalizev3_d(dv).elem[i], la_normalizev3(v).elem[i],
+                  1e-6f);
+    }
+
+    int ok = 0;
+    const la_dmat4 inv = la_inversem4_d(la_m4todm4(a), &ok);
+    EXPECT_EQ(ok, 1);
+    const la_dmat4 id = la_productm4_d(inv, la_m4todm4(a));
+    for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 4; j++) {
+        EXPECT_NEAR(id.elem[i][j], i == j ? 1.0 : 0.0, 1e-12);
+      }
+    }
+  }
+
+  la_dmat4 singular = la_identitym4_d();
+  singular.elem[2][0] = singular.elem[2][1] = 0.0;
+  singular.elem[2][2] = singular.elem[2][3] = 0.0;
+  int ok = 1;
+  la_dmat4 inv = la_inversem4_d(singular, &ok);
+  EXPECT_EQ(ok, 0);
+  EXPECT_EQ(la_determinantm4_d(singular), 0.0);
+  expect_dm4_near(inv, la_identitym4(), 0.0f);
+
+  expect_dm4_near(la_perspective_d(1.0, 1.5, 0.1, 100.0),
+                  la_perspective(1.0f, 1.5f, 0.1f, 100.0f), 1e-6f);
+  expect_dm4_near(la_orthographic_d(-1.0, 2.0, -3.0, 4.0, 0.5, 50.0),
+                  la_orthographic(-1.0f, 2.0f, -3.0f, 4.0f, 0.5f, 50.0f),
+                  1e-6f);
+  const la_vec3 eye = {.elem = {1.0f, 2.0f, 3.0f}};
+  const la_vec3 ctr = {.elem = {0.0f, 0.5f, 0.0f}};
+  const la_vec3 up = {.elem = {0.0f, 1.0f, 0.0f}};
+  expect_dm4_near(
+      la_look_at_d(la_v3todv3(eye), la_v3todv3(ctr), la_v3todv3(up)),
+      la_look_at(eye, ctr, up), 1e-6f);
+  EXPECT_TRUE(la_cmpv3(la_dv3tov3(la_v3todv3(eye)), eye));
+  expect_m4_eq(la_dm4tom4(la_m4todm4(test_matrix(3))), test_matrix(3));
+}
+
+/* The float functions are the _scalar instantiation of the templates that
+ * also make the double ones, or SIMD versions that must agree with it. The
+ * inverses are compared in check_inverse. */
+TEST(la_tests, la_scalar_reference) {
+  for (unsigned int seed = 1; seed < 16; seed++) {
+    const la_mat4 a = test_matrix(seed);
+    const la_mat4 b = test_matrix(seed * 7919u);
+    const la_vec3 v = test_vec3(seed);
+    const la_vec3 w = test_vec3(seed + 99);
+    const la_vec4 v4 = {.elem = {v.x, v.y, v.z, 1.0f}};
+
+    expect_m4_eq(la_productm4(a, b), la_productm4_scalar(a, b));
+    expect_v4_eq(la_productm4v4(a, v4), la_productm4v4_scalar(a, v4));
+    expect_m4_eq(la_transposem4(a), la_transposem4_scalar(a));
+    EXPECT_EQ(la_determinantm4(a), la_determinantm4_scalar(a));
+    expect_m4_eq(la_translate(a, v), la_translate_scalar(a, v));
+    expect_m4_eq(la_rotate(a, v, 0.7f), la_rotate_scalar(a, v, 0.7f));
+    expect_m4_eq(la_scale(a, v), la_scale_scalar(a, v));
+    EXPECT_EQ(la_dotv3(v, w), la_dotv3_scalar(v, w));
+    expect_v3_eq(la_crossv3(v, w), la_crossv3_scalar(v, w));
+    expect_v3_near(la_normalizev3(v), la_normalizev3_scalar(v), 1e-5f);
+    expect_m4_eq(la_look_at(v, w, la_vec3{.elem = {0.0f, 1.0f, 0.0f}}),
+                 la_look_at_scalar(v, w, la_vec3{.elem = {0.0f, 1.0f, 0.0f}}));
+  }
+  expect_m4_eq(la_identitym4(), la_identitym4_scalar());
+  expect_m4_eq(la_perspective(1.0f, 1.5f, 0.1f, 100.0f),
+               la_perspective_scalar(1.0f, 1.5f, 0.1f, 100.0f));
+  expect_m4_eq(la_orthographic(-1.0f, 2.0f, -3.0f, 4.0f, 0.5f, 50.0f),
+               la_orthographic_scalar(-1.0f, 2.0f, -3.0f, 4.0f, 0.5f, 50.0f));
+}
+
+TEST(la_tests, la_camera_relative) {
+  const la_dvec3 camera = {.elem = {1.0e7, -2.5e6, 3.0e8}};
+  for (size_t n : batch_sizes) {
+    std::vector<double> p[3];
+    std::vector<float> o[3];
+    for (int k = 0; k < 3; k++) {
+      for (size_t i = 0; i < n; i++) {
+        p[k].push_back(camera.elem[k] + test_vec3(i + 1).elem[k] * 0.125);
+      }
+      o[k].resize(n);
+    }
+    la_camera_relative_soa(&camera, p[0].data(), p[1].data(), p[2].data(),
+                           o[0].data(), o[1].data(), o[2].data(), n);
+    for (int k = 0; k < 3; k++) {
+      for (size_t i = 0; i < n; i++) {
+        /* The offsets are exact in float, far from the origin or not. */
+        EXPECT_EQ(o[k][i], test_vec3(i + 1).elem[k] * 0.125f);
+      }
+    }
+  }
+
+  std::vector<la_dmat4> world;
+  for (unsigned int seed = 1; seed < 10; seed++) {
+    la_dmat4 m = la_m4todm4(test_affine(0.3f * seed));
+    m.elem[3][0] += camera.x + seed;
+    m.elem[3][1] += camera.y;
+    m.elem[3][2] += camera.z - seed;
+    world.push_back(m);
+  }
+  std::vector<la_mat4> out(world.size());
+  la_camera_relative_m4_batch(&camera, world.data(), out.data(), world.size());
+  const la_dvec3 back = {.elem = {-camera.x, -camera.y, -camera.z}};
+  for (size_t i = 0; i < world.size(); i++) {
+    const la_dmat4 e =
+        la_productm4_d(world[i], la_translate_d(la_identitym4_d(), back));
+    expect_dm4_near(e, out[i], 1e-6f);
+  }
+}
+
+TEST(la_tests, la_half) {
+  EXPECT_EQ(la_ftoh(1.0f), 0x3c00);
+  EXPECT_EQ(la_ftoh(-2.0f), 0xc000);
+  EXPECT_EQ(la_ftoh(65504.0f), 0x7bff);
+  EXPECT_EQ(la_ftoh(65519.0f), 0x7bff);
+  EXPECT_EQ(la_ftoh(65520.0f), 0x7c00);
+  EXPECT_EQ(la_ftoh(INFINITY), 0x7c00);
+  EXPECT_EQ(la_ftoh(-INFINITY), 0xfc00);
+  EXPECT_EQ(la_ftoh(1e-8f), 0x0000);
+  EXPECT_EQ(la_ftoh(-0.0f), 0x8000);
+  /* Ties round to even. */
+  EXPECT_EQ(la_ftoh(1.0f + 1.0f / 2048), 0x3c00);
+  EXPECT_EQ(la_ftoh(1.0f + 3.0f / 2048), 0x3c02);
+  EXPECT_EQ(la_ftoh(ldexpf(1.0f, -25)), 0x0000);
+  EXPECT_EQ(la_ftoh(ldexpf(3.0f, -25)), 0x0002);
+  EXPECT_EQ(la_ftoh(ldexpf(1.0f, -24)), 0x0001);
+  EXPECT_EQ(la_ftoh(ldexpf(1.0f, -14)), 0x0400);
+  EXPECT_TRUE(std::isnan(la_htof(la_ftoh(NAN))));
+
+  /* Every half converts to float and back unchanged. */
+  for (uint32_t h = 0; h <= 0xffff; h++) {
+    const float f = la_htof((la_half)h);
+    if ((h & 0x7fff) > 0x7c00) {
+      EXPECT_TRUE(std::isnan(f)) << h;
+    } else {
+      EXPECT_EQ(la_ftoh(f), h) << h;
+    }
+  }
+  EXPECT_EQ(la_htof(0x0001), ldexpf(1.0f, -24));
+  EXPECT_EQ(la_htof(0x7bff), 65504.0f);
+
+  for (size_t n : batch_sizes) {
+    std::vector<float> in(n);
+    unsigned int seed = 7;
+    for (size_t i = 0; i < n; i++) {
+      seed = seed * 1664525u + 1013904223u;
+      uint32_t u = seed;
+      if (i % 3 == 0) {
+        u = (u & 0x8fffffffu) | 0x30000000u; // Mostly in half range.
+      }
+      memcpy(&in[i], &u, sizeof(u));
+    }
+    std::vector<la_half> h(n);
+    std::vector<float> back(n);
+    la_ftoh_batch(in.data(), h.data(), n);
+    la_htof_batch(h.data(), back.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      EXPECT_EQ(h[i], la_ftoh(in[i])) << i;
+      const float f = la_htof(h[i]);
+      EXPECT_EQ(memcmp(&back[i], &f, sizeof(f)), 0) << i;
+    }
+  }
+
+  const la_vec4 v = {.elem = {0.5f, -1.25f, 3.0f, 1024.0f}};
+  const la_vec4 r = la_hv4tov4(la_v4tohv4(v));
+  expect_v4_eq(r, v);
+}
+
+static la_mat4 test_rigid(unsigned int seed) {
+  const la_vec3 axis = test_vec3(seed);
+  const la_vec3 t = test_vec3(seed * 31u + 7u);
+  const la_mat4 r = la_rotate(la_identitym4(), axis, 0.37f * seed - 3.0f);
+  return la_translate(r, t);
+}
+
+TEST(la_tests, la_m4toquat) {
+  const la_vec3 axes[] = {{.elem = {1.0f, 0.0f, 0.0f}},
+                          {.elem = {0.0f, 1.0f, 0.0f}},
+                          {.elem = {0.0f, 0.0f, 1.0f}},
+                          {.elem = {0.3f, -1.0f, 0.5f}}};
+  const float angles[] = {0.0f, 0.5f, -1.2f, 3.0f, 3.14159265f};
+  for (const la_vec3 &axis : axes) {
+    for (float a : angles) {
+      const la_quat q = la_axis_angleq(axis, a);
+      la_quat r = la_m4toquat(la_quattom4(q));
+      if (la_dotv4(q, r) < 0.0f) {
+        r = la_quat{.elem = {-r.x, -r.y, -r.z, -r.w}};
+      }
+      expect_q_near(r, q, 1e-5f);
+    }
+  }
+}
+
+TEST(la_tests, la_dualquat) {
+  const la_vec3 p = {.elem = {0.5f, -1.5f, 2.0f}};
+  expect_m4_eq(la_dqtom4(la_identitydq()), la_identitym4());
+  for (unsigned int seed = 1; seed < 20; seed++) {
+    const la_mat4 a = test_rigid(seed);
+    const la_mat4 b = test_rigid(seed + 100);
+    const la_dualquat da = la_m4todq(a);
+    const la_dualquat db = la_m4todq(b);
+    EXPECT_NEAR(la_dotv4(da.real, da.real), 1.0f, 1e-6f);
+    EXPECT_NEAR(la_dotv4(da.real, da.dual), 0.0f, 1e-5f);
+    expect_m4_near(la_dqtom4(da), a, 1e-5f);
+    expect_v3_near(la_transform_point_dq(da, p),
+                   la_transform_point_affine(a, p), 1e-5f);
+    const la_vec3 t = {.elem = {a.elem[3][0], a.elem[3][1], a.elem[3][2]}};
+    expect_v3_near(la_translationdq(da), t, 1e-5f);
+    expect_m4_near(la_dqtom4(la_rigiddq(la_m4toquat(a), t)), a, 1e-5f);
+
+    /* la_productdq(b, a) transforms by a and then by b. */
+    expect_m4_near(la_dqtom4(la_productdq(db, da)), la_productm4(a, b),
+                   1e-5f);
+
+    la_dualquat scaled = da;
+    for (int i = 0; i < 4; i++) {
+      scaled.real.elem[i] *= 3.0f;
+      scaled.dual.elem[i] *= 3.0f;
+    }
+    expect_m4_near(la_dqtom4(la_normalizedq(scaled)), a, 1e-5f);
+  }
+
+  std::vector<la_mat4> m;
+  for (unsigned int seed = 1; seed < 10; seed++) {
+    m.push_back(test_rigid(seed));
+  }
+  std::vector<la_dualquat> dq(m.size());
+  la_m4todq_batch(m.data(), dq.data(), m.size());
+  for (size_t i = 0; i < m.size(); i++) {
+    expect_m4_near(la_dqtom4(dq[i]), m[i], 1e-5f);
+  }
+}
+
+/* A skinned mesh of n vertices with 4 influences each from nbones bones. */
+struct skin_test {
+  size_t n;
+  std::vector<uint16_t> bones;
+  std::vector<float> weights;
+  std::vector<float> in[6];
+  std::vector<float> out[6];
+  la_skin_soa soa;
+
+  skin_test(size_t n, size_t nbones)
+      : n(n), bones(4 * n), weights(4 * n) {
+    for (int c = 0; c < 6; c++) {
+      in[c].resize(n);
+      out[c].resize(n);
+    }
+    for (size_t i = 0; i < n; i++) {
+      const la_vec3 p = test_vec3(i + 1);
+      const la_vec3 nrm = la_normalizev3(test_vec3(i + 1000));
+      for (int c = 0; c < 3; c++) {
+        in[c][i] = p.elem[c];
+        in[c + 3][i] = nrm.elem[c];
+      }
+      float sum = 0.0f;
+      for (size_t k = 0; k < 4; k++) {
+        bones[k * n + i] = (uint16_t)((i * 7 + k * 3) % nbones);
+        weights[k * n + i] = (float)(1 + (i * 5 + k * 3) % 7);
+        sum += weights[k * n + i];
+      }
+      for (size_t k = 0; k < 4; k++) {
+        weights[k * n + i] /= sum;
+      }
+    }
+    soa.n = n;
+    soa.influences = 4;
+    soa.bones = bones.data();
+    soa.weights = weights.data();
+    soa.x = in[0].data();
+    soa.y = in[1].data();
+    soa.z = in[2].data();
+    soa.nx = in[3].data();
+    soa.ny = in[4].data();
+    soa.nz = in[5].data();
+    soa.out_x = out[0].data();
+    soa.out_y = out[1].data();
+    soa.out_z = out[2].data();
+    soa.out_nx = out[3].data();
+    soa.out_ny = out[4].data();
+    soa.out_nz = out[5].data();
+  }
+
+  la_vec3 point(size_t i, int base) const {
+    const la_vec3 v = {.elem = {out[base][i], out[base + 1][i],
+                                out[base + 2][i]}};
+    return v;
+  }
+
+  la_vec3 input(size_t i, int base) const {
+    const la_vec3 v = {.elem = {in[base][i], in[base + 1][i],
+                                in[base + 2][i]}};
+    return v;
+  }
+};
+
+TEST(la_tests, la_skin_linear) {
+  std::vector<la_mat4> m;
+  for (unsigned int seed = 1; seed < 12; seed++) {
+    m.push_back(la_scale(test_rigid(seed), test_vec3(seed + 50)));
+  }
+  std::vector<la_mat3x4> palette(m.size());
+  la_m4tomat3x4_batch(m.data(), palette.data(), m.size());
+
+  for (size_t n : batch_sizes) {
+    skin_test t(n, m.size());
+    la_skin_linear(palette.data(), &t.soa);
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 ep = {.elem = {0.0f, 0.0f, 0.0f}};
+      la_vec3 en = ep;
+      for (size_t k = 0; k < 4; k++) {
+        const la_mat4 &b = m[t.bones[k * n + i]];
+        const float w = t.weights[k * n + i];
+        const la_vec3 p = la_transform_point_affine(b, t.input(i, 0));
+        const la_vec3 d = la_transform_dir_affine(b, t.input(i, 3));
+        for (int c = 0; c < 3; c++) {
+          ep.elem[c] += w * p.elem[c];
+          en.elem[c] += w * d.elem[c];
+        }
+      }
+      expect_v3_near(t.point(i, 0), ep, 1e-4f);
+      expect_v3_near(t.point(i, 3), en, 1e-4f);
+    }
+
+    /* In place, and positions only. */
+    std::vector<float> nx = t.out[3];
+    t.soa.out_x = t.in[0].data();
+    t.soa.out_y = t.in[1].data();
+    t.soa.out_z = t.in[2].data();
+    t.soa.nx = NULL;
+    t.out[3].assign(n, -7.0f);
+    la_skin_linear(palette.data(), &t.soa);
+    for (size_t i = 0; i < n; i++) {
+      EXPECT_EQ(t.input(i, 0).x, t.point(i, 0).x);
+      EXPECT_EQ(t.input(i, 0).z, t.point(i, 0).z);
+      EXPECT_EQ(t.out[3][i], -7.0f);
+    }
+  }
+
+  /* No influences, or weights that are all zero, pass the vertex through
+   * as with la_skin_dual_quat. */
+  for (size_t influences : {0, 4}) {
+    skin_test z(33, m.size());
+    z.soa.influences = influences;
+    std::fill(z.weights.begin(), z.weights.end(), 0.0f);
+    if (influences == 0) {
+      std::fill(z.bones.begin(), z.bones.end(), (uint16_t)0xffff);
+    }
+    la_skin_linear(palette.data(), &z.soa);
+    for (size_t i = 0; i < 33; i++) {
+      expect_v3_eq(z.point(i, 0), z.input(i, 0));
+      expect_v3_eq(z.point(i, 3), z.input(i, 3));
+    }
+  }
+}
+
+TEST(la_tests, la_skin_dual_quat) {
+  std::vector<la_mat4> m;
+  for (unsigned int seed = 1; seed < 12; seed++) {
+    m.push_back(test_rigid(seed));
+  }
+  std::vector<la_dualquat> palette(m.size());
+  la_m4todq_batch(m.data(), palette.data(), m.size());
+  /* The sign of a rotation must not matter. */
+  for (size_t b = 0; b < palette.size(); b += 2) {
+    for (int c = 0; c < 4; c++) {
+      palette[b].real.elem[c] = -palette[b].real.elem[c];
+      palette[b].dual.elem[c] = -palette[b].dual.elem[c];
+    }
+  }
+
+  for (size_t n : batch_sizes) {
+    skin_test t(n, m.size());
+    la_skin_dual_quat(palette.data(), &t.soa);
+    for (size_t i = 0; i < n; i++) {
+      const la_quat q0 = palette[t.bones[i]].real;
+      la_dualquat blend = {};
+      for (size_t k = 0; k < 4; k++) {
+        const la_dualquat &b = palette[t.bones[k * n + i]];
+        float w = t.weights[k * n + i];
+        w = la_dotv4(b.real, q0) < 0.0f ? -w : w;
+        for (int c = 0; c < 4; c++) {
+          blend.real.elem[c] += w * b.real.elem[c];
+          blend.dual.elem[c] += w * b.dual.elem[c];
+        }
+      }
+      blend = la_normalizedq(blend);
+      expect_v3_near(t.point(i, 0),
+                     la_transform_point_dq(blend, t.input(i, 0)), 1e-4f);
+      const la_vec3 en = la_productqv3(blend.real, t.input(i, 3));
+      expect_v3_near(t.point(i, 3), en, 1e-5f);
+      EXPECT_NEAR(la_dotv3(t.point(i, 3), t.point(i, 3)), 1.0f, 1e-5f);
+    }
+  }
+
+  /* A single influence reproduces the bone transform. */
+  skin_test t(33, m.size());
+  t.soa.influences = 1;
+  std::fill(t.weights.begin(), t.weights.begin() + 33, 1.0f);
+  la_skin_dual_quat(palette.data(), &t.soa);
+  for (size_t i = 0; i < 33; i++) {
+    expect_v3_near(t.point(i, 0),
+                   la_transform_point_affine(m[t.bones[i]], t.input(i, 0)),
+                   1e-4f);
+  }
+
+  /* No influences, or weights that are all zero, pass the vertex through.
+   * Without influences the bone indices are never read. */
+  for (size_t influences : {0, 4}) {
+    skin_test z(33, m.size());
+    z.soa.influences = influences;
+    std::fill(z.weights.begin(), z.weights.end(), 0.0f);
+    if (influences == 0) {
+      std::fill(z.bones.begin(), z.bones.end(), (uint16_t)0xffff);
+    }
+    la_skin_dual_quat(palette.data(), &z.soa);
+    for (size_t i = 0; i < 33; i++) {
+      expect_v3_eq(z.point(i, 0), z.input(i, 0));
+      expect_v3_eq(z.point(i, 3), z.input(i, 3));
+    }
+  }
+}
+
+#ifdef LA_PROFILE
+static uint64_t profile_calls(const char *name) {
+  std::vector<la_profile_entry> e(la_profile_dump(NULL, 0));
+  la_profile_dump(e.data(), e.size());
+  for (const la_profile_entry &entry : e) {
+    if (strcmp(entry.name, name) == 0) {
+      return entry.calls;
+    }
+  }
+  return 0;
+}
+#endif
+
+TEST(la_tests, la_profile) {
+  la_profile_reset();
+#ifdef LA_PROFILE
+  ASSERT_GT(la_profile_dump(NULL, 0), 0u);
+  const uint64_t before = profile_calls("la_look_at");
+  const la_vec3 eye = {.elem = {1.0f, 2.0f, 3.0f}};
+  const la_vec3 ctr = {.elem = {0.0f, 0.0f, 0.0f}};
+  const la_vec3 up = {.elem = {0.0f, 1.0f, 0.0f}};
+  for (int i = 0; i < 3; i++) {
+    la_look_at(eye, ctr, up);
+  }
+  std::thread worker([&] { la_look_at(eye, ctr, up); });
+  worker.join();
+  EXPECT_EQ(profile_calls("la_look_at"), before + 4);
+
+  la_profile_entry first;
+  EXPECT_EQ(la_profile_dump(&first, 1), la_profile_dump(NULL, 0));
+  la_profile_reset();
+  EXPECT_EQ(profile_calls("la_look_at"), 0u);
+#else
+  EXPECT_EQ(la_profile_dump(NULL, 0), 0u);
+#endif
+}
+
+template <typename T>
+static void append_bytes(std::vector<uint8_t> &out, const T *p, size_t n) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(p);
+  out.insert(out.end(), bytes, bytes + n * sizeof(T));
+}
+
+/* Runs every dispatched kernel on n elements at the current level and
+ * appends the raw outputs to out, except for the unit vectors of
+ * la_normalizev3_soa which go to unit: with LA_FAST_MATH they come from
+ * the reciprocal square root estimate of each level. */
+static void run_dispatched_kernels(size_t n, std::vector<uint8_t> &out,
+                                   std::vector<float> &unit) {
+  std::vector<la_mat4> a(n);
+  std::vector<la_mat4> b(n);
+  std::vector<la_mat4> ab(n);
+  std::vector<la_vec4> v(n);
+  std::vector<la_vec4> mv(n);
+  std::vector<float> in[4];
+  std::vector<float> res[4];
+  std::vector<float> ctr[3];
+  std::vector<float> ext[3];
+  for (size_t i = 0; i < n; i++) {
+    a[i] = test_matrix(i + 1);
+    b[i] = test_matrix(i + 777);
+    const la_vec3 p = test_vec3(i + 1);
+    v[i] = la_vec4{.elem = {p.x, p.y, p.z, 1.0f - p.x}};
+    for (int k = 0; k < 4; k++) {
+      in[k].push_back(v[i].elem[k] * 3.0f);
+      res[k].push_back(0.0f);
+    }
+    /* Bounds of which about a fifth is in the frustum. */
+    const la_vec3 e = test_vec3(i + 555);
+    for (int k = 0; k < 3; k++) {
+      ctr[k].push_back(p.elem[k] * 0.5f);
+      ext[k].push_back(e.elem[k] / 8.0f);
+    }
+  }
+  const la_mat4 m = test_matrix(42);
+  la_productm4_batch(a.data(), b.data(), ab.data(), n);
+  la_transform_points_v4_aos(&m, v.data(), mv.data(), n);
+  append_bytes(out, ab.data(), n);
+  append_bytes(out, mv.data(), n);
+
+  la_transform_points_v4(&m, in[0].data(), in[1].data(), in[2].data(),
+                         in[3].data(), res[0].data(), res[1].data(),
+                         res[2].data(), res[3].data(), n);
+  for (int k = 0; k < 4; k++) {
+    append_bytes(out, res[k].data(), n);
+  }
+  la_normalizev3_soa(in[0].data(), in[1].data(), in[2].data(), res[0].data(),
+                     res[1].data(), res[2].data(), n);
+  for (int k = 0; k < 3; k++) {
+    unit.insert(unit.end(), res[k].begin(), res[k].end());
+  }
+
+  const la_mat4 proj = la_perspective(la_radians(60.0f), 1.5f, 0.5f, 5.0f);
+  const la_frustum f = la_frustum_from_m4(proj);
+  std::vector<uint32_t> mask((n + 31) / 32);
+  la_frustum_cull_spheres(&f, ctr[0].data(), ctr[1].data(), ctr[2].data(),
+                          ext[0].data(), n, mask.data());
+  append_bytes(out, mask.data(), mask.size());
+  la_frustum_cull_aabbs(&f, ctr[0].data(), ctr[1].data(), ctr[2].data(),
+                        ext[0].data(), ext[1].data(), ext[2].data(), n,
+                        mask.data());
+  append_bytes(out, mask.data(), mask.size());
+}
+
+TEST(la_tests, la_simd_dispatch) {
+  const la_simd_level saved = la_get_simd_level();
+  const la_simd_level max = la_simd_max_level();
+  EXPECT_LE(saved, max);
+  const char *env = getenv("LA_SIMD");
+  if (env != NULL && strcmp(env, "baseline") == 0) {
+    EXPECT_EQ(saved, LA_SIMD_BASELINE);
+  } else if (env != NULL && strcmp(env, "avx2") == 0) {
+    EXPECT_EQ(saved, std::min(max, LA_SIMD_AVX2));
+  } else {
+    EXPECT_EQ(saved, max);
+  }
+  EXPECT_EQ(la_set_simd_level((la_simd_level)(max + 1)), 0);
+
+  for (size_t n : batch_sizes) {
+    ASSERT_EQ(la_set_simd_level(LA_SIMD_BASELINE), 1);
+    std::vector<uint8_t> expected;
+    std::vector<float> expected_unit;
+    run_dispatched_kernels(n, expected, expected_unit);
+    for (int level = LA_SIMD_AVX2; level <= max; level++) {
+      SCOPED_TRACE(level);
+      ASSERT_EQ(la_set_simd_level((la_simd_level)level), 1);
+      EXPECT_EQ(la_get_simd_level(), level);
+      std::vector<uint8_t> got;
+      std::vector<float> got_unit;
+      run_dispatched_kernels(n, got, got_unit);
+      EXPECT_TRUE(got == expected);
+      ASSERT_EQ(got_unit.size(), expected_unit.size());
+#ifdef LA_FAST_MATH
+      for (size_t i = 0; i < got_unit.size(); i++) {
+        EXPECT_NEAR(got_unit[i], expected_unit[i], 1e-6f) << i;
+      }
+#else
+      EXPECT_TRUE(got_unit == expected_unit);
+#endif
+    }
+  }
+  la_set_simd_level(saved);
+}
+
+TEST(la_tests, la_mat2) {
+  la_mat2 a = {{{1.0f, 2.0f}, {3.0f, 4.0f}}};
+  la_mat2 b = {{{-2.0f, 0.5f}, {1.5f, 3.0f}}};
+  la_mat2 ab = la_productm2(a, b);
+  EXPECT_FLOAT_EQ(ab.elem[0][0], 1.0f);
+  EXPECT_FLOAT_EQ(ab.elem[0][1], 6.5f);
+  EXPECT_FLOAT_EQ(ab.elem[1][0], 0.0f);
+  EXPECT_FLOAT_EQ(ab.elem[1][1], 13.5f);
+
+  la_vec2 v = {.elem = {5.0f, -1.0f}};
+  la_vec2 av = la_productm2v2(a, v);
+  EXPECT_FLOAT_EQ(av.x, 3.0f);
+  EXPECT_FLOAT_EQ(av.y, 11.0f);
+
+  la_mat2 t = la_transposem2(a);
+  EXPECT_FLOAT_EQ(t.elem[0][1], 3.0f);
+  EXPECT_FLOAT_EQ(t.elem[1][0], 2.0f);
+  EXPECT_FLOAT_EQ(la_determinantm2(a), -2.0f);
+
+  int invertible = 0;
+  la_mat2 i = la_productm2(a, la_inversem2(a, &invertible));
+  EXPECT_EQ(invertible, 1);
+  for (int r = 0; r < 2; r++) {
+    for (int c = 0; c < 2; c++) {
+      EXPECT_NEAR(i.elem[r][c], r == c ? 1.0f : 0.0f, 1e-6f);
+    }
+  }
+
+  la_mat2 singular = {{{1.0f, 2.0f}, {2.0f, 4.0f}}};
+  la_mat2 inv = la_inversem2(singular, &invertible);
+  EXPECT_EQ(invertible, 0);
+  const la_mat2 id = la_identitym2();
+  EXPECT_EQ(memcmp(&inv, &id, sizeof(inv)), 0);
+}
+
+TEST(la_tests, la_mat3) {
+  for (unsigned int seed = 1; seed < 20; seed++) {
+    SCOPED_TRACE(seed);
+    const la_mat4 m4 = test_matrix(seed);
+    const la_mat4 n4 = test_matrix(seed + 100);
+    const la_mat3 m = la_m4tom3(m4);
+    const la_mat3 n = la_m4tom3(n4);
+
+    /* The 3x3 functions agree with their la_mat4 versions on matrices
+     * without translation and projection. */
+    const la_mat4 mm = la_m3tom4(m);
+    const la_mat4 nn = la_m3tom4(n);
+    expect_m4_near(la_m3tom4(la_productm3(m, n)), la_productm4(mm, nn), 1e-4f);
+    expect_m4_eq(la_m3tom4(la_transposem3(m)), la_transposem4(mm));
+    EXPECT_NEAR(la_determinantm3(m), la_determinantm4(mm), 1e-3f);
+
+    la_vec3 v = test_vec3(seed);
+    la_vec4 v4 = {.elem = {v.x, v.y, v.z, 0.0f}};
+    la_vec3 mv = la_productm3v3(m, v);
+    la_vec4 mv4 = la_productm4v4(mm, v4);
+    expect_v3_near(mv, {.elem = {mv4.x, mv4.y, mv4.z}}, 1e-4f);
+
+    int invertible = 0;
+    const la_mat3 inv = la_inversem3(m, &invertible);
+    EXPECT_EQ(invertible, 1);
+    expect_m4_near(la_m3tom4(la_productm3(m, inv)), la_identitym4(), 1e-4f);
+  }
+
+  la_mat3 singular = {{{1.0f, 2.0f, 3.0f}, {2.0f, 4.0f, 6.0f},
+                       {0.0f, 1.0f, 0.0f}}};
+  int invertible = 1;
+  la_mat3 inv = la_inversem3(singular, &invertible);
+  EXPECT_EQ(invertible, 0);
+  expect_m4_eq(la_m3tom4(inv), la_identitym4());
+}
+
+TEST(la_tests, la_normal_matrix) {
+  /* A non-uniform scale, a rotation and a translation: the transformed
+   * normal stays perpendicular to the transformed tangents. */
+  la_vec3 axis = {.elem = {0.2f, 1.0f, -0.4f}};
+  la_mat4 m = la_scale(la_identitym4(), {.elem = {3.0f, 0.5f, 1.5f}});
+  m = la_productm4(m, la_rotate(la_identitym4(), axis, 0.9f));
+  m = la_productm4(m, la_translate(la_identitym4(), {.elem = {4, -2, 1}}));
+
+  int invertible = 0;
+  const la_mat3 nm = la_normal_matrix(m, &invertible);
+  EXPECT_EQ(invertible, 1);
+  const la_mat3 m3 = la_m4tom3(m);
+  const la_vec3 normal = la_normalizev3({.elem = {1.0f, 2.0f, -0.5f}});
+  const la_vec3 t1 = la_crossv3(normal, {.elem = {0.0f, 0.0f, 1.0f}});
+  const la_vec3 t2 = la_crossv3(normal, t1);
+  const la_vec3 n = la_normalizev3(la_productm3v3(nm, normal));
+  EXPECT_NEAR(la_dotv3(n, la_normalizev3(la_productm3v3(m3, t1))), 0.0f,
+              1e-5f);
+  EXPECT_NEAR(la_dotv3(n, la_normalizev3(la_productm3v3(m3, t2))), 0.0f,
+              1e-5f);
+
+  /* For a rotation the normal matrix is the rotation. */
+  const la_mat4 r = la_rotate(la_identitym4(), axis, 0.9f);
+  expect_m4_near(la_m3tom4(la_normal_matrix(r, NULL)), la_m3tom4(la_m4tom3(r)),
+                 1e-5f);
+
+  la_mat4 flat = la_scale(la_identitym4(), {.elem = {1.0f, 0.0f, 1.0f}});
+  expect_m4_eq(la_m3tom4(la_normal_matrix(flat, &invertible)),
+               la_identitym4());
+  EXPECT_EQ(invertible, 0);
+}
+
+/* Fills rows x cols floats with a row stride of ld, and the padding with
+ * NaN so that reading it would show up in the product. */
+static std::vector<float> test_matrix_mn(size_t rows, size_t cols, size_t ld,
+                                         unsigned int seed) {
+  std::vector<float> m(rows * ld, NAN);
+  for (size_t i = 0; i < rows; i++) {
+    for (size_t j = 0; j < cols; j++) {
+      seed = seed * 1664525u + 1013904223u;
+      m[i * ld + j] = ((seed >> 8) / 16777216.0f) * 2.0f - 1.0f;
+    }
+  }
+  return m;
+}
+
+TEST(la_tests, la_productmn) {
+  const la_mat4 a4 = test_matrix(1);
+  const la_mat4 b4 = test_matrix(2);
+  la_mat4 c4;
+  la_productmn(&a4.elem[0][0], 4, &b4.elem[0][0], 4, &c4.elem[0][0], 4, 4, 4,
+               4);
+  expect_m4_eq(c4, la_productm4_scalar(a4, b4));
+
+  /* Sizes around the vector width, the row panel and the 64 wide tiles,
+   * with padded strides. */
+  const size_t dims[][3] = {{1, 1, 1},    {2, 3, 5},    {6, 6, 6},
+                            {7, 9, 17},   {16, 16, 16}, {33, 65, 31},
+                            {64, 64, 64}, {65, 130, 67}};
+  for (const auto &d : dims) {
+    const size_t m = d[0], n = d[1], p = d[2];
+    SCOPED_TRACE(testing::Message() << m << "x" << n << "x" << p);
+    const size_t lda = n + 3, ldb = p + 1, ldc = p + 2;
+    std::vector<float> a = test_matrix_mn(m, n, lda, (unsigned int)(m + n));
+    std::vector<float> b = test_matrix_mn(n, p, ldb, (unsigned int)(n * p));
+    std::vector<float> c(m * ldc, -1.0f);
+    la_productmn(a.data(), lda, b.data(), ldb, c.data(), ldc, m, n, p);
+
+    for (size_t i = 0; i < m; i++) {
+      for (size_t k = 0; k < p; k++) {
+        double ref = 0.0;
+        for (size_t j = 0; j < n; j++) {
+          ref += (double)a[i * lda + j] * b[j * ldb + k];
+        }
+        ASSERT_NEAR(c[i * ldc + k], ref, 1e-4) << i << ", " << k;
+      }
+      for (size_t k = p; k < ldc; k++) {
+        ASSERT_EQ(c[i * ldc + k], -1.0f);
+      }
+    }
+
+    std::vector<float> v = test_matrix_mn(1, n, n, (unsigned int)p);
+    std::vector<float> out(m);
+    la_productmnvn(a.data(), lda, v.data(), out.data(), m, n);
+    for (size_t i = 0; i < m; i++) {
+      EXPECT_FLOAT_EQ(out[i], la_dotvn(&a[i * lda], v.data(), n));
+    }
+  }
+
+  la_vec4 v4 = {.elem = {1.0f, -2.0f, 0.5f, 3.0f}};
+  la_vec4 r4;
+  la_productmnvn(&a4.elem[0][0], 4, v4.elem, r4.elem, 4, 4);
+  expect_v4_eq(r4, la_productm4v4_scalar(a4, v4));
+}
+
+/* A file name of its own for each test, and each ctest run of the tests. */
+static std::string test_path(const char *name) {
+  const char *level = getenv("LA_SIMD");
+  return testing::TempDir() + "la_" + name + "_" + (level ? level : "") +
+         ".bin";
+}
+
+static std::vector<la_mat4> test_matrices(size_t n) {
+  std::vector<la_mat4> m(n);
+  for (size_t i = 0; i < n; i++) {
+    m[i] = test_matrix((unsigned int)i);
+  }
+  return m;
+}
+
+TEST(la_tests, la_bin_arrays) {
+  const std::string path = test_path("bin_arrays");
+  const std::vector<la_mat4> mats = test_matrices(301);
+  std::vector<la_vec4> points(2501);
+  for (size_t i = 0; i < points.size(); i++) {
+    points[i] = la_productm4v4(mats[i % mats.size()],
+                               {.elem = {1.0f, 2.0f, 3.0f, 1.0f}});
+  }
+
+  la_bin_writer *w = la_bin_writer_open(path.c_str());
+  ASSERT_NE(w, nullptr);
+  /* Streamed in uneven pieces, including an empty one. */
+  ASSERT_EQ(la_bin_begin(w, "mats", LA_BIN_MAT4, LA_BIN_AOS, mats.size(),
+                         NULL, NULL),
+            1);
+  EXPECT_EQ(la_bin_write(w, mats.data(), 100), 1);
+  EXPECT_EQ(la_bin_write(w, mats.data() + 100, 0), 1);
+  EXPECT_EQ(la_bin_write(w, mats.data() + 100, 201), 1);
+  EXPECT_EQ(la_bin_end(w), 1);
+  ASSERT_EQ(la_bin_begin(w, "points", LA_BIN_VEC4, LA_BIN_SOA, points.size(),
+                         NULL, NULL),
+            1);
+  for (size_t i = 0; i < points.size(); i += 1000) {
+    const size_t n = std::min<size_t>(1000, points.size() - i);
+    EXPECT_EQ(la_bin_write(w, &points[i], n), 1);
+  }
+  EXPECT_EQ(la_bin_end(w), 1);
+  EXPECT_EQ(la_bin_write_array(w, "quantized", LA_BIN_MAT4, LA_BIN_Q16,
+                               mats.data(), mats.size()),
+            1);
+  EXPECT_EQ(la_bin_write_array(w, "empty", LA_BIN_FLOAT, LA_BIN_SOA, NULL, 0),
+            1);
+  ASSERT_EQ(la_bin_writer_close(w), 1);
+
+  la_bin *b = la_bin_open(path.c_str());
+  ASSERT_NE(b, nullptr);
+  ASSERT_EQ(la_bin_count(b), 4u);
+  EXPECT_STREQ(la_bin_entry_at(b, 2)->name, "quantized");
+  EXPECT_EQ(la_bin_entry_at(b, 4), nullptr);
+  EXPECT_EQ(la_bin_find(b, "missing"), nullptr);
+
+  /* AoS data is used in place. */
+  const la_bin_entry *e = la_bin_find(b, "mats");
+  ASSERT_NE(e, nullptr);
+  EXPECT_EQ(e->type, (uint32_t)LA_BIN_MAT4);
+  EXPECT_EQ(e->count, mats.size());
+  const la_mat4 *m = (const la_mat4 *)la_bin_data(b, e);
+  EXPECT_EQ((uintptr_t)m % LA_CACHE_LINE, 0u);
+  EXPECT_EQ(memcmp(m, mats.data(), mats.size() * sizeof(la_mat4)), 0);
+  EXPECT_EQ(la_bin_stream(b, e, 0), nullptr);
+
+  /* So are SoA streams, e.g. by la_transform_points_v4. */
+  e = la_bin_find(b, "points");
+  ASSERT_NE(e, nullptr);
+  const float *s[4];
+  for (size_t c = 0; c < 4; c++) {
+    s[c] = la_bin_stream(b, e, c);
+    ASSERT_NE(s[c], nullptr);
+    EXPECT_EQ((uintptr_t)s[c] % LA_CACHE_LINE, 0u);
+  }
+  EXPECT_EQ(la_bin_stream(b, e, 4), nullptr);
+  EXPECT_EQ(la_bin_data(b, e), (const void *)s[0]);
+  const size_t n = points.size();
+  std::vector<float> out(4 * n);
+  const la_mat4 t = test_matrix(7);
+  la_transform_points_v4(&t, s[0], s[1], s[2], s[3], &out[0], &out[n],
+                         &out[2 * n], &out[3 * n], n);
+  for (size_t i = 0; i < n; i += 97) {
+    const la_vec4 ref = la_productm4v4(t, points[i]);
+    for (size_t c = 0; c < 4; c++) {
+      EXPECT_FLOAT_EQ(out[c * n + i], ref.elem[c]) << i;
+    }
+  }
+  std::vector<la_vec4> read(10);
+  ASSERT_EQ(la_bin_read(b, e, 2490, 10, read.data()), 1);
+  EXPECT_EQ(memcmp(read.data(), &points[2490], 10 * sizeof(la_vec4)), 0);
+  EXPECT_EQ(la_bin_read(b, e, 2490, 12, read.data()), 0);
+
+  /* Quantized components are within half a step of their range. */
+  e = la_bin_find(b, "quantized");
+  ASSERT_NE(e, nullptr);
+  EXPECT_EQ(e->layout, (uint32_t)LA_BIN_Q16);
+  EXPECT_EQ(e->size, 32 * sizeof(float) + mats.size() * sizeof(la_mat4) / 2);
+  std::vector<la_mat4> q(mats.size());
+  ASSERT_EQ(la_bin_read(b, e, 0, q.size(), q.data()), 1);
+  for (int c = 0; c < 16; c++) {
+    float lo = INFINITY, hi = -INFINITY;
+    for (const la_mat4 &a : mats) {
+      lo = std::min(lo, a.elem[c / 4][c % 4]);
+      hi = std::max(hi, a.elem[c / 4][c % 4]);
+    }
+    const float bound = (hi - lo) / 131070.0f * 1.01f;
+    for (size_t i = 0; i < mats.size(); i++) {
+      ASSERT_NEAR(q[i].elem[c / 4][c % 4], mats[i].elem[c / 4][c % 4], bound)
+          << i << ", " << c;
+    }
+  }
+
+  e = la_bin_find(b, "empty");
+  ASSERT_NE(e, nullptr);
+  EXPECT_EQ(e->count, 0u);
+  EXPECT_EQ(la_bin_read(b, e, 0, 0, NULL), 1);
+  la_bin_close(b);
+  remove(path.c_str());
+}
+
+static std::vector<char> read_file(const std::string &path) {
+  std::vector<char> bytes;
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f != NULL) {
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+      bytes.insert(bytes.end(), buf, buf + n);
+    }
+    fclose(f);
+  }
+  return bytes;
+}
+
+static void write_file(const std::string &path, const std::vector<char> &b) {
+  FILE *f = fopen(path.c_str(), "wb");
+  ASSERT_NE(f, nullptr);
+  ASSERT_EQ(fwrite(b.data(), 1, b.size(), f), b.size());
+  fclose(f);
+}
+
+TEST(la_tests, la_bin_errors) {
+  const std::string path = test_path("bin_errors");
+  const std::vector<la_mat4> mats = test_matrices(4);
+  EXPECT_EQ(la_bin_writer_open("/nonexistent/dir/la.bin"), nullptr);
+  EXPECT_EQ(la_bin_open("/nonexistent/dir/la.bin"), nullptr);
+
+  /* Misuse fails the call and the whole file. */
+  la_bin_writer *w = la_bin_writer_open(path.c_str());
+  ASSERT_NE(w, nullptr);
+  EXPECT_EQ(la_bin_write(w, mats.data(), 1), 0);
+  EXPECT_EQ(la_bin_writer_close(w), 0);
+
+  const struct {
+    const char *name;
+    la_bin_type type;
+    la_bin_layout layout;
+  } bad[] = {{"a name that is too long to be stored", LA_BIN_MAT4, LA_BIN_AOS},
+             {"type", (la_bin_type)0, LA_BIN_AOS},
+             {"layout", LA_BIN_MAT4, (la_bin_layout)3},
+             {"range", LA_BIN_MAT4, LA_BIN_Q16}};
+  for (const auto &a : bad) {
+    SCOPED_TRACE(a.name);
+    w = la_bin_writer_open(path.c_str());
+    ASSERT_NE(w, nullptr);
+    EXPECT_EQ(la_bin_begin(w, a.name, a.type, a.layout, 4, NULL, NULL), 0);
+    EXPECT_EQ(la_bin_writer_close(w), 0);
+  }
+
+  w = la_bin_writer_open(path.c_str());
+  ASSERT_EQ(la_bin_begin(w, "mats", LA_BIN_MAT4, LA_BIN_AOS, 4, NULL, NULL),
+            1);
+  EXPECT_EQ(la_bin_write(w, mats.data(), 3), 1);
+  EXPECT_EQ(la_bin_end(w), 0);
+  EXPECT_EQ(la_bin_writer_close(w), 0);
+
+  w = la_bin_writer_open(path.c_str());
+  ASSERT_EQ(la_bin_begin(w, "mats", LA_BIN_MAT4, LA_BIN_SOA, 3, NULL, NULL),
+            1);
+  EXPECT_EQ(la_bin_write(w, mats.data(), 4), 0);
+  EXPECT_EQ(la_bin_writer_close(w), 0);
+
+  /* Truncated or foreign files are rejected. */
+  w = la_bin_writer_open(path.c_str());
+  ASSERT_EQ(la_bin_write_array(w, "mats", LA_BIN_MAT4, LA_BIN_AOS,
+                               mats.data(), mats.size()),
+            1);
+  ASSERT_EQ(la_bin_writer_close(w), 1);
+  const std::vector<char> good = read_file(path);
+  la_bin *b = la_bin_open(path.c_str());
+  ASSERT_NE(b, nullptr);
+  la_bin_close(b);
+
+  std::vector<char> bytes(good.begin(), good.end() - 1);
+  write_file(path, bytes);
+  EXPECT_EQ(la_bin_open(path.c_str()), nullptr);
+
+  const size_t corrupt[] = {0, 8, 12};  // Magic, version, byte order.
+  for (size_t at : corrupt) {
+    SCOPED_TRACE(at);
+    bytes = good;
+    bytes[at] ^= 0x40;
+    write_file(path, bytes);
+    EXPECT_EQ(la_bin_open(path.c_str()), nullptr);
+  }
+
+  /* The entry's offset and size, in the directory at the end of the file. */
+  for (size_t at : {48, 56}) {
+    SCOPED_TRACE(at);
+    bytes = good;
+    bytes[bytes.size() - sizeof(la_bin_entry) + at] ^= 0x40;
+    write_file(path, bytes);
+    EXPECT_EQ(la_bin_open(path.c_str()), nullptr);
+  }
+  remove(path.c_str());
+}
+
+TEST(la_tests, la_ray_tests) {
+  la_ray r = {.origin = {.elem = {0.25f, 0.25f, 0.0f}},
+              .dir = {.elem = {0.0f, 0.0f, -1.0f}},
+              .tmin = 0.0f,
+              .tmax = 100.0f};
+  la_vec3 tri[3] = {{.elem = {0.0f, 0.0f, -5.0f}},
+                    {.elem = {1.0f, 0.0f, -5.0f}},
+                    {.elem = {0.0f, 1.0f, -5.0f}}};
+  float t = 0.0f;
+  la_vec2 uv;
+  EXPECT_TRUE(la_ray_test_triangle(&r, tri, &t, &uv));
+  EXPECT_FLOAT_EQ(t, 5.0f);
+  EXPECT_FLOAT_EQ(uv.x, 0.25f);
+  EXPECT_FLOAT_EQ(uv.y, 0.25f);
+  r.tmax = 4.0f;
+  EXPECT_FALSE(la_ray_test_triangle(&r, tri, NULL, NULL));
+  r.tmax = 100.0f;
+  r.origin.x = 0.8f;
+  EXPECT_FALSE(la_ray_test_triangle(&r, tri, NULL, NULL));
+
+  la_vec3 min = {.elem = {0.0f, 0.0f, -3.0f}};
+  la_vec3 max = {.elem = {1.0f, 1.0f, -2.0f}};
+  EXPECT_TRUE(la_ray_test_aabb(&r, min, max, &t));
+  EXPECT_FLOAT_EQ(t, 2.0f);
+  r.origin.z = -2.5f;
+  EXPECT_TRUE(la_ray_test_aabb(&r, min, max, &t));
+  EXPECT_FLOAT_EQ(t, 0.0f);
+  r.origin.z = -4.0f;
+  EXPECT_FALSE(la_ray_test_aabb(&r, min, max, &t));
+  r.origin.z = 0.0f;
+  r.origin.x = 1.5f;
+  EXPECT_FALSE(la_ray_test_aabb(&r, min, max, &t));
+
+  la_vec3 c = {.elem = {0.0f, 0.0f, -10.0f}};
+  r.origin.x = 0.0f;
+  r.origin.y = 0.0f;
+  EXPECT_TRUE(la_ray_test_sphere(&r, c, 2.0f, &t));
+  EXPECT_FLOAT_EQ(t, 8.0f);
+  r.origin.z = -10.0f;
+  EXPECT_TRUE(la_ray_test_sphere(&r, c, 2.0f, &t));
+  EXPECT_FLOAT_EQ(t, 2.0f);
+  r.origin.z = -13.0f;
+  EXPECT_FALSE(la_ray_test_sphere(&r, c, 2.0f, &t));
+  r.origin.z = 0.0f;
+  r.origin.x = 2.5f;
+  EXPECT_FALSE(la_ray_test_sphere(&r, c, 2.0f, &t));
+}
+
+/* A ray from around the scene towards near a point of it. */
+static la_ray test_ray(unsigned int seed, la_vec3 at) {
+  la_vec3 o = test_vec3(seed * 7919u);
+  la_vec3 q = test_vec3(seed * 7919u + 1);
+  la_ray r;
+  for (int k = 0; k < 3; k++) {
+    r.origin.elem[k] = o.elem[k] * 4.0f;
+    r.dir.elem[k] = at.elem[k] + q.elem[k] * 0.0625f - r.origin.elem[k];
+  }
+  r.dir = la_normalizev3(r.dir);
+  r.tmin = 0.0f;
+  r.tmax = 100.0f;
+  return r;
+}
+
+/* Checks a packet against the single ray tests: test(r, i, &t, &uv) tests
+ * ray r against primitive i. In LA_RAY_ANY mode a lane keeps the first
+ * primitive it hits. */
+template <typename F>
+static void check_ray_packet(la_ray_packet *p, const la_ray *rays,
+                             uint32_t active, size_t n, la_ray_mode mode,
+                             uint32_t hits, F test) {
+  uint32_t expected = 0;
+  for (size_t l = 0; l < LA_RAY_PACKET; l++) {
+    la_ray r = rays[l];
+    int32_t prim = -1;
+    int32_t first = -1;
+    float first_t = 0.0f;
+    la_vec2 uv = {.elem = {0.0f, 0.0f}};
+    for (size_t i = 0; (active >> l) & 1 && i < n; i++) {
+      float t;
+      la_vec2 tuv = {.elem = {0.0f, 0.0f}};
+      if (test(&r, i, &t, &tuv)) {
+        r.tmax = t;
+        prim = (int32_t)i;
+        uv = tuv;
+        if (first < 0) {
+          first = prim;
+          first_t = t;
+        }
+      }
+    }
+    if (mode == LA_RAY_NEAREST || prim < 0) {
+      EXPECT_EQ(p->prim[l], prim) << l;
+    }
+    if (prim < 0) {
+      continue;
+    }
+    expected |= 1u << l;
+    if (mode == LA_RAY_NEAREST) {
+      EXPECT_NEAR(p->t[l], r.tmax, 1e-4f) << l;
+      EXPECT_NEAR(p->u[l], uv.x, 1e-4f) << l;
+      EXPECT_NEAR(p->v[l], uv.y, 1e-4f) << l;
+    } else {
+      EXPECT_EQ(p->prim[l], first) << l;
+      EXPECT_NEAR(p->t[l], first_t, 1e-4f) << l;
+      EXPECT_GE(p->t[l], r.tmax - 1e-4f) << l;
+    }
+  }
+  EXPECT_EQ(hits, expected);
+}
+
+TEST(la_tests, la_ray_packet) {
+  const size_t n = 37;
+  std::vector<la_vec3> tris(3 * n), min(n), max(n);
+  std::vector<la_vec4> spheres(n);
+  for (size_t i = 0; i < n; i++) {
+    la_vec3 c = test_vec3(i * 7919u + 1000);
+    la_vec3 e = test_vec3(i * 7919u + 2000);
+    for (int v = 0; v < 3; v++) {
+      la_vec3 d = test_vec3((i * 3 + v) * 7919u + 3000);
+      for (int k = 0; k < 3; k++) {
+        tris[i * 3 + v].elem[k] = c.elem[k] + d.elem[k] * 0.25f;
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      min[i].elem[k] = c.elem[k] - fabsf(e.elem[k]) * 0.125f;
+      max[i].elem[k] = c.elem[k] + fabsf(e.elem[k]) * 0.125f;
+      spheres[i].elem[k] = c.elem[k];
+    }
+    spheres[i].w = fabsf(e.x) * 0.125f + 0.1f;
+  }
+
+  auto test_triangle = [&](const la_ray *r, size_t i, float *t, la_vec2 *uv) {
+    return la_ray_test_triangle(r, &tris[i * 3], t, uv);
+  };
+  auto test_aabb = [&](const la_ray *r, size_t i, float *t, la_vec2 *) {
+    return la_ray_test_aabb(r, min[i], max[i], t);
+  };
+  auto test_sphere = [&](const la_ray *r, size_t i, float *t, la_vec2 *) {
+    la_vec3 c = {.elem = {spheres[i].x, spheres[i].y, spheres[i].z}};
+    return la_ray_test_sphere(r, c, spheres[i].w, t);
+  };
+
+  /* Hit lanes of the nearest queries, to check that the scene is neither
+   * empty nor in the way of every ray. */
+  int hit_lanes[3] = {0, 0, 0};
+  int active_lanes = 0;
+  for (unsigned int seed = 1; seed < 400; seed += LA_RAY_PACKET) {
+    la_ray rays[LA_RAY_PACKET];
+    la_ray_packet p;
+    /* One lane in three is left inactive. */
+    uint32_t active = 0;
+    la_ray_packet_clear(&p);
+    for (size_t l = 0; l < LA_RAY_PACKET; l++) {
+      la_vec4 s = spheres[(seed + l) % n];
+      la_vec3 at = {.elem = {s.x, s.y, s.z}};
+      rays[l] = test_ray(seed + l, at);
+      if ((seed + l) % 3 != 0) {
+        la_ray_packet_set(&p, l, &rays[l]);
+        active |= 1u << l;
+      }
+    }
+    const la_ray_packet cleared = p;
+    active_lanes += __builtin_popcount(active);
+    for (la_ray_mode mode : {LA_RAY_NEAREST, LA_RAY_ANY}) {
+      p = cleared;
+      uint32_t hits = la_ray_packet_triangles(&p, tris.data(), n, mode);
+      check_ray_packet(&p, rays, active, n, mode, hits, test_triangle);
+      hit_lanes[0] += mode == LA_RAY_NEAREST ? __builtin_popcount(hits) : 0;
+      p = cleared;
+      hits = la_ray_packet_aabbs(&p, min.data(), max.data(), n, mode);
+      check_ray_packet(&p, rays, active, n, mode, hits, test_aabb);
+      hit_lanes[1] += mode == LA_RAY_NEAREST ? __builtin_popcount(hits) : 0;
+      p = cleared;
+      hits = la_ray_packet_spheres(&p, spheres.data(), n, mode);
+      check_ray_packet(&p, rays, active, n, mode, hits, test_sphere);
+      hit_lanes[2] += mode == LA_RAY_NEAREST ? __builtin_popcount(hits) : 0;
+    }
+
+    /* The nearest hits are kept, so a second pass sets nothing. */
+    p = cleared;
+    la_ray_packet_spheres(&p, spheres.data(), n, LA_RAY_NEAREST);
+    EXPECT_EQ(la_ray_packet_spheres(&p, spheres.data(), n, LA_RAY_NEAREST),
+              0u);
+    EXPECT_EQ(la_ray_packet_spheres(&p, spheres.data(), n, LA_RAY_ANY), 0u);
+  }
+  for (int k = 0; k < 3; k++) {
+    EXPECT_GT(hit_lanes[k], active_lanes / 8) << k;
+    EXPECT_LT(hit_lanes[k], active_lanes) << k;
+  }
+
+  la_ray_packet p;
+  la_ray_packet_clear(&p);
+  EXPECT_EQ(la_ray_packet_spheres(&p, spheres.data(), n, LA_RAY_NEAREST), 0u);
+  la_vec3 at = {.elem = {spheres[0].x, spheres[0].y, spheres[0].z}};
+  la_ray r = test_ray(1, at);
+  la_ray_packet_set(&p, 3, &r);
+  EXPECT_EQ(la_ray_packet_spheres(&p, spheres.data(), 0, LA_RAY_NEAREST), 0u);
+  EXPECT_EQ(p.prim[3], -1);
+  EXPECT_EQ(p.t[3], r.tmax);
+
+  /* A lane that already has a hit is skipped in LA_RAY_ANY mode, also when
+   * a primitive is closer. The other lanes are as in a fresh query. */
+  la_ray rays[LA_RAY_PACKET];
+  for (size_t l = 0; l < LA_RAY_PACKET; l++) {
+    rays[l] = test_ray(l + 1, at);
+    la_ray_packet_set(&p, l, &rays[l]);
+  }
+  p.prim[0] = 42;
+  p.t[0] = 50.0f;
+  la_ray_packet fresh = p;
+  fresh.prim[0] = -1;
+  fresh.t[0] = rays[0].tmax;
+  const uint32_t fresh_hits =
+      la_ray_packet_spheres(&fresh, spheres.data(), 1, LA_RAY_ANY);
+  ASSERT_TRUE(fresh_hits & 1u);
+  ASSERT_LT(fresh.t[0], 50.0f);
+  const uint32_t hits = la_ray_packet_spheres(&p, spheres.data(), 1,
+                                              LA_RAY_ANY);
+  EXPECT_EQ(hits, fresh_hits & ~1u);
+  EXPECT_EQ(p.prim[0], 42);
+  EXPECT_EQ(p.t[0], 50.0f);
+  for (size_t l = 1; l < LA_RAY_PACKET; l++) {
+    EXPECT_EQ(p.prim[l], fresh.prim[l]) << l;
+    EXPECT_EQ(p.t[l], fresh.t[l]) << l;
+  }
+  check_ray_packet(&fresh, rays, 0xffu, 1, LA_RAY_ANY, fresh_hits,
+                   test_sphere);
+}
+
+TEST(la_tests, la_pick_ray) {
+  la_vec3 eye = {.elem = {1.0f, 2.0f, 10.0f}};
+  la_vec3 ctr = {.elem = {0.0f, 0.0f, 0.0f}};
+  la_vec3 up = {.elem = {0.0f, 1.0f, 0.0f}};
+  la_mat4 proj = la_perspective(la_radians(60.0f), 1.5f, 0.5f, 50.0f);
+  la_mat4 vp = la_productm4(la_look_at(eye, ctr, up), proj);
+  int invertible = 0;
+  la_mat4 inv_vp = la_inversem4(vp, &invertible);
+  ASSERT_TRUE(invertible);
+  la_vec4 viewport = {.elem = {10.0f, 20.0f, 1200.0f, 800.0f}};
+
+  for (unsigned int seed = 1; seed < 50; seed++) {
+    la_vec3 q = test_vec3(seed);
+    la_vec3 w = {.elem = {q.x * 0.5f, q.y * 0.5f, q.z * 0.5f}};
+    float h[4];
+    for (int k = 0; k < 4; k++) {
+      h[k] = w.x * vp.elem[0][k] + w.y * vp.elem[1][k] + w.z * vp.elem[2][k] +
+             vp.elem[3][k];
+    }
+    la_vec3 ndc = {.elem = {h[0] / h[3], h[1] / h[3], h[2] / h[3]}};
+    la_vec3 back = la_unproject(inv_vp, ndc);
+    for (int k = 0; k < 3; k++) {
+      EXPECT_NEAR(back.elem[k], w.elem[k], 1e-3f) << seed;
+    }
+
+    la_vec2 pixel = {
+        .elem = {viewport.x + (ndc.x + 1.0f) * 0.5f * viewport.z,
+                 viewport.y + (1.0f - ndc.y) * 0.5f * viewport.w}};
+    la_ray r = la_pick_ray(inv_vp, viewport, pixel);
+    EXPECT_NEAR(la_dotv3(r.dir, r.dir), 1.0f, 1e-5f);
+    EXPECT_EQ(r.tmin, 0.0f);
+    la_vec3 d = {.elem = {w.x - r.origin.x, w.y - r.origin.y,
+                          w.z - r.origin.z}};
+    const float t = la_dotv3(d, r.dir);
+    EXPECT_GT(t, 0.0f);
+    EXPECT_LT(t, r.tmax);
+    for (int k = 0; k < 3; k++) {
+      EXPECT_NEAR(r.origin.elem[k] + r.dir.elem[k] * t, w.elem[k], 1e-3f)
+          << seed;
+    }
+  }
+
+  /* The middle of the window looks at ctr, from the near to the far plane. */
+  la_vec2 middle = {.elem = {610.0f, 420.0f}};
+  la_ray r = la_pick_ray(inv_vp, viewport, middle);
+  la_vec3 dir = {.elem = {ctr.x - eye.x, ctr.y - eye.y, ctr.z - eye.z}};
+  dir = la_normalizev3(dir);
+  for (int k = 0; k < 3; k++) {
+    EXPECT_NEAR(r.dir.elem[k], dir.elem[k], 1e-4f);
+    EXPECT_NEAR(r.origin.elem[k], eye.elem[k] + dir.elem[k] * 0.5f, 1e-3f);
+  }
+  EXPECT_NEAR(r.tmax, 49.5f, 1e-2f);
+}
+
+/* Triangles and boxes spread over [-8, 8], and rays through them. */
+struct bvh_scene {
+  std::vector<la_vec3> tris, min, max;
+  std::vector<la_ray> rays;
+
+  bvh_scene(size_t n, size_t nrays) {
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 c = test_vec3((unsigned int)i * 7919u + 11);
+      la_vec3 e = test_vec3((unsigned int)i * 7919u + 12);
+      for (int v = 0; v < 3; v++) {
+        la_vec3 d = test_vec3(((unsigned int)i * 3 + v) * 7919u + 13);
+        la_vec3 p;
+        for (int k = 0; k < 3; k++) {
+          p.elem[k] = c.elem[k] + d.elem[k] * 0.125f;
+        }
+        tris.push_back(p);
+      }
+      la_vec3 lo, hi;
+      for (int k = 0; k < 3; k++) {
+        lo.elem[k] = c.elem[k] - fabsf(e.elem[k]) * 0.0625f;
+        hi.elem[k] = c.elem[k] + fabsf(e.elem[k]) * 0.0625f;
+      }
+      min.push_back(lo);
+      max.push_back(hi);
+    }
+    /* Aimed at the middle of a triangle or of a box in turn. */
+    for (size_t i = 0; i < nrays; i++) {
+      const size_t j = n > 0 ? (i / 2) % n : 0;
+      la_vec3 at = test_vec3(1);
+      for (int k = 0; n > 0 && k < 3; k++) {
+        at.elem[k] = i % 2 ? (min[j].elem[k] + max[j].elem[k]) * 0.5f
+                           : (tris[j * 3].elem[k] + tris[j * 3 + 1].elem[k] +
+                              tris[j * 3 + 2].elem[k]) /
+                                 3.0f;
+      }
+      rays.push_back(test_ray((unsigned int)i + 1, at));
+    }
+  }
+};
+
+/* The nearest hit over every primitive, as la_bvh_closest. */
+static int brute_closest(const bvh_scene &s, int boxes, la_ray r, float *t,
+                         uint32_t *prim) {
+  int found = 0;
+  for (size_t i = 0; i < s.min.size(); i++) {
+    float h;
+    int hit = boxes ? la_ray_test_aabb(&r, s.min[i], s.max[i], &h)
+                    : la_ray_test_triangle(&r, &s.tris[i * 3], &h, NULL);
+    if (hit) {
+      r.tmax = h;
+      *t = h;
+      *prim = (uint32_t)i;
+      found = 1;
+    }
+  }
+  return found;
+}
+
+static void check_bvh(const la_bvh *bvh, const bvh_scene &s, int boxes) {
+  for (const la_ray &r : s.rays) {
+    float t = 0.0f, bt = 0.0f;
+    uint32_t prim = 0, bprim = 0;
+    la_vec2 uv;
+    const int hit = la_bvh_closest(bvh, &r, &t, &uv, &prim);
+    ASSERT_EQ(hit, brute_closest(s, boxes, r, &bt, &bprim));
+    EXPECT_EQ(la_bvh_any(bvh, &r), hit);
+    if (!hit) {
+      continue;
+    }
+    EXPECT_EQ(t, bt);
+    if (prim != bprim) {
+      /* Another primitive at the same distance. */
+      la_ray one = r;
+      float h;
+      one.tmax = INFINITY;
+      EXPECT_TRUE(boxes ? la_ray_test_aabb(&one, s.min[prim], s.max[prim], &h)
+                        : la_ray_test_triangle(&one, &s.tris[prim * 3], &h,
+                                               NULL));
+      EXPECT_EQ(h, t);
+    }
+  }
+
+  for (size_t i = 0; i + LA_RAY_PACKET <= s.rays.size(); i += LA_RAY_PACKET) {
+    for (la_ray_mode mode : {LA_RAY_NEAREST, LA_RAY_ANY}) {
+      la_ray_packet p;
+      for (size_t l = 0; l < LA_RAY_PACKET; l++) {
+        la_ray_packet_set(&p, l, &s.rays[i + l]);
+      }
+      const uint32_t hits = la_bvh_packet(bvh, &p, mode);
+      for (size_t l = 0; l < LA_RAY_PACKET; l++) {
+        float t = 0.0f;
+        const la_ray &r = s.rays[i + l];
+        const int hit = la_bvh_closest(bvh, &r, &t, NULL, NULL);
+        EXPECT_EQ((hits >> l) & 1, (uint32_t)hit);
+        EXPECT_EQ(p.prim[l] >= 0, hit);
+        if (hit && mode == LA_RAY_NEAREST) {
+          EXPECT_EQ(p.t[l], t);
+        } else if (hit) {
+          la_ray one = r;
+          one.tmax = INFINITY;
+          float h;
+          const int32_t j = p.prim[l];
+          EXPECT_TRUE(boxes ? la_ray_test_aabb(&one, s.min[j], s.max[j], &h)
+                            : la_ray_test_triangle(&one, &s.tris[j * 3], &h,
+                                                   NULL));
+          EXPECT_EQ(p.t[l], h);
+        }
+      }
+    }
+  }
+
+  for (size_t q = 0; q < 20; q++) {
+    la_vec3 c = test_vec3((unsigned int)q * 7919u + 5);
+    la_vec3 lo, hi;
+    for (int k = 0; k < 3; k++) {
+      lo.elem[k] = c.elem[k] - 0.25f * (float)(q % 5);
+      hi.elem[k] = c.elem[k] + 0.25f * (float)(q % 5);
+    }
+    std::vector<uint32_t> expected;
+    for (size_t i = 0; i < s.min.size(); i++) {
+      la_vec3 a = boxes ? s.min[i] : s.tris[i * 3];
+      la_vec3 b = boxes ? s.max[i] : s.tris[i * 3];
+      for (int v = 1; !boxes && v < 3; v++) {
+        for (int k = 0; k < 3; k++) {
+          a.elem[k] = std::min(a.elem[k], s.tris[i * 3 + v].elem[k]);
+          b.elem[k] = std::max(b.elem[k], s.tris[i * 3 + v].elem[k]);
+        }
+      }
+      if (a.x <= hi.x && lo.x <= b.x && a.y <= hi.y && lo.y <= b.y &&
+          a.z <= hi.z && lo.z <= b.z) {
+        expected.push_back((uint32_t)i);
+      }
+    }
+    std::vector<uint32_t> found(s.min.size() + 1);
+    const size_t n =
+        la_bvh_overlap(bvh, lo, hi, found.data(), found.size());
+    ASSERT_EQ(n, expected.size());
+    found.resize(n);
+    std::sort(found.begin(), found.end());
+    EXPECT_EQ(found, expected);
+    if (n > 1) {
+      EXPECT_EQ(la_bvh_overlap(bvh, lo, hi, found.data(), 1), n);
+    }
+  }
+}
+
+TEST(la_tests, la_bvh) {
+  for (size_t n : {0, 1, 2, 3, 5, 8, 17, 100, 3000}) {
+    SCOPED_TRACE(n);
+    bvh_scene s(n, 64);
+    la_bvh *tris = la_bvh_create_triangles(NULL, s.tris.data(), n);
+    la_bvh *boxes = la_bvh_create_aabbs(NULL, s.min.data(), s.max.data(), n);
+    ASSERT_NE(tris, nullptr);
+    ASSERT_NE(boxes, nullptr);
+    check_bvh(tris, s, 0);
+    check_bvh(boxes, s, 1);
+
+    la_vec3 lo, hi;
+    la_bvh_bounds(boxes, &lo, &hi);
+    for (int k = 0; k < 3; k++) {
+      float a = INFINITY, b = -INFINITY;
+      for (size_t i = 0; i < n; i++) {
+        a = std::min(a, s.min[i].elem[k]);
+        b = std::max(b, s.max[i].elem[k]);
+      }
+      EXPECT_EQ(lo.elem[k], a);
+      EXPECT_EQ(hi.elem[k], b);
+    }
+
+    /* An unbounded box overlaps every primitive, but no empty child. */
+    const la_vec3 all_lo = {.elem = {-INFINITY, -INFINITY, -INFINITY}};
+    const la_vec3 all_hi = {.elem = {INFINITY, INFINITY, INFINITY}};
+    std::vector<uint32_t> all(n + 1);
+    for (la_bvh *bvh : {tris, boxes}) {
+      ASSERT_EQ(la_bvh_overlap(bvh, all_lo, all_hi, all.data(), n + 1), n);
+      std::sort(all.begin(), all.begin() + n);
+      for (size_t i = 0; i < n; i++) {
+        EXPECT_EQ(all[i], i);
+      }
+    }
+
+    /* Deform the geometry and refit. */
+    for (size_t i = 0; i < n; i++) {
+      for (int k = 0; k < 3; k++) {
+        const float d = 0.5f * sinf((float)i + (float)k);
+        for (int v = 0; v < 3; v++) {
+          s.tris[i * 3 + v].elem[k] = s.tris[i * 3 + v].elem[k] * 1.5f + d;
+        }
+        s.min[i].elem[k] = s.min[i].elem[k] * 1.5f + d;
+        s.max[i].elem[k] = s.max[i].elem[k] * 1.5f + d;
+      }
+    }
+    EXPECT_TRUE(la_bvh_refit_triangles(tris, s.tris.data()));
+    EXPECT_TRUE(la_bvh_refit_aabbs(boxes, s.min.data(), s.max.data()));
+    EXPECT_FALSE(la_bvh_refit_triangles(boxes, s.tris.data()));
+    EXPECT_FALSE(la_bvh_refit_aabbs(tris, s.min.data(), s.max.data()));
+    check_bvh(tris, s, 0);
+    check_bvh(boxes, s, 1);
+    la_bvh_destroy(tris);
+    la_bvh_destroy(boxes);
+  }
+}
+
+TEST(la_tests, la_bvh_subnormal_centroids) {
+  /* Centroids about 1e-40 apart must not scale the bins to infinity. */
+  const size_t n = 40;
+  std::vector<la_vec3> min(n), max(n);
+  for (size_t i = 0; i < n; i++) {
+    const float x = (float)i * 1e-41f;
+    min[i] = {.elem = {x, -1.0f, -1.0f}};
+    max[i] = {.elem = {x, 1.0f, 1.0f}};
+  }
+  la_bvh *bvh = la_bvh_create_aabbs(NULL, min.data(), max.data(), n);
+  ASSERT_NE(bvh, nullptr);
+
+  const la_vec3 all_lo = {.elem = {-INFINITY, -INFINITY, -INFINITY}};
+  const la_vec3 all_hi = {.elem = {INFINITY, INFINITY, INFINITY}};
+  std::vector<uint32_t> all(n + 1);
+  ASSERT_EQ(la_bvh_overlap(bvh, all_lo, all_hi, all.data(), n + 1), n);
+  std::sort(all.begin(), all.begin() + n);
+  for (size_t i = 0; i < n; i++) {
+    EXPECT_EQ(all[i], i);
+  }
+
+  /* Every box is at t = 5 in float. */
+  const la_ray r = {.origin = {.elem = {-5.0f, 0.0f, 0.0f}},
+                    .dir = {.elem = {1.0f, 0.0f, 0.0f}},
+                    .tmin = 0.0f,
+                    .tmax = INFINITY};
+  float t = 0.0f;
+  uint32_t prim = 0;
+  ASSERT_TRUE(la_bvh_closest(bvh, &r, &t, NULL, &prim));
+  EXPECT_LT(prim, n);
+  EXPECT_EQ(t, 5.0f);
+  la_bvh_destroy(bvh);
+}
+
+#ifdef LA_HAS_POOL
+TEST(la_tests, la_bvh_mt) {
+  /* Large enough for the top nodes to be binned in parallel. */
+  const size_t n = 70000;
+  bvh_scene s(n, 256);
+  la_bvh *serial = la_bvh_create_triangles(NULL, s.tris.data(), n);
+  la_pool *pool = la_pool_create(4);
+  ASSERT_NE(pool, nullptr);
+  la_jobs jobs = la_pool_jobs(pool, 0);
+  la_bvh *mt = la_bvh_create_triangles(&jobs, s.tris.data(), n);
+  la_pool_destroy(pool);
+  ASSERT_NE(serial, nullptr);
+  ASSERT_NE(mt, nullptr);
+
+  /* The same tree whatever the threads. */
+  for (const la_ray &r : s.rays) {
+    float t[2] = {0.0f, 0.0f};
+    uint32_t prim[2] = {0, 0};
+    la_vec2 uv[2];
+    const int hit = la_bvh_closest(serial, &r, &t[0], &uv[0], &prim[0]);
+    ASSERT_EQ(la_bvh_closest(mt, &r, &t[1], &uv[1], &prim[1]), hit);
+    if (hit) {
+      EXPECT_EQ(t[0], t[1]);
+      EXPECT_EQ(prim[0], prim[1]);
+    }
+  }
+  std::vector<uint32_t> a(n), b(n);
+  la_vec3 lo = {.elem = {-2.0f, -2.0f, -2.0f}};
+  la_vec3 hi = {.elem = {2.0f, 2.0f, 2.0f}};
+  const size_t count = la_bvh_overlap(serial, lo, hi, a.data(), n);
+  ASSERT_EQ(la_bvh_overlap(mt, lo, hi, b.data(), n), count);
+  EXPECT_TRUE(std::equal(a.begin(), a.begin() + count, b.begin()));
+
+  /* Spot check against every triangle. */
+  bvh_scene few = s;
+  few.rays.resize(8);
+  for (const la_ray &r : few.rays) {
+    float t = 0.0f, bt = 0.0f;
+    uint32_t prim, bprim;
+    const int hit = la_bvh_closest(mt, &r, &t, NULL, &prim);
+    ASSERT_EQ(hit, brute_closest(few, 0, r, &bt, &bprim));
+    EXPECT_EQ(t, bt);
+  }
+  la_bvh_destroy(serial);
+  la_bvh_destroy(mt);
+}
+#endif
+
+static la_mat4 test_trs_reference(const la_vec3 &t, const la_quat &r,
+                                  const la_vec3 &s) {
+  la_mat4 m = la_productm4(la_scale(la_identitym4(), s), la_quattom4(r));
+  return la_productm4(m, la_translate(la_identitym4(), t));
+}
+
+static void test_trs(unsigned int seed, la_vec3 *t, la_quat *r, la_vec3 *s) {
+  *t = test_vec3(seed * 7919u);
+  *r = la_axis_angleq(la_normalizev3(test_vec3(seed * 7919u + 1)),
+                      0.37f * (float)seed);
+  const la_vec3 v = test_vec3(seed * 7919u + 2);
+  *s = la_vec3{.elem = {0.25f + fabsf(v.x) * 0.25f, 0.25f + fabsf(v.y) * 0.25f,
+                        0.25f + fabsf(v.z) * 0.25f}};
+}
+
+TEST(la_tests, la_compose_trs) {
+  const la_vec3 zero = {.elem = {0.0f, 0.0f, 0.0f}};
+  const la_vec3 one = {.elem = {1.0f, 1.0f, 1.0f}};
+  expect_m4_eq(la_compose_trs(zero, la_identityq(), one), la_identitym4());
+  for (unsigned int seed = 1; seed <= 50; seed++) {
+    la_vec3 t, s;
+    la_quat r;
+    test_trs(seed, &t, &r, &s);
+    if (seed % 5 == 0) {
+      s.elem[seed % 3] = -s.elem[seed % 3];
+    }
+    expect_m4_near(la_compose_trs(t, r, s), test_trs_reference(t, r, s),
+                   1e-5f);
+  }
+}
+
+TEST(la_tests, la_decompose_trs) {
+  la_vec3 t, s;
+  la_quat r;
+  ASSERT_EQ(la_decompose_trs(la_identitym4(), &t, &r, &s), 1);
+  expect_v3_eq(t, la_vec3{.elem = {0.0f, 0.0f, 0.0f}});
+  expect_q_near(r, la_identityq(), 1e-7f);
+  expect_v3_eq(s, la_vec3{.elem = {1.0f, 1.0f, 1.0f}});
+
+  for (unsigned int seed = 1; seed <= 50; seed++) {
+    la_vec3 t0, s0;
+    la_quat r0;
+    test_trs(seed, &t0, &r0, &s0);
+    if (r0.w < 0.0f) {
+      r0 = la_quat{.elem = {-r0.x, -r0.y, -r0.z, -r0.w}};
+    }
+    const la_mat4 m = la_compose_trs(t0, r0, s0);
+    ASSERT_EQ(la_decompose_trs(m, &t, &r, &s), 1) << seed;
+    expect_v3_eq(t, t0);
+    expect_q_near(r, r0, 1e-5f);
+    expect_v3_near(s, s0, 1e-5f);
+  }
+
+  /* Reflections and zero scales still compose back to the matrix, with a
+   * unit rotation. */
+  const la_vec3 scales[] = {{.elem = {1.0f, -2.0f, 3.0f}},
+                            {.elem = {-1.0f, -1.0f, -1.0f}},
+                            {.elem = {2.0f, 3.0f, -0.5f}},
+                            {.elem = {0.0f, 1.0f, 2.0f}},
+                            {.elem = {1.0f, 0.0f, 2.0f}},
+                            {.elem = {1.0f, 2.0f, 0.0f}},
+                            {.elem = {0.0f, 0.0f, 2.0f}},
+                            {.elem = {0.0f, -3.0f, 0.0f}},
+                            {.elem = {0.0f, 0.0f, 0.0f}}};
+  for (const la_vec3 &s0 : scales) {
+    for (unsigned int seed = 1; seed <= 10; seed++) {
+      la_vec3 t0, unused;
+      la_quat r0;
+      test_trs(seed, &t0, &r0, &unused);
+      const la_mat4 m = la_compose_trs(t0, r0, s0);
+      ASSERT_EQ(la_decompose_trs(m, &t, &r, &s), 1);
+      EXPECT_NEAR(la_dotv4(r, r), 1.0f, 1e-5f);
+      EXPECT_GE(r.w, 0.0f);
+      expect_m4_near(la_compose_trs(t, r, s), m, 1e-5f);
+    }
+  }
+
+  /* Shear and projection are reported, and dropped from a valid result. */
+  la_vec3 t0, s0;
+  la_quat r0;
+  test_trs(3, &t0, &r0, &s0);
+  const la_mat4 m = la_compose_trs(t0, r0, s0);
+  la_mat4 sheared = m;
+  for (int k = 0; k < 3; k++) {
+    sheared.elem[2][k] += 0.5f * m.elem[0][k];
+  }
+  ASSERT_EQ(la_decompose_trs(sheared, &t, &r, &s), 0);
+  EXPECT_NEAR(la_dotv4(r, r), 1.0f, 1e-5f);
+  expect_v3_eq(t, t0);
+  la_vec3 ts;
+  la_quat rs;
+  la_vec3 ss;
+  la_mat4 unsheared = la_compose_trs(t, r, s);
+  ASSERT_EQ(la_decompose_trs(unsheared, &ts, &rs, &ss), 1);
+  expect_v3_near(ss, s, 1e-5f);
+  la_mat4 projective = m;
+  projective.elem[1][3] = 0.25f;
+  ASSERT_EQ(la_decompose_trs(projective, &t, &r, &s), 0);
+  projective = m;
+  projective.elem[3][3] = 2.0f;
+  ASSERT_EQ(la_decompose_trs(projective, &t, &r, &s), 0);
+}
+
+/* n TRS transforms as SoA streams. */
+struct trs_streams {
+  std::vector<float> v[10];
+  la_trs_soa soa;
+
+  explicit trs_streams(size_t n) {
+    float *p[10];
+    for (int k = 0; k < 10; k++) {
+      v[k].resize(n);
+      p[k] = v[k].data();
+    }
+    soa = {p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8], p[9]};
+  }
+};
+
+TEST(la_tests, la_compose_trs_soa) {
+  for (size_t n : batch_sizes) {
+    trs_streams in(n);
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 t, s;
+      la_quat r;
+      test_trs((unsigned int)i + 1, &t, &r, &s);
+      for (int k = 0; k < 3; k++) {
+        in.v[k][i] = t.elem[k];
+        in.v[7 + k][i] = s.elem[k];
+      }
+      for (int k = 0; k < 4; k++) {
+        in.v[3 + k][i] = r.elem[k];
+      }
+    }
+    std::vector<la_mat4> out(n);
+    la_compose_trs_soa(&in.soa, out.data(), n);
+    for (size_t i = 0; i < n; i++) {
+      const la_vec3 t = {.elem = {in.v[0][i], in.v[1][i], in.v[2][i]}};
+      const la_quat r = {
+          .elem = {in.v[3][i], in.v[4][i], in.v[5][i], in.v[6][i]}};
+      const la_vec3 s = {.elem = {in.v[7][i], in.v[8][i], in.v[9][i]}};
+      expect_m4_eq(out[i], la_compose_trs(t, r, s));
+    }
+
+    trs_streams back(n);
+    ASSERT_EQ(la_decompose_trs_soa(out.data(), &back.soa, n), 1);
+    for (size_t i = 0; i < n; i++) {
+      la_vec3 t, s;
+      la_quat r;
+      la_decompose_trs(out[i], &t, &r, &s);
+      const float expect[10] = {t.x, t.y, t.z, r.x, r.y, r.z, r.w,
+                                s.x, s.y, s.z};
+      for (int k = 0; k < 10; k++) {
+        ASSERT_EQ(back.v[k][i], expect[k]) << i << ", " << k;
+      }
+    }
+    if (n > 0) {
+      out[n / 2].elem[0][3] = 1.0f;
+      ASSERT_EQ(la_decompose_trs_soa(out.data(), &back.soa, n), 0);
+    }
+  }
+}
+
+#ifdef LA_HAS_POOL
+TEST(la_tests, la_compose_trs_soa_mt) {
+  const size_t n = 10007;
+  trs_streams in(n);
+  for (size_t i = 0; i < n; i++) {
+    for (int k = 0; k < 10; k++) {
+      in.v[k][i] = (float)((i * (k + 3)) % 97) / 97.0f - 0.5f;
+    }
+  }
+  std::vector<la_mat4> ref(n), out(n);
+  la_compose_trs_soa(&in.soa, ref.data(), n);
+  la_pool *pool = la_pool_create(4);
+  la_jobs jobs = la_pool_jobs(pool, 0);
+  la_compose_trs_soa_mt(&jobs, &in.soa, out.data(), n);
+  for (size_t i = 0; i < n; i++) {
+    expect_m4_eq(out[i], ref[i]);
+  }
+  la_pool_destroy(pool);
+}
+#endif
+
+/* Keys for one animation track. */
+struct anim_track {
+  std::vector<float> times, values, tangents;
+  la_anim_track_desc desc;
+
+  anim_track(uint32_t target, la_anim_channel channel, la_anim_interp interp,
+             size_t count, unsigned int seed) {
+    const size_t width = channel == LA_ANIM_ROTATION ? 4 : 3;
+    float t = 0.5f * (float)(seed % 3) - 0.5f;
+    for (size_t k = 0; k < count; k++) {
+      const la_vec3 v = test_vec3(seed * 7919u + (unsigned int)k);
+      times.push_back(t);
+      t += 0.1f + 0.05f * fabsf(v.x);
+      if (width == 4) {
+        /* Hermite keys turn slowly about one axis, staying in one
+         * hemisphere. Linear keys jump around. */
+        const la_quat q =
+            interp == LA_ANIM_HERMITE
+                ? la_axis_angleq(la_normalizev3(test_vec3(seed)), 0.3f * k)
+                : la_axis_angleq(la_normalizev3(v), 2.5f * v.y);
+        values.insert(values.end(), q.elem, q.elem + 4);
+      } else {
+        values.insert(values.end(), v.elem, v.elem + 3);
+      }
+      for (size_t j = 0; j < 2 * width; j++) {
+        tangents.push_back(0.1f * test_vec3(seed + 31 * (unsigned int)k + 1)
+                                      .elem[j % 3]);
+      }
+    }
+    desc = {target, channel, interp, count, times.data(), values.data(),
+            interp == LA_ANIM_HERMITE ? tangents.data() : NULL};
+  }
+};
+
+/* Samples a track the straightforward way. */
+static void anim_reference(const la_anim_track_desc &d, float time,
+                           float *out) {
+  const size_t width = d.channel == LA_ANIM_ROTATION ? 4 : 3;
+  size_t k = 0;
+  while (k + 2 < d.count && d.times[k + 1] <= time) {
+    k++;
+  }
+  const size_t k1 = d.count > 1 ? k + 1 : k;
+  const float dt = d.times[k1] - d.times[k];
+  const float a =
+      dt > 0.0f ? std::min(std::max((time - d.times[k]) / dt, 0.0f), 1.0f)
+                : 0.0f;
+  const float *v0 = d.values + k * width, *v1 = d.values + k1 * width;
+  float sign = 1.0f;
+  if (width == 4 && la_dotv4(*(const la_vec4 *)v0, *(const la_vec4 *)v1) < 0) {
+    sign = -1.0f;
+  }
+  for (size_t j = 0; j < width; j++) {
+    if (d.interp == LA_ANIM_HERMITE) {
+      const float m0 = d.tangents[k * width * 2 + width + j];
+      const float m1 = d.tangents[k1 * width * 2 + j];
+      const float a2 = a * a, a3 = a2 * a;
+      out[j] = (2 * a3 - 3 * a2 + 1) * v0[j] + (3 * a2 - 2 * a3) * v1[j] +
+               (a3 - 2 * a2 + a) * dt * m0 + (a3 - a2) * dt * m1;
+    } else {
+      out[j] = v0[j] + (sign * v1[j] - v0[j]) * a;
+    }
+  }
+  if (width == 4) {
+    const la_quat q = la_normalizeq(*(const la_quat *)out);
+    memcpy(out, q.elem, sizeof(q.elem));
+  }
+}
+
+static la_quat trs_rotation(const trs_streams &p, size_t i) {
+  la_quat q = {.elem = {p.v[3][i], p.v[4][i], p.v[5][i], p.v[6][i]}};
+  return q;
+}
+
+static std::vector<anim_track> anim_tracks(size_t per_group) {
+  std::vector<anim_track> tracks;
+  const la_anim_channel channels[] = {LA_ANIM_TRANSLATION, LA_ANIM_ROTATION,
+                                      LA_ANIM_SCALE};
+  unsigned int seed = 1;
+  for (la_anim_channel channel : channels) {
+    for (la_anim_interp interp : {LA_ANIM_LINEAR, LA_ANIM_HERMITE}) {
+      for (size_t i = 0; i < per_group; i++, seed++) {
+        /* Targets interleave the channels and leave gaps. */
+        const uint32_t target = (uint32_t)(2 * (i * 2 + interp) + 1);
+        tracks.emplace_back(target, channel, interp, 1 + seed % 9, seed);
+      }
+    }
+  }
+  return tracks;
+}
+
+TEST(la_tests, la_anim_clip) {
+  la_anim_clip *empty = la_anim_clip_create(NULL, 0);
+  ASSERT_NE(empty, nullptr);
+  EXPECT_EQ(la_anim_clip_tracks(empty), 0u);
+  EXPECT_EQ(la_anim_clip_duration(empty), 0.0f);
+  la_anim_clip_destroy(empty);
+
+  anim_track a(0, LA_ANIM_TRANSLATION, LA_ANIM_LINEAR, 4, 1);
+  anim_track b(0, LA_ANIM_ROTATION, LA_ANIM_HERMITE, 3, 2);
+  la_anim_track_desc d[2] = {a.desc, b.desc};
+  la_anim_clip *clip = la_anim_clip_create(d, 2);
+  ASSERT_NE(clip, nullptr);
+  EXPECT_EQ(la_anim_clip_tracks(clip), 2u);
+  EXPECT_EQ(la_anim_clip_duration(clip), std::max(a.times[3], b.times[2]));
+  la_anim_clip_destroy(clip);
+
+  la_anim_track_desc bad[2] = {a.desc, b.desc};
+  bad[1].channel = LA_ANIM_TRANSLATION;
+  EXPECT_EQ(la_anim_clip_create(bad, 2), nullptr);
+  bad[1] = b.desc;
+  bad[1].tangents = NULL;
+  EXPECT_EQ(la_anim_clip_create(bad, 2), nullptr);
+  bad[1] = b.desc;
+  bad[1].count = 0;
+  EXPECT_EQ(la_anim_clip_create(bad, 2), nullptr);
+  a.times[2] = a.times[1];
+  EXPECT_EQ(la_anim_clip_create(&a.desc, 1), nullptr);
+}
+
+TEST(la_tests, la_anim_sample) {
+  const std::vector<anim_track> tracks = anim_tracks(37);
+  std::vector<la_anim_track_desc> descs;
+  for (const anim_track &t : tracks) {
+    descs.push_back(t.desc);
+  }
+  la_anim_clip *clip = la_anim_clip_create(descs.data(), descs.size());
+  ASSERT_NE(clip, nullptr);
+  const size_t count = 2 * 2 * 37;
+  trs_streams pose(count + 1);
+  std::vector<uint32_t> cursor(la_anim_clip_tracks(clip), 0);
+  EXPECT_EQ(la_anim_sample(clip, 0.0f, cursor.data(), &pose.soa, count - 1),
+            0);
+
+  /* Playback forward, then jumps both ways, with and without a cursor. */
+  std::vector<float> times;
+  for (float t = -0.7f; t < la_anim_clip_duration(clip) + 0.5f; t += 0.033f) {
+    times.push_back(t);
+  }
+  for (float t : {1.7f, 0.2f, 0.21f, -3.0f, 100.0f, 0.9f}) {
+    times.push_back(t);
+  }
+  trs_streams stateless(count + 1);
+  for (float time : times) {
+    for (size_t k = 0; k < 10; k++) {
+      std::fill(pose.v[k].begin(), pose.v[k].end(), -7.0f);
+    }
+    ASSERT_EQ(la_anim_sample(clip, time, cursor.data(), &pose.soa, count + 1),
+              1);
+    ASSERT_EQ(la_anim_sample(clip, time, NULL, &stateless.soa, count + 1), 1);
+    for (const anim_track &t : tracks) {
+      const size_t i = t.desc.target;
+      const size_t first = t.desc.channel * 3 + (t.desc.channel > 1);
+      const size_t width = t.desc.channel == LA_ANIM_ROTATION ? 4 : 3;
+      float ref[4];
+      anim_reference(t.desc, time, ref);
+      float sign = 1.0f;
+      if (width == 4) {
+        const la_quat r = {.elem = {ref[0], ref[1], ref[2], ref[3]}};
+        sign = la_dotv4(r, trs_rotation(pose, i)) < 0.0f ? -1.0f : 1.0f;
+      }
+      for (size_t j = 0; j < width; j++) {
+        ASSERT_NEAR(pose.v[first + j][i], sign * ref[j], 2e-5f)
+            << time << " " << i << " " << j;
+        ASSERT_EQ(pose.v[first + j][i], stateless.v[first + j][i]);
+      }
+    }
+    /* Channels without a track are left alone. */
+    ASSERT_EQ(pose.v[0][0], -7.0f);
+    ASSERT_EQ(pose.v[6][count], -7.0f);
+  }
+  la_anim_clip_destroy(clip);
+}
+
+TEST(la_tests, la_anim_pose) {
+  anim_track a(1, LA_ANIM_TRANSLATION, LA_ANIM_LINEAR, 1, 1);
+  anim_track b(1, LA_ANIM_TRANSLATION, LA_ANIM_LINEAR, 1, 2);
+  anim_track ra(1, LA_ANIM_ROTATION, LA_ANIM_LINEAR, 1, 3);
+  anim_track rb(1, LA_ANIM_ROTATION, LA_ANIM_LINEAR, 1, 4);
+  /* Near ra, but stored in the other hemisphere. */
+  la_quat qa = {.elem = {ra.values[0], ra.values[1], ra.values[2],
+                         ra.values[3]}};
+  la_quat qb = qa;
+  qb.x += 0.2f;
+  qb = la_normalizeq(qb);
+  for (size_t j = 0; j < 4; j++) {
+    rb.values[j] = -qb.elem[j];
+  }
+  la_anim_track_desc da[2] = {a.desc, ra.desc};
+  la_anim_track_desc db[2] = {b.desc, rb.desc};
+  la_anim_clip *ca = la_anim_clip_create(da, 2);
+  la_anim_clip *cb = la_anim_clip_create(db, 2);
+  ASSERT_NE(ca, nullptr);
+  ASSERT_NE(cb, nullptr);
+
+  la_anim_pose *pose = la_anim_pose_create(3);
+  ASSERT_NE(pose, nullptr);
+  trs_streams rest(3);
+  for (size_t k = 0; k < 10; k++) {
+    std::fill(rest.v[k].begin(), rest.v[k].end(), 0.5f + (float)k);
+  }
+  la_quat expect;
+  for (size_t j = 0; j < 4; j++) {
+    expect.elem[j] = 0.25f * qa.elem[j] + 0.5f * qb.elem[j];
+  }
+  expect = la_normalizeq(expect);
+
+  /* Blending again reuses the pose, without the previous frame leaking. */
+  for (int frame = 0; frame < 2; frame++) {
+    la_anim_pose_clear(pose);
+    ASSERT_EQ(la_anim_pose_add(pose, ca, 0.0f, NULL, 0.25f), 1);
+    ASSERT_EQ(la_anim_pose_add(pose, cb, 0.0f, NULL, 0.5f), 1);
+    la_anim_pose_finish(pose, frame == 0 ? &rest.soa : NULL);
+    const float t[3] = {pose->trs.tx[1], pose->trs.ty[1], pose->trs.tz[1]};
+    for (size_t j = 0; j < 3; j++) {
+      EXPECT_NEAR(t[j], (0.25f * a.values[j] + 0.5f * b.values[j]) / 0.75f,
+                  1e-6f);
+    }
+    const la_quat got = {.elem = {pose->trs.rx[1], pose->trs.ry[1],
+                                  pose->trs.rz[1], pose->trs.rw[1]}};
+    expect_q_near(got, expect, 1e-6f);
+
+    /* Channels no clip animated come from the rest pose. */
+    EXPECT_EQ(pose->trs.sx[1], frame == 0 ? 7.5f : 1.0f);
+    EXPECT_EQ(pose->trs.tx[0], frame == 0 ? 0.5f : 0.0f);
+    EXPECT_EQ(pose->trs.rw[2], frame == 0 ? 6.5f : 1.0f);
+  }
+
+  la_anim_pose *small = la_anim_pose_create(1);
+  EXPECT_EQ(la_anim_pose_add(small, ca, 0.0f, NULL, 1.0f), 0);
+  la_anim_pose_destroy(small);
+  la_anim_pose_destroy(pose);
+  la_anim_clip_destroy(ca);
+  la_anim_clip_destroy(cb);
+}
+
+/* The angle between the rotations of two unit quaternions. */
+static double rotation_angle(const la_quat &a, const la_quat &b) {
+  double plus = 0.0, minus = 0.0;
+  for (int k = 0; k < 4; k++) {
+    plus += ((double)a.elem[k] + b.elem[k]) * ((double)a.elem[k] + b.elem[k]);
+    minus += ((double)a.elem[k] - b.elem[k]) * ((double)a.elem[k] - b.elem[k]);
+  }
+  return 4.0 * asin(std::min(sqrt(std::min(plus, minus)), 2.0) / 2.0);
+}
+
+/* Rotations that stress smallest three: each axis, ties for the largest
+ * component, negative largest components, and the worst case for the
+ * rebuilt component, where all four are equal. */
+static std::vector<la_quat> quant_rotations() {
+  std::vector<la_quat> qs;
+  const float h = 0.70710678f;
+  const la_quat fixed[] = {{.elem = {0.0f, 0.0f, 0.0f, 1.0f}},
+                           {.elem = {0.0f, 0.0f, 0.0f, -1.0f}},
+                           {.elem = {1.0f, 0.0f, 0.0f, 0.0f}},
+                           {.elem = {0.0f, -1.0f, 0.0f, 0.0f}},
+                           {.elem = {0.0f, 0.0f, 1.0f, 0.0f}},
+                           {.elem = {h, h, 0.0f, 0.0f}},
+                           {.elem = {0.0f, -h, 0.0f, h}},
+                           {.elem = {0.5f, 0.5f, 0.5f, 0.5f}},
+                           {.elem = {-0.5f, 0.5f, -0.5f, -0.5f}}};
+  qs.assign(fixed, fixed + sizeof(fixed) / sizeof(fixed[0]));
+  for (unsigned int seed = 1; seed <= 2000; seed++) {
+    const la_vec3 v = test_vec3(seed * 7919u);
+    const la_vec3 u = test_vec3(seed * 7919u + 1);
+    la_quat q = {.elem = {v.x, v.y, v.z, u.x}};
+    if (seed % 4 == 0) {
+      q = la_quat{.elem = {0.5f + v.x * 1e-3f, 0.5f + v.y * 1e-3f,
+                           0.5f + v.z * 1e-3f, 0.5f + u.x * 1e-3f}};
+    }
+    qs.push_back(la_normalizeq(q));
+  }
+  return qs;
+}
+
+TEST(la_tests, la_quat_pack) {
+  double worst32 = 0.0, worst48 = 0.0;
+  for (const la_quat &q : quant_rotations()) {
+    const la_quat d32 = la_quat_unpack32(la_quat_pack32(q));
+    uint16_t p48[3];
+    la_quat_pack48(q, p48);
+    const la_quat d48 = la_quat_unpack48(p48);
+    for (const la_quat &d : {d32, d48}) {
+      EXPECT_NEAR(la_dotv4(d, d), 1.0f, 1e-6f);
+      /* The largest component is positive, up to a step for ties. */
+      float largest = 0.0f, positive = 0.0f;
+      for (int k = 0; k < 4; k++) {
+        largest = std::max(largest, fabsf(d.elem[k]));
+        positive = std::max(positive, d.elem[k]);
+      }
+      EXPECT_GE(positive, largest - 0.002f);
+    }
+    worst32 = std::max(worst32, rotation_angle(q, d32));
+    worst48 = std::max(worst48, rotation_angle(q, d48));
+  }
+  EXPECT_LE(worst32, 0.005);
+  EXPECT_LE(worst48, 0.0002);
+
+  /* Encoding a decoded rotation gives the same bits. */
+  const la_quat q = la_normalizeq(la_quat{.elem = {0.1f, -0.7f, 0.3f, 0.2f}});
+  const uint32_t p32 = la_quat_pack32(q);
+  EXPECT_EQ(la_quat_pack32(la_quat_unpack32(p32)), p32);
+  uint16_t p48[3], again[3];
+  la_quat_pack48(q, p48);
+  la_quat_pack48(la_quat_unpack48(p48), again);
+  EXPECT_EQ(memcmp(p48, again, sizeof(p48)), 0);
+}
+
+TEST(la_tests, la_quat_pack_soa) {
+  const std::vector<la_quat> rotations = quant_rotations();
+  for (size_t n : batch_sizes) {
+    trs_streams in(n), out32(n), out48(n);
+    for (size_t i = 0; i < n; i++) {
+      const la_quat &q = rotations[(i * 37) % rotations.size()];
+      for (int k = 0; k < 4; k++) {
+        in.v[3 + k][i] = q.elem[k];
+      }
+    }
+    const la_trs_soa &s = in.soa;
+    std::vector<uint32_t> p32(n);
+    std::vector<uint16_t> p48(3 * n);
+    la_quat_pack32_soa(s.rx, s.ry, s.rz, s.rw, p32.data(), n);
+    la_quat_pack48_soa(s.rx, s.ry, s.rz, s.rw, p48.data(), n);
+    la_quat_unpack32_soa(p32.data(), out32.soa.rx, out32.soa.ry, out32.soa.rz,
+                         out32.soa.rw, n);
+    la_quat_unpack48_soa(p48.data(), out48.soa.rx, out48.soa.ry, out48.soa.rz,
+                         out48.soa.rw, n);
+    for (size_t i = 0; i < n; i++) {
+      const la_quat q = trs_rotation(in, i);
+      EXPECT_LE(rotation_angle(q, trs_rotation(out32, i)), 0.005) << n;
+      EXPECT_LE(rotation_angle(q, trs_rotation(out48, i)), 0.0002) << n;
+
+      /* The batches decode like the single versions. */
+      expect_q_near(trs_rotation(out32, i), la_quat_unpack32(p32[i]), 1e-6f);
+      expect_q_near(trs_rotation(out48, i), la_quat_unpack48(&p48[3 * i]),
+                    1e-6f);
+    }
+  }
+}
+
+TEST(la_tests, la_quat_pack_soa_lanes) {
+  /* Neighbouring lanes take different sides of every select: the largest
+   * component moves and flips sign from one rotation to the next. */
+  const size_t n = 32;
+  trs_streams in(n);
+  std::vector<la_quat> qs(n);
+  for (size_t i = 0; i < n; i++) {
+    la_quat q = {.elem = {0.1f, -0.2f, 0.3f, -0.15f}};
+    q.elem[i % 4] = (i / 4) % 2 ? -0.9f : 0.9f;
+    qs[i] = la_normalizeq(q);
+    for (int k = 0; k < 4; k++) {
+      in.v[3 + k][i] = qs[i].elem[k];
+    }
+  }
+  std::vector<uint32_t> p32(n);
+  la_quat_pack32_soa(in.soa.rx, in.soa.ry, in.soa.rz, in.soa.rw, p32.data(),
+                     n);
+  for (size_t i = 0; i < n; i++) {
+    EXPECT_EQ(p32[i], la_quat_pack32(qs[i])) << i;
+  }
+}
+
+TEST(la_tests, la_position_pack16) {
+  const la_vec3 min = {.elem = {-10.0f, 0.0f, -100.0f}};
+  const la_vec3 max = {.elem = {10.0f, 5.0f, 300.0f}};
+  for (size_t n : batch_sizes) {
+    trs_streams in(n), out(n);
+    for (size_t i = 0; i < n; i++) {
+      const la_vec3 v = test_vec3((unsigned int)i * 7919u);
+      for (int a = 0; a < 3; a++) {
+        const float f = 0.5f + 0.5f * v.elem[a] / 10.0f;
+        in.v[a][i] = min.elem[a] + f * (max.elem[a] - min.elem[a]);
+      }
+    }
+    /* The corners of the box, and positions outside it. */
+    if (n >= 3) {
+      for (int a = 0; a < 3; a++) {
+        in.v[a][0] = min.elem[a];
+        in.v[a][1] = max.elem[a];
+        in.v[a][2] = a == 1 ? max.elem[a] + 1.0f : min.elem[a] - 1.0f;
+      }
+    }
+    std::vector<uint16_t> p(3 * n);
+    la_position_pack16_soa(in.soa.tx, in.soa.ty, in.soa.tz, min, max,
+                           p.data(), n);
+    la_position_unpack16_soa(p.data(), min, max, out.soa.tx, out.soa.ty,
+                             out.soa.tz, n);
+    for (size_t i = 0; i < n; i++) {
+      for (int a = 0; a < 3; a++) {
+        const float range = max.elem[a] - min.elem[a];
+        const float clamped =
+            std::min(std::max(in.v[a][i], min.elem[a]), max.elem[a]);
+        EXPECT_NEAR(out.v[a][i], clamped, range / 65535.0f * 0.5f + 1e-4f)
+            << n << " " << i;
+      }
+    }
+    if (n >= 3) {
+      EXPECT_EQ(p[0], 0);
+      EXPECT_EQ(p[3], 65535);
+      EXPECT_EQ(p[7], 65535);
+      EXPECT_EQ(p[6], 0);
+    }
+  }
+
+  /* A flat box decodes to its plane. */
+  const la_vec3 lo = {.elem = {-10.0f, 2.0f, -100.0f}};
+  const la_vec3 hi = {.elem = {10.0f, 2.0f, 300.0f}};
+  const float x = 3.0f, y = 4.0f, z = 5.0f;
+  uint16_t p[3];
+  float ox, oy, oz;
+  la_position_pack16_soa(&x, &y, &z, lo, hi, p, 1);
+  la_position_unpack16_soa(p, lo, hi, &ox, &oy, &oz, 1);
+  EXPECT_NEAR(ox, x, 20.0f / 65535.0f);
+  EXPECT_EQ(oy, 2.0f);
+  EXPECT_NEAR(oz, z, 400.0f / 65535.0f);
+}
+
+TEST(la_tests, la_scale_pack16) {
+  const float lo = 1.0f / 1024.0f, hi = 1024.0f;
+  const size_t n = 1000;
+  trs_streams in(n), out(n);
+  for (size_t i = 0; i < n; i++) {
+    const la_vec3 v = test_vec3((unsigned int)i * 7919u);
+    for (size_t a = 0; a < 3; a++) {
+      const float s = exp2f(v.elem[a]);
+      in.v[7 + a][i] = i % 7 == a ? -s : s;
+    }
+  }
+  const float special[] = {0.0f, -0.0f, 1.0f, -1.0f, lo, hi, 1e-9f, -1e9f};
+  for (size_t i = 0; i < sizeof(special) / sizeof(special[0]); i++) {
+    in.v[7][i] = special[i];
+  }
+  std::vector<uint16_t> p(3 * n);
+  la_scale_pack16_soa(in.soa.sx, in.soa.sy, in.soa.sz, lo, hi, p.data(), n);
+  la_scale_unpack16_soa(p.data(), lo, hi, out.soa.sx, out.soa.sy, out.soa.sz,
+                        n);
+  /* Half a step of 20 / 32766 in log2 is a relative error of 0.021%. */
+  for (size_t i = 0; i < n; i++) {
+    for (int a = 0; a < 3; a++) {
+      const float s = in.v[7 + a][i];
+      const float clamped = copysignf(std::min(std::max(fabsf(s), lo), hi), s);
+      const float expect = s == 0.0f ? 0.0f : clamped;
+      EXPECT_NEAR(out.v[7 + a][i], expect, fabsf(expect) * 2.2e-4f) << i;
+    }
+  }
+  EXPECT_EQ(out.soa.sx[0], 0.0f);
+  EXPECT_EQ(out.soa.sx[1], 0.0f);
+
+  /* Vector lanes and the scalar tail give the same codes. */
+  for (size_t i = 0; i < n; i += 37) {
+    uint16_t one[3];
+    la_scale_pack16_soa(in.soa.sx + i, in.soa.sy + i, in.soa.sz + i, lo, hi,
+                        one, 1);
+    EXPECT_EQ(memcmp(one, &p[3 * i], sizeof(one)), 0) << i;
+  }
+}